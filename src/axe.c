@@ -24,10 +24,19 @@
 
 #include "axe.h"
 #include "gsl_combination.h"
+#include <qes_split.h>
+#include <qes_gzindex.h>
+#include <qes_match.h>
+#include <qes_simd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <math.h>
 #include <unistd.h>
 
+volatile sig_atomic_t axe_metrics_requested = 0;
+
 /* Holds the current timestamp, so we don't have to free the returned string
  * from now(). */
 char _time_now[10] = "";
@@ -104,8 +113,134 @@ axe_barcode_destroy_(struct axe_barcode *barcode)
     qes_free(barcode);
 }
 
+/* State loaded from a checkpoint file, see axe_write_checkpoint */
+
+struct axe_checkpoint_output {
+    char *path;
+    struct qes_file_sums sums;
+};
+
+struct axe_checkpoint {
+    size_t n_parts;
+    size_t first_part;
+    size_t threads;
+    int gz_index;
+    off_t (*pos)[2];        /* Per thread */
+    struct axe_checkpoint_output *outputs;
+    size_t n_outputs;
+};
+
+static void
+axe_checkpoint_destroy_(struct axe_checkpoint *checkpoint)
+{
+    size_t iii = 0;
+
+    if (checkpoint == NULL) {
+        return;
+    }
+    for (iii = 0; iii < checkpoint->n_outputs; iii++) {
+        qes_free(checkpoint->outputs[iii].path);
+    }
+    qes_free(checkpoint->outputs);
+    qes_free(checkpoint->pos);
+    qes_free(checkpoint);
+}
+#define axe_checkpoint_destroy(cp) STMT_BEGIN                               \
+    axe_checkpoint_destroy_(cp);                                            \
+    cp = NULL;                                                              \
+    STMT_END
+
+/* Per-thread progress and counters */
+
+static void
+axe_free_parts(struct axe_config *config)
+{
+    size_t iii = 0;
+
+    if (config->parts == NULL) {
+        return;
+    }
+    for (iii = 0; iii < config->n_parts; iii++) {
+        axe_stream_destroy(config->parts[iii].stream);
+    }
+    qes_free(config->parts);
+    config->n_parts = 0;
+}
+
+/* Tracked unknown prefixes per prefix reported, so the top few are
+ * accurate even when the unknown reads are diverse */
+#define AXE_TOPK_TRACKED 64
+
+/* Combinatorial matches sum the mismatches of both barcodes */
+static inline size_t
+axe_n_mismatch_levels(const struct axe_config *config)
+{
+    return config->mismatches + 1 +
+           (config->match_combo ? config->mismatches : 0);
+}
+
+/* Lengths of the longest R1 and R2 barcodes, which unknown reads' prefixes
+ * are cut to */
+static void
+axe_max_barcode_lens(const struct axe_config *config, size_t *lens)
+{
+    size_t iii = 0;
+
+    lens[0] = lens[1] = 0;
+    for (iii = 0; iii < config->n_barcode_pairs; iii++) {
+        if (config->barcodes[iii]->len1 > lens[0]) {
+            lens[0] = config->barcodes[iii]->len1;
+        }
+        if (config->barcodes[iii]->len2 > lens[1]) {
+            lens[1] = config->barcodes[iii]->len2;
+        }
+    }
+}
+
+/* Unknown prefix sketch, counting unknown pairs of R1 and R2 prefixes joined
+ * by '+' if combinatorial */
+static inline struct axe_topk *
+axe_unknown_topk_create(size_t top, const size_t *lens, bool combo)
+{
+    return axe_topk_create(top * AXE_TOPK_TRACKED,
+                           combo ? lens[0] + 1 + lens[1] : lens[0]);
+}
+
+/* Allocates the counters that checkpoints save and restore, which workers'
+ * counts are reduced into */
+static void
+axe_alloc_counters(struct axe_config *config)
+{
+    if (config->mismatch_counts != NULL) {
+        return;
+    }
+    if (config->unknown_top > 0) {
+        axe_max_barcode_lens(config, config->unknown_prefix_len);
+        config->unknown_prefixes = axe_unknown_topk_create(
+                config->unknown_top, config->unknown_prefix_len,
+                config->match_combo);
+    }
+    if (config->match_combo) {
+        config->pair_counts = axe_pair_counts_create(config->n_barcodes_1,
+                                                     config->n_barcodes_2,
+                                                     AXE_PAIR_DENSE_MAX);
+    }
+    config->n_mismatch_levels = axe_n_mismatch_levels(config);
+    config->mismatch_counts = qes_calloc(config->n_barcode_pairs *
+                                         config->n_mismatch_levels,
+                                         sizeof(*config->mismatch_counts));
+}
+
 /* Axe config struct ctor/dtor */
 
+/* Bytes in each row of config->barcode_lookup */
+static inline size_t
+axe_lookup_row_size(const struct axe_config *config)
+{
+    return (config->match_combo ? config->n_barcodes_2 : 1) *
+           sizeof(**config->barcode_lookup);
+}
+
 struct axe_config *
 axe_config_create(void)
 {
@@ -151,13 +286,36 @@ axe_config_destroy_(struct axe_config *config)
     /* barcode lookup */
     if (config->barcode_lookup != NULL) {
         for (iii = 0; iii < config->n_barcodes_1; iii++) {
-            qes_free(config->barcode_lookup[iii]);
+            qes_free_tagged(config->barcode_lookup[iii],
+                            axe_lookup_row_size(config), AXE_MEM_LOOKUP);
         }
     }
-    qes_free(config->barcode_lookup);
+    qes_free_tagged(config->barcode_lookup,
+                    config->n_barcodes_1 * sizeof(*config->barcode_lookup),
+                    AXE_MEM_LOOKUP);
+    qes_free(config->barcode_seqs[0]);
+    qes_free(config->barcode_seqs[1]);
     /* Tries */
-    axe_trie_destroy(config->fwd_trie);
-    axe_trie_destroy(config->rev_trie);
+    axe_matcher_destroy(config->matcher);
+    if (config->engine_ops != NULL) {
+        config->engine_ops->destroy(config->indices[0]);
+        config->engine_ops->destroy(config->indices[1]);
+    }
+    qes_gzindex_destroy(config->gz_index);
+    /* Checkpoints and statistics */
+    qes_free(config->checkpoint_file);
+    axe_checkpoint_destroy(config->checkpoint);
+    axe_free_parts(config);
+    qes_free(config->stats_file);
+    qes_free(config->mismatch_counts);
+    axe_topk_destroy(config->unknown_prefixes);
+    axe_pair_counts_destroy(config->pair_counts);
+    qes_free(config->matrix_file);
+    qes_free(config->metrics_file);
+    qes_free(config->live_file);
+    if (config->live != NULL) {
+        munmap(config->live, config->live_size);
+    }
     /* Logger */
     qes_logger_destroy(config->logger);
     /* config stuct */
@@ -165,8 +323,8 @@ axe_config_destroy_(struct axe_config *config)
 }
 
 
-static char *
-_axe_format_outfile_path (const char *prefix, const char *id, int read,
+char *
+axe_format_outfile_path (const char *prefix, const char *id, int read,
                           const char *ext)
 {
     char buf[4096];
@@ -216,14 +374,17 @@ axe_output_create(const char *fwd_fpath, const char *rev_fpath,
     }
     out = qes_calloc(1, sizeof(*out));
     out->mode = mode;
-    out->fwd_file = qes_seqfile_create(fwd_fpath, fp_mode);
+    /* Outputs are summed as they're written, for axe_write_manifest */
+    out->fwd_file = qes_seqfile_create_file(qes_file_open_summed(fwd_fpath,
+                                                                 fp_mode));
     if (out->fwd_file == NULL) {
         qes_free(out);
         return NULL;
     }
     qes_seqfile_set_format(out->fwd_file, FASTQ_FMT);
     if (rev_fpath != NULL) {
-        out->rev_file = qes_seqfile_create(rev_fpath, fp_mode);
+        out->rev_file = qes_seqfile_create_file(
+                qes_file_open_summed(rev_fpath, fp_mode));
         if (out->rev_file == NULL) {
             qes_seqfile_destroy(out->fwd_file);
             qes_free(out);
@@ -415,11 +576,13 @@ setup_barcode_lookup_single(struct axe_config *config)
     }
     config->n_barcodes_1 = config->n_barcode_pairs;
     config->n_barcodes_2 = 0;
-    config->barcode_lookup = qes_malloc(config->n_barcodes_1 *
-                                        sizeof(*config->barcode_lookup));
+    config->barcode_lookup = qes_malloc_tagged(config->n_barcodes_1 *
+                                               sizeof(*config->barcode_lookup),
+                                               AXE_MEM_LOOKUP);
     for (iii = 0; iii < config->n_barcode_pairs; iii++) {
-        config->barcode_lookup[iii] = qes_malloc(
-                                          sizeof(**config->barcode_lookup));
+        config->barcode_lookup[iii] = qes_malloc_tagged(
+                                          axe_lookup_row_size(config),
+                                          AXE_MEM_LOOKUP);
         config->barcode_lookup[iii][0] = iii;
     }
     return 0;
@@ -449,6 +612,10 @@ setup_barcode_lookup_combo(struct axe_config *config)
     seq1_trie = axe_trie_create();
     seq2_trie = axe_trie_create();
     assert(seq1_trie != NULL && seq2_trie != NULL);
+    config->barcode_seqs[0] = qes_calloc(config->n_barcode_pairs,
+                                         sizeof(*config->barcode_seqs[0]));
+    config->barcode_seqs[1] = qes_calloc(config->n_barcode_pairs,
+                                         sizeof(*config->barcode_seqs[1]));
     for (iii = 0; iii < config->n_barcode_pairs; iii++) {
         this_barcode = config->barcodes[iii];
         if (!axe_barcode_ok(this_barcode)) {
@@ -458,20 +625,24 @@ setup_barcode_lookup_combo(struct axe_config *config)
             goto error;
         }
         if (!axe_trie_get(seq1_trie, this_barcode->seq1, &tmp)) {
+            config->barcode_seqs[0][n_barcodes_1] = this_barcode->seq1;
             axe_trie_add(seq1_trie, this_barcode->seq1, n_barcodes_1++);
         }
         if (!axe_trie_get(seq2_trie, this_barcode->seq2, &tmp)) {
+            config->barcode_seqs[1][n_barcodes_2] = this_barcode->seq2;
             axe_trie_add(seq2_trie, this_barcode->seq2, n_barcodes_2++);
         }
     }
     config->n_barcodes_1 = n_barcodes_1;
     config->n_barcodes_2 = n_barcodes_2;
     /* Make barcode lookup */
-    config->barcode_lookup = qes_malloc(n_barcodes_1 *
-                                        sizeof(*config->barcode_lookup));
+    config->barcode_lookup = qes_malloc_tagged(n_barcodes_1 *
+                                               sizeof(*config->barcode_lookup),
+                                               AXE_MEM_LOOKUP);
     for (bcd1 = 0; bcd1 < config->n_barcodes_1; bcd1++) {
-        config->barcode_lookup[bcd1] = qes_calloc(n_barcodes_2,
-                                       sizeof(**config->barcode_lookup));
+        config->barcode_lookup[bcd1] = qes_calloc_tagged(n_barcodes_2,
+                                       sizeof(**config->barcode_lookup),
+                                       AXE_MEM_LOOKUP);
         memset(config->barcode_lookup[bcd1], -1,
                n_barcodes_2 * sizeof(**config->barcode_lookup));
     }
@@ -511,46 +682,198 @@ axe_setup_barcode_lookup(struct axe_config *config)
     return setup_barcode_lookup_single(config);
 }
 
-int
-axe_make_tries(struct axe_config *config)
+/* Mutants of each barcode within m mismatches, stopping at ``limit`` */
+static size_t
+trie_keys_estimate(size_t len, size_t mismatches, size_t limit)
 {
-    if (!axe_config_ok(config)) {
-        return -1;
+    size_t keys = 0;
+    size_t mutants = 1;
+    size_t jjj = 0;
+
+    for (jjj = 0; jjj <= mismatches && jjj <= len && keys < limit; jjj++) {
+        /* Choose jjj of len bases, each mutated to one of three others */
+        if (jjj > 0) {
+            mutants = mutants * (len - jjj + 1) / jjj * 3;
+        }
+        keys += mutants;
     }
-    config->fwd_trie = axe_trie_create();
-    if (config->fwd_trie == NULL) {
-        goto error;
+    return keys < limit ? keys : limit;
+}
+
+/* Whether an engine can index the barcodes, or if ``picking`` is worth
+ * trying when none is asked for. The tries are skipped when they'd hold too
+ * many mutants. Whitelists then suit many barcodes of one length, but seeds
+ * suit high mismatch levels better, and anything else. */
+static bool
+engine_suits(const struct axe_config *config, enum axe_engine_type type,
+             bool picking)
+{
+    const size_t n[2] = {
+        config->match_combo ? config->n_barcodes_1 : config->n_barcode_pairs,
+        config->match_combo ? config->n_barcodes_2 : 0,
+    };
+    size_t min_len = SIZE_MAX;
+    size_t max_len = 0;
+    size_t keys = 0;
+    size_t len = 0;
+    size_t iii = 0;
+    size_t jjj = 0;
+
+    for (iii = 0; iii < 2; iii++) {
+        for (jjj = 0; jjj < n[iii]; jjj++) {
+            len = strlen(config->match_combo ?
+                         config->barcode_seqs[iii][jjj] :
+                         config->barcodes[jjj]->seq1);
+            min_len = len < min_len ? len : min_len;
+            max_len = len > max_len ? len : max_len;
+            keys += trie_keys_estimate(len, config->mismatches,
+                                       AXE_TRIE_MAX_KEYS);
+        }
     }
-    if (config->match_combo) {
-        config->rev_trie = axe_trie_create();
-        if (config->rev_trie == NULL) {
-            goto error;
+    switch (type) {
+        case AXE_ENGINE_BRUTE:
+            return n[0] <= AXE_BRUTE_MAX_BARCODES &&
+                   n[1] <= AXE_BRUTE_MAX_BARCODES &&
+                   max_len <= AXE_BRUTE_MAX_LEN;
+        case AXE_ENGINE_TRIE:
+            return config->mismatches <= 4 && config->mismatches < min_len &&
+                   keys < AXE_TRIE_MAX_KEYS;
+        case AXE_ENGINE_WHITELIST:
+            return (config->mismatches <= 4 || !picking) &&
+                   min_len == max_len && max_len <= AXE_WHITELIST_MAX_LEN;
+        case AXE_ENGINE_SEED:
+        case AXE_ENGINE_EDIT:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/* Engines tried in turn if none is asked for, until one suits */
+static const enum axe_engine_type auto_engines[] = {
+    AXE_ENGINE_BRUTE,
+    AXE_ENGINE_TRIE,
+    AXE_ENGINE_WHITELIST,
+    AXE_ENGINE_SEED,
+};
+#define N_AUTO_ENGINES (sizeof(auto_engines) / sizeof(*auto_engines))
+
+/* What an engine asked for can index, by type, if it can't */
+static const char *const engine_limits[AXE_N_ENGINES] = {
+    [AXE_ENGINE_TRIE] = "supports -m <= 4 and -m < barcode length, up to "
+                        "2^24 mutant barcodes",
+    [AXE_ENGINE_BRUTE] = "supports up to 128 barcodes per read, of up to "
+                         "32 bases",
+    [AXE_ENGINE_WHITELIST] = "supports barcodes of one length, up to 32 "
+                             "bases",
+};
+
+/* Picks the first engine from ``from`` in auto_engines that suits */
+static const struct axe_engine *
+pick_engine(const struct axe_config *config, size_t from)
+{
+    size_t iii = 0;
+
+    for (iii = from; iii < N_AUTO_ENGINES; iii++) {
+        if (engine_suits(config, auto_engines[iii], true)) {
+            return axe_engines[auto_engines[iii]];
         }
     }
-    return 0;
+    return NULL;
+}
 
-error:
-    qes_log_message_fatal(
-            config->logger,
-            "make_tries -- ERROR: axe_trie_create returned NULL\n");
-    axe_trie_destroy(config->fwd_trie);
-    if (config->match_combo) {
-        axe_trie_destroy(config->rev_trie);
+int
+axe_make_tries(struct axe_config *config)
+{
+    if (!axe_config_ok(config) || config->engine >= AXE_N_ENGINES) {
+        return -1;
     }
-    return 1;
+    if (config->engine != AXE_ENGINE_AUTO) {
+        if (!engine_suits(config, config->engine, false)) {
+            qes_log_format_fatal(config->logger,
+                                 "make_tries -- The %s engine %s\n",
+                                 axe_engines[config->engine]->name,
+                                 engine_limits[config->engine]);
+            return 1;
+        }
+        config->engine_ops = axe_engines[config->engine];
+    } else {
+        config->engine_ops = pick_engine(config, 0);
+    }
+    return config->engine_ops == NULL;
 }
 
-static char *
+char *
 axe_make_file_ext(const struct axe_config *config)
 {
+    char buf[64] = "";
+    const char *ext = "fastq";
+
     if (!axe_config_ok(config)) {
         return NULL;
     }
     if (config->out_compress_level > 0 &&
         config->out_compress_level < 10) {
-        return strdup("fastq.gz");
+        ext = "fastq.gz";
     }
-    return strdup("fastq");
+    if (config->n_chunks > 0) {
+        /* Chunk outputs get an infix so axe-merge can find them, e.g.
+         * prefix_A1_R1.chunk2of8.fastq.gz. Chunks are numbered from 1. */
+        snprintf(buf, sizeof(buf), "chunk%zuof%zu.%s",
+                 config->chunk_index + 1, config->n_chunks, ext);
+        return strdup(buf);
+    }
+    return strdup(ext);
+}
+
+/* Chunk runs write their tables etc. to e.g. table.tsv.chunk2of8 */
+char *
+axe_make_chunk_path(const struct axe_config *config, const char *path)
+{
+    char *chunk_path = NULL;
+    int res = 0;
+
+    if (!axe_config_ok(config) || path == NULL) {
+        return NULL;
+    }
+    if (config->n_chunks == 0) {
+        return strdup(path);
+    }
+    res = asprintf(&chunk_path, "%s.chunk%zuof%zu", path,
+                   config->chunk_index + 1, config->n_chunks);
+    if (res < 0) {
+        return NULL;
+    }
+    return chunk_path;
+}
+
+char *
+axe_make_table_path(const struct axe_config *config)
+{
+    if (!axe_config_ok(config)) {
+        return NULL;
+    }
+    return axe_make_chunk_path(config, config->table_file);
+}
+
+/* The manifest of output checksums sits next to the table */
+char *
+axe_make_manifest_path(const struct axe_config *config)
+{
+    char *table = NULL;
+    char *path = NULL;
+    int res = 0;
+
+    table = axe_make_table_path(config);
+    if (table == NULL) {
+        return NULL;
+    }
+    res = asprintf(&path, "%s.manifest", table);
+    qes_free(table);
+    if (res < 0) {
+        return NULL;
+    }
+    return path;
 }
 
 static char *
@@ -568,246 +891,711 @@ axe_make_zmode(const struct axe_config *config)
     return strdup("wT");
 }
 
-static inline int
-load_tries_combo(struct axe_config *config)
+/* Checkpoints
+ *
+ * A checkpoint records, for each thread, the input position after the last
+ * read it wrote out, with the size and sums of every output and the counts
+ * so far. Outputs are synced first, so everything before the recorded sizes
+ * is complete (gzip outputs end a member at each checkpoint). Resuming
+ * truncates the outputs back to those sizes and re-reads the input from the
+ * recorded positions.
+ */
+
+static int
+axe_input_stat(const char *path, off_t *size, int64_t *mtime)
 {
-    int bcd1 = -1;
-    int bcd2 = -1;
-    int retval = 0;
-    char **mutated = NULL;
-    size_t num_mutated = 0;
-    int ret = 0;
-    size_t iii = 0;
-    size_t jjj = 0;
-    size_t mmm = 0;
-    struct axe_barcode *this_bcd = NULL;
-    intptr_t tmp = 0;
+    struct stat st;
 
-    if (!axe_config_ok(config)) {
-        fprintf(stderr, "[load_tries] Bad config\n");
-        ret = -1;
-        goto exit;
-    }
-    /* Make mutated barcodes and add to trie */
-    for (iii = 0; iii < config->n_barcode_pairs; iii++) {
-        this_bcd = config->barcodes[iii];
-        if (!axe_barcode_ok(this_bcd)) {
-            qes_log_format_fatal(config->logger,
-                    "load_tries -- Bad R1 barcode at %zu\n", iii);
-            ret = -1;
-            goto exit;
-        }
-        /* Either lookup the index of the first read in the barcode table, or
-         * insert this barcode into the table, storing its index.
-         * Note the NOT here. */
-        if (!axe_trie_get(config->fwd_trie, this_bcd->seq1, &tmp)) {
-            ret = axe_trie_add(config->fwd_trie, this_bcd->seq1, ++bcd1);
-            if (ret != 0) {
-                qes_log_format_fatal(config->logger,
-                        "load_tries -- Could not load barcode %s into trie %zu\n",
-                        this_bcd->seq1, iii);
-                ret = 1;
-                goto exit;
-            }
-        } else {
-            continue;
-        }
-        for (jjj = 1; jjj <= config->mismatches; jjj++) {
-            /* Do the forwards read barcode */
-            mutated = hamming_mutate_dna(&num_mutated, this_bcd->seq1,
-                                         this_bcd->len1, jjj, 0);
-            if (mutated == NULL) {
-                ret = 1;
-                goto exit;
-            }
-            for (mmm = 0; mmm < num_mutated; mmm++) {
-                ret = axe_trie_add(config->fwd_trie, mutated[mmm], bcd1);
-                if (ret != 0) {
-                    if (config->permissive) {
-                        if (config->verbosity >= 0) {
-                            qes_log_format_warning(config->logger,
-                                "load_tries -- warning: Will only match to %dmm\n",
-                                 (int)jjj - 1);
-                        }
-                        axe_trie_delete(config->fwd_trie, mutated[mmm]);
-                        qes_free(mutated[mmm]);
-                        continue;
-                    }
-                    qes_log_format_fatal(config->logger,
-                            "load_tries -- Barcode %s already in fwd trie (%dmm) %s\n",
-                            mutated[mmm], (int)jjj, this_bcd->seq1);
-                    retval = 1;
-                    goto exit;
-                }
-                qes_free(mutated[mmm]);
-            }
-            qes_free(mutated);
-        }
-    }
-    /* Ditto for the reverse read */
-    for (iii = 0; iii < config->n_barcode_pairs; iii++) {
-        this_bcd = config->barcodes[iii];
-        /* Likewise for the reverse read index */
-        if (!axe_trie_get(config->rev_trie, this_bcd->seq2, &tmp)) {
-            ret = axe_trie_add(config->rev_trie, this_bcd->seq2, ++bcd2);
-            if (ret != 0) {
-                qes_log_format_fatal(config->logger,
-                        "load_tries -- Could not load barcode %s into trie %zu\n",
-                        this_bcd->seq2, iii);
-                retval = 1;
-                goto exit;
-            }
-        } else {
-            continue;
-        }
-        for (jjj = 1; jjj <= config->mismatches; jjj++) {
-            num_mutated = 0;
-            mutated = hamming_mutate_dna(&num_mutated, this_bcd->seq2,
-                                         this_bcd->len2, jjj, 0);
-            if (mutated == NULL) {
-                ret = 1;
-                goto exit;
-            }
-            for (mmm = 0; mmm < num_mutated; mmm++) {
-                ret = axe_trie_add(config->rev_trie, mutated[mmm], bcd2);
-                if (ret != 0) {
-                    if (config->permissive) {
-                        if (config->verbosity >= 0) {
-                            qes_log_format_warning(config->logger,
-                                "load_tries -- Will only match %s to %dmm\n",
-                                this_bcd->id, (int)jjj - 1);
-                        }
-                        trie_delete(config->rev_trie->trie,
-                                    mutated[mmm]);
-                        qes_free(mutated[mmm]);
-                        continue;
-                    }
-                    qes_log_format_fatal(config->logger,
-                            "load_tries -- Barcode %s already in rev trie (%dmm) %s\n",
-                            mutated[mmm], (int)jjj, this_bcd->seq1);
-                    retval = 1;
-                    goto exit;
-                }
-                qes_free(mutated[mmm]);
-            }
-            qes_free(mutated);
-        }
+    if (stat(path, &st) != 0) {
+        return 1;
     }
-    /* we got here, so we succeeded. set retval accordingly */
-    retval = 0;
+    *size = st.st_size;
+    *mtime = (int64_t)st.st_mtime;
+    return 0;
+}
 
-exit:
-    if (mutated != NULL) {
-        for (mmm = 0; mmm < num_mutated; mmm++) {
-            qes_free(mutated[mmm]);
-        }
-        qes_free(mutated);
+static int
+write_checkpoint_output(FILE *fp, struct qes_seqfile *sf)
+{
+    struct qes_file_sums sums;
+
+    if (sf == NULL) {
+        return 0;
     }
-    return retval;
+    if (qes_file_sync(sf->qf) != 0 || qes_file_sums(sf->qf, &sums) != 0) {
+        return 1;
+    }
+    fprintf(fp, "output %" PRIu64 " %08" PRIx32 " %" PRIu64 " %08" PRIx32
+            " %s\n", sums.size, sums.crc, sums.data_size, sums.data_crc,
+            sf->qf->path);
+    return 0;
 }
 
-static inline int
-load_tries_single(struct axe_config *config)
+/* Call only within the output critical section, once the workers' counts
+ * are reduced */
+static int
+axe_write_checkpoint(struct axe_config *config)
 {
-    char **mutated = NULL;
-    size_t num_mutated = 0;
-    int ret = 0;
+    FILE *fp = NULL;
+    struct axe_output *out = NULL;
+    const struct axe_pair_counts *pc = NULL;
+    char *tmppath = NULL;
+    off_t size = 0;
+    int64_t mtime = 0;
     size_t iii = 0;
     size_t jjj = 0;
-    size_t mmm = 0;
-    intptr_t tmp = 0;
-    int retval = -1;
-    struct axe_barcode *this_bcd = NULL;
+    size_t idx = 0;
+    int res = 0;
 
-    if (!axe_config_ok(config)) {
-        fprintf(stderr, "[load_tries] Bad config\n");
-        return -1;
+    if (asprintf(&tmppath, "%s.tmp", config->checkpoint_file) < 0) {
+        return 1;
+    }
+    fp = fopen(tmppath, "w");
+    if (fp == NULL) {
+        qes_log_format_fatal(config->logger,
+                             "checkpoint -- Could not open %s\n%s\n",
+                             tmppath, strerror(errno));
+        qes_free(tmppath);
+        return 1;
     }
-    /* Make mutated barcodes and add to trie */
+    fprintf(fp, "AXE_CHECKPOINT 1\n");
+    fprintf(fp, "layout %zu %zu %zu %d %zu\n", config->parts_total,
+            config->parts_first, config->n_parts, config->gz_index != NULL,
+            config->n_barcode_pairs);
+    for (iii = 0; iii < 2 && config->infiles[iii] != NULL; iii++) {
+        res |= axe_input_stat(config->infiles[iii], &size, &mtime);
+        fprintf(fp, "input %lld %" PRId64 " %s\n", (long long)size, mtime,
+                config->infiles[iii]);
+    }
+    fprintf(fp, "reads %" PRIu64 " %" PRIu64 " %" PRIu64 "\n",
+            config->reads_processed, config->reads_demultiplexed,
+            config->reads_failed);
     for (iii = 0; iii < config->n_barcode_pairs; iii++) {
-        this_bcd = config->barcodes[iii];
-        if (!axe_barcode_ok(this_bcd)) {
-            fprintf(stderr, "[load_tries] Bad barcode at %zu\n", iii);
-            return -1;
-        }
-        /* Either lookup the index of the first read in the barcode table, or
-         * insert this barcode into the table, storing its index.
-         * Note the NOT here. */
-        if (!axe_trie_get(config->fwd_trie, this_bcd->seq1, &tmp)) {
-            ret = axe_trie_add(config->fwd_trie, this_bcd->seq1, (int)iii);
-            if (ret != 0) {
-                fprintf(stderr,
-                        "ERROR: Could not load barcode %s into trie %zu\n",
-                        this_bcd->seq1, iii);
-                return 1;
-            }
-        } else {
-            fprintf(stderr, "ERROR: Duplicate barcode %s\n", this_bcd->seq1);
-            return 1;
+        fprintf(fp, "count %zu %" PRIu64 "\n", iii,
+                config->barcodes[iii]->count);
+    }
+    for (iii = 0; iii < config->n_barcode_pairs; iii++) {
+        fprintf(fp, "mismatches %zu", iii);
+        for (jjj = 0; jjj < config->n_mismatch_levels; jjj++) {
+            idx = iii * config->n_mismatch_levels + jjj;
+            fprintf(fp, " %" PRIu64, config->mismatch_counts[idx]);
         }
-        for (jjj = 1; jjj <= config->mismatches; jjj++) {
-            mutated = hamming_mutate_dna(&num_mutated, this_bcd->seq1,
-                                         this_bcd->len1, jjj, 0);
-            if (mutated == NULL) {
-                ret = 1;
-                goto exit;
-            }
-            for (mmm = 0; mmm < num_mutated; mmm++) {
-                ret = axe_trie_add(config->fwd_trie, mutated[mmm], iii);
-                if (ret != 0) {
-                    if (config->permissive) {
-                        if (config->verbosity >= 0) {
-                            fprintf(stderr,
-                                    "[%s] warning: Will only match to %dmm\n",
-                                    __func__, (int)jjj - 1);
-                        }
-                        trie_delete(config->fwd_trie->trie,
-                                    mutated[mmm]);
-                        qes_free(mutated[mmm]);
-                        continue;
-                    }
-                    fprintf(stderr,
-                            "[%s] ERROR: Barcode %s already in trie (%dmm)\n",
-                            __func__, mutated[mmm], (int)jjj);
-                    retval = 1;
-                    goto exit;
-                }
-                qes_free(mutated[mmm]);
-            }
-            qes_free(mutated);
-            num_mutated = 0;
+        fprintf(fp, "\n");
+    }
+    for (iii = 0; config->unknown_prefixes != NULL &&
+                  iii < config->unknown_prefixes->n; iii++) {
+        fprintf(fp, "unknown %" PRIu64 " %" PRIu64 " %s\n",
+                config->unknown_prefixes->entries[iii].count,
+                config->unknown_prefixes->entries[iii].error,
+                config->unknown_prefixes->entries[iii].key);
+    }
+    /* Only pairs seen, straight from the storage, as axe_pair_counts_merge
+     * walks it */
+    pc = config->pair_counts;
+    for (iii = 0; pc != NULL && pc->dense != NULL &&
+                  iii < pc->n1 * pc->n2; iii++) {
+        if (pc->dense[iii] > 0) {
+            fprintf(fp, "pair %zu %zu %" PRIu64 "\n", iii / pc->n2,
+                    iii % pc->n2, pc->dense[iii]);
         }
     }
-    /* we got here, so we succeeded */
-    retval = 0;
-
-exit:
-    if (mutated != NULL) {
-        for (mmm = 0; mmm < num_mutated; mmm++) {
-            qes_free(mutated[mmm]);
+    for (iii = 0; pc != NULL && pc->dense == NULL &&
+                  iii < pc->table_size; iii++) {
+        if (pc->keys[iii] != 0 && pc->counts[iii] > 0) {
+            fprintf(fp, "pair %zu %zu %" PRIu64 "\n",
+                    (size_t)((pc->keys[iii] - 1) / pc->n2),
+                    (size_t)((pc->keys[iii] - 1) % pc->n2), pc->counts[iii]);
         }
-        qes_free(mutated);
     }
-    return retval;
+    for (iii = 0; iii < config->n_parts; iii++) {
+        fprintf(fp, "part %zu %lld %lld\n", iii,
+                (long long)config->parts[iii].pos[0],
+                (long long)config->parts[iii].pos[1]);
+    }
+    for (iii = 0; config->outputs != NULL && iii <= config->n_barcode_pairs;
+            iii++) {
+        out = iii < config->n_barcode_pairs ? config->outputs[iii] :
+                                              config->unknown_output;
+        res |= write_checkpoint_output(fp, out->fwd_file);
+        res |= write_checkpoint_output(fp, out->rev_file);
+    }
+    res |= fclose(fp) != 0;
+    /* Replace the old checkpoint only once the new one is complete */
+    if (res == 0 && rename(tmppath, config->checkpoint_file) != 0) {
+        res = 1;
+    }
+    if (res != 0) {
+        qes_log_format_fatal(config->logger,
+                             "checkpoint -- Could not write %s\n%s\n",
+                             config->checkpoint_file, strerror(errno));
+        unlink(tmppath);
+    } else {
+        qes_log_format_debug(config->logger,
+                             "checkpoint -- Checkpointed at %" PRIu64 " reads\n",
+                             config->reads_processed);
+    }
+    qes_free(tmppath);
+    return res;
 }
 
-int
-axe_make_outputs(struct axe_config *config)
+static inline uint64_t
+axe_now_ns(void)
 {
-    size_t iii = 0;
-    char *name_fwd = NULL;
-    char *name_rev = NULL;
-    char *file_ext = NULL;
-    char *zmode = NULL;
-    struct axe_barcode *this_bcd = NULL;
+    struct timespec now;
 
-    if (!axe_config_ok(config)) {
-        fprintf(stderr, "[make_outputs] Bad config\n");
-        return -1;
-    }
-    file_ext = axe_make_file_ext(config);
-    zmode = axe_make_zmode(config);
-    config->outputs = qes_calloc(config->n_barcode_pairs,
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+static uint64_t
+axe_unix_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+/* Creates and maps the live statistics file */
+static int
+axe_open_live(struct axe_config *config)
+{
+    struct axe_live_header *live = NULL;
+    size_t names_offset = 0;
+    size_t size = 0;
+    size_t iii = 0;
+    char *names = NULL;
+    int fd = -1;
+
+    names_offset = sizeof(*live) + config->n_barcode_pairs * sizeof(uint64_t);
+    size = names_offset;
+    for (iii = 0; iii < config->n_barcode_pairs; iii++) {
+        size += strlen(config->barcodes[iii]->id) + 1;
+    }
+    fd = open(config->live_file, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || ftruncate(fd, size) != 0) {
+        goto error;
+    }
+    live = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (live == MAP_FAILED) {
+        goto error;
+    }
+    close(fd);
+    memcpy(live->magic, AXE_LIVE_MAGIC, sizeof(live->magic));
+    live->n_samples = config->n_barcode_pairs;
+    live->names_offset = names_offset;
+    live->start_time = axe_unix_ns() / 1000000000;
+    names = (char *)live + names_offset;
+    for (iii = 0; iii < config->n_barcode_pairs; iii++) {
+        strcpy(names, config->barcodes[iii]->id);
+        names += strlen(names) + 1;
+    }
+    config->live = live;
+    config->live_size = size;
+    return 0;
+error:
+    qes_log_format_fatal(config->logger,
+                         "live_stats -- Could not create %s\n%s\n",
+                         config->live_file, strerror(errno));
+    if (fd >= 0) {
+        close(fd);
+    }
+    return 1;
+}
+
+/* Copies the counters to the live statistics file. Call only within the
+ * output critical section. */
+static void
+axe_update_live(struct axe_config *config, bool running)
+{
+    struct axe_live_header *live = config->live;
+    uint64_t *counts = NULL;
+    size_t iii = 0;
+
+    if (live == NULL) {
+        return;
+    }
+    counts = (uint64_t *)(live + 1);
+    __atomic_store_n(&live->seq, live->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    live->running = running;
+    live->update_time_ns = axe_unix_ns();
+    live->reads_processed = config->reads_processed;
+    live->reads_demultiplexed = config->reads_demultiplexed;
+    live->reads_failed = config->reads_failed;
+    for (iii = 0; iii < config->n_barcode_pairs; iii++) {
+        counts[iii] = config->barcodes[iii]->count;
+    }
+    __atomic_store_n(&live->seq, live->seq + 1, __ATOMIC_RELEASE);
+}
+
+static void
+write_prom_label(FILE *fp, const char *str)
+{
+    for (; *str != '\0'; str++) {
+        switch (*str) {
+            case '\\': fputs("\\\\", fp); break;
+            case '"': fputs("\\\"", fp); break;
+            case '\n': fputs("\\n", fp); break;
+            default: fputc(*str, fp); break;
+        }
+    }
+}
+
+static void
+write_prom_metrics(const struct axe_config *config, FILE *fp, bool running)
+{
+    double seconds = (double)(axe_now_ns() - config->start_ns) / 1e9;
+    double rate = 0;
+    double failed = 0;
+    size_t iii = 0;
+
+    if (seconds > 0) {
+        rate = (double)(config->reads_processed - config->start_reads) /
+               seconds;
+    }
+    if (config->reads_processed > 0) {
+        failed = (double)config->reads_failed /
+                 (double)config->reads_processed;
+    }
+    fprintf(fp, "# HELP axe_reads_processed_total Reads (or read pairs) processed.\n"
+                "# TYPE axe_reads_processed_total counter\n"
+                "axe_reads_processed_total %" PRIu64 "\n",
+            config->reads_processed);
+    fprintf(fp, "# HELP axe_reads_demultiplexed_total Reads assigned to a sample.\n"
+                "# TYPE axe_reads_demultiplexed_total counter\n"
+                "axe_reads_demultiplexed_total %" PRIu64 "\n",
+            config->reads_demultiplexed);
+    fprintf(fp, "# HELP axe_reads_failed_total Reads that could not be demultiplexed.\n"
+                "# TYPE axe_reads_failed_total counter\n"
+                "axe_reads_failed_total %" PRIu64 "\n",
+            config->reads_failed);
+    fprintf(fp, "# HELP axe_prefix_cache_lookups_total Barcode lookups of cacheable prefixes.\n"
+                "# TYPE axe_prefix_cache_lookups_total counter\n"
+                "axe_prefix_cache_lookups_total %" PRIu64 "\n",
+            config->cache_lookups);
+    fprintf(fp, "# HELP axe_prefix_cache_hits_total Barcode lookups answered by the prefix cache.\n"
+                "# TYPE axe_prefix_cache_hits_total counter\n"
+                "axe_prefix_cache_hits_total %" PRIu64 "\n",
+            config->cache_hits);
+    fprintf(fp, "# HELP axe_undetermined_ratio Fraction of reads that could not be demultiplexed.\n"
+                "# TYPE axe_undetermined_ratio gauge\n"
+                "axe_undetermined_ratio %.6f\n", failed);
+    fprintf(fp, "# HELP axe_reads_per_second Mean rate of processing reads.\n"
+                "# TYPE axe_reads_per_second gauge\n"
+                "axe_reads_per_second %.1f\n", rate);
+    fprintf(fp, "# HELP axe_running Whether the run is still processing reads.\n"
+                "# TYPE axe_running gauge\n"
+                "axe_running %d\n", running);
+    fprintf(fp, "# HELP axe_sample_reads_total Reads assigned to each sample.\n"
+                "# TYPE axe_sample_reads_total counter\n");
+    for (iii = 0; iii < config->n_barcode_pairs; iii++) {
+        fprintf(fp, "axe_sample_reads_total{sample=\"");
+        write_prom_label(fp, config->barcodes[iii]->id);
+        fprintf(fp, "\"} %" PRIu64 "\n", config->barcodes[iii]->count);
+    }
+}
+
+/* Rewrites the metrics file (atomically, as the textfile collector may read
+ * it at any time) or, if there isn't one, writes the metrics to stderr. Call
+ * only within the output critical section. */
+static int
+axe_dump_metrics(struct axe_config *config, bool running)
+{
+    FILE *fp = NULL;
+    char *tmppath = NULL;
+    int res = 0;
+
+    if (config->metrics_file == NULL) {
+        write_prom_metrics(config, stderr, running);
+        return 0;
+    }
+    if (asprintf(&tmppath, "%s.tmp", config->metrics_file) < 0) {
+        return 1;
+    }
+    fp = fopen(tmppath, "w");
+    if (fp == NULL) {
+        qes_log_format_error(config->logger,
+                             "metrics -- Could not open %s\n%s\n",
+                             tmppath, strerror(errno));
+        qes_free(tmppath);
+        return 1;
+    }
+    write_prom_metrics(config, fp, running);
+    res = fclose(fp) != 0;
+    if (res == 0 && rename(tmppath, config->metrics_file) != 0) {
+        res = 1;
+    }
+    if (res != 0) {
+        qes_log_format_error(config->logger,
+                             "metrics -- Could not write %s\n%s\n",
+                             config->metrics_file, strerror(errno));
+        unlink(tmppath);
+    }
+    qes_free(tmppath);
+    return res;
+}
+
+static void
+worker_reduce_counts(struct axe_config *config, struct axe_worker *worker);
+
+/* Adds every thread's counts to the config's. The sketches of unknown
+ * prefixes and barcode pairs are left alone unless ``sketches``, as they're
+ * only needed for checkpoints and at the end. Call only within the output
+ * critical section, or once threads have finished, as workers count there. */
+static void
+axe_reduce_workers(struct axe_config *config, bool sketches)
+{
+    size_t iii = 0;
+
+    for (iii = 0; iii < config->n_parts; iii++) {
+        if (sketches) {
+            axe_worker_reduce(config, config->parts[iii].stream->worker);
+        } else {
+            worker_reduce_counts(config, config->parts[iii].stream->worker);
+        }
+    }
+}
+
+static inline void
+print_progress(struct axe_config *config)
+{
+    uint64_t reads = config->reads_so_far;
+
+    if (reads % 100000 == 0) {
+        if (config->verbosity >= 0) {
+            axe_format_progress(config->logger,
+                                "%s: Processed %.1fM %s\r",
+                                nowstr(),
+                                (float)(reads/1000000.0),
+                    config->out_mode == READS_SINGLE ? "reads" : "read pairs");
+        }
+    }
+}
+
+/* Publishes live statistics when they're due or requested. Workers' counts
+ * are only reduced to publish them. Failing to write metrics isn't fatal, as
+ * demultiplexing can carry on regardless. Call only within the output
+ * critical section. */
+static inline void
+axe_update_metrics(struct axe_config *config)
+{
+    uint64_t now = 0;
+
+    if (axe_metrics_requested) {
+        axe_metrics_requested = 0;
+        axe_reduce_workers(config, false);
+        axe_update_live(config, true);
+        axe_dump_metrics(config, true);
+    }
+    if ((config->live == NULL && config->metrics_file == NULL) ||
+            config->reads_so_far % AXE_LIVE_READS != 0) {
+        return;
+    }
+    axe_reduce_workers(config, false);
+    axe_update_live(config, true);
+    if (config->metrics_file == NULL) {
+        return;
+    }
+    now = axe_now_ns();
+    if (now >= config->next_metrics_ns) {
+        config->next_metrics_ns = now + config->metrics_every * 1000000000;
+        axe_dump_metrics(config, true);
+    }
+}
+
+/* Publishes the final statistics, once reads are all processed */
+static int
+axe_finish_metrics(struct axe_config *config)
+{
+    axe_update_live(config, false);
+    if (config->metrics_file == NULL) {
+        return 0;
+    }
+    return axe_dump_metrics(config, false);
+}
+
+/* Records that a read of ``part`` is written (and counted by its worker),
+ * and checkpoints if it's time to. Call only within the output critical
+ * section. */
+static inline int
+axe_commit_part(struct axe_config *config, struct axe_part *part)
+{
+    uint64_t reads = 0;
+
+    part->pos[0] = part->in[0]->qf->filepos;
+    if (part->in[1] != NULL) {
+        part->pos[1] = part->in[1]->qf->filepos;
+    }
+    reads = ++config->reads_so_far;
+    print_progress(config);
+    axe_update_metrics(config);
+    if (config->checkpoint_file == NULL || reads < config->next_checkpoint) {
+        return 0;
+    }
+    config->next_checkpoint = reads + config->checkpoint_every;
+    axe_reduce_workers(config, true);
+    return axe_write_checkpoint(config);
+}
+
+static int
+parse_checkpoint_line(struct axe_config *config, struct axe_checkpoint *cp,
+                      char *line)
+{
+    struct axe_checkpoint_output *cpo = NULL;
+    struct axe_topk_entry *entry = NULL;
+    char *end = NULL;
+    unsigned long long a = 0;
+    unsigned long long b = 0;
+    unsigned long long c = 0;
+    long long x = 0;
+    long long y = 0;
+    int64_t mtime = 0;
+    off_t size = 0;
+    size_t idx = 0;
+    size_t idx2 = 0;
+    size_t level = 0;
+    int path = 0;
+
+    line[strcspn(line, "\n")] = '\0';
+    if (sscanf(line, "layout %zu %zu %zu %d %llu", &cp->n_parts,
+               &cp->first_part, &cp->threads, &cp->gz_index, &a) == 5) {
+        if (a != config->n_barcode_pairs || cp->threads == 0) {
+            return 1;
+        }
+        cp->pos = qes_calloc(cp->threads, sizeof(*cp->pos));
+        return 0;
+    }
+    if (sscanf(line, "input %lld %lld %n", &x, &y, &path) == 2 && path > 0) {
+        /* The input must be exactly what was being read */
+        for (idx = 0; idx < 2 && config->infiles[idx] != NULL; idx++) {
+            if (strcmp(config->infiles[idx], line + path) == 0) {
+                break;
+            }
+        }
+        if (idx == 2 || config->infiles[idx] == NULL ||
+                axe_input_stat(config->infiles[idx], &size, &mtime) != 0 ||
+                size != x || mtime != y) {
+            qes_log_format_fatal(config->logger,
+                                 "checkpoint -- %s has changed since the "
+                                 "checkpoint\n", line + path);
+            return 1;
+        }
+        return 0;
+    }
+    if (sscanf(line, "reads %llu %llu %llu", &a, &b, &c) == 3) {
+        config->reads_processed = a;
+        config->reads_demultiplexed = b;
+        config->reads_failed = c;
+        return 0;
+    }
+    if (sscanf(line, "count %zu %llu", &idx, &a) == 2) {
+        if (idx >= config->n_barcode_pairs) {
+            return 1;
+        }
+        config->barcodes[idx]->count = a;
+        return 0;
+    }
+    if (sscanf(line, "mismatches %zu %n", &idx, &path) == 1 && path > 0) {
+        if (idx >= config->n_barcode_pairs) {
+            return 1;
+        }
+        line += path;
+        for (level = 0; level < config->n_mismatch_levels; level++) {
+            a = strtoull(line, &end, 10);
+            if (end == line) {
+                /* Too few levels: a different --mismatch */
+                return 1;
+            }
+            config->mismatch_counts[idx * config->n_mismatch_levels + level] = a;
+            line = end;
+        }
+        return *line != '\0';
+    }
+    if (sscanf(line, "unknown %llu %llu %n", &a, &b, &path) == 2 && path > 0) {
+        /* Restore the sketch as it was, if it's still being kept */
+        if (config->unknown_prefixes != NULL) {
+            entry = axe_topk_add(config->unknown_prefixes, line + path,
+                                 strlen(line + path), a);
+            entry->error = b;
+        }
+        return 0;
+    }
+    if (sscanf(line, "pair %zu %zu %llu", &idx, &idx2, &a) == 3) {
+        if (config->pair_counts == NULL || idx >= config->n_barcodes_1 ||
+                idx2 >= config->n_barcodes_2) {
+            return 1;
+        }
+        axe_pair_counts_add(config->pair_counts, idx, idx2, a);
+        return 0;
+    }
+    if (sscanf(line, "part %zu %lld %lld", &idx, &x, &y) == 3) {
+        if (cp->pos == NULL || idx >= cp->threads || x < 0 || y < 0) {
+            return 1;
+        }
+        cp->pos[idx][0] = x;
+        cp->pos[idx][1] = y;
+        return 0;
+    }
+    if (strncmp(line, "output ", 7) == 0) {
+        cp->outputs = qes_realloc(cp->outputs,
+                                  (cp->n_outputs + 1) * sizeof(*cp->outputs));
+        cpo = &cp->outputs[cp->n_outputs];
+        memset(cpo, 0, sizeof(*cpo));
+        if (sscanf(line, "output %" SCNu64 " %" SCNx32 " %" SCNu64 " %"
+                   SCNx32 " %n", &cpo->sums.size, &cpo->sums.crc,
+                   &cpo->sums.data_size, &cpo->sums.data_crc, &path) != 4 ||
+                path == 0) {
+            return 1;
+        }
+        cpo->path = strdup(line + path);
+        cp->n_outputs++;
+        return 0;
+    }
+    return 1;
+}
+
+int
+axe_load_checkpoint(struct axe_config *config)
+{
+    struct axe_checkpoint *cp = NULL;
+    FILE *fp = NULL;
+    char *line = NULL;
+    size_t linesz = 0;
+    size_t lineno = 0;
+    int res = 0;
+
+    if (!axe_config_ok(config)) {
+        return -1;
+    }
+    if (config->checkpoint_file == NULL || !config->resume) {
+        return 0;
+    }
+    fp = fopen(config->checkpoint_file, "r");
+    if (fp == NULL) {
+        if (errno != ENOENT) {
+            qes_log_format_fatal(config->logger,
+                                 "checkpoint -- Could not open %s\n%s\n",
+                                 config->checkpoint_file, strerror(errno));
+            return 1;
+        }
+        /* Nothing to resume, so start from the beginning */
+        if (config->verbosity >= 0) {
+            qes_log_format_info(config->logger,
+                                "checkpoint -- No checkpoint at %s, starting "
+                                "from the beginning\n",
+                                config->checkpoint_file);
+        }
+        return 0;
+    }
+    cp = qes_calloc(1, sizeof(*cp));
+    axe_alloc_counters(config);
+    while (res == 0 && getline(&line, &linesz, fp) > 0) {
+        if (lineno++ == 0) {
+            res = strcmp(line, "AXE_CHECKPOINT 1\n") != 0;
+        } else {
+            res = parse_checkpoint_line(config, cp, line);
+        }
+    }
+    free(line);
+    fclose(fp);
+    if (res != 0 || cp->pos == NULL) {
+        qes_log_format_fatal(config->logger,
+                             "checkpoint -- %s is invalid, or isn't from a "
+                             "run with these barcodes and inputs\n",
+                             config->checkpoint_file);
+        axe_checkpoint_destroy(cp);
+        return 1;
+    }
+    config->checkpoint = cp;
+    if (config->verbosity >= 0) {
+        axe_format_bold(config->logger,
+                        "checkpoint -- Resuming after %" PRIu64 " reads\n",
+                        config->reads_processed);
+    }
+    return 0;
+}
+
+/* Truncate outputs opened for appending back to their checkpointed sizes */
+static int
+resume_output(struct axe_config *config, struct qes_seqfile *sf)
+{
+    struct axe_checkpoint *cp = config->checkpoint;
+    struct stat st;
+    size_t iii = 0;
+
+    if (sf == NULL) {
+        return 0;
+    }
+    for (iii = 0; iii < cp->n_outputs; iii++) {
+        if (strcmp(cp->outputs[iii].path, sf->qf->path) == 0) {
+            break;
+        }
+    }
+    if (iii == cp->n_outputs) {
+        qes_log_format_fatal(config->logger,
+                             "checkpoint -- %s isn't in the checkpoint\n",
+                             sf->qf->path);
+        return 1;
+    }
+    if (stat(sf->qf->path, &st) != 0 ||
+            (uint64_t)st.st_size < cp->outputs[iii].sums.size) {
+        qes_log_format_fatal(config->logger,
+                             "checkpoint -- %s is shorter than when it was "
+                             "checkpointed\n", sf->qf->path);
+        return 1;
+    }
+    if (truncate(sf->qf->path, cp->outputs[iii].sums.size) != 0 ||
+            qes_file_set_sums(sf->qf, &cp->outputs[iii].sums) != 0) {
+        qes_log_format_fatal(config->logger,
+                             "checkpoint -- Couldn't truncate %s\n%s\n",
+                             sf->qf->path, strerror(errno));
+        return 1;
+    }
+    return 0;
+}
+
+static int
+axe_resume_outputs(struct axe_config *config)
+{
+    struct axe_output *out = NULL;
+    size_t iii = 0;
+    int res = 0;
+
+    for (iii = 0; iii <= config->n_barcode_pairs && res == 0; iii++) {
+        out = iii < config->n_barcode_pairs ? config->outputs[iii] :
+                                              config->unknown_output;
+        res |= resume_output(config, out->fwd_file);
+        res |= resume_output(config, out->rev_file);
+    }
+    return res;
+}
+
+int
+axe_make_outputs(struct axe_config *config)
+{
+    size_t iii = 0;
+    char *name_fwd = NULL;
+    char *name_rev = NULL;
+    char *file_ext = NULL;
+    char *zmode = NULL;
+    struct axe_barcode *this_bcd = NULL;
+
+    if (!axe_config_ok(config)) {
+        fprintf(stderr, "[make_outputs] Bad config\n");
+        return -1;
+    }
+    if (config->count_only) {
+        /* Nothing will be written */
+        return 0;
+    }
+    file_ext = axe_make_file_ext(config);
+    zmode = axe_make_zmode(config);
+    if (config->checkpoint != NULL) {
+        /* Append to the outputs, which are truncated below */
+        zmode[0] = 'a';
+    }
+    config->outputs = qes_calloc(config->n_barcode_pairs,
                                  sizeof(*config->outputs));
     /* For each sample, make the filename, make an output */
     for (iii = 0; iii < config->n_barcode_pairs; iii++) {
@@ -815,18 +1603,18 @@ axe_make_outputs(struct axe_config *config)
         /* Open barcode files */
         switch (config->out_mode) {
         case READS_SINGLE:
-            name_fwd = _axe_format_outfile_path(config->out_prefixes[0],
+            name_fwd = axe_format_outfile_path(config->out_prefixes[0],
                                                 this_bcd->id, 1, file_ext);
             name_rev = NULL;
             break;
         case READS_PAIRED:
-            name_fwd = _axe_format_outfile_path(config->out_prefixes[0],
+            name_fwd = axe_format_outfile_path(config->out_prefixes[0],
                                                 this_bcd->id, 1, file_ext);
-            name_rev = _axe_format_outfile_path(config->out_prefixes[1],
+            name_rev = axe_format_outfile_path(config->out_prefixes[1],
                                                 this_bcd->id, 2, file_ext);
             break;
         case READS_INTERLEAVED:
-            name_fwd =  _axe_format_outfile_path(config->out_prefixes[0],
+            name_fwd =  axe_format_outfile_path(config->out_prefixes[0],
                                                  this_bcd->id, 0, file_ext);
             name_rev = NULL;
             break;
@@ -850,18 +1638,18 @@ axe_make_outputs(struct axe_config *config)
     /* Generate the unknown file in the same manner, using id == unknown */
     switch (config->out_mode) {
     case READS_SINGLE:
-        name_fwd = _axe_format_outfile_path(config->out_prefixes[0],
+        name_fwd = axe_format_outfile_path(config->out_prefixes[0],
                                             "unknown", 1, file_ext);
         name_rev = NULL;
         break;
     case READS_PAIRED:
-        name_fwd = _axe_format_outfile_path(config->out_prefixes[0],
+        name_fwd = axe_format_outfile_path(config->out_prefixes[0],
                                             "unknown", 1, file_ext);
-        name_rev = _axe_format_outfile_path(config->out_prefixes[1],
+        name_rev = axe_format_outfile_path(config->out_prefixes[1],
                                             "unknown", 2, file_ext);
         break;
     case READS_INTERLEAVED:
-        name_fwd =  _axe_format_outfile_path(config->out_prefixes[0],
+        name_fwd =  axe_format_outfile_path(config->out_prefixes[0],
                                              "unknown", 0, file_ext);
         name_rev = NULL;
         break;
@@ -878,8 +1666,13 @@ axe_make_outputs(struct axe_config *config)
                 name_fwd);
         goto error;
     }
+    qes_free(name_fwd);
+    qes_free(name_rev);
     qes_free(file_ext);
     qes_free(zmode);
+    if (config->checkpoint != NULL) {
+        return axe_resume_outputs(config);
+    }
     return 0;
 
 error:
@@ -890,26 +1683,93 @@ error:
     return 1;
 }
 
-int
-axe_load_tries(struct axe_config *config)
+/* Indexes the R1 (and R2) barcodes with the picked engine, numbered as in
+ * the barcode lookup. Unless ``quiet``, says what the engine needed if it
+ * couldn't. */
+static int
+load_indices(struct axe_config *config, bool quiet)
 {
-    int ret = 1;
-    if (!axe_config_ok(config)) {
-        return -1;
-    }
+    const struct axe_engine *engine = config->engine_ops;
+    const char **seqs = NULL;
+    size_t n[2] = {config->n_barcode_pairs, 0};
+    const int64_t bytes = qes_mem_current(AXE_MEM_TRIE);
+    const uint64_t start = axe_now_ns();
+    size_t iii = 0;
+    size_t jjj = 0;
+
     if (config->match_combo) {
-        ret = load_tries_combo(config);
-    } else {
-        ret = load_tries_single(config);
+        n[0] = config->n_barcodes_1;
+        n[1] = config->n_barcodes_2;
     }
-    if (config->verbosity > 0) {
-        fprintf(stderr, "[load_tries] (%s) Barcode tries loaded\n",
-                nowstr());
+    seqs = qes_calloc(n[0] > n[1] ? n[0] : n[1], sizeof(*seqs));
+    for (iii = 0; iii < 2 && n[iii] > 0; iii++) {
+        for (jjj = 0; jjj < n[iii]; jjj++) {
+            seqs[jjj] = config->match_combo ? config->barcode_seqs[iii][jjj] :
+                                              config->barcodes[jjj]->seq1;
+        }
+        config->indices[iii] = engine->build(seqs, n[iii], config);
+        if (config->indices[iii] == NULL) {
+            if (!quiet && engine->needs != NULL) {
+                qes_log_format_fatal(config->logger,
+                                     "load_tries -- Can't index the R%zu "
+                                     "barcodes: the %s engine needs %s\n",
+                                     iii + 1, engine->name, engine->needs);
+            }
+            engine->destroy(config->indices[0]);
+            config->indices[0] = NULL;
+            qes_free(seqs);
+            return 1;
+        }
     }
-    return ret;
+    qes_free(seqs);
+    config->engine_stats.build_seconds = (axe_now_ns() - start) / 1e9;
+    config->engine_stats.bytes = qes_mem_current(AXE_MEM_TRIE) - bytes;
+    config->engine_stats.keys = engine->keys(config->indices[0]) +
+                                engine->keys(config->indices[1]);
+    return 0;
 }
 
-static inline int
+/* Whether an engine picked automatically gives way to the next if it can't
+ * index the barcodes. The tries say why they can't, and seeds are the last
+ * resort. */
+static bool
+engine_gives_way(const struct axe_config *config)
+{
+    return config->engine == AXE_ENGINE_AUTO &&
+           (config->engine_ops->type == AXE_ENGINE_BRUTE ||
+            config->engine_ops->type == AXE_ENGINE_WHITELIST);
+}
+
+int
+axe_load_tries(struct axe_config *config)
+{
+    size_t next = 0;
+    int ret = 1;
+
+    if (!axe_config_ok(config) || config->engine_ops == NULL) {
+        return -1;
+    }
+    ret = load_indices(config, engine_gives_way(config));
+    while (ret != 0 && engine_gives_way(config)) {
+        next = 0;
+        while (auto_engines[next] != config->engine_ops->type) {
+            next++;
+        }
+        config->engine_ops = pick_engine(config, next + 1);
+        ret = load_indices(config, engine_gives_way(config));
+    }
+    if (ret == 0 && config->verbosity >= 0) {
+        qes_log_format_info(config->logger,
+                            "load_tries -- (%s) Matching with the %s engine "
+                            "(%s kernels), built in %0.3fs using %0.1f MiB\n",
+                            nowstr(), config->engine_ops->name, qes_simd->name,
+                            config->engine_stats.build_seconds,
+                            config->engine_stats.bytes / 1048576.0);
+    }
+    return ret;
+}
+
+static inline int
 write_barcoded_read_combo(struct axe_output *out, struct qes_seq *seq1,
                           struct qes_seq *seq2, size_t bcd1_len,
                           size_t bcd2_len)
@@ -987,35 +1847,23 @@ write_barcoded_read_combo(struct axe_output *out, struct qes_seq *seq1,
     return 0;
 }
 
-static inline void
-increment_reads_print_progress(struct axe_config *config)
-{
-    config->reads_processed++;
-    if (config->reads_processed % 100000 == 0) {
-        if (config->verbosity >= 0) {
-            axe_format_progress(config->logger,
-                                "%s: Processed %.1fM %s\r",
-                                nowstr(),
-                                (float)(config->reads_processed/1000000.0),
-                    config->out_mode == READS_SINGLE ? "reads" : "read pairs");
-        }
-    }
-}
-
-static inline int
-process_read_pair_single(struct axe_config *config, struct qes_seq *seq1,
-                        struct qes_seq *seq2)
+/* Sink writing a read (pair) to its sample's output. The outputs are shared
+ * between threads, so this must be called from within a critical section. */
+static int
+output_read_pair_single(void *data, const struct axe_match *match,
+                        struct qes_seq *seq1, struct qes_seq *seq2)
 {
+    struct axe_config *config = data;
     int ret = 0;
-    ssize_t bcd = -1;
-    size_t barcode_pair_index = 0;
     struct axe_output *outfile = NULL;
     size_t bcd_len = 0;
+    size_t rev_len = 0;
 
-    ret = axe_match_read(config, &bcd, config->fwd_trie, seq1);
-    increment_reads_print_progress(config);
-    if (ret != 0) {
+    if (match->sample < 0) {
         /* No match */
+        if (config->count_only) {
+            return 0;
+        }
         qes_seqfile_write(config->unknown_output->fwd_file, seq1);
         if (seq2 != NULL) {
             if (config->out_mode == READS_INTERLEAVED) {
@@ -1024,16 +1872,17 @@ process_read_pair_single(struct axe_config *config, struct qes_seq *seq1,
                 qes_seqfile_write(config->unknown_output->rev_file, seq2);
             }
         }
-        config->reads_failed++;
         return 0;
     }
     /* Found a match */
-    config->reads_demultiplexed++;
-    /* FIXME: we need to check bcd doesn't cause segfault */
-    barcode_pair_index = config->barcode_lookup[bcd][0];
-    outfile = config->outputs[barcode_pair_index];
-    bcd_len = config->barcodes[barcode_pair_index]->len1;
-    config->barcodes[bcd]->count++;
+    if (config->count_only) {
+        return 0;
+    }
+    outfile = config->outputs[match->sample];
+    /* R1 loses the read bases the barcode took up, which differ from its
+     * length by any indels. -2 trims R2 by the barcode's own length. */
+    bcd_len = match->lens[0];
+    rev_len = config->barcodes[match->sample]->len1;
     if (seq1->seq.len <= bcd_len) {
         /* Don't write out seqs shorter than the barcode */
         return 0;
@@ -1064,10 +1913,10 @@ process_read_pair_single(struct axe_config *config, struct qes_seq *seq1,
     /* And do the same with seq2, if we have one */
     if (seq2 != NULL) {
         if (config->trim_rev) {
-            seq2->seq.str += bcd_len;
-            seq2->seq.len -= bcd_len;
-            seq2->qual.str += bcd_len;
-            seq2->qual.len -= bcd_len;
+            seq2->seq.str += rev_len;
+            seq2->seq.len -= rev_len;
+            seq2->qual.str += rev_len;
+            seq2->qual.len -= rev_len;
         }
         if (outfile->mode == READS_INTERLEAVED) {
             ret = qes_seqfile_write(outfile->fwd_file, seq2);
@@ -1091,18 +1940,295 @@ process_read_pair_single(struct axe_config *config, struct qes_seq *seq1,
             }
         }
         if (config->trim_rev) {
-            seq2->seq.str -= bcd_len;
-            seq2->seq.len += bcd_len;
-            seq2->qual.str -= bcd_len;
-            seq2->qual.len += bcd_len;
+            seq2->seq.str -= rev_len;
+            seq2->seq.len += rev_len;
+            seq2->qual.str -= rev_len;
+            seq2->qual.len += rev_len;
+        }
+    }
+    return 0;
+}
+
+
+/* Number of mismatches between a barcode and the start of a read it matched */
+static inline size_t
+barcode_mismatches(const char *barcode, size_t len, const struct qes_seq *seq)
+{
+    size_t mismatches = 0;
+    size_t iii = 0;
+
+    len = len < seq->seq.len ? len : seq->seq.len;
+    for (iii = 0; iii < len; iii++) {
+        mismatches += barcode[iii] != seq->seq.str[iii];
+    }
+    return mismatches;
+}
+
+/* Adds the time since ``since`` to a stage of the part, returning now */
+static inline uint64_t
+part_time_stage(struct axe_part *part, enum axe_stage stage, uint64_t since)
+{
+    uint64_t now = axe_now_ns();
+
+    part->stage_ns[stage] += now - since;
+    return now;
+}
+
+/* Starts a read (pair), returning true if its stages should be timed */
+static inline bool
+part_begin_read(struct axe_part *part, uint64_t *now)
+{
+    if (part->n_reads++ % AXE_TIMING_SAMPLE != 0) {
+        return false;
+    }
+    *now = part_time_stage(part, AXE_STAGE_READ, part->last_ns);
+    return true;
+}
+
+static inline void
+part_end_read(struct axe_part *part, bool timed, uint64_t since)
+{
+    if (timed) {
+        part_time_stage(part, AXE_STAGE_WRITE, since);
+        part->n_timed++;
+    }
+    if (part->n_reads % AXE_TIMING_SAMPLE == 0) {
+        /* The next read will be timed, from when we start reading it */
+        part->last_ns = axe_now_ns();
+    }
+}
+
+/* Demultiplexes a read (pair) with the part's stream, whose sink writes it
+ * to the outputs */
+static inline int
+process_read_pair(struct axe_config *config, struct axe_part *part,
+                  struct qes_seq *seq1, struct qes_seq *seq2)
+{
+    int ret = 0;
+    struct axe_match match;
+    uint64_t now = 0;
+    bool timed = part_begin_read(part, &now);
+
+    /* Matching only reads the tries, so can happen in parallel */
+    axe_stream_match(part->stream, seq1, seq2, &match);
+    if (timed) {
+        now = part_time_stage(part, AXE_STAGE_MATCH, now);
+    }
+#ifdef OPENMP_FOUND
+    #pragma omp critical (axe_output)
+#endif
+    {
+        if (timed) {
+            now = part_time_stage(part, AXE_STAGE_WAIT, now);
+        }
+        ret = axe_stream_emit(part->stream, &match, seq1, seq2);
+        if (ret == 0) {
+            ret = axe_commit_part(config, part);
+        }
+    }
+    part_end_read(part, timed, now);
+    return ret;
+}
+
+
+static bool
+axe_input_splittable(const struct axe_config *config)
+{
+    enum qes_split_format fmt = qes_split_guess_format(config->infiles[0]);
+
+    if (config->in_mode == READS_PAIRED) {
+        /* R2 is found by name, which we can only do in plain text */
+        return fmt == QES_SPLIT_PLAIN &&
+               qes_split_guess_format(config->infiles[1]) == QES_SPLIT_PLAIN;
+    }
+    if (fmt == QES_SPLIT_GZIP) {
+        return config->gz_index != NULL;
+    }
+    return fmt == QES_SPLIT_PLAIN || fmt == QES_SPLIT_BGZF;
+}
+
+/* Loads or builds the access point index of ordinary gzip input, so that
+ * axe_open_infiles can split it, or resume from the access point before a
+ * checkpoint rather than the start. Failure isn't fatal, the input just
+ * can't be split. */
+static void
+axe_load_gz_index(struct axe_config *config)
+{
+    if ((!config->use_gz_index && config->checkpoint_file == NULL) ||
+            config->gz_index != NULL ||
+            config->in_mode == READS_PAIRED ||
+            qes_split_guess_format(config->infiles[0]) != QES_SPLIT_GZIP) {
+        return;
+    }
+    if (config->verbosity >= 0) {
+        axe_format_progress(config->logger,
+                            "process_file -- Indexing %s\n",
+                            config->infiles[0]);
+    }
+    config->gz_index = qes_gzindex_get(config->infiles[0], QES_GZINDEX_SPAN);
+    if (config->gz_index == NULL) {
+        qes_log_format_warning(config->logger,
+                               "process_file -- Couldn't index %s. It must be "
+                               "a single member gzip file\n",
+                               config->infiles[0]);
+    } else {
+        qes_log_format_debug(config->logger,
+                             "process_file -- %s has %zu access points\n",
+                             config->infiles[0], config->gz_index->n_points);
+    }
+}
+
+/* Calculates the range(s) of part ``idx`` of ``n`` of the input file(s) */
+static int
+axe_split_range(const struct axe_config *config, size_t idx, size_t n,
+                struct qes_split_range *range1,
+                struct qes_split_range *range2)
+{
+    int interleaved = config->in_mode == READS_INTERLEAVED;
+    int res = 0;
+
+    if (config->in_mode == READS_PAIRED) {
+        res = qes_split_range_paired(config->infiles[0], config->infiles[1],
+                                     idx, n, range1, range2);
+    } else if (config->gz_index != NULL) {
+        res = qes_gzindex_split_range(config->gz_index, config->infiles[0],
+                                      idx, n, interleaved, range1);
+    } else {
+        res = qes_split_range(config->infiles[0], idx, n, interleaved,
+                              range1);
+    }
+    if (res == 1) {
+        qes_log_format_fatal(config->logger,
+                             "process_file -- Can't split input into %zu parts. "
+                             "Only uncompressed or BGZF files, or gzip "
+                             "files with --gz-index, can be split\n",
+                             n);
+    } else if (res != 0) {
+        qes_log_format_fatal(config->logger,
+                             "process_file -- Couldn't split input into %zu parts\n",
+                             n);
+    }
+    return res;
+}
+
+/* Opens part ``idx`` of ``n`` of the input file(s), at the positions in
+ * ``part`` if resuming. */
+static int
+axe_open_infiles(struct axe_config *config, struct axe_part *part,
+                 size_t idx, size_t n, struct qes_seqfile **fwdsf,
+                 struct qes_seqfile **revsf)
+{
+    struct qes_split_range range1 = {0, 0, -1};
+    struct qes_split_range range2 = {0, 0, -1};
+    int interleaved = config->in_mode == READS_INTERLEAVED;
+    int paired = config->in_mode == READS_PAIRED;
+
+    *fwdsf = NULL;
+    *revsf = NULL;
+    if (n == 1 && part->pos[0] == 0) {
+        *fwdsf = qes_seqfile_create(config->infiles[0], "r");
+        if (paired) {
+            *revsf = qes_seqfile_create(config->infiles[1], "r");
+        }
+    } else if (n == 1 && config->gz_index != NULL) {
+        /* Resuming: inflate from the access point before what was read */
+        *fwdsf = qes_gzindex_split_open_at(config->gz_index,
+                                           config->infiles[0], &range1,
+                                           part->pos[0], interleaved ? 2 : 1);
+    } else if (n == 1) {
+        /* Resuming: skip what was read, however the input allows */
+        *fwdsf = qes_split_open_at(config->infiles[0], &range1, part->pos[0],
+                                   interleaved ? 2 : 1);
+        if (paired) {
+            *revsf = qes_split_open_at(config->infiles[1], &range2,
+                                       part->pos[1], 1);
+        }
+    } else {
+        if (axe_split_range(config, idx, n, &range1, &range2) != 0) {
+            return 1;
+        }
+        qes_log_format_debug(config->logger,
+                             "process_file -- Part %zu of %zu starts at %lld+%lld\n",
+                             idx + 1, n, (long long)range1.offset,
+                             (long long)range1.skip);
+        /* A part that hasn't started yet opens at its beginning */
+        part->pos[0] = part->pos[0] > range1.skip ? part->pos[0] : range1.skip;
+        part->pos[1] = part->pos[1] > range2.skip ? part->pos[1] : range2.skip;
+        if (config->gz_index != NULL) {
+            *fwdsf = qes_gzindex_split_open_at(config->gz_index,
+                                               config->infiles[0], &range1,
+                                               part->pos[0],
+                                               interleaved ? 2 : 1);
+        } else {
+            *fwdsf = qes_split_open_at(config->infiles[0], &range1,
+                                       part->pos[0], interleaved ? 2 : 1);
+        }
+        if (paired) {
+            *revsf = qes_split_open_at(config->infiles[1], &range2,
+                                       part->pos[1], 1);
         }
     }
+    if (*fwdsf == NULL) {
+        qes_log_format_fatal(config->logger,
+                             "process_file -- Couldn't open seqfile %s\n",
+                             config->infiles[0]);
+        return 1;
+    }
+    if (paired && *revsf == NULL) {
+        qes_log_format_fatal(config->logger,
+                             "process_file -- Couldn't open seqfile %s\n",
+                             config->infiles[1]);
+        qes_seqfile_destroy(*fwdsf);
+        return 1;
+    }
+    part->in[0] = *fwdsf;
+    part->in[1] = *revsf;
     return 0;
 }
 
+static inline bool
+axe_preview_done(const struct axe_config *config)
+{
+    return config->preview > 0 && config->reads_so_far >= config->preview;
+}
+
+/* Fraction of a file parsed so far, or 0 if unknown. Compressed files are
+ * measured by compressed size, assuming what's been parsed compressed as
+ * well as everything inflated so far. */
+static double
+axe_read_fraction(const struct qes_file *qf)
+{
+    struct stat st;
+    double pos = qf->filepos;
+
+    if (qf->reader != NULL || qf->fp == NULL || stat(qf->path, &st) != 0 ||
+            st.st_size == 0) {
+        return 0;
+    }
+#ifdef ZLIB_FOUND
+    if (!gzdirect(qf->fp) && gztell(qf->fp) > 0 && gzoffset(qf->fp) > 0) {
+        pos *= (double)gzoffset(qf->fp) / (double)gztell(qf->fp);
+    }
+#endif
+    return pos >= st.st_size ? 1.0 : pos / (double)st.st_size;
+}
+
+/* Closes the input(s) of ``part``, first noting how much of the input was
+ * read if a preview stopped early */
+static void
+axe_close_infiles(struct axe_config *config, struct axe_part *part)
+{
+    if (part->in[0] != NULL && axe_preview_done(config)) {
+        config->input_fraction = axe_read_fraction(part->in[0]->qf);
+    }
+    qes_seqfile_destroy(part->in[0]);
+    qes_seqfile_destroy(part->in[1]);
+}
+
 
 static int
-process_file_single(struct axe_config *config)
+process_file_single(struct axe_config *config, struct axe_part *part,
+                    size_t idx, size_t n)
 {
     struct qes_seqfile *fwdsf = NULL;
     struct qes_seqfile *revsf = NULL;
@@ -1112,13 +2238,10 @@ process_file_single(struct axe_config *config)
     if (!axe_config_ok(config)) {
         return -1;
     }
-    fwdsf = qes_seqfile_create(config->infiles[0], "r");
-    if (fwdsf == NULL) {
-        qes_log_format_fatal(config->logger,
-                             "process_file -- Couldn't open seqfile %s\n",
-                             config->infiles[0]);
+    if (axe_open_infiles(config, part, idx, n, &fwdsf, &revsf) != 0) {
         goto exit;
     }
+    part->last_ns = axe_now_ns();
     switch(config->in_mode) {
     case READS_SINGLE:
         goto single;
@@ -1127,13 +2250,6 @@ process_file_single(struct axe_config *config)
         goto interleaved;
         break;
     case READS_PAIRED:
-        revsf = qes_seqfile_create(config->infiles[1], "r");
-        if (revsf == NULL) {
-            qes_log_format_fatal(config->logger,
-                                 "process_file -- Couldn't open seqfile %s\n",
-                                 config->infiles[1]);
-            goto exit;
-        }
         goto paired;
         break;
     case READS_UNKNOWN:
@@ -1147,7 +2263,8 @@ process_file_single(struct axe_config *config)
 
 single:
     QES_SEQFILE_ITER_SINGLE_BEGIN(fwdsf, seq, seqlen) {
-        ret = process_read_pair_single(config, seq, NULL);
+        ret = process_read_pair(config, part, seq, NULL);
+        if (axe_preview_done(config)) break;
     }
     QES_SEQFILE_ITER_SINGLE_END(seq);
     retval = ret == 0 ? 0 : 1;
@@ -1155,7 +2272,8 @@ single:
 
 interleaved:
     QES_SEQFILE_ITER_INTERLEAVED_BEGIN(fwdsf, seq1, seq2, seqlen1, seqlen2) {
-        ret = process_read_pair_single(config, seq1, seq2);
+        ret = process_read_pair(config, part, seq1, seq2);
+        if (axe_preview_done(config)) break;
     }
     QES_SEQFILE_ITER_INTERLEAVED_END(seq1, seq2);
     retval = ret == 0 ? 0 : 1;
@@ -1163,70 +2281,55 @@ interleaved:
 
 paired:
     QES_SEQFILE_ITER_PAIRED_BEGIN(fwdsf, revsf, seq1, seq2, seqlen1, seqlen2) {
-        ret = process_read_pair_single(config, seq1, seq2);
+        ret = process_read_pair(config, part, seq1, seq2);
+        if (axe_preview_done(config)) break;
     }
     QES_SEQFILE_ITER_PAIRED_END(seq1, seq2);
     retval = ret == 0 ? 0 : 1;
     goto exit;
 exit:
-    qes_seqfile_destroy(fwdsf);
-    qes_seqfile_destroy(revsf);
+    axe_close_infiles(config, part);
     return retval;
 }
 
 
+/* As for output_read_pair_single, call only within a critical section */
 static int
-process_read_pair_combo(struct axe_config *config, struct qes_seq *seq1,
-                        struct qes_seq *seq2)
-{
-    ssize_t barcode_pair_index = 0;
-    intptr_t bcd1 = -1;
-    intptr_t bcd2 = -1;
-    int r1_ret = 0;
-    int r2_ret = 0;
+output_read_pair_combo(void *data, const struct axe_match *match,
+                       struct qes_seq *seq1, struct qes_seq *seq2)
+{
+    struct axe_config *config = data;
     size_t bcd1_len = 0;
     size_t bcd2_len = 0;
     struct axe_output *outfile = NULL;
 
-    r1_ret = axe_match_read(config, &bcd1, config->fwd_trie, seq1);
-    r2_ret = axe_match_read(config, &bcd2, config->rev_trie, seq2);
-    increment_reads_print_progress(config);
-    if (r1_ret != 0 || r2_ret != 0) {
-        /* No match */
+    if (match->sample < 0) {
+        /* No match, or an invalid match */
+        if (config->count_only) {
+            return 0;
+        }
         qes_seqfile_write(config->unknown_output->fwd_file, seq1);
         if (config->out_mode == READS_INTERLEAVED) {
             qes_seqfile_write(config->unknown_output->fwd_file, seq2);
         } else {
             qes_seqfile_write(config->unknown_output->rev_file, seq2);
         }
-        config->reads_failed++;
         return 0;
     }
-    /* Found a match */
-    barcode_pair_index = config->barcode_lookup[bcd1][bcd2];
-    if (barcode_pair_index < 0) {
-        /* Invalid match */
-        qes_seqfile_write(config->unknown_output->fwd_file, seq1);
-        if (config->out_mode == READS_INTERLEAVED) {
-            qes_seqfile_write(config->unknown_output->fwd_file, seq2);
-        } else {
-            qes_seqfile_write(config->unknown_output->rev_file, seq2);
-        }
-        config->reads_failed++;
+    if (config->count_only) {
         return 0;
     }
-    config->reads_demultiplexed++;
-    outfile = config->outputs[barcode_pair_index];
-    bcd1_len = config->barcodes[barcode_pair_index]->len1;
-    bcd2_len = config->barcodes[barcode_pair_index]->len2;
-    config->barcodes[barcode_pair_index]->count++;
+    outfile = config->outputs[match->sample];
+    bcd1_len = match->lens[0];
+    bcd2_len = match->lens[1];
     return write_barcoded_read_combo(outfile, seq1, seq2, bcd1_len,
                                      bcd2_len);
 }
 
 
 static int
-process_file_combo(struct axe_config *config)
+process_file_combo(struct axe_config *config, struct axe_part *part,
+                   size_t idx, size_t n)
 {
     struct qes_seqfile *fwdsf = NULL;
     struct qes_seqfile *revsf = NULL;
@@ -1235,25 +2338,15 @@ process_file_combo(struct axe_config *config)
     if (!axe_config_ok(config)) {
         return -1;
     }
-    fwdsf = qes_seqfile_create(config->infiles[0], "r");
-    if (fwdsf == NULL) {
-        qes_log_format_fatal(config->logger,
-                             "process_file -- Couldn't open seqfile %s\n",
-                             config->infiles[0]);
+    if (axe_open_infiles(config, part, idx, n, &fwdsf, &revsf) != 0) {
         goto error;
     }
+    part->last_ns = axe_now_ns();
     switch(config->in_mode) {
     case READS_INTERLEAVED:
         goto interleaved;
         break;
     case READS_PAIRED:
-        revsf = qes_seqfile_create(config->infiles[1], "r");
-        if (revsf == NULL) {
-            qes_log_format_fatal(config->logger,
-                                 "process_file -- Couldn't open seqfile %s\n",
-                                 config->infiles[0]);
-            goto error;
-        }
         goto paired;
         break;
     case READS_SINGLE:
@@ -1268,56 +2361,274 @@ process_file_combo(struct axe_config *config)
 
 interleaved:
     QES_SEQFILE_ITER_INTERLEAVED_BEGIN(fwdsf, seq1, seq2, seqlen1, seqlen2)
-    if (process_read_pair_combo(config, seq1, seq2)) {
+    if (process_read_pair(config, part, seq1, seq2)) {
         have_error = 1;
         break;
     }
+    if (axe_preview_done(config)) break;
     QES_SEQFILE_ITER_INTERLEAVED_END(seq1, seq2)
     if (!have_error) goto clean_exit;
     else goto error;
 
 paired:
     QES_SEQFILE_ITER_PAIRED_BEGIN(fwdsf, revsf, seq1, seq2, seqlen1, seqlen2)
-    if (process_read_pair_combo(config, seq1, seq2)) {
+    if (process_read_pair(config, part, seq1, seq2)) {
         have_error = 1;
         break;
     }
+    if (axe_preview_done(config)) break;
     QES_SEQFILE_ITER_PAIRED_END(seq1, seq2)
     if (!have_error) goto clean_exit;
     else goto error;
 
 clean_exit:
-    qes_seqfile_destroy(fwdsf);
-    qes_seqfile_destroy(revsf);
+    axe_close_infiles(config, part);
     return 0;
 error:
-    qes_seqfile_destroy(fwdsf);
-    qes_seqfile_destroy(revsf);
+    axe_close_infiles(config, part);
     return 1;
 }
 
 
+/* Adds each thread's counters to the config's, zeroing them. Stage times
+ * are scaled up from the timed reads to all reads. */
+static void
+axe_reduce_parts(struct axe_config *config)
+{
+    struct axe_part *part = NULL;
+    size_t iii = 0;
+    size_t jjj = 0;
+
+    axe_reduce_workers(config, true);
+    for (iii = 0; iii < config->n_parts; iii++) {
+        part = &config->parts[iii];
+        for (jjj = 0; part->n_timed > 0 && jjj < AXE_N_STAGES; jjj++) {
+            config->stage_seconds[jjj] += (double)part->stage_ns[jjj] / 1e9 *
+                    (double)part->n_reads / (double)part->n_timed;
+        }
+        memset(part->stage_ns, 0, sizeof(part->stage_ns));
+        part->n_reads = part->n_timed = 0;
+    }
+}
+
+/* Allocates each thread's progress, from the checkpoint if resuming */
+static int
+axe_setup_parts(struct axe_config *config, size_t threads, size_t first_part,
+                size_t n_parts)
+{
+    struct axe_checkpoint *cp = config->checkpoint;
+    size_t iii = 0;
+
+    axe_free_parts(config);
+    axe_alloc_counters(config);
+    if (config->matcher == NULL) {
+        config->matcher = axe_matcher_create(config);
+        if (config->matcher == NULL) {
+            qes_log_message_fatal(config->logger,
+                                  "process_file -- Barcode tries aren't "
+                                  "loaded\n");
+            return 1;
+        }
+    }
+    config->parts = qes_calloc(threads, sizeof(*config->parts));
+    config->n_parts = threads;
+    for (iii = 0; iii < threads; iii++) {
+        config->parts[iii].stream = axe_stream_create(
+                config->matcher, config->match_combo ? output_read_pair_combo :
+                                                       output_read_pair_single,
+                config);
+    }
+    config->parts_first = first_part;
+    config->parts_total = n_parts;
+    config->next_checkpoint = config->reads_processed +
+                              config->checkpoint_every;
+    if (cp == NULL) {
+        return 0;
+    }
+    if (cp->threads != threads || cp->first_part != first_part ||
+            cp->n_parts != n_parts ||
+            cp->gz_index != (config->gz_index != NULL)) {
+        qes_log_format_fatal(config->logger,
+                             "process_file -- %s splits the input into "
+                             "different parts. Resume with the same "
+                             "--threads, --chunk and --gz-index\n",
+                             config->checkpoint_file);
+        return 1;
+    }
+    for (iii = 0; iii < threads; iii++) {
+        config->parts[iii].pos[0] = cp->pos[iii][0];
+        config->parts[iii].pos[1] = cp->pos[iii][1];
+    }
+    return 0;
+}
+
+static int
+process_part(struct axe_config *config, struct axe_part *part, size_t idx,
+             size_t n)
+{
+    if (config->match_combo) {
+        return process_file_combo(config, part, idx, n);
+    }
+    return process_file_single(config, part, idx, n);
+}
+
+/* Index of the ``iii``th of ``picked`` evenly spaced windows of ``n`` */
+static inline size_t
+axe_sample_window(size_t iii, size_t picked, size_t n)
+{
+    return (2 * iii + 1) * n / (2 * picked);
+}
+
+/* Picks the windows to read, and works out the fraction of the input they
+ * cover from where they start */
+static int
+axe_setup_sampling(struct axe_config *config)
+{
+    struct qes_split_range range1 = {0, 0, -1};
+    struct qes_split_range range2 = {0, 0, -1};
+    struct qes_split_range next = {0, 0, -1};
+    struct stat st;
+    size_t windows = AXE_SAMPLE_WINDOWS;
+    size_t picked = 0;
+    size_t idx = 0;
+    size_t iii = 0;
+    double total = 0;
+    double covered = 0;
+    off_t end = 0;
+
+    if (!axe_input_splittable(config)) {
+        qes_log_format_fatal(config->logger,
+                             "process_file -- Can't sample %s. Only "
+                             "uncompressed or BGZF files, or gzip files with "
+                             "--gz-index, can be sampled\n",
+                             config->infiles[0]);
+        return 1;
+    }
+    if (config->gz_index != NULL) {
+        /* Windows start at access points, so more would be empty */
+        if (windows > config->gz_index->n_points) {
+            windows = config->gz_index->n_points;
+        }
+        total = config->gz_index->length;
+    } else if (stat(config->infiles[0], &st) == 0) {
+        total = st.st_size;
+    }
+    picked = (size_t)(config->sample_fraction * windows + 0.5);
+    picked = picked < 1 ? 1 : picked > windows ? windows : picked;
+    for (iii = 0; iii < picked; iii++) {
+        idx = axe_sample_window(iii, picked, windows);
+        if (axe_split_range(config, idx, windows, &range1, &range2) != 0) {
+            return 1;
+        }
+        end = total;
+        if (idx + 1 < windows) {
+            if (axe_split_range(config, idx + 1, windows, &next,
+                                &range2) != 0) {
+                return 1;
+            }
+            end = next.offset;
+        }
+        covered += end - range1.offset;
+    }
+    config->sample_windows = windows;
+    config->sample_picked = picked;
+    config->input_fraction = total > 0 ? covered / total : 0;
+    qes_log_format_debug(config->logger,
+                         "process_file -- Sampling %zu of %zu windows, "
+                         "%0.2f%% of the input\n",
+                         picked, windows, config->input_fraction * 100.0);
+    return 0;
+}
+
+/* Processes thread ``thread``'s share of the windows picked for sampling */
+static int
+process_sampled(struct axe_config *config, struct axe_part *part,
+                size_t thread, size_t threads)
+{
+    int ret = 0;
+    size_t iii = 0;
+
+    for (iii = thread; iii < config->sample_picked && ret == 0;
+            iii += threads) {
+        part->pos[0] = part->pos[1] = 0;
+        ret = process_part(config, part,
+                           axe_sample_window(iii, config->sample_picked,
+                                             config->sample_windows),
+                           config->sample_windows);
+    }
+    return ret;
+}
+
 int
 axe_process_file(struct axe_config *config)
 {
     int ret = 0;
-    clock_t start = 0;
+    struct timespec start;
+    struct timespec end;
+    size_t threads = 1;
+    size_t n_parts = 0;
+    size_t first_part = 0;
+    size_t iii = 0;
 
     if (!axe_config_ok(config)) {
         return -1;
     }
-    start = clock();
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    config->start_ns = axe_now_ns();
+    config->start_reads = config->reads_processed;
+    config->reads_so_far = config->reads_processed;
+    config->next_metrics_ns = config->start_ns;
+    if (config->live_file != NULL && axe_open_live(config) != 0) {
+        return 1;
+    }
+    config->input_fraction = 1.0;
+    axe_load_gz_index(config);
+    if (config->sample_fraction > 0 && axe_setup_sampling(config) != 0) {
+        return 1;
+    }
+    /* A preview reads the first reads of the input, so uses one thread */
+    if (config->threads > 1 && config->preview == 0) {
+        threads = config->threads;
+        if (!axe_input_splittable(config)) {
+            qes_log_message_warning(config->logger,
+                                    "process_file -- Input can't be split, "
+                                    "using one thread\n");
+            threads = 1;
+        }
+    }
+    /* Each thread parses its own part of the input (or of this chunk of
+     * the input). Parts are numbered across all chunks. */
+    n_parts = threads * (config->n_chunks > 0 ? config->n_chunks : 1);
+    first_part = config->chunk_index * threads;
+    if (axe_setup_parts(config, threads, first_part, n_parts) != 0) {
+        return 1;
+    }
     if (config->verbosity >= 0) {
         axe_format_bold(config->logger,
                         "process_file -- (%s) Starting demultiplexing\n",
                         nowstr());
     }
-    if (config->match_combo) {
-        ret = process_file_combo(config);
-    } else {
-        ret = process_file_single(config);
+#ifdef OPENMP_FOUND
+    #pragma omp parallel for num_threads(threads) schedule(static, 1) \
+                             reduction(|:ret)
+#endif
+    for (iii = 0; iii < threads; iii++) {
+        if (config->sample_fraction > 0) {
+            ret |= process_sampled(config, &config->parts[iii], iii, threads);
+        } else {
+            ret |= process_part(config, &config->parts[iii], first_part + iii,
+                                n_parts);
+        }
     }
-    config->time_taken = (float)(clock() - start) / CLOCKS_PER_SEC;
+    axe_reduce_parts(config);
+    axe_finish_metrics(config);
+    if (ret == 0 && config->checkpoint_file != NULL) {
+        /* Finished, so there's nothing to resume */
+        unlink(config->checkpoint_file);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    config->time_taken = (float)(end.tv_sec - start.tv_sec) +
+                         (float)(end.tv_nsec - start.tv_nsec) / 1e9;
     if (config->verbosity >= 0) {
         /* Jump to new line so we don't clobber the progress bar */
         fprintf(stderr, "\n");
@@ -1415,132 +2726,2321 @@ hamming_mutate_dna(size_t *n_results_o, const char *str, size_t len,
     return result;
 }
 
-struct axe_trie *
-axe_trie_create(void)
+/* Space-Saving heavy hitters (Metwally et al. 2005). Entries sit in a
+ * min-heap on count, so the least frequent can be replaced in O(log n), and
+ * are found by key through an open addressing hash table. */
+
+struct axe_topk *
+axe_topk_create(size_t capacity, size_t key_len)
 {
-    struct axe_trie *trie = NULL;
-    AlphaMap *map = alpha_map_new();
-    int ret = 0;
+    struct axe_topk *topk = NULL;
+    size_t table_size = 1;
+    size_t iii = 0;
+
+    if (capacity == 0) {
+        return NULL;
+    }
+    /* Keep the table at most half full, so probes stay short */
+    while (table_size < 2 * capacity) {
+        table_size <<= 1;
+    }
+    topk = qes_calloc(1, sizeof(*topk));
+    topk->entries = qes_calloc(capacity, sizeof(*topk->entries));
+    topk->keys = qes_calloc(capacity, key_len + 1);
+    topk->heap = qes_calloc(capacity, sizeof(*topk->heap));
+    topk->table = qes_calloc(table_size, sizeof(*topk->table));
+    topk->table_mask = table_size - 1;
+    topk->capacity = capacity;
+    topk->key_len = key_len;
+    for (iii = 0; iii < capacity; iii++) {
+        topk->entries[iii].key = topk->keys + iii * (key_len + 1);
+    }
+    return topk;
+}
+
+void
+axe_topk_destroy_(struct axe_topk *topk)
+{
+    if (topk == NULL) {
+        return;
+    }
+    qes_free(topk->entries);
+    qes_free(topk->keys);
+    qes_free(topk->heap);
+    qes_free(topk->table);
+    qes_free(topk);
+}
+
+static inline size_t
+topk_hash(const char *key, size_t len)
+{
+    /* FNV-1a */
+    uint64_t hash = 14695981039346656037ULL;
+    size_t iii = 0;
+
+    for (iii = 0; iii < len; iii++) {
+        hash ^= (unsigned char)key[iii];
+        hash *= 1099511628211ULL;
+    }
+    return (size_t)hash;
+}
+
+/* Returns the table slot holding ``key``, or the empty slot ending its probe
+ * sequence */
+static inline size_t
+topk_find(const struct axe_topk *topk, const char *key, size_t len)
+{
+    size_t slot = topk_hash(key, len) & topk->table_mask;
+    const char *ekey = NULL;
+
+    while (topk->table[slot] != 0) {
+        ekey = topk->entries[topk->table[slot] - 1].key;
+        if (strncmp(ekey, key, len) == 0 && ekey[len] == '\0') {
+            break;
+        }
+        slot = (slot + 1) & topk->table_mask;
+    }
+    return slot;
+}
+
+/* Empties a table slot, shifting later entries of the probe run back so
+ * they can still be found */
+static void
+topk_unlink(struct axe_topk *topk, size_t slot)
+{
+    size_t next = slot;
+    size_t home = 0;
+    const char *key = NULL;
+
+    while (1) {
+        topk->table[slot] = 0;
+        do {
+            next = (next + 1) & topk->table_mask;
+            if (topk->table[next] == 0) {
+                return;
+            }
+            key = topk->entries[topk->table[next] - 1].key;
+            home = topk_hash(key, strlen(key)) & topk->table_mask;
+            /* Leave it if its home is cyclically within (slot, next] */
+        } while (slot <= next ? (slot < home && home <= next) :
+                                (slot < home || home <= next));
+        topk->table[slot] = topk->table[next];
+        slot = next;
+    }
+}
+
+static inline void
+topk_heap_swap(struct axe_topk *topk, size_t a, size_t b)
+{
+    size_t tmp = topk->heap[a];
+
+    topk->heap[a] = topk->heap[b];
+    topk->heap[b] = tmp;
+    topk->entries[topk->heap[a]].heap_pos = a;
+    topk->entries[topk->heap[b]].heap_pos = b;
+}
+
+/* Counts only grow, so an entry can only need to move down the heap */
+static void
+topk_sift_down(struct axe_topk *topk, size_t pos)
+{
+    size_t child = 0;
+
+    while ((child = 2 * pos + 1) < topk->n) {
+        if (child + 1 < topk->n &&
+                topk->entries[topk->heap[child + 1]].count <
+                topk->entries[topk->heap[child]].count) {
+            child++;
+        }
+        if (topk->entries[topk->heap[pos]].count <=
+                topk->entries[topk->heap[child]].count) {
+            break;
+        }
+        topk_heap_swap(topk, pos, child);
+        pos = child;
+    }
+}
+
+struct axe_topk_entry *
+axe_topk_add(struct axe_topk *topk, const char *key, size_t len,
+             uint64_t weight)
+{
+    struct axe_topk_entry *entry = NULL;
+    size_t slot = 0;
+    size_t idx = 0;
+
+    if (topk == NULL || key == NULL) {
+        return NULL;
+    }
+    len = len < topk->key_len ? len : topk->key_len;
+    slot = topk_find(topk, key, len);
+    if (topk->table[slot] != 0) {
+        entry = &topk->entries[topk->table[slot] - 1];
+        entry->count += weight;
+        topk_sift_down(topk, entry->heap_pos);
+        return entry;
+    }
+    if (topk->n < topk->capacity) {
+        idx = topk->n;
+        topk->heap[idx] = idx;
+        topk->entries[idx].heap_pos = idx;
+        topk->entries[idx].count = 0;
+        topk->n++;
+        /* A zero count belongs at the top, from where it sifts down */
+        while (idx > 0) {
+            topk_heap_swap(topk, idx, (idx - 1) / 2);
+            idx = (idx - 1) / 2;
+        }
+        idx = topk->n - 1;
+    } else {
+        /* Replace the least frequent key, inheriting its count as error */
+        idx = topk->heap[0];
+        topk_unlink(topk, topk_find(topk, topk->entries[idx].key,
+                                    strlen(topk->entries[idx].key)));
+        slot = topk_find(topk, key, len);
+    }
+    entry = &topk->entries[idx];
+    memcpy(entry->key, key, len);
+    entry->key[len] = '\0';
+    entry->error = entry->count;
+    entry->count += weight;
+    topk->table[slot] = idx + 1;
+    topk_sift_down(topk, entry->heap_pos);
+    return entry;
+}
+
+static int
+topk_entry_cmp(const void *a, const void *b)
+{
+    const struct axe_topk_entry *ea = *(struct axe_topk_entry * const *)a;
+    const struct axe_topk_entry *eb = *(struct axe_topk_entry * const *)b;
+
+    if (ea->count != eb->count) {
+        return ea->count < eb->count ? 1 : -1;
+    }
+    return strcmp(ea->key, eb->key);
+}
+
+/* Returns the tracked entries by decreasing count, as a NULL-terminated
+ * array which the caller frees */
+struct axe_topk_entry **
+axe_topk_sorted(const struct axe_topk *topk)
+{
+    struct axe_topk_entry **sorted = NULL;
+    size_t iii = 0;
+
+    if (topk == NULL) {
+        return NULL;
+    }
+    sorted = qes_calloc(topk->n + 1, sizeof(*sorted));
+    for (iii = 0; iii < topk->n; iii++) {
+        sorted[iii] = &topk->entries[iii];
+    }
+    qsort(sorted, topk->n, sizeof(*sorted), topk_entry_cmp);
+    return sorted;
+}
+
+/* Adds the counts of src's keys to dst (with their errors, as each may be
+ * overestimated by both), and empties src */
+void
+axe_topk_merge(struct axe_topk *dst, struct axe_topk *src)
+{
+    struct axe_topk_entry *entry = NULL;
+    size_t iii = 0;
+
+    if (dst == NULL || src == NULL) {
+        return;
+    }
+    for (iii = 0; iii < src->n; iii++) {
+        entry = axe_topk_add(dst, src->entries[iii].key,
+                             strlen(src->entries[iii].key),
+                             src->entries[iii].count);
+        entry->error += src->entries[iii].error;
+    }
+    memset(src->table, 0, (src->table_mask + 1) * sizeof(*src->table));
+    src->n = 0;
+}
+
+/* Pair counts. The sparse table uses linear probing, and never deletes. */
+
+struct axe_pair_counts *
+axe_pair_counts_create(size_t n1, size_t n2, size_t dense_max)
+{
+    struct axe_pair_counts *pc = qes_calloc(1, sizeof(*pc));
+
+    pc->n1 = n1;
+    pc->n2 = n2;
+    if (n1 * n2 <= dense_max) {
+        pc->dense = qes_calloc(n1 * n2 > 0 ? n1 * n2 : 1, sizeof(*pc->dense));
+    } else {
+        pc->table_size = 1024;
+        pc->keys = qes_calloc(pc->table_size, sizeof(*pc->keys));
+        pc->counts = qes_calloc(pc->table_size, sizeof(*pc->counts));
+    }
+    return pc;
+}
+
+void
+axe_pair_counts_destroy_(struct axe_pair_counts *pc)
+{
+    if (pc == NULL) {
+        return;
+    }
+    qes_free(pc->dense);
+    qes_free(pc->keys);
+    qes_free(pc->counts);
+    qes_free(pc);
+}
+
+static inline size_t
+pair_counts_slot(const uint64_t *keys, size_t table_size, uint64_t key)
+{
+    /* Fibonacci hashing spreads consecutive keys across the table */
+    size_t slot = (size_t)((key * 11400714819323198485ULL) >> 32) &
+                  (table_size - 1);
+
+    while (keys[slot] != 0 && keys[slot] != key) {
+        slot = (slot + 1) & (table_size - 1);
+    }
+    return slot;
+}
+
+static void
+pair_counts_grow(struct axe_pair_counts *pc)
+{
+    size_t table_size = pc->table_size * 2;
+    uint64_t *keys = qes_calloc(table_size, sizeof(*keys));
+    uint64_t *counts = qes_calloc(table_size, sizeof(*counts));
+    size_t slot = 0;
+    size_t iii = 0;
+
+    for (iii = 0; iii < pc->table_size; iii++) {
+        if (pc->keys[iii] != 0) {
+            slot = pair_counts_slot(keys, table_size, pc->keys[iii]);
+            keys[slot] = pc->keys[iii];
+            counts[slot] = pc->counts[iii];
+        }
+    }
+    qes_free(pc->keys);
+    qes_free(pc->counts);
+    pc->keys = keys;
+    pc->counts = counts;
+    pc->table_size = table_size;
+}
+
+void
+axe_pair_counts_add(struct axe_pair_counts *pc, size_t bcd1, size_t bcd2,
+                    uint64_t n)
+{
+    uint64_t key = 0;
+    size_t slot = 0;
+
+    if (pc == NULL || bcd1 >= pc->n1 || bcd2 >= pc->n2) {
+        return;
+    }
+    if (pc->dense != NULL) {
+        pc->dense[bcd1 * pc->n2 + bcd2] += n;
+        return;
+    }
+    key = (uint64_t)bcd1 * pc->n2 + bcd2 + 1;
+    slot = pair_counts_slot(pc->keys, pc->table_size, key);
+    if (pc->keys[slot] == 0) {
+        /* Keep the table at most half full */
+        if (2 * (pc->n_keys + 1) > pc->table_size) {
+            pair_counts_grow(pc);
+            slot = pair_counts_slot(pc->keys, pc->table_size, key);
+        }
+        pc->keys[slot] = key;
+        pc->n_keys++;
+    }
+    pc->counts[slot] += n;
+}
+
+uint64_t
+axe_pair_counts_get(const struct axe_pair_counts *pc, size_t bcd1,
+                    size_t bcd2)
+{
+    size_t slot = 0;
+
+    if (pc == NULL || bcd1 >= pc->n1 || bcd2 >= pc->n2) {
+        return 0;
+    }
+    if (pc->dense != NULL) {
+        return pc->dense[bcd1 * pc->n2 + bcd2];
+    }
+    slot = pair_counts_slot(pc->keys, pc->table_size,
+                            (uint64_t)bcd1 * pc->n2 + bcd2 + 1);
+    return pc->counts[slot];
+}
+
+/* Adds src's counts to dst, and zeroes them. The pairs src has seen stay in
+ * its table, as they're likely to be seen again. */
+void
+axe_pair_counts_merge(struct axe_pair_counts *dst,
+                      struct axe_pair_counts *src)
+{
+    size_t iii = 0;
+
+    if (dst == NULL || src == NULL || dst->n1 != src->n1 ||
+            dst->n2 != src->n2) {
+        return;
+    }
+    if (src->dense != NULL) {
+        for (iii = 0; iii < src->n1 * src->n2; iii++) {
+            if (src->dense[iii] > 0) {
+                axe_pair_counts_add(dst, iii / src->n2, iii % src->n2,
+                                    src->dense[iii]);
+                src->dense[iii] = 0;
+            }
+        }
+        return;
+    }
+    for (iii = 0; iii < src->table_size; iii++) {
+        if (src->keys[iii] != 0 && src->counts[iii] > 0) {
+            axe_pair_counts_add(dst, (src->keys[iii] - 1) / src->n2,
+                                (src->keys[iii] - 1) % src->n2,
+                                src->counts[iii]);
+            src->counts[iii] = 0;
+        }
+    }
+}
+
+struct axe_trie *
+axe_trie_create(void)
+{
+    struct axe_trie *trie = NULL;
+    AlphaMap *map = alpha_map_new();
+    int ret = 0;
+
+    /* Make trie AlphaMap */
+    if (map == NULL) {
+        return NULL;
+    }
+#define _AM_ADD(chr)                                                    \
+    ret = alpha_map_add_range(map, chr, chr);                               \
+    if (ret != 0) {                                                         \
+        fprintf(stderr, "[trie_create] Failed to add char %c to alphamap\n",\
+                chr);                                                       \
+        alpha_map_free(map);                                                \
+        return NULL;                                                        \
+    }
+    _AM_ADD('A')
+    _AM_ADD('C')
+    _AM_ADD('G')
+    _AM_ADD('T')
+    _AM_ADD('N')
+#undef _AM_ADD
+    trie = qes_calloc(1, sizeof(*trie));
+    trie->trie = trie_new(map);
+    if (trie->trie == NULL) {
+        qes_free(trie);
+        alpha_map_free(map);
+        return NULL;
+    }
+    alpha_map_free(map);
+    return trie;
+}
+
+void
+axe_trie_destroy_(struct axe_trie *trie)
+{
+    if (trie != NULL) {
+        /* trie_free doesn't check for null, so we better */
+        if (trie->trie != NULL) {
+            trie_free(trie->trie);
+        }
+        qes_free(trie);
+    }
+}
+
+inline int
+axe_trie_get(struct axe_trie *trie, const char *str, intptr_t *data)
+{
+    if (!axe_trie_ok(trie) || str == NULL) return -1;
+    return trie_retrieve(trie->trie, str, data);
+}
+
+inline int
+axe_trie_delete(struct axe_trie *trie, const char *str)
+{
+    if (!axe_trie_ok(trie) || str == NULL) return -1;
+    if (trie_delete(trie->trie, str)) {
+        trie->n_keys--;
+        return 1;
+    }
+    return 0;
+}
+
+inline int
+axe_trie_add(struct axe_trie *trie, const char *str, intptr_t data)
+{
+    if (!axe_trie_ok(trie) || str == NULL) return -1;
+    if (trie_store_if_absent(trie->trie, str, data)) {
+        trie->n_keys++;
+        return 0;
+    }
+    return 1;
+}
+
+/* Whitelists */
+
+/* 2-bit codes of bases, plus one, or 0 for anything but ACGT */
+static const uint8_t whitelist_codes[256] = {
+    ['A'] = 1, ['C'] = 2, ['G'] = 3, ['T'] = 4,
+};
+
+/* Packs the first ``len`` bases of ``seq`` with the first base highest, so
+ * packed barcodes sort as their sequences do. Returns 1 if any base isn't
+ * ACGT. */
+static inline int
+whitelist_pack(const char *seq, size_t len, uint64_t *packed)
+{
+    uint64_t bits = 0;
+    unsigned int code = 0;
+    unsigned int bad = 0;
+    size_t iii = 0;
+
+    for (iii = 0; iii < len; iii++) {
+        code = whitelist_codes[(unsigned char)seq[iii]];
+        bad |= code == 0;
+        bits = (bits << 2) | ((code - 1) & 3);
+    }
+    *packed = bits;
+    return bad;
+}
+
+/* Mismatches between two packed sequences, counting bases differing in
+ * either bit */
+static inline size_t
+packed_mismatches(uint64_t a, uint64_t b)
+{
+    uint64_t diff = a ^ b;
+
+    return __builtin_popcountll((diff | (diff >> 1)) &
+                                0x5555555555555555ULL);
+}
+
+/* Pack kernels. Up to 8 bases are loaded into a word at once, padded with
+ * A. Bytes are checked for ACGT branch free: a byte is zero after XOR with
+ * its base's letter, and zero bytes are found without carries between
+ * bytes. ASCII A, C, G and T have ((c >> 1) ^ (c >> 2)) & 3 = 0, 1, 2 and 3,
+ * and the codes are then gathered from the bytes by shifts. */
+#define AXE_PACK_KERNEL_LENS(X) X(6) X(8) X(10) X(12) X(16)
+
+#define BYTES_OF(c) (UINT64_C(0x0101010101010101) * (c))
+
+/* 0x80 in each byte of v that's zero, 0 in the others */
+static inline uint64_t
+zero_bytes(uint64_t v)
+{
+    const uint64_t low7 = BYTES_OF(0x7F);
+
+    return ~(((v & low7) + low7) | v | low7);
+}
+
+/* Packs ``n``, at most 8, bases. Inlined with n constant, the load is of
+ * fixed width and all shifts are constant. */
+static inline int
+pack_word(const char *seq, size_t n, uint64_t *packed)
+{
+    uint64_t word = 0;
+    uint64_t acgt = 0;
+    uint64_t codes = 0;
+    uint32_t word32 = 0;
+    uint16_t word16 = 0;
+    size_t at = 0;
+
+#if !defined(__BYTE_ORDER__) || __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+    return whitelist_pack(seq, n, packed);
+#endif
+    /* Loaded in registers, as a short copy into the padded word would stall
+     * loading it whole */
+    if (n == 8) {
+        memcpy(&word, seq, 8);
+    } else {
+        if (n >= 4) {
+            memcpy(&word32, seq, 4);
+            word = word32;
+            at = 4;
+        }
+        if (n - at >= 2) {
+            memcpy(&word16, seq + at, 2);
+            word |= (uint64_t)word16 << (8 * at);
+            at += 2;
+        }
+        if (n > at) {
+            word |= (uint64_t)(unsigned char)seq[at] << (8 * at);
+        }
+        word |= BYTES_OF('A') << (8 * n);
+    }
+    acgt = zero_bytes(word ^ BYTES_OF('A')) | zero_bytes(word ^ BYTES_OF('C')) |
+           zero_bytes(word ^ BYTES_OF('G')) | zero_bytes(word ^ BYTES_OF('T'));
+    /* First base in the top byte, so its code ends up highest */
+    codes = __builtin_bswap64(((word >> 1) ^ (word >> 2)) & BYTES_OF(3));
+    codes = (codes | (codes >> 6)) & UINT64_C(0x000F000F000F000F);
+    codes = (codes | (codes >> 12)) & UINT64_C(0x000000FF000000FF);
+    codes = (codes | (codes >> 24)) & UINT64_C(0xFFFF);
+    *packed = codes >> (2 * (8 - n));
+    return acgt != BYTES_OF(0x80);
+}
+
+/* Unrolled, so with len constant each word's width is too. Tails of a few
+ * bases are cheaper to look up a base at a time than as a word. */
+#define PACK_NEXT_WORD(at)                                                  \
+    if (len > at) {                                                         \
+        n = len - at < 8 ? len - at : 8;                                    \
+        if (at > 0 && n <= 4) {                                             \
+            bad |= whitelist_pack(seq + at, n, &word);                      \
+        } else {                                                            \
+            bad |= pack_word(seq + at, n, &word);                           \
+        }                                                                   \
+        bits = (bits << (2 * n)) | word;                                    \
+    }
+
+static inline int
+pack_fixed(const char *seq, size_t len, uint64_t *packed)
+{
+    uint64_t bits = 0;
+    uint64_t word = 0;
+    size_t n = 0;
+    int bad = 0;
+
+    PACK_NEXT_WORD(0)
+    PACK_NEXT_WORD(8)
+    PACK_NEXT_WORD(16)
+    PACK_NEXT_WORD(24)
+    *packed = bits;
+    return bad;
+}
+#undef PACK_NEXT_WORD
+
+#define PACK_KERNEL(LEN)                                                    \
+static int                                                                  \
+pack_kernel_##LEN(const char *seq, size_t len, uint64_t *packed)           \
+{                                                                           \
+    (void)len;                                                              \
+    return pack_fixed(seq, LEN, packed);                                    \
+}
+AXE_PACK_KERNEL_LENS(PACK_KERNEL)
+#undef PACK_KERNEL
+
+axe_pack_fn
+axe_pack_kernel(size_t len)
+{
+    if (len == 0 || len > 32) {
+        return NULL;
+    }
+    switch (len) {
+#define PACK_KERNEL_CASE(LEN) case LEN: return pack_kernel_##LEN;
+    AXE_PACK_KERNEL_LENS(PACK_KERNEL_CASE)
+#undef PACK_KERNEL_CASE
+    default:
+        return whitelist_pack;
+    }
+}
+
+struct whitelist_entry {
+    uint64_t key;
+    uint32_t id;
+};
+
+static int
+whitelist_entry_cmp(const void *a, const void *b)
+{
+    const struct whitelist_entry *ea = a;
+    const struct whitelist_entry *eb = b;
+
+    if (ea->key != eb->key) {
+        return ea->key < eb->key ? -1 : 1;
+    }
+    return ea->id < eb->id ? -1 : ea->id > eb->id;
+}
+
+struct axe_whitelist *
+axe_whitelist_create(const char *const *seqs, size_t n, size_t mismatches)
+{
+    struct axe_whitelist *wl = NULL;
+    struct whitelist_entry *entries = NULL;
+    size_t len = 0;
+    size_t block_len = 0;
+    size_t start = 0;
+    size_t bbb = 0;
+    size_t iii = 0;
+
+    if (seqs == NULL || n == 0 || n > UINT32_MAX) {
+        return NULL;
+    }
+    len = strlen(seqs[0]);
+    if (len == 0 || len > AXE_WHITELIST_MAX_LEN || mismatches >= len) {
+        return NULL;
+    }
+    wl = qes_calloc(1, sizeof(*wl));
+    wl->n = n;
+    wl->len = len;
+    wl->mismatches = mismatches;
+    wl->n_blocks = mismatches + 1;
+    wl->pack = axe_pack_kernel(len);
+    wl->packed = qes_malloc_tagged(n * sizeof(*wl->packed), AXE_MEM_TRIE);
+    entries = qes_malloc(n * sizeof(*entries));
+    for (iii = 0; iii < n; iii++) {
+        if (strlen(seqs[iii]) != len ||
+                whitelist_pack(seqs[iii], len, &wl->packed[iii]) != 0) {
+            goto error;
+        }
+        entries[iii].key = wl->packed[iii];
+        entries[iii].id = iii;
+    }
+    /* Barcodes must be distinct */
+    qsort(entries, n, sizeof(*entries), whitelist_entry_cmp);
+    for (iii = 1; iii < n; iii++) {
+        if (entries[iii].key == entries[iii - 1].key) {
+            goto error;
+        }
+    }
+    /* Blocks are as even in length as they can be */
+    for (bbb = 0; bbb < wl->n_blocks; bbb++) {
+        block_len = len / wl->n_blocks + (bbb < len % wl->n_blocks);
+        start += block_len;
+        wl->block_shift[bbb] = 2 * (len - start);
+        wl->block_mask[bbb] = block_len == 32 ? UINT64_MAX :
+                              (UINT64_C(1) << (2 * block_len)) - 1;
+        for (iii = 0; iii < n; iii++) {
+            entries[iii].key = (wl->packed[iii] >> wl->block_shift[bbb]) &
+                               wl->block_mask[bbb];
+            entries[iii].id = iii;
+        }
+        qsort(entries, n, sizeof(*entries), whitelist_entry_cmp);
+        wl->keys[bbb] = qes_malloc_tagged(n * sizeof(**wl->keys),
+                                          AXE_MEM_TRIE);
+        wl->ids[bbb] = qes_malloc_tagged(n * sizeof(**wl->ids),
+                                         AXE_MEM_TRIE);
+        for (iii = 0; iii < n; iii++) {
+            wl->keys[bbb][iii] = entries[iii].key;
+            wl->ids[bbb][iii] = entries[iii].id;
+        }
+    }
+    qes_free(entries);
+    return wl;
+
+error:
+    qes_free(entries);
+    axe_whitelist_destroy(wl);
+    return NULL;
+}
+
+void
+axe_whitelist_destroy_(struct axe_whitelist *wl)
+{
+    size_t bbb = 0;
+
+    if (wl == NULL) {
+        return;
+    }
+    qes_free_tagged(wl->packed, wl->n * sizeof(*wl->packed), AXE_MEM_TRIE);
+    for (bbb = 0; bbb < wl->n_blocks; bbb++) {
+        qes_free_tagged(wl->keys[bbb], wl->n * sizeof(**wl->keys),
+                        AXE_MEM_TRIE);
+        qes_free_tagged(wl->ids[bbb], wl->n * sizeof(**wl->ids),
+                        AXE_MEM_TRIE);
+    }
+    qes_free(wl);
+}
+
+/* Index of the first of n sorted keys not less than key */
+static inline size_t
+whitelist_lower_bound(const uint64_t *keys, size_t n, uint64_t key)
+{
+    size_t lo = 0;
+    size_t half = 0;
+
+    while (n > 0) {
+        half = n / 2;
+        if (keys[lo + half] < key) {
+            lo += half + 1;
+            n -= half + 1;
+        } else {
+            n = half;
+        }
+    }
+    return lo;
+}
+
+inline int
+axe_whitelist_match(const struct axe_whitelist *wl, const char *seq,
+                    size_t len, intptr_t *value)
+{
+    uint64_t packed = 0;
+    uint64_t key = 0;
+    intptr_t found = -1;
+    size_t bbb = 0;
+    size_t iii = 0;
+    uint32_t id = 0;
+
+    if (wl == NULL || seq == NULL || value == NULL) {
+        return -1;
+    }
+    *value = -1;
+    if (len < wl->len || wl->pack(seq, wl->len, &packed) != 0) {
+        return 1;
+    }
+    /* A barcode within reach matches some block exactly, though it may
+     * match several */
+    for (bbb = 0; bbb < wl->n_blocks; bbb++) {
+        key = (packed >> wl->block_shift[bbb]) & wl->block_mask[bbb];
+        iii = whitelist_lower_bound(wl->keys[bbb], wl->n, key);
+        for (; iii < wl->n && wl->keys[bbb][iii] == key; iii++) {
+            id = wl->ids[bbb][iii];
+            if ((intptr_t)id == found ||
+                    packed_mismatches(packed, wl->packed[id]) >
+                    wl->mismatches) {
+                continue;
+            }
+            if (found >= 0) {
+                /* Ambiguous */
+                return 1;
+            }
+            found = id;
+        }
+    }
+    if (found < 0) {
+        return 1;
+    }
+    *value = found;
+    return 0;
+}
+
+/* Seed indices */
+
+/* Orders barcodes by sequence, through an array of pointers to them */
+static int
+seed_seq_cmp(const void *a, const void *b)
+{
+    return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+/* Slot of key in a seed index's table, or of the empty slot it'd go in */
+static inline size_t
+seed_index_slot(const uint64_t *keys, size_t table_size, uint64_t key)
+{
+    size_t slot = (size_t)((key * 11400714819323198485ULL) >> 32) &
+                  (table_size - 1);
+
+    while (keys[slot] != 0 && keys[slot] != key) {
+        slot = (slot + 1) & (table_size - 1);
+    }
+    return slot;
+}
+
+/* Key of seed number ``seed``, of the read or barcode ``seq``, or 0 if the
+ * seed has bases other than ACGT */
+static inline uint64_t
+seed_index_key(const struct axe_seed_index *si, size_t seed, const char *seq)
+{
+    uint64_t packed = 0;
+
+    if (si->seed_packs[seed](seq + si->seed_starts[seed],
+                             si->seed_lens[seed], &packed) != 0) {
+        return 0;
+    }
+    return ((packed << 8) | seed) + 1;
+}
+
+struct axe_seed_index *
+axe_seed_index_create(const char *const *seqs, size_t n, size_t mismatches)
+{
+    struct axe_seed_index *si = NULL;
+    struct whitelist_entry *entries = NULL;
+    const char **sorted = NULL;
+    uint64_t packed = 0;
+    size_t n_entries = 0;
+    size_t n_keys = 0;
+    size_t slot = 0;
+    size_t start = 0;
+    size_t seed_len = 0;
+    size_t sss = 0;
+    size_t ggg = 0;
+    size_t iii = 0;
+
+    if (seqs == NULL || n == 0 || n > UINT32_MAX ||
+            mismatches >= AXE_SEED_MAX_SEEDS) {
+        return NULL;
+    }
+    si = qes_calloc(1, sizeof(*si));
+    si->n = n;
+    si->mismatches = mismatches;
+    si->n_seeds = mismatches + 1;
+    si->min_len = SIZE_MAX;
+    si->starts = qes_malloc_tagged(n * sizeof(*si->starts), AXE_MEM_TRIE);
+    si->lens = qes_malloc_tagged(n * sizeof(*si->lens), AXE_MEM_TRIE);
+    for (iii = 0; iii < n; iii++) {
+        si->starts[iii] = si->seqs_size;
+        si->lens[iii] = strlen(seqs[iii]);
+        si->seqs_size += si->lens[iii] + 1;
+        if (si->lens[iii] < si->min_len) {
+            si->min_len = si->lens[iii];
+        }
+        if (si->lens[iii] > si->max_len) {
+            si->max_len = si->lens[iii];
+        }
+        if (whitelist_pack(seqs[iii], si->lens[iii], &packed) != 0) {
+            goto error;
+        }
+    }
+    if (mismatches >= si->min_len) {
+        goto error;
+    }
+    /* Each length once, longest first, as reads are matched */
+    si->group_lens = qes_malloc_tagged(n * sizeof(*si->group_lens),
+                                       AXE_MEM_TRIE);
+    for (iii = 0; iii < n; iii++) {
+        for (ggg = 0; ggg < si->n_groups; ggg++) {
+            if (si->group_lens[ggg] <= si->lens[iii]) {
+                break;
+            }
+        }
+        if (ggg < si->n_groups && si->group_lens[ggg] == si->lens[iii]) {
+            continue;
+        }
+        memmove(si->group_lens + ggg + 1, si->group_lens + ggg,
+                (si->n_groups - ggg) * sizeof(*si->group_lens));
+        si->group_lens[ggg] = si->lens[iii];
+        si->n_groups++;
+    }
+    si->seqs = qes_malloc_tagged(si->seqs_size, AXE_MEM_TRIE);
+    for (iii = 0; iii < n; iii++) {
+        memcpy(si->seqs + si->starts[iii], seqs[iii], si->lens[iii] + 1);
+    }
+    /* Barcodes must be distinct */
+    sorted = qes_malloc(n * sizeof(*sorted));
+    memcpy(sorted, seqs, n * sizeof(*sorted));
+    qsort(sorted, n, sizeof(*sorted), seed_seq_cmp);
+    for (iii = 1; iii < n; iii++) {
+        if (strcmp(sorted[iii], sorted[iii - 1]) == 0) {
+            goto error;
+        }
+    }
+    /* Seeds split the bases all barcodes have as evenly as they can */
+    for (sss = 0; sss < si->n_seeds; sss++) {
+        seed_len = si->min_len / si->n_seeds +
+                   (sss < si->min_len % si->n_seeds);
+        si->seed_starts[sss] = start;
+        si->seed_lens[sss] = seed_len < AXE_SEED_MAX_LEN ? seed_len :
+                                                           AXE_SEED_MAX_LEN;
+        si->seed_packs[sss] = axe_pack_kernel(si->seed_lens[sss]);
+        start += seed_len;
+    }
+    /* Group the barcodes by the keys of their seeds */
+    n_entries = n * si->n_seeds;
+    entries = qes_malloc(n_entries * sizeof(*entries));
+    for (iii = 0; iii < n; iii++) {
+        for (sss = 0; sss < si->n_seeds; sss++) {
+            entries[iii * si->n_seeds + sss].key =
+                    seed_index_key(si, sss, seqs[iii]);
+            entries[iii * si->n_seeds + sss].id = iii;
+        }
+    }
+    qsort(entries, n_entries, sizeof(*entries), whitelist_entry_cmp);
+    si->ids = qes_malloc_tagged(n_entries * sizeof(*si->ids), AXE_MEM_TRIE);
+    for (iii = 0; iii < n_entries; iii++) {
+        si->ids[iii] = entries[iii].id;
+        n_keys += iii == 0 || entries[iii].key != entries[iii - 1].key;
+    }
+    /* Keep the table at most half full */
+    si->table_size = 16;
+    while (si->table_size < 2 * n_keys) {
+        si->table_size *= 2;
+    }
+    si->keys = qes_calloc_tagged(si->table_size, sizeof(*si->keys),
+                                 AXE_MEM_TRIE);
+    si->firsts = qes_calloc_tagged(si->table_size, sizeof(*si->firsts),
+                                   AXE_MEM_TRIE);
+    si->counts = qes_calloc_tagged(si->table_size, sizeof(*si->counts),
+                                   AXE_MEM_TRIE);
+    for (iii = 0; iii < n_entries; iii++) {
+        slot = seed_index_slot(si->keys, si->table_size, entries[iii].key);
+        if (si->keys[slot] == 0) {
+            si->keys[slot] = entries[iii].key;
+            si->firsts[slot] = iii;
+        }
+        si->counts[slot]++;
+    }
+    qes_free(entries);
+    qes_free(sorted);
+    return si;
+
+error:
+    qes_free(entries);
+    qes_free(sorted);
+    axe_seed_index_destroy(si);
+    return NULL;
+}
+
+void
+axe_seed_index_destroy_(struct axe_seed_index *si)
+{
+    if (si == NULL) {
+        return;
+    }
+    qes_free_tagged(si->seqs, si->seqs_size, AXE_MEM_TRIE);
+    qes_free_tagged(si->starts, si->n * sizeof(*si->starts), AXE_MEM_TRIE);
+    qes_free_tagged(si->lens, si->n * sizeof(*si->lens), AXE_MEM_TRIE);
+    qes_free_tagged(si->group_lens, si->n * sizeof(*si->group_lens),
+                    AXE_MEM_TRIE);
+    qes_free_tagged(si->ids, si->n * si->n_seeds * sizeof(*si->ids),
+                    AXE_MEM_TRIE);
+    qes_free_tagged(si->keys, si->table_size * sizeof(*si->keys),
+                    AXE_MEM_TRIE);
+    qes_free_tagged(si->firsts, si->table_size * sizeof(*si->firsts),
+                    AXE_MEM_TRIE);
+    qes_free_tagged(si->counts, si->table_size * sizeof(*si->counts),
+                    AXE_MEM_TRIE);
+    qes_free(si);
+}
+
+int
+axe_seed_index_match(const struct axe_seed_index *si, const char *seq,
+                     size_t len, intptr_t *value)
+{
+    size_t slots[AXE_SEED_MAX_SEEDS];
+    intptr_t best = -1;
+    size_t best_mismatches = 0;
+    bool ambiguous = false;
+    size_t acgt_len = 0;
+    size_t mismatches = 0;
+    size_t len_here = 0;
+    size_t end = 0;
+    uint32_t id = 0;
+    size_t sss = 0;
+    size_t ggg = 0;
+    size_t iii = 0;
+
+    if (si == NULL || seq == NULL || value == NULL) {
+        return -1;
+    }
+    *value = -1;
+    /* As with the tries, barcodes never match bases other than ACGT */
+    len = len < si->max_len ? len : si->max_len;
+    while (acgt_len < len && whitelist_codes[(unsigned char)seq[acgt_len]]) {
+        acgt_len++;
+    }
+    if (acgt_len < si->min_len) {
+        return 1;
+    }
+    for (sss = 0; sss < si->n_seeds; sss++) {
+        slots[sss] = seed_index_slot(si->keys, si->table_size,
+                                     seed_index_key(si, sss, seq));
+    }
+    /* As the tries and brute force do, the longest length with a barcode
+     * within mismatches wins, taking the nearest barcode of that length.
+     * Reads equally near two barcodes of a length fall through to shorter
+     * ones. */
+    for (ggg = 0; ggg < si->n_groups; ggg++) {
+        len_here = si->group_lens[ggg];
+        if (len_here > acgt_len) {
+            continue;
+        }
+        best = -1;
+        ambiguous = false;
+        for (sss = 0; sss < si->n_seeds; sss++) {
+            end = si->firsts[slots[sss]] + si->counts[slots[sss]];
+            for (iii = si->firsts[slots[sss]]; iii < end; iii++) {
+                id = si->ids[iii];
+                if ((intptr_t)id == best || si->lens[id] != len_here) {
+                    continue;
+                }
+                mismatches = qes_match_hamming_max(seq,
+                        si->seqs + si->starts[id], len_here, si->mismatches);
+                if (mismatches > si->mismatches) {
+                    continue;
+                }
+                if (best < 0 || mismatches < best_mismatches) {
+                    best = id;
+                    best_mismatches = mismatches;
+                    ambiguous = false;
+                } else if (mismatches == best_mismatches) {
+                    ambiguous = true;
+                }
+            }
+        }
+        if (best >= 0 && !ambiguous) {
+            *value = best;
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Edit indices */
+
+struct axe_edit_index *
+axe_edit_index_create(const char *const *seqs, size_t n, size_t mismatches)
+{
+    struct axe_edit_index *ei = NULL;
+    size_t old_size = 0;
+    size_t node = 0;
+    size_t len = 0;
+    size_t iii = 0;
+    size_t jjj = 0;
+    unsigned int code = 0;
+
+    if (seqs == NULL || n == 0 || n > INT32_MAX) {
+        return NULL;
+    }
+    ei = qes_calloc(1, sizeof(*ei));
+    ei->n = n;
+    ei->mismatches = mismatches;
+    ei->min_len = SIZE_MAX;
+    ei->nodes_alloced = 64;
+    ei->children = qes_calloc_tagged(ei->nodes_alloced,
+                                     sizeof(*ei->children), AXE_MEM_TRIE);
+    ei->ids = qes_malloc_tagged(ei->nodes_alloced * sizeof(*ei->ids),
+                                AXE_MEM_TRIE);
+    ei->ids[0] = -1;
+    ei->n_nodes = 1;
+    for (iii = 0; iii < n; iii++) {
+        len = strlen(seqs[iii]);
+        if (len + mismatches > AXE_EDIT_MAX_LEN) {
+            goto error;
+        }
+        ei->min_len = len < ei->min_len ? len : ei->min_len;
+        ei->max_len = len > ei->max_len ? len : ei->max_len;
+        node = 0;
+        for (jjj = 0; jjj < len; jjj++) {
+            code = whitelist_codes[(unsigned char)seqs[iii][jjj]];
+            if (code == 0) {
+                goto error;
+            }
+            if (ei->children[node][code - 1] == 0) {
+                if (ei->n_nodes == ei->nodes_alloced) {
+                    old_size = ei->nodes_alloced;
+                    ei->nodes_alloced *= 2;
+                    ei->children = qes_realloc_tagged(
+                            ei->children, old_size * sizeof(*ei->children),
+                            ei->nodes_alloced * sizeof(*ei->children),
+                            AXE_MEM_TRIE);
+                    memset(ei->children + old_size, 0,
+                           old_size * sizeof(*ei->children));
+                    ei->ids = qes_realloc_tagged(
+                            ei->ids, old_size * sizeof(*ei->ids),
+                            ei->nodes_alloced * sizeof(*ei->ids),
+                            AXE_MEM_TRIE);
+                }
+                ei->ids[ei->n_nodes] = -1;
+                ei->children[node][code - 1] = ei->n_nodes++;
+            }
+            node = ei->children[node][code - 1];
+        }
+        /* Barcodes must be distinct */
+        if (ei->ids[node] >= 0) {
+            goto error;
+        }
+        ei->ids[node] = iii;
+    }
+    if (mismatches >= ei->min_len) {
+        goto error;
+    }
+    return ei;
+
+error:
+    axe_edit_index_destroy(ei);
+    return NULL;
+}
+
+void
+axe_edit_index_destroy_(struct axe_edit_index *ei)
+{
+    if (ei == NULL) {
+        return;
+    }
+    qes_free_tagged(ei->children, ei->nodes_alloced * sizeof(*ei->children),
+                    AXE_MEM_TRIE);
+    qes_free_tagged(ei->ids, ei->nodes_alloced * sizeof(*ei->ids),
+                    AXE_MEM_TRIE);
+    qes_free(ei);
+}
+
+/* A trie node to visit, and the DP column for its depth: bit i of pos
+ * (neg) is set if the edit distance of the read's first i + 1 bases to the
+ * node's prefix is one more (less) than that of its first i bases. */
+struct edit_state {
+    uint32_t node;
+    uint32_t depth;
+    uint64_t pos;
+    uint64_t neg;
+};
+
+/* Edits between a node's prefix and the read's first ``bases`` bases */
+static inline size_t
+edit_distance_at(const struct edit_state *state, size_t bases)
+{
+    const uint64_t below = bases >= 64 ? UINT64_MAX :
+                                         (UINT64_C(1) << bases) - 1;
+
+    return state->depth + __builtin_popcountll(state->pos & below) -
+           __builtin_popcountll(state->neg & below);
+}
+
+int
+axe_edit_index_match(const struct axe_edit_index *ei, const char *seq,
+                     size_t len, intptr_t *value, size_t *edits,
+                     size_t *consumed)
+{
+    /* Depth first, each node pushes at most four children */
+    struct edit_state stack[4 * AXE_EDIT_MAX_LEN + 4];
+    struct edit_state state;
+    struct edit_state *child = NULL;
+    uint64_t mask = 0;
+    uint64_t peq[4] = {0, 0, 0, 0};
+    uint64_t eq = 0;
+    uint64_t xv = 0;
+    uint64_t xh = 0;
+    uint64_t ph = 0;
+    uint64_t mh = 0;
+    /* The nearest barcode at each depth, and if another is as near */
+    intptr_t depth_ids[AXE_EDIT_MAX_LEN + 1];
+    size_t depth_edits[AXE_EDIT_MAX_LEN + 1];
+    size_t depth_consumed[AXE_EDIT_MAX_LEN + 1];
+    bool depth_ambiguous[AXE_EDIT_MAX_LEN + 1];
+    size_t other = SIZE_MAX;
+    size_t n_stack = 0;
+    size_t depth = 0;
+    size_t lo = 0;
+    size_t hi = 0;
+    size_t dist = 0;
+    size_t min_dist = 0;
+    size_t min_bases = 0;
+    size_t iii = 0;
+    unsigned int code = 0;
+
+    if (ei == NULL || seq == NULL || value == NULL || edits == NULL ||
+            consumed == NULL) {
+        return -1;
+    }
+    *value = -1;
+    len = len < ei->max_len + ei->mismatches ? len :
+                                               ei->max_len + ei->mismatches;
+    if (len + ei->mismatches < ei->min_len) {
+        return 1;
+    }
+    /* Where each base is in the read. Others never match, and as in the
+     * other engines, a barcode doesn't if one is in the bases it'd take. */
+    for (iii = 0; iii < len; iii++) {
+        code = whitelist_codes[(unsigned char)seq[iii]];
+        if (code != 0) {
+            peq[code - 1] |= UINT64_C(1) << iii;
+        } else if (other == SIZE_MAX) {
+            other = iii;
+        }
+    }
+    for (depth = ei->min_len; depth <= ei->max_len; depth++) {
+        depth_ids[depth] = -1;
+        depth_ambiguous[depth] = false;
+    }
+    mask = len == 64 ? UINT64_MAX : (UINT64_C(1) << len) - 1;
+    stack[0].node = 0;
+    stack[0].depth = 0;
+    stack[0].pos = mask;
+    stack[0].neg = 0;
+    n_stack = 1;
+    while (n_stack > 0) {
+        state = stack[--n_stack];
+        /* Only read lengths within mismatches of the depth can be near
+         * enough */
+        lo = state.depth > ei->mismatches ? state.depth - ei->mismatches : 0;
+        hi = state.depth + ei->mismatches < len ?
+             state.depth + ei->mismatches : len;
+        min_dist = SIZE_MAX;
+        for (iii = lo; iii <= hi; iii++) {
+            dist = edit_distance_at(&state, iii);
+            /* Ties go to the length nearest the barcode's, then the
+             * shorter */
+            if (dist < min_dist ||
+                    (dist == min_dist &&
+                     (iii > state.depth ? iii - state.depth :
+                                           state.depth - iii) <
+                     (min_bases > state.depth ? min_bases - state.depth :
+                                                 state.depth - min_bases))) {
+                min_dist = dist;
+                min_bases = iii;
+            }
+        }
+        if (lo > hi || min_dist > ei->mismatches) {
+            continue;
+        }
+        if (ei->ids[state.node] >= 0 && state.depth <= other) {
+            if (depth_ids[state.depth] >= 0 &&
+                    min_dist == depth_edits[state.depth]) {
+                depth_ambiguous[state.depth] = true;
+            } else if (depth_ids[state.depth] < 0 ||
+                       min_dist < depth_edits[state.depth]) {
+                depth_ids[state.depth] = ei->ids[state.node];
+                depth_edits[state.depth] = min_dist;
+                depth_consumed[state.depth] = min_bases;
+                depth_ambiguous[state.depth] = false;
+            }
+        }
+        /* Advance the column by each child's base (Myers 1999) */
+        for (code = 0; code < 4; code++) {
+            if (ei->children[state.node][code] == 0) {
+                continue;
+            }
+            eq = peq[code];
+            xv = eq | state.neg;
+            xh = (((eq & state.pos) + state.pos) ^ state.pos) | eq;
+            ph = state.neg | ~(xh | state.pos);
+            mh = state.pos & xh;
+            /* The empty read is one edit further from each level */
+            ph = (ph << 1) | 1;
+            mh <<= 1;
+            child = &stack[n_stack++];
+            child->node = ei->children[state.node][code];
+            child->depth = state.depth + 1;
+            child->pos = (mh | ~(xv | ph)) & mask;
+            child->neg = ph & xv & mask;
+        }
+    }
+    /* As the other engines do, the longest barcode length with a barcode
+     * within mismatches wins, unless two are equally near */
+    for (depth = ei->max_len + 1; depth-- > ei->min_len;) {
+        if (depth_ids[depth] >= 0 && !depth_ambiguous[depth]) {
+            *value = depth_ids[depth];
+            *edits = depth_edits[depth];
+            *consumed = depth_consumed[depth];
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Brute force indices */
+
+struct axe_brute_index *
+axe_brute_index_create(const char *const *seqs, size_t n, size_t mismatches,
+                       bool permissive)
+{
+    struct axe_brute_index *bi = NULL;
+    uint64_t packed[AXE_BRUTE_MAX_BARCODES];
+    size_t lens[AXE_BRUTE_MAX_BARCODES];
+    /* Mutants of barcodes this near clash */
+    const size_t clash = permissive ? mismatches : 2 * mismatches;
+    size_t len = 0;
+    size_t iii = 0;
+    size_t jjj = 0;
+
+    if (seqs == NULL || n == 0 || n > AXE_BRUTE_MAX_BARCODES) {
+        return NULL;
+    }
+    for (iii = 0; iii < n; iii++) {
+        lens[iii] = strlen(seqs[iii]);
+        if (lens[iii] == 0 || lens[iii] > AXE_BRUTE_MAX_LEN ||
+                whitelist_pack(seqs[iii], lens[iii], &packed[iii]) != 0) {
+            return NULL;
+        }
+        for (jjj = 0; jjj < iii; jjj++) {
+            if (lens[jjj] == lens[iii] &&
+                    packed_mismatches(packed[iii], packed[jjj]) <= clash) {
+                return NULL;
+            }
+        }
+    }
+    bi = qes_calloc(1, sizeof(*bi));
+    bi->n = n;
+    bi->mismatches = mismatches;
+    bi->packed = qes_malloc_tagged(n * sizeof(*bi->packed), AXE_MEM_TRIE);
+    bi->ids = qes_malloc_tagged(n * sizeof(*bi->ids), AXE_MEM_TRIE);
+    /* Longest first, as the tries prefer them */
+    jjj = 0;
+    for (len = AXE_BRUTE_MAX_LEN; len > 0; len--) {
+        for (iii = 0; iii < n; iii++) {
+            if (lens[iii] != len) {
+                continue;
+            }
+            if (bi->n_groups == 0 || bi->group_lens[bi->n_groups - 1] != len) {
+                bi->group_lens[bi->n_groups++] = len;
+            }
+            bi->packed[jjj] = packed[iii];
+            bi->ids[jjj] = iii;
+            bi->group_ends[bi->n_groups - 1] = ++jjj;
+        }
+    }
+    bi->max_len = bi->group_lens[0];
+    bi->pack = axe_pack_kernel(bi->max_len);
+    return bi;
+}
+
+void
+axe_brute_index_destroy_(struct axe_brute_index *bi)
+{
+    if (bi == NULL) {
+        return;
+    }
+    qes_free_tagged(bi->packed, bi->n * sizeof(*bi->packed), AXE_MEM_TRIE);
+    qes_free_tagged(bi->ids, bi->n * sizeof(*bi->ids), AXE_MEM_TRIE);
+    qes_free(bi);
+}
+
+int
+axe_brute_index_match(const struct axe_brute_index *bi, const char *seq,
+                      size_t len, intptr_t *value)
+{
+    uint64_t packed = 0;
+    uint64_t prefix = 0;
+    size_t acgt_len = 0;
+    size_t found = 0;
+    size_t n_found = 0;
+    size_t start = 0;
+    size_t ggg = 0;
+    size_t iii = 0;
+
+    if (bi == NULL || seq == NULL || value == NULL) {
+        return -1;
+    }
+    *value = -1;
+    if (bi->n_groups == 1) {
+        /* Barcodes of one length can't match reads with other than ACGT in
+         * their first max_len bases */
+        if (len < bi->max_len || bi->pack(seq, bi->max_len, &packed) != 0) {
+            return 1;
+        }
+        for (iii = 0; iii < bi->n; iii++) {
+            if (packed_mismatches(packed, bi->packed[iii]) <=
+                    bi->mismatches) {
+                found = iii;
+                n_found++;
+            }
+        }
+        if (n_found != 1) {
+            return 1;
+        }
+        *value = bi->ids[found];
+        return 0;
+    }
+    /* Tries hold only ACGT, so their walks stop at any other base */
+    len = len < bi->max_len ? len : bi->max_len;
+    while (acgt_len < len && whitelist_codes[(unsigned char)seq[acgt_len]]) {
+        acgt_len++;
+    }
+    whitelist_pack(seq, acgt_len, &packed);
+    for (ggg = 0; ggg < bi->n_groups; start = bi->group_ends[ggg++]) {
+        if (bi->group_lens[ggg] > acgt_len) {
+            continue;
+        }
+        prefix = packed >> (2 * (acgt_len - bi->group_lens[ggg]));
+        n_found = 0;
+        for (iii = start; iii < bi->group_ends[ggg]; iii++) {
+            if (packed_mismatches(prefix, bi->packed[iii]) <=
+                    bi->mismatches) {
+                found = iii;
+                n_found++;
+            }
+        }
+        if (n_found == 1) {
+            *value = bi->ids[found];
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Matches the start of a read, of ``len`` bases and NUL terminated, against
+ * a trie, walking ``iter`` and keeping the longest terminal state in
+ * ``last``, which mustn't be shared with other threads. Returns 0 and sets
+ * *value on a match, 1 if there's none. */
+static inline int
+match_read_states(intptr_t *value, const struct axe_trie *trie,
+                  const char *seq, size_t len, TrieState *iter,
+                  TrieState *last)
+{
+    bool have_last = false;
+    size_t seq_pos = 0;
+
+    /* Set *value here, then we just don't update it on error */
+    *value = -1;
+    if (len < trie->min_len) {
+        return 1;
+    }
+    trie_state_rewind(iter);
+    /* A first base not in the trie matches nothing, rather than being
+     * skipped */
+    if (!trie_state_is_walkable(iter, seq[0])) {
+        return 1;
+    }
+    /* Consume seq until we can't */
+    do {
+        trie_state_walk(iter, seq[seq_pos]);
+        if (trie_state_is_terminal(iter)) {
+            trie_state_copy(last, iter);
+            have_last = true;
+        }
+    } while (trie_state_is_walkable(iter, seq[++seq_pos]));
+    /* If we get to a terminal state, then great! */
+    if (trie_state_is_terminal(iter)) {
+        trie_state_walk(iter, '\0');
+        *value = (intptr_t)trie_state_get_data(iter);
+        return 0;
+    } else if (have_last) {
+        trie_state_walk(last, '\0');
+        *value = (intptr_t)trie_state_get_data(last);
+        return 0;
+    }
+    return 1;
+}
+
+inline int
+axe_match_read(intptr_t *value, const struct axe_trie *trie,
+               const struct qes_seq *seq)
+{
+    TrieState *iter = NULL;
+    TrieState *last = NULL;
+    int ret = -1;
+
+    /* value is set to -1 on anything bad happening including failed lookup */
+    if (value == NULL || !axe_trie_ok(trie) || !qes_seq_ok(seq)) {
+        return -1;
+    }
+    iter = trie_root(trie->trie);
+    last = trie_root(trie->trie);
+    if (iter != NULL && last != NULL) {
+        ret = match_read_states(value, trie, seq->seq.str, seq->seq.len,
+                                iter, last);
+    }
+    if (iter != NULL) {
+        trie_state_free(iter);
+    }
+    if (last != NULL) {
+        trie_state_free(last);
+    }
+    return ret;
+}
+
+/* Engines
+ *
+ * Each engine wraps one of the indices above in the operations of a
+ * ``struct axe_engine``, so the matcher and workers needn't know which they
+ * use.
+ */
+
+/* Adds each barcode and its mutants to a trie. A barcode already in the trie
+ * is an error, as is a mutant already in it unless permissive, when it's
+ * removed so neither barcode matches it. */
+static void *
+trie_engine_build(const char *const *seqs, size_t n,
+                  const struct axe_config *config)
+{
+    struct axe_trie *trie = axe_trie_create();
+    char **mutated = NULL;
+    size_t num_mutated = 0;
+    intptr_t tmp = 0;
+    size_t iii = 0;
+    size_t jjj = 0;
+    size_t mmm = 0;
+
+    if (trie == NULL) {
+        qes_log_message_fatal(config->logger,
+                              "load_tries -- axe_trie_create returned NULL\n");
+        return NULL;
+    }
+    for (iii = 0; iii < n; iii++) {
+        if (axe_trie_get(trie, seqs[iii], &tmp)) {
+            qes_log_format_fatal(config->logger,
+                                 "load_tries -- Duplicate barcode %s\n",
+                                 seqs[iii]);
+            goto error;
+        }
+        if (axe_trie_add(trie, seqs[iii], iii) != 0) {
+            qes_log_format_fatal(config->logger,
+                                 "load_tries -- Could not load barcode %s "
+                                 "into trie %zu\n", seqs[iii], iii);
+            goto error;
+        }
+        for (jjj = 1; jjj <= config->mismatches; jjj++) {
+            mutated = hamming_mutate_dna(&num_mutated, seqs[iii],
+                                         strlen(seqs[iii]), jjj, 0);
+            if (mutated == NULL) {
+                goto error;
+            }
+            for (mmm = 0; mmm < num_mutated; mmm++) {
+                if (axe_trie_add(trie, mutated[mmm], iii) == 0) {
+                    qes_free(mutated[mmm]);
+                    continue;
+                }
+                if (!config->permissive) {
+                    qes_log_format_fatal(config->logger,
+                            "load_tries -- Barcode %s already in trie "
+                            "(%zumm) %s\n", mutated[mmm], jjj, seqs[iii]);
+                    goto error;
+                }
+                if (config->verbosity >= 0) {
+                    qes_log_format_warning(config->logger,
+                            "load_tries -- Will only match %s to %zumm\n",
+                            seqs[iii], jjj - 1);
+                }
+                axe_trie_delete(trie, mutated[mmm]);
+                qes_free(mutated[mmm]);
+            }
+            qes_free(mutated);
+        }
+    }
+    return trie;
+
+error:
+    if (mutated != NULL) {
+        for (; mmm < num_mutated; mmm++) {
+            qes_free(mutated[mmm]);
+        }
+        qes_free(mutated);
+    }
+    axe_trie_destroy(trie);
+    return NULL;
+}
+
+/* Tries are walked with two states: one walking, and the last terminal */
+static void *
+trie_engine_state_create(const void *index)
+{
+    const struct axe_trie *trie = index;
+    TrieState **states = qes_calloc(2, sizeof(*states));
+
+    states[0] = trie_root(trie->trie);
+    states[1] = trie_root(trie->trie);
+    if (states[0] == NULL || states[1] == NULL) {
+        if (states[0] != NULL) {
+            trie_state_free(states[0]);
+        }
+        qes_free(states);
+        return NULL;
+    }
+    return states;
+}
+
+static void
+trie_engine_state_destroy(void *state)
+{
+    TrieState **states = state;
+
+    trie_state_free(states[0]);
+    trie_state_free(states[1]);
+    qes_free(states);
+}
+
+static int
+trie_engine_match(const void *index, void *state, const char *seq, size_t len,
+                  intptr_t *value, size_t *edits, size_t *consumed)
+{
+    TrieState **states = state;
+
+    (void)edits;
+    (void)consumed;
+    return match_read_states(value, index, seq, len, states[0], states[1]);
+}
+
+static size_t
+trie_engine_keys(const void *index)
+{
+    return index != NULL ? ((const struct axe_trie *)index)->n_keys : 0;
+}
+
+static void
+trie_engine_destroy(void *index)
+{
+    axe_trie_destroy_(index);
+}
+
+static void *
+brute_engine_build(const char *const *seqs, size_t n,
+                   const struct axe_config *config)
+{
+    return axe_brute_index_create(seqs, n, config->mismatches,
+                                  config->permissive);
+}
+
+static int
+brute_engine_match(const void *index, void *state, const char *seq,
+                   size_t len, intptr_t *value, size_t *edits,
+                   size_t *consumed)
+{
+    (void)state;
+    (void)edits;
+    (void)consumed;
+    return axe_brute_index_match(index, seq, len, value);
+}
+
+static size_t
+brute_engine_keys(const void *index)
+{
+    return index != NULL ? ((const struct axe_brute_index *)index)->n : 0;
+}
+
+static void
+brute_engine_destroy(void *index)
+{
+    axe_brute_index_destroy_(index);
+}
+
+static void *
+whitelist_engine_build(const char *const *seqs, size_t n,
+                       const struct axe_config *config)
+{
+    return axe_whitelist_create(seqs, n, config->mismatches);
+}
+
+static int
+whitelist_engine_match(const void *index, void *state, const char *seq,
+                       size_t len, intptr_t *value, size_t *edits,
+                       size_t *consumed)
+{
+    (void)state;
+    (void)edits;
+    (void)consumed;
+    return axe_whitelist_match(index, seq, len, value);
+}
+
+static size_t
+whitelist_engine_keys(const void *index)
+{
+    return index != NULL ? ((const struct axe_whitelist *)index)->n : 0;
+}
+
+static void
+whitelist_engine_destroy(void *index)
+{
+    axe_whitelist_destroy_(index);
+}
+
+static void *
+seed_engine_build(const char *const *seqs, size_t n,
+                  const struct axe_config *config)
+{
+    return axe_seed_index_create(seqs, n, config->mismatches);
+}
+
+static int
+seed_engine_match(const void *index, void *state, const char *seq,
+                  size_t len, intptr_t *value, size_t *edits,
+                  size_t *consumed)
+{
+    (void)state;
+    (void)edits;
+    (void)consumed;
+    return axe_seed_index_match(index, seq, len, value);
+}
+
+static size_t
+seed_engine_keys(const void *index)
+{
+    return index != NULL ? ((const struct axe_seed_index *)index)->n : 0;
+}
+
+static void
+seed_engine_destroy(void *index)
+{
+    axe_seed_index_destroy_(index);
+}
+
+static void *
+edit_engine_build(const char *const *seqs, size_t n,
+                  const struct axe_config *config)
+{
+    return axe_edit_index_create(seqs, n, config->mismatches);
+}
+
+static int
+edit_engine_match(const void *index, void *state, const char *seq,
+                  size_t len, intptr_t *value, size_t *edits,
+                  size_t *consumed)
+{
+    (void)state;
+    return axe_edit_index_match(index, seq, len, value, edits, consumed);
+}
+
+static size_t
+edit_engine_keys(const void *index)
+{
+    return index != NULL ? ((const struct axe_edit_index *)index)->n_nodes : 0;
+}
+
+static void
+edit_engine_destroy(void *index)
+{
+    axe_edit_index_destroy_(index);
+}
+
+static const struct axe_engine trie_engine = {
+    .type = AXE_ENGINE_TRIE,
+    .name = "trie",
+    .needs = NULL,
+    .edits = false,
+    .build = trie_engine_build,
+    .state_create = trie_engine_state_create,
+    .state_destroy = trie_engine_state_destroy,
+    .match = trie_engine_match,
+    .keys = trie_engine_keys,
+    .destroy = trie_engine_destroy,
+};
+
+static const struct axe_engine brute_engine = {
+    .type = AXE_ENGINE_BRUTE,
+    .name = "brute",
+    .needs = "at most 128 barcodes of up to 32 ACGT bases, none of a length "
+             "within twice -m mismatches of each other (-m with -p)",
+    .edits = false,
+    .build = brute_engine_build,
+    .match = brute_engine_match,
+    .keys = brute_engine_keys,
+    .destroy = brute_engine_destroy,
+};
+
+static const struct axe_engine whitelist_engine = {
+    .type = AXE_ENGINE_WHITELIST,
+    .name = "whitelist",
+    .needs = "distinct barcodes of one length, of up to 32 ACGT bases, "
+             "and fewer mismatches than that length",
+    .edits = false,
+    .build = whitelist_engine_build,
+    .match = whitelist_engine_match,
+    .keys = whitelist_engine_keys,
+    .destroy = whitelist_engine_destroy,
+};
+
+static const struct axe_engine seed_engine = {
+    .type = AXE_ENGINE_SEED,
+    .name = "seed",
+    .needs = "distinct barcodes of ACGT bases, and fewer mismatches than "
+             "the shortest has bases, or 64",
+    .edits = false,
+    .build = seed_engine_build,
+    .match = seed_engine_match,
+    .keys = seed_engine_keys,
+    .destroy = seed_engine_destroy,
+};
+
+static const struct axe_engine edit_engine = {
+    .type = AXE_ENGINE_EDIT,
+    .name = "edit",
+    .needs = "distinct barcodes of ACGT bases, fewer mismatches than the "
+             "shortest has bases, and none longer than 64 bases less "
+             "mismatches",
+    .edits = true,
+    .build = edit_engine_build,
+    .match = edit_engine_match,
+    .keys = edit_engine_keys,
+    .destroy = edit_engine_destroy,
+};
+
+/* By type. AXE_ENGINE_AUTO is picked in axe_make_tries. */
+const struct axe_engine *const axe_engines[AXE_N_ENGINES] = {
+    [AXE_ENGINE_AUTO] = NULL,
+    [AXE_ENGINE_TRIE] = &trie_engine,
+    [AXE_ENGINE_BRUTE] = &brute_engine,
+    [AXE_ENGINE_WHITELIST] = &whitelist_engine,
+    [AXE_ENGINE_SEED] = &seed_engine,
+    [AXE_ENGINE_EDIT] = &edit_engine,
+};
+
+int
+axe_engine_find(const char *name)
+{
+    size_t iii = 0;
+
+    if (name == NULL) {
+        return -1;
+    }
+    if (strcmp(name, "auto") == 0) {
+        return AXE_ENGINE_AUTO;
+    }
+    for (iii = 0; iii < AXE_N_ENGINES; iii++) {
+        if (axe_engines[iii] != NULL &&
+                strcmp(name, axe_engines[iii]->name) == 0) {
+            return (int)iii;
+        }
+    }
+    return -1;
+}
+
+ssize_t
+axe_engine_match_batch(const struct axe_engine *engine, const void *index,
+                       void *state, struct qes_seq *const *seqs, size_t n,
+                       intptr_t *values)
+{
+    size_t edits = 0;
+    size_t consumed = 0;
+    ssize_t matched = 0;
+    size_t iii = 0;
+
+    if (engine == NULL || index == NULL || seqs == NULL || values == NULL ||
+            (engine->state_create != NULL && state == NULL)) {
+        return -1;
+    }
+    for (iii = 0; iii < n; iii++) {
+        values[iii] = -1;
+        if (!qes_seq_ok(seqs[iii])) {
+            continue;
+        }
+        if (engine->match(index, state, seqs[iii]->seq.str,
+                          seqs[iii]->seq.len, &values[iii], &edits,
+                          &consumed) == 0) {
+            matched++;
+        }
+    }
+    return matched;
+}
+
+/* Matchers and workers */
+
+struct axe_matcher *
+axe_matcher_create(const struct axe_config *config)
+{
+    struct axe_matcher *matcher = NULL;
+    size_t len = 0;
+    size_t iii = 0;
+
+    if (!axe_config_ok(config) || config->barcode_lookup == NULL ||
+            config->engine_ops == NULL || config->indices[0] == NULL ||
+            (config->match_combo && config->indices[1] == NULL)) {
+        return NULL;
+    }
+    matcher = qes_calloc(1, sizeof(*matcher));
+    matcher->engine = config->engine_ops;
+    matcher->indices[0] = config->indices[0];
+    matcher->indices[1] = config->match_combo ? config->indices[1] : NULL;
+    matcher->barcode_lookup = config->barcode_lookup;
+    matcher->barcodes = config->barcodes;
+    matcher->n_barcodes_1 = config->n_barcodes_1;
+    matcher->n_barcodes_2 = config->n_barcodes_2;
+    matcher->n_barcode_pairs = config->n_barcode_pairs;
+    matcher->n_mismatch_levels = axe_n_mismatch_levels(config);
+    matcher->unknown_top = config->unknown_top;
+    axe_max_barcode_lens(config, matcher->unknown_prefix_len);
+    matcher->combo = config->match_combo;
+    for (iii = 0; iii < 2 && matcher->indices[iii] != NULL; iii++) {
+        /* Engines counting edits look as far as an insertion per edit */
+        len = matcher->unknown_prefix_len[iii] +
+              (matcher->engine->edits ? config->mismatches : 0);
+        if (len <= 32) {
+            matcher->cache_lens[iii] = len;
+            matcher->cache_packs[iii] = axe_pack_kernel(len);
+        }
+    }
+    return matcher;
+}
+
+void
+axe_matcher_destroy_(struct axe_matcher *matcher)
+{
+    qes_free(matcher);
+}
+
+struct axe_worker *
+axe_worker_create(const struct axe_matcher *matcher)
+{
+    struct axe_worker *worker = NULL;
+    size_t iii = 0;
+    size_t jjj = 0;
+
+    if (matcher == NULL) {
+        return NULL;
+    }
+    worker = qes_calloc(1, sizeof(*worker));
+    worker->matcher = matcher;
+    worker->engine = matcher->engine;
+    for (iii = 0; iii < 2 && matcher->indices[iii] != NULL; iii++) {
+        /* Scratch space to match with, such as states to walk tries */
+        if (matcher->engine->state_create == NULL) {
+            continue;
+        }
+        worker->states[iii] =
+                matcher->engine->state_create(matcher->indices[iii]);
+        if (worker->states[iii] == NULL) {
+            axe_worker_destroy(worker);
+            return NULL;
+        }
+    }
+    for (iii = 0; iii < 2 && matcher->cache_lens[iii] > 0; iii++) {
+        worker->caches[iii] = qes_malloc(AXE_CACHE_SIZE *
+                                         sizeof(**worker->caches));
+        for (jjj = 0; jjj < AXE_CACHE_SIZE; jjj++) {
+            worker->caches[iii][jjj].value = AXE_CACHE_EMPTY;
+        }
+    }
+    worker->counts = qes_calloc(matcher->n_barcode_pairs,
+                                sizeof(*worker->counts));
+    worker->mismatch_counts = qes_calloc(matcher->n_barcode_pairs *
+                                         matcher->n_mismatch_levels,
+                                         sizeof(*worker->mismatch_counts));
+    if (matcher->combo) {
+        /* Threads see few of the pairs between reductions, so are sparse */
+        worker->pair_counts = axe_pair_counts_create(matcher->n_barcodes_1,
+                                                     matcher->n_barcodes_2,
+                                                     0);
+    }
+    if (matcher->unknown_top > 0) {
+        worker->unknown_prefixes = axe_unknown_topk_create(
+                matcher->unknown_top, matcher->unknown_prefix_len,
+                matcher->combo);
+    }
+    return worker;
+}
+
+void
+axe_worker_destroy_(struct axe_worker *worker)
+{
+    size_t iii = 0;
+
+    if (worker == NULL) {
+        return;
+    }
+    for (iii = 0; iii < 2; iii++) {
+        if (worker->states[iii] != NULL) {
+            worker->engine->state_destroy(worker->states[iii]);
+        }
+        qes_free(worker->caches[iii]);
+    }
+    qes_free(worker->counts);
+    qes_free(worker->mismatch_counts);
+    axe_pair_counts_destroy(worker->pair_counts);
+    axe_topk_destroy(worker->unknown_prefixes);
+    qes_free(worker);
+}
+
+/* Matches one read of a pair against index ``idx``, or finds how its
+ * prefix last matched in the worker's cache. Engines counting edits also set
+ * the edits to the barcode and the read bases it took up. */
+static inline int
+worker_match_read(struct axe_worker *worker, size_t idx,
+                  const struct qes_seq *seq, intptr_t *value, size_t *edits,
+                  size_t *consumed)
+{
+    const struct axe_matcher *matcher = worker->matcher;
+    const size_t cache_len = matcher->cache_lens[idx];
+    struct axe_cache_entry *entry = NULL;
+    uint64_t key = 0;
+    int res = 0;
+
+    *value = -1;
+    if (!qes_seq_ok(seq)) {
+        return 1;
+    }
+    /* Reads too short or with other than ACGT in the prefix can't be
+     * cached, so don't count towards the hit rate */
+    if (cache_len > 0 && seq->seq.len >= cache_len &&
+            matcher->cache_packs[idx](seq->seq.str, cache_len, &key) == 0) {
+        worker->cache_lookups++;
+        entry = &worker->caches[idx][(key * UINT64_C(0x9E3779B97F4A7C15)) >>
+                                     (64 - AXE_CACHE_BITS)];
+        if (entry->value != AXE_CACHE_EMPTY && entry->key == key) {
+            worker->cache_hits++;
+            *value = entry->value;
+            *edits = entry->edits;
+            *consumed = entry->consumed;
+            return entry->value < 0;
+        }
+    }
+    res = worker->engine->match(matcher->indices[idx], worker->states[idx],
+                                seq->seq.str, seq->seq.len, value, edits,
+                                consumed);
+    if (entry != NULL) {
+        entry->key = key;
+        entry->value = res == 0 ? *value : -1;
+        entry->edits = *edits;
+        entry->consumed = *consumed;
+    }
+    return res;
+}
+
+inline int
+axe_worker_match(struct axe_worker *worker, const struct qes_seq *seq1,
+                 const struct qes_seq *seq2, struct axe_match *match)
+{
+    const struct axe_matcher *matcher = NULL;
+    const struct axe_barcode *barcode = NULL;
+    size_t edits[2] = {0, 0};
+
+    if (worker == NULL || match == NULL || seq1 == NULL) {
+        return -1;
+    }
+    matcher = worker->matcher;
+    match->bcd[1] = -1;
+    match->sample = -1;
+    match->mismatches = 0;
+    match->lens[0] = match->lens[1] = 0;
+    if (worker_match_read(worker, 0, seq1, &match->bcd[0], &edits[0],
+                          &match->lens[0]) != 0) {
+        return 1;
+    }
+    if (!matcher->combo) {
+        match->sample = matcher->barcode_lookup[match->bcd[0]][0];
+        barcode = matcher->barcodes[match->sample];
+        if (matcher->engine->edits) {
+            match->mismatches = edits[0];
+            return 0;
+        }
+        match->mismatches = barcode_mismatches(barcode->seq1, barcode->len1,
+                                               seq1);
+        match->lens[0] = barcode->len1;
+        return 0;
+    }
+    if (seq2 == NULL) {
+        return -1;
+    }
+    if (worker_match_read(worker, 1, seq2, &match->bcd[1], &edits[1],
+                          &match->lens[1]) != 0) {
+        return 1;
+    }
+    /* Both barcodes matched, but they may be an unused pair */
+    match->sample = matcher->barcode_lookup[match->bcd[0]][match->bcd[1]];
+    if (match->sample < 0) {
+        return 1;
+    }
+    barcode = matcher->barcodes[match->sample];
+    if (matcher->engine->edits) {
+        match->mismatches = edits[0] + edits[1];
+        return 0;
+    }
+    match->mismatches = barcode_mismatches(barcode->seq1, barcode->len1,
+                                           seq1) +
+                        barcode_mismatches(barcode->seq2, barcode->len2,
+                                           seq2);
+    match->lens[0] = barcode->len1;
+    match->lens[1] = barcode->len2;
+    return 0;
+}
+
+/* Counts the barcode-length prefix of an unknown read (or R1+R2 prefixes in
+ * combinatorial mode) */
+static inline void
+worker_count_unknown(struct axe_worker *worker, const struct qes_seq *seq1,
+                     const struct qes_seq *seq2)
+{
+    struct axe_topk *topk = worker->unknown_prefixes;
+    char key[2 * 100 + 2];
+    size_t len1 = 0;
+    size_t len2 = 0;
+
+    if (topk == NULL) {
+        return;
+    }
+    if (!worker->matcher->combo || seq2 == NULL) {
+        axe_topk_add(topk, seq1->seq.str, seq1->seq.len, 1);
+        return;
+    }
+    /* Barcodes are at most 99 bases (see read_barcode_combo) */
+    len1 = worker->matcher->unknown_prefix_len[0];
+    len1 = len1 < seq1->seq.len ? len1 : seq1->seq.len;
+    len2 = worker->matcher->unknown_prefix_len[1];
+    len2 = len2 < seq2->seq.len ? len2 : seq2->seq.len;
+    memcpy(key, seq1->seq.str, len1);
+    key[len1] = '+';
+    memcpy(key + len1 + 1, seq2->seq.str, len2);
+    axe_topk_add(topk, key, len1 + 1 + len2, 1);
+}
+
+inline int
+axe_worker_count(struct axe_worker *worker, const struct axe_match *match,
+                 const struct qes_seq *seq1, const struct qes_seq *seq2)
+{
+    if (worker == NULL || match == NULL || seq1 == NULL) {
+        return -1;
+    }
+    worker->reads_processed++;
+    if (match->bcd[0] >= 0 && match->bcd[1] >= 0) {
+        /* Count every pair, including unused (e.g. index hopped) pairs */
+        axe_pair_counts_add(worker->pair_counts, match->bcd[0],
+                            match->bcd[1], 1);
+    }
+    if (match->sample < 0) {
+        worker_count_unknown(worker, seq1, seq2);
+        worker->reads_failed++;
+        return 0;
+    }
+    worker->reads_demultiplexed++;
+    worker->counts[match->sample]++;
+    worker->mismatch_counts[match->sample *
+                            worker->matcher->n_mismatch_levels +
+                            match->mismatches]++;
+    return 0;
+}
+
+/* Adds the worker's read and sample counts to the config's */
+static void
+worker_reduce_counts(struct axe_config *config, struct axe_worker *worker)
+{
+    const size_t n = worker->matcher->n_barcode_pairs *
+                     worker->matcher->n_mismatch_levels;
+    size_t iii = 0;
+
+    config->reads_processed += worker->reads_processed;
+    config->reads_demultiplexed += worker->reads_demultiplexed;
+    config->reads_failed += worker->reads_failed;
+    config->cache_lookups += worker->cache_lookups;
+    config->cache_hits += worker->cache_hits;
+    worker->reads_processed = 0;
+    worker->reads_demultiplexed = 0;
+    worker->reads_failed = 0;
+    worker->cache_lookups = 0;
+    worker->cache_hits = 0;
+    for (iii = 0; iii < worker->matcher->n_barcode_pairs; iii++) {
+        config->barcodes[iii]->count += worker->counts[iii];
+        worker->counts[iii] = 0;
+    }
+    for (iii = 0; iii < n; iii++) {
+        config->mismatch_counts[iii] += worker->mismatch_counts[iii];
+        worker->mismatch_counts[iii] = 0;
+    }
+}
+
+int
+axe_worker_reduce(struct axe_config *config, struct axe_worker *worker)
+{
+    if (!axe_config_ok(config) || worker == NULL ||
+            worker->matcher->n_barcode_pairs != config->n_barcode_pairs) {
+        return -1;
+    }
+    axe_alloc_counters(config);
+    worker_reduce_counts(config, worker);
+    axe_pair_counts_merge(config->pair_counts, worker->pair_counts);
+    axe_topk_merge(config->unknown_prefixes, worker->unknown_prefixes);
+    return 0;
+}
+
+/* Streams */
+
+struct axe_stream *
+axe_stream_create(const struct axe_matcher *matcher, axe_sink_fn sink,
+                  void *data)
+{
+    struct axe_stream *stream = NULL;
 
-    /* Make trie AlphaMap */
-    if (map == NULL) {
+    if (matcher == NULL || sink == NULL) {
         return NULL;
     }
-#define _AM_ADD(chr)                                                    \
-    ret = alpha_map_add_range(map, chr, chr);                               \
-    if (ret != 0) {                                                         \
-        fprintf(stderr, "[trie_create] Failed to add char %c to alphamap\n",\
-                chr);                                                       \
-        alpha_map_free(map);                                                \
-        return NULL;                                                        \
-    }
-    _AM_ADD('A')
-    _AM_ADD('C')
-    _AM_ADD('G')
-    _AM_ADD('T')
-    _AM_ADD('N')
-#undef _AM_ADD
-    trie = qes_calloc(1, sizeof(*trie));
-    trie->trie = trie_new(map);
-    if (trie->trie == NULL) {
-        qes_free(trie);
-        alpha_map_free(map);
+    stream = qes_calloc(1, sizeof(*stream));
+    stream->worker = axe_worker_create(matcher);
+    if (stream->worker == NULL) {
+        qes_free(stream);
         return NULL;
     }
-    alpha_map_free(map);
-    return trie;
+    stream->sink = sink;
+    stream->sink_data = data;
+    return stream;
 }
 
 void
-axe_trie_destroy_(struct axe_trie *trie)
+axe_stream_destroy_(struct axe_stream *stream)
 {
-    if (trie != NULL) {
-        /* trie_free doesn't check for null, so we better */
-        if (trie->trie != NULL) {
-            trie_free(trie->trie);
-        }
-        qes_free(trie);
+    if (stream == NULL) {
+        return;
     }
+    axe_worker_destroy(stream->worker);
+    qes_free(stream);
 }
 
 inline int
-axe_trie_get(struct axe_trie *trie, const char *str, intptr_t *data)
+axe_stream_match(struct axe_stream *stream, const struct qes_seq *seq1,
+                 const struct qes_seq *seq2, struct axe_match *match)
 {
-    if (!axe_trie_ok(trie) || str == NULL) return -1;
-    return trie_retrieve(trie->trie, str, data);
+    if (stream == NULL) {
+        return -1;
+    }
+    return axe_worker_match(stream->worker, seq1, seq2, match);
 }
 
 inline int
-axe_trie_delete(struct axe_trie *trie, const char *str)
+axe_stream_emit(struct axe_stream *stream, const struct axe_match *match,
+                struct qes_seq *seq1, struct qes_seq *seq2)
 {
-    if (!axe_trie_ok(trie) || str == NULL) return -1;
-    return trie_delete(trie->trie, str);
+    if (stream == NULL ||
+            axe_worker_count(stream->worker, match, seq1, seq2) != 0) {
+        return -1;
+    }
+    return stream->sink(stream->sink_data, match, seq1, seq2) == 0 ? 0 : 1;
 }
 
-inline int
-axe_trie_add(struct axe_trie *trie, const char *str, intptr_t data)
+int
+axe_stream_read(struct axe_stream *stream, struct qes_seq *seq1,
+                struct qes_seq *seq2)
 {
-    if (!axe_trie_ok(trie) || str == NULL) return -1;
-    if (trie_store_if_absent(trie->trie, str, data)) {
-        return 0;
+    struct axe_match match;
+
+    if (axe_stream_match(stream, seq1, seq2, &match) < 0) {
+        return -1;
     }
-    return 1;
+    return axe_stream_emit(stream, &match, seq1, seq2);
 }
 
-inline int
-axe_match_read (struct axe_config *config, ssize_t *value,
-                struct axe_trie *trie, const struct qes_seq *seq)
+int
+axe_stream_batch(struct axe_stream *stream, struct qes_seq *const *seq1,
+                 struct qes_seq *const *seq2, size_t n)
 {
-    TrieState *trie_iter = NULL;
-    TrieState *last_good_state = NULL;
-    size_t seq_pos = 0;
+    size_t iii = 0;
+    int ret = 0;
 
-    /* value is set to -1 on anything bad happening including failed lookup */
-    if (value == NULL || !axe_trie_ok(trie) || !qes_seq_ok(seq)) {
+    if (stream == NULL || seq1 == NULL) {
         return -1;
     }
-    /* Set *value here, then we just don't update it on error */
-    *value = -1;
-    if (seq->seq.len < trie->min_len) {
-        return 1;
+    for (iii = 0; iii < n && ret == 0; iii++) {
+        ret = axe_stream_read(stream, seq1[iii],
+                              seq2 != NULL ? seq2[iii] : NULL);
     }
-    /* Only look until the maximum of the largest barcode, or seq len */
-    /* Grab tree root iter, and check it. */
-    trie_iter = trie_root(trie->trie);
-    if (trie_iter == NULL) {
-        qes_log_message_fatal(config->logger,
-                              "match_read -- trie_root() returned NULL!\n");
-        return -1;
+    return ret;
+}
+
+/* 95% Wilson score interval of the proportion count/n */
+void
+axe_wilson_interval(uint64_t count, uint64_t n, double *low, double *high)
+{
+    const double z = 1.96;
+    double p = 0;
+    double denom = 0;
+    double centre = 0;
+    double half = 0;
+
+    if (n == 0) {
+        *low = 0;
+        *high = 1;
+        return;
     }
-    /* Consume seq until we can't */
-    do {
-        trie_state_walk(trie_iter, seq->seq.str[seq_pos]);
-        if (trie_state_is_terminal(trie_iter)) {
-            if (last_good_state != NULL) {
-                trie_state_free(last_good_state);
-            }
-            last_good_state = trie_state_clone(trie_iter);
-        }
-    } while (trie_state_is_walkable(trie_iter, seq->seq.str[++seq_pos]));
-    /* If we get to a terminal state, then great! */
-    if (trie_state_is_terminal(trie_iter)) {
-        trie_state_walk(trie_iter, '\0');
-        trie_state_free(last_good_state);
-        *value =  (ssize_t) trie_state_get_data(trie_iter);
-        trie_state_free(trie_iter);
-        return 0;
-    } else if (last_good_state != NULL) {
-        trie_state_free(trie_iter);
-        trie_state_walk(last_good_state, '\0');
-        *value =  (ssize_t) trie_state_get_data(last_good_state);
-        trie_state_free(last_good_state);
+    p = (double)count / (double)n;
+    denom = 1 + z * z / n;
+    centre = (p + z * z / (2.0 * n)) / denom;
+    half = z * sqrt(p * (1 - p) / n + z * z / (4.0 * n * n)) / denom;
+    *low = centre - half < 0 ? 0 : centre - half;
+    *high = centre + half > 1 ? 1 : centre + half;
+}
+
+/* Whether only part of the input was read, so counts are extrapolated */
+static inline bool
+axe_is_estimate(const struct axe_config *config)
+{
+    return config->preview > 0 || config->sample_fraction > 0;
+}
+
+/* Estimated number of reads in the whole input, or 0 if unknown */
+static inline double
+axe_estimated_reads(const struct axe_config *config)
+{
+    if (config->input_fraction <= 0) {
         return 0;
     }
-    trie_state_free(trie_iter);
-    if (last_good_state != NULL) {
-        trie_state_free(last_good_state);
+    return (double)config->reads_processed / config->input_fraction;
+}
+
+static void
+write_table_estimate(FILE *fp, const struct axe_config *config,
+                     uint64_t count)
+{
+    double total = axe_estimated_reads(config);
+    double low = 0;
+    double high = 0;
+
+    axe_wilson_interval(count, config->reads_processed, &low, &high);
+    fprintf(fp, "\t%.6f\t%.6f\t%.6f", config->reads_processed > 0 ?
+            (double)count / (double)config->reads_processed : 0, low, high);
+    if (total > 0) {
+        fprintf(fp, "\t%.0f\t%.0f\t%.0f", (double)count / config->input_fraction,
+                low * total, high * total);
+    } else {
+        fprintf(fp, "\tNA\tNA\tNA");
     }
-    return 1;
 }
 
 int
@@ -1548,7 +5048,10 @@ axe_write_table(const struct axe_config *config)
 {
     FILE *tab_fp = NULL;
     struct axe_barcode *this_bcd = NULL;
+    char *tab_path = NULL;
+    size_t levels = 0;
     size_t iii = 0;
+    size_t jjj = 0;
     int res = 0;
 
     if (!axe_config_ok(config)) {
@@ -1559,47 +5062,381 @@ axe_write_table(const struct axe_config *config)
            if we don't have a file to write it to. */
         return 0;
     }
-    tab_fp = fopen(config->table_file, "w");
+    tab_path = axe_make_table_path(config);
+    if (tab_path == NULL) {
+        return 1;
+    }
+    tab_fp = fopen(tab_path, "w");
     if (tab_fp == NULL) {
         qes_log_format_fatal(config->logger, "write_table -- ERROR: Could not open %s\n%s\n",
-                             config->table_file, strerror(errno));
+                             tab_path, strerror(errno));
+        qes_free(tab_path);
         return 1;
     }
+    /* With mismatches allowed, counts are also broken down by the number of
+     * mismatches (summed over both barcodes if combinatorial) */
+    levels = config->mismatches > 0 && config->mismatch_counts != NULL ?
+             config->n_mismatch_levels : 0;
     if (config->match_combo) {
-        fprintf(tab_fp, "R1Barcode\tR2Barcode\tSample\tCount\n");
+        fprintf(tab_fp, "R1Barcode\tR2Barcode\tSample\tCount");
     } else {
-        fprintf(tab_fp, "Barcode\tSample\tCount\n");
+        fprintf(tab_fp, "Barcode\tSample\tCount");
+    }
+    for (jjj = 0; jjj < levels; jjj++) {
+        fprintf(tab_fp, "\t%zumm", jjj);
+    }
+    if (axe_is_estimate(config)) {
+        /* Extrapolated from the part of the input that was read */
+        fprintf(tab_fp, "\tShare\tShareLow\tShareHigh"
+                        "\tEstimate\tEstimateLow\tEstimateHigh");
     }
+    fprintf(tab_fp, "\n");
     for (iii = 0; iii < config->n_barcode_pairs; iii++) {
         this_bcd = config->barcodes[iii];
         if (config->match_combo) {
-            fprintf(tab_fp, "%s\t%s\t%s\t%" PRIu64 "\n", this_bcd->seq1,
+            fprintf(tab_fp, "%s\t%s\t%s\t%" PRIu64, this_bcd->seq1,
                     this_bcd->seq2, this_bcd->id, this_bcd->count);
         } else {
-            fprintf(tab_fp, "%s\t%s\t%" PRIu64 "\n", this_bcd->seq1,
+            fprintf(tab_fp, "%s\t%s\t%" PRIu64, this_bcd->seq1,
                     this_bcd->id, this_bcd->count);
         }
+        for (jjj = 0; jjj < levels; jjj++) {
+            fprintf(tab_fp, "\t%" PRIu64,
+                    config->mismatch_counts[iii * levels + jjj]);
+        }
+        if (axe_is_estimate(config)) {
+            write_table_estimate(tab_fp, config, this_bcd->count);
+        }
+        fprintf(tab_fp, "\n");
     }
     if (config->match_combo) {
-        fprintf(tab_fp, "N\tN\tNo Barcode\t%" PRIu64 "\n",
-                config->reads_failed);
+        fprintf(tab_fp, "N\tN\tNo Barcode\t%" PRIu64, config->reads_failed);
     } else {
-        fprintf(tab_fp, "N\tNo Barcode\t%" PRIu64 "\n", config->reads_failed);
+        fprintf(tab_fp, "N\tNo Barcode\t%" PRIu64, config->reads_failed);
+    }
+    for (jjj = 0; jjj < levels; jjj++) {
+        fprintf(tab_fp, "\t0");
+    }
+    if (axe_is_estimate(config)) {
+        write_table_estimate(tab_fp, config, config->reads_failed);
     }
+    fprintf(tab_fp, "\n");
     res = fclose(tab_fp);
     if (res != 0) {
         qes_log_format_error(config->logger,
                              "[write_table] Couldn't close tab file %s\n%s\n",
-                              config->table_file, strerror(errno));
+                              tab_path, strerror(errno));
+        qes_free(tab_path);
+        return 1;
+    }
+    qes_free(tab_path);
+    return 0;
+}
+
+static int
+write_manifest_line(FILE *fp, struct qes_seqfile *sf)
+{
+    struct qes_file_sums sums;
+
+    if (sf == NULL) {
+        return 0;
+    }
+    /* Sums are only final once the file is */
+    if (qes_file_finish(sf->qf) != 0 || qes_file_sums(sf->qf, &sums) != 0) {
+        return 1;
+    }
+    fprintf(fp, "%s\t%" PRIu64 "\t%08" PRIx32 "\t%" PRIu64 "\t%08" PRIx32 "\n",
+            sf->qf->path, sums.size, sums.crc, sums.data_size, sums.data_crc);
+    return 0;
+}
+
+int
+axe_write_manifest(struct axe_config *config)
+{
+    FILE *fp = NULL;
+    struct axe_output *out = NULL;
+    char *path = NULL;
+    size_t iii = 0;
+    int res = 0;
+
+    if (!axe_config_ok(config)) {
+        return -1;
+    }
+    if (config->table_file == NULL || config->count_only) {
+        return 0;
+    }
+    path = axe_make_manifest_path(config);
+    if (path == NULL) {
+        return 1;
+    }
+    fp = fopen(path, "w");
+    if (fp == NULL) {
+        qes_log_format_fatal(config->logger, "write_manifest -- ERROR: Could not open %s\n%s\n",
+                             path, strerror(errno));
+        qes_free(path);
+        return 1;
+    }
+    fprintf(fp, "File\tBytes\tCRC32\tDataBytes\tDataCRC32\n");
+    for (iii = 0; iii <= config->n_barcode_pairs; iii++) {
+        out = iii < config->n_barcode_pairs ? config->outputs[iii] :
+                                              config->unknown_output;
+        res |= write_manifest_line(fp, out->fwd_file);
+        res |= write_manifest_line(fp, out->rev_file);
+    }
+    if (res != 0) {
+        qes_log_format_error(config->logger,
+                             "write_manifest -- Couldn't finish writing outputs\n%s\n",
+                             strerror(errno));
+    }
+    if (fclose(fp) != 0) {
+        qes_log_format_error(config->logger,
+                             "write_manifest -- Couldn't close %s\n%s\n",
+                             path, strerror(errno));
+        res = 1;
+    }
+    qes_free(path);
+    return res;
+}
+
+static void
+write_json_string(FILE *fp, const char *str)
+{
+    fputc('"', fp);
+    for (; *str != '\0'; str++) {
+        if (*str == '"' || *str == '\\') {
+            fprintf(fp, "\\%c", *str);
+        } else if ((unsigned char)*str < 0x20) {
+            fprintf(fp, "\\u%04x", (unsigned char)*str);
+        } else {
+            fputc(*str, fp);
+        }
+    }
+    fputc('"', fp);
+}
+
+static const char *axe_stage_names[AXE_N_STAGES] = {
+    "read", "match", "wait", "write",
+};
+
+static const char *axe_mem_names[AXE_N_MEM_TAGS] = {
+    "io", "zlib", "tries", "lookup",
+};
+
+/* Mean number of threads waiting to write. By Little's law, this is the
+ * total time threads spent waiting over the time taken. */
+static double
+axe_mean_write_queue(const struct axe_config *config)
+{
+    if (config->time_taken <= 0) {
+        return 0;
+    }
+    return config->stage_seconds[AXE_STAGE_WAIT] / config->time_taken;
+}
+
+/* Fraction of barcode lookups found in the workers' prefix caches */
+static double
+axe_cache_hit_rate(const struct axe_config *config)
+{
+    if (config->cache_lookups == 0) {
+        return 0;
+    }
+    return (double)config->cache_hits / (double)config->cache_lookups;
+}
+
+static void
+write_json_estimate(FILE *fp, const struct axe_config *config,
+                    uint64_t count)
+{
+    double total = axe_estimated_reads(config);
+    double low = 0;
+    double high = 0;
+
+    axe_wilson_interval(count, config->reads_processed, &low, &high);
+    fprintf(fp, "{\"share\": %.6f, \"share_low\": %.6f, "
+                "\"share_high\": %.6f", config->reads_processed > 0 ?
+            (double)count / (double)config->reads_processed : 0, low, high);
+    if (total > 0) {
+        fprintf(fp, ", \"reads\": %.0f, \"reads_low\": %.0f, "
+                    "\"reads_high\": %.0f}",
+                (double)count / config->input_fraction, low * total,
+                high * total);
+    } else {
+        fprintf(fp, ", \"reads\": null, \"reads_low\": null, "
+                    "\"reads_high\": null}");
+    }
+}
+
+int
+axe_write_stats(const struct axe_config *config)
+{
+    FILE *fp = NULL;
+    struct axe_barcode *this_bcd = NULL;
+    struct axe_topk_entry **sorted = NULL;
+    size_t iii = 0;
+    size_t jjj = 0;
+    int res = 0;
+
+    if (!axe_config_ok(config)) {
+        return -1;
+    }
+    if (config->stats_file == NULL) {
+        return 0;
+    }
+    fp = fopen(config->stats_file, "w");
+    if (fp == NULL) {
+        qes_log_format_fatal(config->logger, "write_stats -- ERROR: Could not open %s\n%s\n",
+                             config->stats_file, strerror(errno));
+        return 1;
+    }
+    fprintf(fp, "{\n");
+    fprintf(fp, "  \"version\": \"%s\",\n", AXE_VERSION);
+    fprintf(fp, "  \"combinatorial\": %s,\n",
+            config->match_combo ? "true" : "false");
+    fprintf(fp, "  \"max_mismatches\": %zu,\n", config->mismatches);
+    fprintf(fp, "  \"reads_processed\": %" PRIu64 ",\n",
+            config->reads_processed);
+    fprintf(fp, "  \"reads_demultiplexed\": %" PRIu64 ",\n",
+            config->reads_demultiplexed);
+    fprintf(fp, "  \"reads_failed\": %" PRIu64 ",\n", config->reads_failed);
+    fprintf(fp, "  \"prefix_cache\": {\"lookups\": %" PRIu64 ", \"hits\": %"
+                PRIu64 ", \"hit_rate\": %.4f},\n", config->cache_lookups,
+            config->cache_hits, axe_cache_hit_rate(config));
+    if (axe_is_estimate(config)) {
+        fprintf(fp, "  \"sampling\": {\"preview\": %" PRIu64 ", "
+                    "\"sample_fraction\": %g, \"input_fraction\": %.6f, "
+                    "\"estimated_reads\": %.0f},\n",
+                config->preview, config->sample_fraction,
+                config->input_fraction, axe_estimated_reads(config));
+        fprintf(fp, "  \"failed_estimate\": ");
+        write_json_estimate(fp, config, config->reads_failed);
+        fprintf(fp, ",\n");
+    }
+    fprintf(fp, "  \"seconds\": %.3f,\n", config->time_taken);
+    fprintf(fp, "  \"threads\": %zu,\n", config->n_parts);
+    fprintf(fp, "  \"stage_seconds\": {");
+    for (iii = 0; iii < AXE_N_STAGES; iii++) {
+        fprintf(fp, "%s\"%s\": %.3f", iii > 0 ? ", " : "",
+                axe_stage_names[iii], config->stage_seconds[iii]);
+    }
+    fprintf(fp, "},\n");
+    fprintf(fp, "  \"mean_write_queue\": %.3f,\n",
+            axe_mean_write_queue(config));
+    fprintf(fp, "  \"memory\": {");
+    for (iii = 0; iii < AXE_N_MEM_TAGS; iii++) {
+        fprintf(fp, "%s\"%s\": {\"current\": %" PRId64 ", \"peak\": %" PRId64
+                "}", iii > 0 ? ", " : "", axe_mem_names[iii],
+                qes_mem_current(iii), qes_mem_peak(iii));
+    }
+    fprintf(fp, "},\n");
+    fprintf(fp, "  \"samples\": [");
+    for (iii = 0; iii < config->n_barcode_pairs; iii++) {
+        this_bcd = config->barcodes[iii];
+        fprintf(fp, "%s\n    {\"id\": ", iii > 0 ? "," : "");
+        write_json_string(fp, this_bcd->id);
+        fprintf(fp, ", \"barcode1\": ");
+        write_json_string(fp, this_bcd->seq1);
+        if (config->match_combo) {
+            fprintf(fp, ", \"barcode2\": ");
+            write_json_string(fp, this_bcd->seq2);
+        }
+        fprintf(fp, ", \"count\": %" PRIu64 ", \"mismatches\": [",
+                this_bcd->count);
+        for (jjj = 0; config->mismatch_counts != NULL &&
+                      jjj < config->n_mismatch_levels; jjj++) {
+            fprintf(fp, "%s%" PRIu64, jjj > 0 ? ", " : "",
+                    config->mismatch_counts[iii * config->n_mismatch_levels +
+                                            jjj]);
+        }
+        fprintf(fp, "]");
+        if (axe_is_estimate(config)) {
+            fprintf(fp, ", \"estimate\": ");
+            write_json_estimate(fp, config, this_bcd->count);
+        }
+        fprintf(fp, "}");
+    }
+    fprintf(fp, "\n  ],\n");
+    fprintf(fp, "  \"unknown_prefixes\": [");
+    sorted = axe_topk_sorted(config->unknown_prefixes);
+    for (iii = 0; sorted != NULL && sorted[iii] != NULL &&
+                  iii < config->unknown_top; iii++) {
+        fprintf(fp, "%s\n    {\"prefix\": ", iii > 0 ? "," : "");
+        write_json_string(fp, sorted[iii]->key);
+        fprintf(fp, ", \"count\": %" PRIu64 ", \"max_overcount\": %"
+                PRIu64 "}", sorted[iii]->count, sorted[iii]->error);
+    }
+    qes_free(sorted);
+    fprintf(fp, "%s]\n}\n", iii > 0 ? "\n  " : "");
+    res = fclose(fp);
+    if (res != 0) {
+        qes_log_format_error(config->logger,
+                             "write_stats -- Couldn't close %s\n%s\n",
+                             config->stats_file, strerror(errno));
         return 1;
     }
     return 0;
 }
 
+/* Rows are R1 barcodes and columns R2 barcodes, so unused pairs show where
+ * reads have hopped between indexes */
+int
+axe_write_matrix(const struct axe_config *config)
+{
+    FILE *fp = NULL;
+    char *path = NULL;
+    size_t iii = 0;
+    size_t jjj = 0;
+    int res = 0;
+
+    if (!axe_config_ok(config)) {
+        return -1;
+    }
+    if (config->matrix_file == NULL || config->pair_counts == NULL) {
+        return 0;
+    }
+    path = axe_make_chunk_path(config, config->matrix_file);
+    if (path == NULL) {
+        return 1;
+    }
+    fp = fopen(path, "w");
+    if (fp == NULL) {
+        qes_log_format_fatal(config->logger, "write_matrix -- ERROR: Could not open %s\n%s\n",
+                             path, strerror(errno));
+        qes_free(path);
+        return 1;
+    }
+    fprintf(fp, "R1Barcode");
+    for (jjj = 0; jjj < config->n_barcodes_2; jjj++) {
+        fprintf(fp, "\t%s", config->barcode_seqs[1][jjj]);
+    }
+    fprintf(fp, "\n");
+    for (iii = 0; iii < config->n_barcodes_1; iii++) {
+        fprintf(fp, "%s", config->barcode_seqs[0][iii]);
+        for (jjj = 0; jjj < config->n_barcodes_2; jjj++) {
+            fprintf(fp, "\t%" PRIu64,
+                    axe_pair_counts_get(config->pair_counts, iii, jjj));
+        }
+        fprintf(fp, "\n");
+    }
+    res = fclose(fp);
+    if (res != 0) {
+        qes_log_format_error(config->logger,
+                             "write_matrix -- Couldn't close %s\n%s\n",
+                             path, strerror(errno));
+        res = 1;
+    }
+    qes_free(path);
+    return res;
+}
+
 int
 axe_print_summary(const struct axe_config *config)
 {
     const char *tmp;
+    struct axe_topk_entry **sorted = NULL;
+    double stage_total = 0;
+    double low = 0;
+    double high = 0;
+    size_t iii = 0;
 
 #define hr(r) ((float)((r) / ((r) > 1000000.0 ? 1000000.0 : 1000.0)))
 #define unit(r) ((r) > 1000000.0 ? 'M' : 'K')
@@ -1620,6 +5457,37 @@ axe_print_summary(const struct axe_config *config)
             "Processed %.2f%c %s in %0.1f seconds (%0.1fK %s/sec)\n",
             hr(config->reads_processed), unit(config->reads_processed), tmp, config->time_taken,
             (float)(config->reads_processed / 1000) / config->time_taken, tmp);
+    for (iii = 0; iii < AXE_N_STAGES; iii++) {
+        stage_total += config->stage_seconds[iii];
+    }
+    if (stage_total > 0) {
+        axe_format_bold(config->logger,
+                        "Time by stage, summed over %zu thread%s:\n",
+                        config->n_parts, config->n_parts == 1 ? "" : "s");
+        for (iii = 0; iii < AXE_N_STAGES; iii++) {
+            axe_format_bold(config->logger,
+                            "    %s\t%0.2f seconds (%0.1f%%)\n",
+                            axe_stage_names[iii], config->stage_seconds[iii],
+                            config->stage_seconds[iii] / stage_total * 100.0);
+        }
+        axe_format_bold(config->logger,
+                        "On average %0.2f threads were waiting to write\n",
+                        axe_mean_write_queue(config));
+    }
+    if (config->verbosity > 0) {
+        axe_message_bold(config->logger,
+                         "Memory by subsystem, now and at peak:\n");
+        for (iii = 0; iii < AXE_N_MEM_TAGS; iii++) {
+            axe_format_bold(config->logger,
+                            "    %s\t%0.2f MiB\t%0.2f MiB\n",
+                            axe_mem_names[iii],
+                            qes_mem_current(iii) / 1048576.0,
+                            qes_mem_peak(iii) / 1048576.0);
+        }
+        axe_format_bold(config->logger,
+                        "%0.1f%% of barcode lookups hit the prefix cache\n",
+                        axe_cache_hit_rate(config) * 100.0);
+    }
     axe_format_bold(config->logger,
             "%.2f%c %s contained valid barcodes\n",
             hr(config->reads_demultiplexed), unit(config->reads_demultiplexed), tmp);
@@ -1627,7 +5495,108 @@ axe_print_summary(const struct axe_config *config)
             "%.2f%c %s could not be demultiplexed (%0.1f%%)\n",
             hr(config->reads_failed), unit(config->reads_failed), tmp,
             ((float)config->reads_failed/(float)(config->reads_processed)*100.0));
+    if (axe_is_estimate(config)) {
+        axe_wilson_interval(config->reads_failed, config->reads_processed,
+                            &low, &high);
+        axe_format_bold(config->logger,
+                        "Estimated from %s: %0.1f%% to %0.1f%% of %s can't "
+                        "be demultiplexed (95%% CI)\n",
+                        config->preview > 0 ? "the first reads" :
+                                              "a sample of the input",
+                        low * 100.0, high * 100.0, tmp);
+        if (axe_estimated_reads(config) > 0) {
+            axe_format_bold(config->logger,
+                            "Read %0.2f%% of the input, which holds about "
+                            "%.2f%c %s\n", config->input_fraction * 100.0,
+                            hr(axe_estimated_reads(config)),
+                            unit(axe_estimated_reads(config)), tmp);
+        }
+    }
+    sorted = axe_topk_sorted(config->unknown_prefixes);
+    if (sorted != NULL && sorted[0] != NULL) {
+        axe_format_bold(config->logger,
+                        "Most common barcode prefixes of these %s:\n", tmp);
+        for (iii = 0; sorted[iii] != NULL && iii < config->unknown_top;
+                iii++) {
+            axe_format_bold(config->logger,
+                            "    %s\t%" PRIu64 " (%0.1f%%)%s\n",
+                            sorted[iii]->key, sorted[iii]->count,
+                            (float)sorted[iii]->count /
+                                (float)config->reads_failed * 100.0,
+                            sorted[iii]->error > 0 ? " or fewer" : "");
+        }
+    }
+    qes_free(sorted);
     return 0;
 #undef hr
 #undef unit
 }
+
+/* The tries and barcode lookup table are built before any files are opened,
+ * so they're measured. Each thread opens each input, and every output is
+ * opened at once, so their buffers and zlib states are estimated from the
+ * number of threads and outputs. */
+int
+axe_estimate_memory(const struct axe_config *config, int64_t *bytes)
+{
+    int64_t io = 0;
+    int64_t zlib = 0;
+    char *zmode = NULL;
+    size_t threads = 0;
+    size_t n_files = 0;
+    size_t iii = 0;
+
+    if (!axe_config_ok(config) || bytes == NULL) {
+        return -1;
+    }
+    for (iii = 0; iii < AXE_N_MEM_TAGS; iii++) {
+        bytes[iii] = 0;
+    }
+    bytes[AXE_MEM_TRIE] = qes_mem_peak(AXE_MEM_TRIE);
+    bytes[AXE_MEM_LOOKUP] = qes_mem_peak(AXE_MEM_LOOKUP);
+    threads = config->preview > 0 ? 1 : config->threads;
+    n_files = threads * (config->in_mode == READS_PAIRED ? 2 : 1);
+    if (qes_file_mem_estimate("r", 0, &io, &zlib) != 0) {
+        return 1;
+    }
+    bytes[AXE_MEM_IO] += n_files * io;
+    bytes[AXE_MEM_ZLIB] += n_files * zlib;
+    if (config->count_only) {
+        return 0;
+    }
+    /* Each sample, and the unknown reads */
+    n_files = (config->n_barcode_pairs + 1) *
+              (config->out_mode == READS_PAIRED ? 2 : 1);
+    zmode = axe_make_zmode(config);
+    if (zmode == NULL || qes_file_mem_estimate(zmode, 1, &io, &zlib) != 0) {
+        qes_free(zmode);
+        return 1;
+    }
+    bytes[AXE_MEM_IO] += n_files * io;
+    bytes[AXE_MEM_ZLIB] += n_files * zlib;
+    qes_free(zmode);
+    return 0;
+}
+
+int
+axe_print_memory_estimate(const struct axe_config *config)
+{
+    int64_t bytes[AXE_N_MEM_TAGS];
+    int64_t total = 0;
+    size_t iii = 0;
+
+    if (!axe_config_ok(config)) {
+        return -1;
+    }
+    if (axe_estimate_memory(config, bytes) != 0) {
+        return 1;
+    }
+    printf("Subsystem\tBytes\tMiB\n");
+    for (iii = 0; iii < AXE_N_MEM_TAGS; iii++) {
+        printf("%s\t%" PRId64 "\t%0.1f\n", axe_mem_names[iii], bytes[iii],
+               bytes[iii] / 1048576.0);
+        total += bytes[iii];
+    }
+    printf("total\t%" PRId64 "\t%0.1f\n", total, total / 1048576.0);
+    return 0;
+}
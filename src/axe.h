@@ -32,6 +32,7 @@
 #include <assert.h>
 #include <inttypes.h>
 #include <time.h>
+#include <signal.h>
 
 #include <qes_util.h>
 #include <qes_seq.h>
@@ -68,6 +69,7 @@ struct axe_trie {
     int mismatch_level;
     size_t max_len;
     size_t min_len;
+    size_t n_keys;  /* Sequences stored */
 };
 
 struct axe_barcode {
@@ -80,9 +82,340 @@ struct axe_barcode {
     uint64_t count;
 };
 
+/* Space-Saving sketch of the most frequent keys of a stream, in fixed
+ * memory. A key's count may overestimate its true count by up to its error,
+ * and any key making up more than 1 / capacity of the stream is tracked. */
+struct axe_topk_entry {
+    char *key;
+    uint64_t count;
+    uint64_t error;     /* Count inherited from the key this one replaced */
+    size_t heap_pos;
+};
+
+struct axe_topk {
+    struct axe_topk_entry *entries;
+    char *keys;         /* Storage for capacity keys of up to key_len */
+    size_t *heap;       /* Entry indices, as a min-heap on count */
+    size_t *table;      /* Hash table of entry index + 1, or 0 if empty */
+    size_t table_mask;
+    size_t capacity;
+    size_t key_len;
+    size_t n;
+};
+
+/* Counts of every combination of an R1 and an R2 barcode, used or not. Up
+ * to dense_max combinations are counted in a matrix, more in a hash table
+ * of the combinations seen. */
+#define AXE_PAIR_DENSE_MAX (1 << 20)
+
+struct axe_pair_counts {
+    size_t n1;
+    size_t n2;
+    uint64_t *dense;    /* n1 x n2, or NULL if sparse */
+    uint64_t *keys;     /* Sparse: bcd1 * n2 + bcd2 + 1, or 0 if empty */
+    uint64_t *counts;
+    size_t n_keys;
+    size_t table_size;
+};
+
+/* Packs the first bases of a sequence 2 bits per base (A, C, G, T as 0 to 3),
+ * the first base highest, returning 1 if any base isn't ACGT. Kernels
+ * specialised to the common barcode lengths (6, 8, 10, 12 and 16 bases)
+ * load bases a word at a time and ignore ``len``, which must be theirs. */
+typedef int (*axe_pack_fn)(const char *seq, size_t len, uint64_t *packed);
+
+/* Barcodes of one length, matched without listing their mutants, for
+ * whitelists of up to millions of barcodes. Barcodes are packed 2 bits per
+ * base, and split into mismatches + 1 blocks: a read within that many
+ * mismatches of a barcode matches at least one of its blocks exactly. Each
+ * block has a table of the barcodes' values of it, sorted, so candidates are
+ * found by binary search and then checked in full. */
+#define AXE_WHITELIST_MAX_LEN 32
+
+struct axe_whitelist {
+    uint64_t *packed;           /* Barcodes, by index */
+    uint64_t *keys[AXE_WHITELIST_MAX_LEN]; /* Each block's values, sorted, */
+    uint32_t *ids[AXE_WHITELIST_MAX_LEN];  /* and the barcodes they're of */
+    size_t block_shift[AXE_WHITELIST_MAX_LEN];
+    uint64_t block_mask[AXE_WHITELIST_MAX_LEN];
+    size_t n_blocks;
+    size_t n;
+    size_t len;
+    size_t mismatches;
+    axe_pack_fn pack;           /* Packs len bases of reads */
+};
+
+/* Barcodes matched through exact seeds, for long barcodes at mismatch levels
+ * too high to list their mutants. The first min_len bases of each barcode
+ * are split into mismatches + 1 seeds, of which a read within that many
+ * mismatches of the barcode matches at least one exactly. Up to
+ * AXE_SEED_MAX_LEN bases of each seed are hashed, and the barcodes found
+ * through them are checked in full with qes_match_hamming_max. */
+#define AXE_SEED_MAX_LEN 28
+#define AXE_SEED_MAX_SEEDS 64
+
+struct axe_seed_index {
+    char *seqs;                 /* Barcodes, NUL terminated, end to end */
+    size_t *starts;             /* Where each barcode is in seqs */
+    size_t *lens;
+    size_t *group_lens;         /* Lengths of the barcodes, longest first */
+    size_t n_groups;
+    uint64_t *keys;             /* Seed number and bases + 1, or 0 if empty */
+    uint32_t *firsts;           /* Where each key's barcodes are in ids, */
+    uint32_t *counts;           /* and how many there are */
+    uint32_t *ids;
+    size_t seed_starts[AXE_SEED_MAX_SEEDS];
+    size_t seed_lens[AXE_SEED_MAX_SEEDS];
+    axe_pack_fn seed_packs[AXE_SEED_MAX_SEEDS];
+    size_t n_seeds;
+    size_t table_size;
+    size_t seqs_size;
+    size_t n;
+    size_t min_len;
+    size_t max_len;
+    size_t mismatches;
+};
+
+/* Barcodes matched allowing insertions and deletions as well as
+ * substitutions. The barcodes are kept in a trie, walked depth first against
+ * the start of each read with a bit-parallel (Myers) edit distance DP, one
+ * column per trie level; branches more than mismatches edits from every
+ * prefix of the read are pruned, so no indel mutants are listed. Barcodes'
+ * lengths plus mismatches must be at most AXE_EDIT_MAX_LEN, the bits in a
+ * column. */
+#define AXE_EDIT_MAX_LEN 64
+
+struct axe_edit_index {
+    uint32_t (*children)[4];    /* Each node's child by base, or 0 if none */
+    int32_t *ids;               /* Barcode ending at each node, or -1 */
+    size_t n_nodes;
+    size_t nodes_alloced;
+    size_t n;
+    size_t min_len;
+    size_t max_len;
+    size_t mismatches;
+};
+
+/* Small barcode sets, compared in full with each read rather than through
+ * tries, which then needn't be built. Barcodes are packed 2 bits per base
+ * and grouped by length, longest first, so a read is packed once, and each
+ * XOR and popcount compares up to 32 bases. */
+#define AXE_BRUTE_MAX_BARCODES 128
+#define AXE_BRUTE_MAX_LEN 32
+
+struct axe_brute_index {
+    uint64_t *packed;           /* Barcodes, grouped by length */
+    uint32_t *ids;              /* and their indices */
+    size_t group_lens[AXE_BRUTE_MAX_LEN];
+    size_t group_ends[AXE_BRUTE_MAX_LEN];
+    size_t n_groups;
+    size_t n;
+    size_t max_len;
+    size_t mismatches;
+    axe_pack_fn pack;           /* Packs max_len bases of reads */
+};
+
+/* Ways of matching reads to barcodes, by the index they build of each
+ * read's barcodes. AXE_ENGINE_AUTO picks one for the barcodes and mismatch
+ * level when the tries are made. */
+enum axe_engine_type {
+    AXE_ENGINE_AUTO = 0,
+    AXE_ENGINE_TRIE = 1,
+    AXE_ENGINE_BRUTE = 2,
+    AXE_ENGINE_WHITELIST = 3,
+    AXE_ENGINE_SEED = 4,
+    AXE_ENGINE_EDIT = 5,
+    AXE_N_ENGINES = 6,
+};
+
+/* Automatically, the tries are only used if they'd hold fewer sequences
+ * than this, counting every barcode's mutants */
+#define AXE_TRIE_MAX_KEYS (1 << 24)
+
+struct axe_config;
+
+/* An engine's operations. ``build`` indexes one read's barcodes, each
+ * matching the value of its place in ``seqs``, or returns NULL if it can't.
+ * Indices are only read once built, so threads share them, but ``match``
+ * needs each thread's own scratch state from ``state_create`` (NULL for
+ * engines needing none). It matches the start of a NUL terminated read,
+ * returning 0 and setting *value on a match, or 1 if there's none. Only
+ * engines counting ``edits`` set the edits and read bases the barcode took
+ * up; other engines match barcodes whole. */
+struct axe_engine {
+    enum axe_engine_type type;
+    const char *name;
+    const char *needs;  /* What build needs of the barcodes, or NULL */
+    bool edits;
+    void *(*build)(const char *const *seqs, size_t n,
+                   const struct axe_config *config);
+    void *(*state_create)(const void *index);
+    void (*state_destroy)(void *state);
+    int (*match)(const void *index, void *state, const char *seq,
+                 size_t len, intptr_t *value, size_t *edits,
+                 size_t *consumed);
+    size_t (*keys)(const void *index); /* Sequences or nodes held */
+    void (*destroy)(void *index);
+};
+
+/* What building the engine's indices took, over both reads */
+struct axe_engine_stats {
+    double build_seconds;
+    int64_t bytes;
+    size_t keys;
+};
+
+extern const struct axe_engine *const axe_engines[AXE_N_ENGINES];
+
+/* Stages of processing a read (pair). Read includes inflating and parsing,
+ * wait is waiting for other threads to finish writing, and write includes
+ * formatting, deflating and writing. */
+enum axe_stage {
+    AXE_STAGE_READ = 0,
+    AXE_STAGE_MATCH = 1,
+    AXE_STAGE_WAIT = 2,
+    AXE_STAGE_WRITE = 3,
+    AXE_N_STAGES = 4,
+};
+
+/* Stages are timed for one in this many reads, to keep timing cheap */
+#define AXE_TIMING_SAMPLE 32
+
+/* A sampled run splits the input into this many windows, and reads evenly
+ * spaced windows covering about the sample fraction of the input */
+#define AXE_SAMPLE_WINDOWS 1000
+
+/* Subsystems whose memory is counted, as qes_mem tags. libqes counts file
+ * buffers and zlib states, and datrie counts trie cells as QES_MEM_USER. */
+enum axe_mem_tag {
+    AXE_MEM_IO = QES_MEM_IO,
+    AXE_MEM_ZLIB = QES_MEM_ZLIB,
+    AXE_MEM_TRIE = QES_MEM_USER,    /* Or the whitelist index */
+    AXE_MEM_LOOKUP = QES_MEM_USER + 1,
+    AXE_N_MEM_TAGS = QES_MEM_USER + 2,
+};
+
+/* The barcode index: tries, lookup table and barcodes. A matcher only refers
+ * to its config's index, which mustn't change (or be freed) while the matcher
+ * is in use. As nothing in it changes, one matcher can be shared by any
+ * number of threads. */
+struct axe_matcher {
+    const struct axe_engine *engine;
+    const void *indices[2];     /* R1, and R2 if combinatorial */
+    size_t cache_lens[2];       /* Bases keying each read's cache, or 0 */
+    axe_pack_fn cache_packs[2]; /* Packs them */
+    ssize_t *const *barcode_lookup;
+    struct axe_barcode *const *barcodes;
+    size_t n_barcodes_1;
+    size_t n_barcodes_2;
+    size_t n_barcode_pairs;
+    size_t n_mismatch_levels;
+    size_t unknown_top;
+    size_t unknown_prefix_len[2];
+    bool combo;
+};
+
+/* Results of matching recent barcode prefixes. Reads in a lane share few
+ * prefixes, so each worker keeps a direct-mapped cache per read, keyed on
+ * the bases the engine could look at (the longest barcode, plus mismatches
+ * if matching indels) packed 2 bits each. The whole packed prefix is kept as
+ * the tag, so there are no false hits. Prefixes of over 32 bases, or with
+ * bases other than ACGT, aren't cached. */
+#define AXE_CACHE_BITS 10
+#define AXE_CACHE_SIZE (1 << AXE_CACHE_BITS)
+#define AXE_CACHE_EMPTY (-2)
+
+struct axe_cache_entry {
+    uint64_t key;               /* The packed prefix */
+    intptr_t value;             /* Barcode matched, -1, or AXE_CACHE_EMPTY */
+    uint32_t edits;
+    uint32_t consumed;
+};
+
+/* Which barcodes and sample a read (pair) matched */
+struct axe_match {
+    intptr_t bcd[2];    /* R1 and R2 barcode indices, or -1 if not matched */
+    ssize_t sample;     /* Index of the sample, or -1 if unknown */
+    size_t mismatches;  /* With the sample's barcodes, summed over both */
+    size_t lens[2];     /* Bases of R1 and R2 the barcodes took up */
+};
+
+/* One thread's counters and scratch space. Each thread matching reads needs
+ * its own worker, whose counts axe_worker_reduce adds to a config's. */
+struct axe_worker {
+    const struct axe_matcher *matcher;
+    const struct axe_engine *engine; /* The matcher's, which may go first */
+    void *states[2];            /* Its scratch, for each index */
+    struct axe_cache_entry *caches[2];
+    uint64_t cache_lookups;
+    uint64_t cache_hits;
+    uint64_t reads_processed;
+    uint64_t reads_demultiplexed;
+    uint64_t reads_failed;
+    uint64_t *counts;           /* Reads per sample */
+    uint64_t *mismatch_counts;  /* As for the config's */
+    struct axe_pair_counts *pair_counts; /* Combinatorial mode only */
+    struct axe_topk *unknown_prefixes;
+};
+
+/* Receives each read (pair) a stream demultiplexes, with the sample it
+ * matched (match->sample is -1 for unknown reads). The reads are the
+ * caller's, not copies, so are only valid until the sink returns, and seq2
+ * is NULL for single reads. Returns 0, or non-zero to stop the stream. */
+typedef int (*axe_sink_fn)(void *data, const struct axe_match *match,
+                           struct qes_seq *seq1, struct qes_seq *seq2);
+
+/* Demultiplexes reads from memory, handing each to a sink. Like a worker, a
+ * stream belongs to one thread, and its counts are reduced with
+ * axe_worker_reduce(config, stream->worker). */
+struct axe_stream {
+    struct axe_worker *worker;
+    axe_sink_fn sink;
+    void *sink_data;
+};
+
+/* Progress through one thread's part of the input, for checkpoints */
+struct axe_part {
+    struct qes_seqfile *in[2];  /* Inputs, while the part is being read */
+    off_t pos[2];               /* Their filepos after the last read written */
+    struct axe_stream *stream;  /* Writes this thread's reads to the outputs */
+    uint64_t stage_ns[AXE_N_STAGES]; /* Time in each stage of timed reads */
+    uint64_t n_reads;           /* Reads processed by this thread */
+    uint64_t n_timed;           /* Reads timed by this thread */
+    uint64_t last_ns;           /* When the next timed read began reading */
+};
+
+/* Live statistics, in a file monitoring tools can memory-map and poll. The
+ * header is followed by n_samples counts, then the n_samples sample IDs, each
+ * NUL-terminated, at names_offset. Updates happen every AXE_LIVE_READS reads.
+ * seq is odd during an update, so readers should retry if seq is odd or
+ * changes while they copy the counts. */
+#define AXE_LIVE_MAGIC "AXELIVE1"
+#define AXE_LIVE_READS 4096
+
+struct axe_live_header {
+    char magic[8];
+    uint64_t seq;
+    uint64_t n_samples;
+    uint64_t names_offset;
+    uint64_t running;           /* 0 once the run has finished */
+    uint64_t start_time;        /* Unix time the run started */
+    uint64_t update_time_ns;    /* Unix time of the last update, in ns */
+    uint64_t reads_processed;
+    uint64_t reads_demultiplexed;
+    uint64_t reads_failed;
+};
+
+/* Set (e.g. by a SIGUSR1 handler) to write a metrics snapshot */
+extern volatile sig_atomic_t axe_metrics_requested;
+
+struct axe_checkpoint;
+
 struct axe_config {
     char *barcode_file;
     char *table_file;
+    char *stats_file;
+    char *matrix_file;
     char *infiles[2];
     char *out_prefixes[2];
     struct axe_barcode **barcodes;
@@ -91,28 +424,76 @@ struct axe_config {
        Values will be 0 <= x < n_barcode_pairs. barcodes or outputs can then
        be indexed w/ this number */
     ssize_t **barcode_lookup;
-    size_t *mismatch_counts;
+    /* Unique R1 and R2 barcodes by their index in barcode_lookup. These
+       point into barcodes, so aren't freed separately */
+    char **barcode_seqs[2];
+    struct axe_pair_counts *pair_counts; /* Combinatorial mode only */
+    /* Reads per sample by number of mismatches, indexed by
+       sample * n_mismatch_levels + mismatches */
+    uint64_t *mismatch_counts;
+    size_t n_mismatch_levels;
+    struct axe_topk *unknown_prefixes; /* Barcode-length prefixes of unknown
+                                          reads (R1+R2 if combinatorial) */
+    size_t unknown_top;         /* Number of unknown prefixes to report */
+    size_t unknown_prefix_len[2];
     size_t n_barcodes_1; /* Number of first read barcodes */
     size_t n_barcodes_2; /* Number of second read barcodes */
     size_t n_barcode_pairs;
     struct axe_output *unknown_output; /* output for unknown files */
-    struct axe_trie *fwd_trie;
-    struct axe_trie *rev_trie;
+    enum axe_engine_type engine; /* As asked for */
+    const struct axe_engine *engine_ops; /* As picked by axe_make_tries */
+    void *indices[2];           /* R1 and R2 tries etc., once loaded */
+    struct axe_engine_stats engine_stats;
+    struct axe_matcher *matcher; /* The tries etc., once they're loaded */
     struct qes_logger *logger;
     enum read_mode in_mode;
     enum read_mode out_mode;
     int out_compress_level;
     size_t mismatches;
+    size_t chunk_index; /* Zero-based index of the input chunk to process */
+    size_t n_chunks;    /* Number of input chunks, or 0 to process it all */
+    size_t threads;     /* Number of parser threads */
+    struct qes_gzindex *gz_index; /* Access points of gzip input, if used */
+    char *checkpoint_file;
+    uint64_t checkpoint_every;  /* Reads between checkpoints */
+    uint64_t next_checkpoint;   /* reads_processed at the next checkpoint */
+    struct axe_checkpoint *checkpoint; /* Loaded state to resume from */
+    char *metrics_file;         /* Prometheus textfile collector file */
+    uint64_t metrics_every;     /* Seconds between rewriting it */
+    uint64_t next_metrics_ns;
+    uint64_t start_ns;          /* When processing started, and */
+    uint64_t start_reads;       /* reads_processed then */
+    char *live_file;
+    struct axe_live_header *live; /* live_file, mapped */
+    size_t live_size;
+    struct axe_part *parts;     /* One per thread */
+    size_t n_parts;
+    size_t parts_first;         /* Number of the first thread's part */
+    size_t parts_total;         /* Parts across all chunks */
+    uint64_t preview;           /* Stop after this many reads, or 0 */
+    double sample_fraction;     /* Read this fraction of the input, or 0 */
+    size_t sample_windows;      /* Windows the input is split into, */
+    size_t sample_picked;       /* and the number of them read */
+    double input_fraction;      /* Fraction of the input read, 0 if unknown */
     uint64_t reads_processed;
     uint64_t reads_demultiplexed;
     uint64_t reads_failed;
+    uint64_t reads_so_far;      /* Including those only workers count yet */
+    uint64_t cache_lookups;     /* Reads looked up in the prefix caches, */
+    uint64_t cache_hits;        /* and those of them found */
     float time_taken;
+    /* Estimated seconds spent in each stage, summed over threads */
+    double stage_seconds[AXE_N_STAGES];
     int verbosity;
     bool have_cli_opts; /* Set to 1 once CLI is parsed */
     bool match_combo;   /* Match using combinatorial strategy */
     bool permissive;    /* Don't error on mutated bcd confict */
     bool trim_rev;      /* Trim rev read same as fwd read */
     bool debug;         /* Enable debug mode */
+    bool use_gz_index;  /* Index gzip input so it can be split */
+    bool resume;        /* Resume from checkpoint_file, if it exists */
+    bool count_only;    /* Only match and count reads, writing no outputs */
+    bool estimate_memory; /* Estimate memory use, then stop */
 };
 
 extern unsigned int format_call_number;
@@ -259,19 +640,365 @@ void axe_barcode_destroy_(struct axe_barcode *barcode);
 
 
 /* This is the processing pipeline. These functions should be run in this
-   order */
+   order. axe_make_tries picks the engine, which axe_load_tries builds. */
 int axe_read_barcodes(struct axe_config *config);
 int axe_setup_barcode_lookup(struct axe_config *config);
 int axe_make_tries(struct axe_config *config);
 int axe_load_tries(struct axe_config *config);
+int axe_load_checkpoint(struct axe_config *config);
 int axe_make_outputs(struct axe_config *config);
 int axe_process_file(struct axe_config *config);
 int axe_write_table(const struct axe_config *config);
+int axe_write_manifest(struct axe_config *config);
+int axe_write_stats(const struct axe_config *config);
+int axe_write_matrix(const struct axe_config *config);
+void axe_wilson_interval(uint64_t count, uint64_t n, double *low,
+                         double *high);
 int axe_print_summary(const struct axe_config *config);
+int axe_estimate_memory(const struct axe_config *config, int64_t *bytes);
+int axe_print_memory_estimate(const struct axe_config *config);
+
+/* Output file naming, shared with axe-merge */
+char *axe_format_outfile_path(const char *prefix, const char *id, int read,
+                              const char *ext);
+char *axe_make_file_ext(const struct axe_config *config);
+char *axe_make_chunk_path(const struct axe_config *config, const char *path);
+char *axe_make_table_path(const struct axe_config *config);
+char *axe_make_manifest_path(const struct axe_config *config);
+
+/*===  FUNCTION  ============================================================*
+Name:           axe_pack_kernel
+Parameters:     size_t len: Number of bases to pack
+Description:    Picks the fastest way to pack ``len`` bases: a kernel
+                specialised to that length if there is one, otherwise a
+                loop over the bases.
+Returns:        axe_pack_fn: The packing function, or NULL if len is 0 or
+                over 32.
+ *===========================================================================*/
+axe_pack_fn axe_pack_kernel(size_t len);
+
+/*===  FUNCTION  ============================================================*
+Name:           axe_whitelist_create
+Parameters:     const char *const *seqs: Barcodes
+                size_t n: Number of barcodes
+                size_t mismatches: Maximum mismatches to match with
+Description:    Indexes barcodes for axe_whitelist_match. Barcodes must be
+                distinct, of one length of up to AXE_WHITELIST_MAX_LEN, and
+                of only ACGT, and mismatches must be less than their length.
+Returns:        struct axe_whitelist *: A valid whitelist, or NULL on error.
+ *===========================================================================*/
+struct axe_whitelist *axe_whitelist_create(const char *const *seqs, size_t n,
+                                           size_t mismatches);
+void axe_whitelist_destroy_(struct axe_whitelist *wl);
+#define axe_whitelist_destroy(wl) STMT_BEGIN                                \
+    axe_whitelist_destroy_(wl);                                             \
+    wl = NULL;                                                              \
+    STMT_END
+
+/*===  FUNCTION  ============================================================*
+Name:           axe_whitelist_match
+Parameters:     const struct axe_whitelist *wl: Whitelist to match against
+                const char *seq: Read
+                size_t len: Its length
+                intptr_t *value: Set to the index of the barcode matched,
+                    or -1
+Description:    Matches the start of a read to the only barcode within the
+                whitelist's mismatches of it. As with the tries, reads within
+                reach of several barcodes, or with bases other than ACGT in
+                their barcode, don't match.
+Returns:        int: 0 on a match, 1 if there's none, -1 on bad parameters.
+ *===========================================================================*/
+int axe_whitelist_match(const struct axe_whitelist *wl, const char *seq,
+                        size_t len, intptr_t *value);
+
+/*===  FUNCTION  ============================================================*
+Name:           axe_seed_index_create
+Parameters:     const char *const *seqs: Barcodes
+                size_t n: Number of barcodes
+                size_t mismatches: Maximum mismatches to match with
+Description:    Indexes barcodes for axe_seed_index_match. Barcodes must be
+                distinct and of only ACGT, and mismatches must be less than
+                the length of the shortest, and AXE_SEED_MAX_SEEDS.
+Returns:        struct axe_seed_index *: A valid index, or NULL on error.
+ *===========================================================================*/
+struct axe_seed_index *axe_seed_index_create(const char *const *seqs, size_t n,
+                                             size_t mismatches);
+void axe_seed_index_destroy_(struct axe_seed_index *si);
+#define axe_seed_index_destroy(si) STMT_BEGIN                               \
+    axe_seed_index_destroy_(si);                                            \
+    si = NULL;                                                              \
+    STMT_END
+
+/*===  FUNCTION  ============================================================*
+Name:           axe_seed_index_match
+Parameters:     const struct axe_seed_index *si: Index to match against
+                const char *seq: Read
+                size_t len: Its length
+                intptr_t *value: Set to the index of the barcode matched,
+                    or -1
+Description:    Matches the start of a read to the longest barcode within
+                the index's mismatches of it, as the tries do. Of barcodes
+                of one length, the nearest is taken; if two are equally
+                near, shorter barcodes are tried. Bases other than ACGT
+                never match.
+Returns:        int: 0 on a match, 1 if there's none, -1 on bad parameters.
+ *===========================================================================*/
+int axe_seed_index_match(const struct axe_seed_index *si, const char *seq,
+                         size_t len, intptr_t *value);
+
+/*===  FUNCTION  ============================================================*
+Name:           axe_edit_index_create
+Parameters:     const char *const *seqs: Barcodes
+                size_t n: Number of barcodes
+                size_t mismatches: Maximum edits to match with
+Description:    Indexes barcodes for axe_edit_index_match. Barcodes must be
+                distinct and of only ACGT, mismatches must be less than the
+                length of the shortest, and no barcode may be longer than
+                AXE_EDIT_MAX_LEN less mismatches.
+Returns:        struct axe_edit_index *: A valid index, or NULL on error.
+ *===========================================================================*/
+struct axe_edit_index *axe_edit_index_create(const char *const *seqs, size_t n,
+                                             size_t mismatches);
+void axe_edit_index_destroy_(struct axe_edit_index *ei);
+#define axe_edit_index_destroy(ei) STMT_BEGIN                               \
+    axe_edit_index_destroy_(ei);                                            \
+    ei = NULL;                                                              \
+    STMT_END
+
+/*===  FUNCTION  ============================================================*
+Name:           axe_edit_index_match
+Parameters:     const struct axe_edit_index *ei: Index to match against
+                const char *seq: Read
+                size_t len: Its length
+                intptr_t *value: Set to the index of the barcode matched,
+                    or -1
+                size_t *edits: Set to the edits between the barcode and
+                    the start of the read, if it matched
+                size_t *consumed: Set to the bases of the read the barcode
+                    took up, to trim, if it matched
+Description:    Matches the start of a read to the longest barcode within
+                the index's mismatches of it, counting substitutions,
+                insertions and deletions, as the other engines do. Of
+                barcodes of one length, the nearest is taken; if two are
+                equally near, shorter barcodes are tried. Of the read
+                lengths equally near a barcode, the nearest to its length is
+                consumed. A barcode never matches a read with other than
+                ACGT within its length of the start.
+Returns:        int: 0 on a match, 1 if there's none, -1 on bad parameters.
+ *===========================================================================*/
+int axe_edit_index_match(const struct axe_edit_index *ei, const char *seq,
+                         size_t len, intptr_t *value, size_t *edits,
+                         size_t *consumed);
+
+/*===  FUNCTION  ============================================================*
+Name:           axe_brute_index_create
+Parameters:     const char *const *seqs: Barcodes
+                size_t n: Number of barcodes
+                size_t mismatches: Maximum mismatches to match with
+                bool permissive: Whether barcodes' mutants may clash
+Description:    Packs barcodes for axe_brute_index_match, if it would match
+                reads as the tries do. There must be at most
+                AXE_BRUTE_MAX_BARCODES barcodes of only ACGT, of up to
+                AXE_BRUTE_MAX_LEN bases, and no two of a length within
+                mismatches of each other, or within twice that unless
+                permissive.
+Returns:        struct axe_brute_index *: A valid index, or NULL if the tries
+                must be used.
+ *===========================================================================*/
+struct axe_brute_index *axe_brute_index_create(const char *const *seqs,
+                                               size_t n, size_t mismatches,
+                                               bool permissive);
+void axe_brute_index_destroy_(struct axe_brute_index *bi);
+#define axe_brute_index_destroy(bi) STMT_BEGIN                              \
+    axe_brute_index_destroy_(bi);                                           \
+    bi = NULL;                                                              \
+    STMT_END
+
+/*===  FUNCTION  ============================================================*
+Name:           axe_brute_index_match
+Parameters:     const struct axe_brute_index *bi: Index to match against
+                const char *seq: Read
+                size_t len: Its length
+                intptr_t *value: Set to the index of the barcode matched,
+                    or -1
+Description:    Matches the start of a read to the longest barcode within the
+                index's mismatches of it, as the tries do. If two barcodes of
+                a length are within reach, as with --permissive, neither
+                matches, but shorter barcodes may.
+Returns:        int: 0 on a match, 1 if there's none, -1 on bad parameters.
+ *===========================================================================*/
+int axe_brute_index_match(const struct axe_brute_index *bi, const char *seq,
+                          size_t len, intptr_t *value);
+
+/*===  FUNCTION  ============================================================*
+Name:           axe_engine_find
+Parameters:     const char *name: Engine name, as given to --engine
+Description:    Looks up an engine by name. "auto" is AXE_ENGINE_AUTO.
+Returns:        int: The engine's ``enum axe_engine_type``, or -1 if there's
+                no engine of that name.
+ *===========================================================================*/
+int axe_engine_find(const char *name);
+
+/*===  FUNCTION  ============================================================*
+Name:           axe_engine_match_batch
+Parameters:     const struct axe_engine *engine: Engine to match with
+                const void *index: Index it built
+                void *state: This thread's scratch for it
+                struct qes_seq *const *seqs: Reads
+                size_t n: Number of reads
+                intptr_t *values: Set to the barcode each read matched, or -1
+Description:    Matches many reads against one index, as the engine's
+                ``match`` does each. Only barcode indices are found, so
+                edits and trimmed lengths aren't kept.
+Returns:        ssize_t: The number of reads matched, or -1 on bad
+                parameters.
+ *===========================================================================*/
+ssize_t axe_engine_match_batch(const struct axe_engine *engine,
+                               const void *index, void *state,
+                               struct qes_seq *const *seqs, size_t n,
+                               intptr_t *values);
+
+/* Heavy hitters */
+struct axe_topk *axe_topk_create(size_t capacity, size_t key_len);
+void axe_topk_destroy_(struct axe_topk *topk);
+#define axe_topk_destroy(topk) STMT_BEGIN                                   \
+    axe_topk_destroy_(topk);                                                \
+    topk = NULL;                                                            \
+    STMT_END
+struct axe_topk_entry *axe_topk_add(struct axe_topk *topk, const char *key,
+                                    size_t len, uint64_t weight);
+struct axe_topk_entry **axe_topk_sorted(const struct axe_topk *topk);
+void axe_topk_merge(struct axe_topk *dst, struct axe_topk *src);
+struct axe_pair_counts *axe_pair_counts_create(size_t n1, size_t n2,
+                                               size_t dense_max);
+void axe_pair_counts_destroy_(struct axe_pair_counts *pc);
+#define axe_pair_counts_destroy(pc) STMT_BEGIN                              \
+    axe_pair_counts_destroy_(pc);                                           \
+    pc = NULL;                                                              \
+    STMT_END
+void axe_pair_counts_add(struct axe_pair_counts *pc, size_t bcd1, size_t bcd2,
+                         uint64_t n);
+uint64_t axe_pair_counts_get(const struct axe_pair_counts *pc, size_t bcd1,
+                             size_t bcd2);
+void axe_pair_counts_merge(struct axe_pair_counts *dst,
+                          struct axe_pair_counts *src);
+
+/*===  FUNCTION  ============================================================*
+Name:           axe_matcher_create
+Parameters:     const struct axe_config *config: Config whose tries are loaded
+Description:    Creates a matcher over the config's barcode index, which any
+                number of threads can share. The config must outlive it.
+Returns:        struct axe_matcher *: A valid matcher, or NULL if the tries
+                aren't loaded.
+ *===========================================================================*/
+struct axe_matcher *axe_matcher_create(const struct axe_config *config);
+void axe_matcher_destroy_(struct axe_matcher *matcher);
+#define axe_matcher_destroy(matcher) STMT_BEGIN                             \
+    axe_matcher_destroy_(matcher);                                          \
+    matcher = NULL;                                                         \
+    STMT_END
+
+/*===  FUNCTION  ============================================================*
+Name:           axe_worker_create
+Parameters:     const struct axe_matcher *matcher: Matcher the worker uses
+Description:    Creates a worker, with zeroed counters, for one thread to match
+                and count reads with.
+Returns:        struct axe_worker *: A valid worker, or NULL on error.
+ *===========================================================================*/
+struct axe_worker *axe_worker_create(const struct axe_matcher *matcher);
+void axe_worker_destroy_(struct axe_worker *worker);
+#define axe_worker_destroy(worker) STMT_BEGIN                               \
+    axe_worker_destroy_(worker);                                            \
+    worker = NULL;                                                          \
+    STMT_END
+
+/*===  FUNCTION  ============================================================*
+Name:           axe_worker_match
+Parameters:     struct axe_worker *worker: This thread's worker
+                const struct qes_seq *seq1: R1, or the only read
+                const struct qes_seq *seq2: R2, needed only if combinatorial
+                struct axe_match *match: Filled with the match
+Description:    Matches a read (pair) to a sample, without counting it.
+Returns:        int: 0 if a sample matched, 1 if none did, -1 on bad
+                parameters.
+ *===========================================================================*/
+int axe_worker_match(struct axe_worker *worker, const struct qes_seq *seq1,
+                     const struct qes_seq *seq2, struct axe_match *match);
+
+/*===  FUNCTION  ============================================================*
+Name:           axe_worker_count
+Parameters:     struct axe_worker *worker: This thread's worker
+                const struct axe_match *match: From axe_worker_match
+                const struct qes_seq *seq1, *seq2: The reads matched
+Description:    Counts a matched read (pair) in the worker's counters, and the
+                barcode-length prefix of an unknown one.
+Returns:        int: 0 on success, -1 on bad parameters.
+ *===========================================================================*/
+int axe_worker_count(struct axe_worker *worker, const struct axe_match *match,
+                     const struct qes_seq *seq1, const struct qes_seq *seq2);
+
+/*===  FUNCTION  ============================================================*
+Name:           axe_worker_reduce
+Parameters:     struct axe_config *config: Config the worker's matcher is over
+                struct axe_worker *worker: Worker whose counts to merge
+Description:    Adds a worker's counts to the config's totals, and zeroes them.
+                Nothing else may use the worker or config meanwhile.
+Returns:        int: 0 on success, -1 on bad parameters.
+ *===========================================================================*/
+int axe_worker_reduce(struct axe_config *config, struct axe_worker *worker);
+
+/*===  FUNCTION  ============================================================*
+Name:           axe_stream_create
+Parameters:     const struct axe_matcher *matcher: Matcher the stream uses
+                axe_sink_fn sink: Called with each read (pair)
+                void *data: Passed to sink
+Description:    Creates a stream, which demultiplexes reads held in memory for
+                one thread.
+Returns:        struct axe_stream *: A valid stream, or NULL on error.
+ *===========================================================================*/
+struct axe_stream *axe_stream_create(const struct axe_matcher *matcher,
+                                     axe_sink_fn sink, void *data);
+void axe_stream_destroy_(struct axe_stream *stream);
+#define axe_stream_destroy(stream) STMT_BEGIN                               \
+    axe_stream_destroy_(stream);                                            \
+    stream = NULL;                                                          \
+    STMT_END
+
+/*===  FUNCTION  ============================================================*
+Name:           axe_stream_read
+Parameters:     struct axe_stream *stream: This thread's stream
+                struct qes_seq *seq1: R1, or the only read
+                struct qes_seq *seq2: R2, or NULL for single reads
+Description:    Matches a read (pair), counts it, and hands it to the sink.
+                This is axe_stream_match then axe_stream_emit, which callers
+                needing to lock around emitting (but not matching) can call
+                themselves.
+Returns:        int: 0 on success, 1 if the sink returned non-zero, -1 on bad
+                parameters.
+ *===========================================================================*/
+int axe_stream_read(struct axe_stream *stream, struct qes_seq *seq1,
+                    struct qes_seq *seq2);
+int axe_stream_match(struct axe_stream *stream, const struct qes_seq *seq1,
+                     const struct qes_seq *seq2, struct axe_match *match);
+int axe_stream_emit(struct axe_stream *stream, const struct axe_match *match,
+                    struct qes_seq *seq1, struct qes_seq *seq2);
+
+/*===  FUNCTION  ============================================================*
+Name:           axe_stream_batch
+Parameters:     struct axe_stream *stream: This thread's stream
+                struct qes_seq *const *seq1: n R1 reads
+                struct qes_seq *const *seq2: n R2 reads, or NULL if single
+                size_t n: Number of reads (pairs)
+Description:    Calls axe_stream_read for each read (pair) of a batch, stopping
+                early if the sink does.
+Returns:        int: As for axe_stream_read.
+ *===========================================================================*/
+int axe_stream_batch(struct axe_stream *stream, struct qes_seq *const *seq1,
+                     struct qes_seq *const *seq2, size_t n);
 
 /* Libraries or inner functions */
-extern int axe_match_read(struct axe_config *config, intptr_t *value,
-                          struct axe_trie *trie, const struct qes_seq *seq);
+extern int axe_match_read(intptr_t *value, const struct axe_trie *trie,
+                          const struct qes_seq *seq);
 int product(int64_t len, int64_t elem, uintptr_t *choices, int at_start);
 char **hamming_mutate_dna(size_t *n_results_o, const char *str, size_t len,
                           unsigned int dist, int keep_original);
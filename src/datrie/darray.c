@@ -186,7 +186,9 @@ da_new (void)
         return NULL;
 
     d->num_cells = DA_POOL_BEGIN;
-    d->cells     = (DACell *) malloc (d->num_cells * sizeof (DACell));
+    d->cells     = (DACell *) qes_malloc_tagged_ (d->num_cells * sizeof (DACell),
+                                                  TRIE_MEM_TAG, errnil,
+                                                  __FILE__, __LINE__);
     if (!d->cells)
         goto exit_da_created;
     d->cells[0].base = DA_SIGNATURE;
@@ -213,7 +215,7 @@ exit_da_created:
 void
 da_free (DArray *d)
 {
-    free (d->cells);
+    qes_free_tagged (d->cells, d->num_cells * sizeof (DACell), TRIE_MEM_TAG);
     free (d);
 }
 
@@ -554,6 +556,7 @@ static bool
 da_extend_pool     (DArray         *d,
                     TrieIndex       to_index)
 {
+    void       *new_block;
     TrieIndex   new_begin;
     TrieIndex   i;
     TrieIndex   free_tail;
@@ -564,7 +567,13 @@ da_extend_pool     (DArray         *d,
     if (to_index < d->num_cells)
         return true;
 
-    d->cells = (DACell *) realloc (d->cells, (to_index + 1) * sizeof (DACell));
+    new_block = qes_realloc_tagged_ (d->cells, d->num_cells * sizeof (DACell),
+                                     (to_index + 1) * sizeof (DACell),
+                                     TRIE_MEM_TAG, errnil, __FILE__, __LINE__);
+    if (!new_block)
+        return false;
+
+    d->cells = (DACell *) new_block;
     new_begin = d->num_cells;
     d->num_cells = to_index + 1;
 
@@ -31,6 +31,7 @@
 #endif
 #include <stdio.h>
 
+#include "trie-private.h"
 #include "tail.h"
 
 /*----------------------------------*
@@ -44,6 +45,10 @@
 static TrieIndex    tail_alloc_block (Tail *t);
 static void         tail_free_block (Tail *t, TrieIndex block);
 
+/* Suffixes are strdup()ed, and counted against TRIE_MEM_TAG */
+#define tail_free_suffix(suffix) \
+    qes_free_tagged (suffix, strlen ((const char *)(suffix)) + 1, TRIE_MEM_TAG)
+
 /* ==================== BEGIN IMPLEMENTATION PART ====================  */
 
 /*------------------------------------*
@@ -123,8 +128,9 @@ tail_free (Tail *t)
     if (t->tails) {
         for (i = 0; i < t->num_tails; i++)
             if (t->tails[i].suffix)
-                free (t->tails[i].suffix);
-        free (t->tails);
+                tail_free_suffix (t->tails[i].suffix);
+        qes_free_tagged (t->tails, t->num_tails * sizeof (TailBlock),
+                         TRIE_MEM_TAG);
     }
     free (t);
 }
@@ -167,10 +173,13 @@ tail_set_suffix (Tail *t, TrieIndex index, const TrieChar *suffix)
          * so, dup it before it's overwritten
          */
         TrieChar *tmp = NULL;
-        if (suffix)
+        if (suffix) {
             tmp = (TrieChar *) strdup ((const char *)suffix);
+            if (tmp)
+                qes_mem_account (TRIE_MEM_TAG, strlen ((const char *)tmp) + 1);
+        }
         if (t->tails[index].suffix)
-            free (t->tails[index].suffix);
+            tail_free_suffix (t->tails[index].suffix);
         t->tails[index].suffix = tmp;
 
         return true;
@@ -209,8 +218,11 @@ tail_alloc_block (Tail *t)
         t->first_free = t->tails[block].next_free;
     } else {
         block = t->num_tails;
-        t->tails = (TailBlock *) realloc (t->tails,
-                                          ++t->num_tails * sizeof (TailBlock));
+        t->tails = (TailBlock *) qes_realloc_tagged (t->tails,
+                                          t->num_tails * sizeof (TailBlock),
+                                          (t->num_tails + 1) * sizeof (TailBlock),
+                                          TRIE_MEM_TAG);
+        ++t->num_tails;
     }
     t->tails[block].next_free = -1;
     t->tails[block].data = TRIE_DATA_ERROR;
@@ -231,7 +243,7 @@ tail_free_block (Tail *t, TrieIndex block)
 
     t->tails[block].data = TRIE_DATA_ERROR;
     if (NULL != t->tails[block].suffix) {
-        free (t->tails[block].suffix);
+        tail_free_suffix (t->tails[block].suffix);
         t->tails[block].suffix = NULL;
     }
 
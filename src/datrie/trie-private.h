@@ -28,6 +28,7 @@
 #define __TRIE_PRIVATE_H
 
 #include <datrie/typedefs.h>
+#include <qes_util.h>
 
 /**
  * @file trie-private.h
@@ -42,6 +43,11 @@
  * @brief Maximum value macro
  */
 #define MAX_VAL(a,b)  ((a)>(b)?(a):(b))
+/**
+ * @brief Tag that double-array and tail memory is counted against, for
+ * qes_mem_current() and qes_mem_peak()
+ */
+#define TRIE_MEM_TAG  QES_MEM_USER
 
 #endif  /* __TRIE_PRIVATE_H */
 
@@ -28,6 +28,128 @@
 
 #include "qes_file.h"
 
+#include "qes_libgnu.h"
+
+#include <fcntl.h>
+
+struct qes_file_sink {
+    int fd;
+    int compress;           /* Write gzip, not the data as is */
+    int failed;
+    uint64_t synced;        /* data_size at the last qes_file_sync */
+#ifdef ZLIB_FOUND
+    z_stream strm;
+    unsigned char out[QES_FILEBUFFER_LEN];
+#endif
+    struct qes_file_sums sums;
+};
+
+/* Writes all of ``buf`` to disk, summing it as it goes */
+static int
+__qes_sink_output(struct qes_file_sink *sink, const char *buf, size_t len)
+{
+    ssize_t res = 0;
+
+    sink->sums.crc = crc32_update(sink->sums.crc, buf, len);
+    sink->sums.size += len;
+    while (len > 0) {
+        res = write(sink->fd, buf, len);
+        if (res < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return 1;
+        }
+        buf += res;
+        len -= res;
+    }
+    return 0;
+}
+
+/* Compresses ``buf`` if needed and writes it out. ``finish`` ends the gzip
+ * stream. */
+static int
+__qes_sink_write(struct qes_file_sink *sink, const char *buf, size_t len,
+                 int finish)
+{
+#ifdef ZLIB_FOUND
+    size_t have = 0;
+    int ret = 0;
+#endif
+
+    if (len > 0) {
+        sink->sums.data_crc = crc32_update(sink->sums.data_crc, buf, len);
+        sink->sums.data_size += len;
+    }
+    if (!sink->compress) {
+        return __qes_sink_output(sink, buf, len);
+    }
+#ifdef ZLIB_FOUND
+    sink->strm.next_in = (Bytef *)buf;
+    sink->strm.avail_in = len;
+    do {
+        sink->strm.next_out = sink->out;
+        sink->strm.avail_out = sizeof(sink->out);
+        ret = deflate(&sink->strm, finish ? Z_FINISH : Z_NO_FLUSH);
+        if (ret == Z_STREAM_ERROR) {
+            return 1;
+        }
+        have = sizeof(sink->out) - sink->strm.avail_out;
+        if (have > 0 &&
+                __qes_sink_output(sink, (char *)sink->out, have) != 0) {
+            return 1;
+        }
+    } while (sink->strm.avail_out == 0);
+#else
+    (void) finish;
+#endif
+    return 0;
+}
+
+/* Writes out what has been buffered by __qes_file_sink_put */
+static int
+__qes_file_flush_sink(struct qes_file *file)
+{
+    size_t len = file->bufiter - file->buffer;
+
+    file->bufiter = file->buffer;
+    if (len == 0) {
+        return 0;
+    }
+    if (__qes_sink_write(file->sink, file->buffer, len, 0) != 0) {
+        file->sink->failed = 1;
+        return 1;
+    }
+    return 0;
+}
+
+static int
+__qes_file_sink_put(struct qes_file *file, const char *buf, size_t len)
+{
+    size_t space = 0;
+
+    if (file->sink->fd < 0 || file->sink->failed) {
+        return -1;
+    }
+    while (len > 0) {
+        space = QES_FILEBUFFER_LEN - (file->bufiter - file->buffer);
+        if (space == 0) {
+            if (__qes_file_flush_sink(file) != 0) {
+                return -1;
+            }
+            continue;
+        }
+        if (space > len) {
+            space = len;
+        }
+        memcpy(file->bufiter, buf, space);
+        file->bufiter += space;
+        buf += space;
+        len -= space;
+    }
+    return 0;
+}
+
 static int
 __qes_file_fill_buffer (struct qes_file *file)
 {
@@ -40,7 +162,12 @@ __qes_file_fill_buffer (struct qes_file *file)
         file->eof = 1;
         return EOF;
     }
-    res = QES_ZREAD(file->fp, file->buffer, QES_FILEBUFFER_LEN - 1);
+    if (file->reader != NULL) {
+        res = file->reader(file->reader_data, file->buffer,
+                           QES_FILEBUFFER_LEN - 1);
+    } else {
+        res = QES_ZREAD(file->fp, file->buffer, QES_FILEBUFFER_LEN - 1);
+    }
     if (res < 0) {
         /* Errored */
         return 0;
@@ -59,6 +186,50 @@ __qes_file_fill_buffer (struct qes_file *file)
     return 1;
 }
 
+/* zlib allocates a gzFile's state itself, so we can only estimate it: the
+ * input and output buffers at gzbuffer's default size, plus inflate's state
+ * and 32K window, or deflate's state at the default window and memLevel
+ * (see zconf.h) */
+#define QES_INFLATE_MEM (7200 + (1 << 15))
+#define QES_DEFLATE_MEM (6000 + (1 << 17) + (1 << 17))
+#define QES_GZREAD_MEM (8192 + 16384 + QES_INFLATE_MEM)
+#define QES_GZWRITE_MEM (16384 + 8192 + QES_DEFLATE_MEM)
+
+static struct qes_file *
+__qes_file_setup (struct qes_file *qf, const char *path, const char *mode,
+                  qes_errhandler_func onerr, const char *file, int line)
+{
+    qf->mode = qes_file_guess_mode(mode);
+    if (qf->mode == QES_FILE_MODE_UNKNOWN) {
+        if (qf->fp != NULL) QES_ZCLOSE(qf->fp);
+        qes_free(qf);
+        return NULL;
+    }
+    qf->buffer = qes_calloc_tagged_(sizeof(*qf->buffer),  QES_FILEBUFFER_LEN,
+            QES_MEM_IO, onerr, file, line);
+    if (qf->buffer == NULL) {
+        if (qf->fp != NULL) QES_ZCLOSE(qf->fp);
+        qes_free(qf);
+        (*onerr)("Coudn't allocate buffer memory", file, line);
+        return NULL;
+    }
+    qf->bufiter = qf->buffer;
+    qf->buffer[0] = '\0';
+    qf->bufend = qf->buffer;
+    /* init struct fields */
+    qf->eof = 0;
+    qf->filepos = 0;
+    qf->path = strndup(path, QES_MAX_FN_LEN);
+#ifdef ZLIB_FOUND
+    if (qf->fp != NULL) {
+        qf->zmem = qf->mode == QES_FILE_MODE_READ ? QES_GZREAD_MEM
+                                                  : QES_GZWRITE_MEM;
+        qes_mem_account(QES_MEM_ZLIB, (int64_t)qf->zmem);
+    }
+#endif
+    return(qf);
+}
+
 struct qes_file *
 qes_file_open_ (const char *path, const char *mode, qes_errhandler_func onerr,
                 const char *file, int line)
@@ -88,28 +259,256 @@ qes_file_open_ (const char *path, const char *mode, qes_errhandler_func onerr,
         qes_free(qf);
         return(NULL);
     }
-    qf->mode = qes_file_guess_mode(mode);
-    if (qf->mode == QES_FILE_MODE_UNKNOWN) {
-        QES_ZCLOSE(qf->fp);
-        qes_free(qf);
+    return __qes_file_setup(qf, path, mode, onerr, file, line);
+}
+
+struct qes_file *
+qes_file_open_offset_ (const char *path, const char *mode, off_t offset,
+                       qes_errhandler_func onerr, const char *file, int line)
+{
+    struct qes_file *qf = NULL;
+    int fd = -1;
+
+    if (path == NULL || mode == NULL || onerr == NULL || file == NULL ||
+            offset < 0 || qes_file_guess_mode(mode) != QES_FILE_MODE_READ) {
         return NULL;
     }
-    qf->buffer = qes_calloc_(sizeof(*qf->buffer),  QES_FILEBUFFER_LEN,
-            onerr, file, line);
-    if (qf->buffer == NULL) {
-        QES_ZCLOSE(qf->fp);
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        (*onerr)("Opening file %s failed:\n%s\n", file, line,
+                path, strerror(errno));
+        return NULL;
+    }
+    /* The z*dopen functions start reading from the current offset of the
+     * descriptor, which lets us start at any gzip member boundary (or
+     * anywhere at all in a plain text file). */
+    if (lseek(fd, offset, SEEK_SET) != offset) {
+        (*onerr)("Seeking to %lld in %s failed:\n%s\n", file, line,
+                (long long)offset, path, strerror(errno));
+        close(fd);
+        return NULL;
+    }
+    qf = qes_calloc(1, sizeof(*qf));
+    qf->fp = QES_ZDOPEN(fd, mode);
+    if (qf->fp == NULL) {
+        (*onerr)("Opening file %s failed:\n%s\n", file, line,
+                path, strerror(errno));
+        close(fd);
         qes_free(qf);
-        (*onerr)("Coudn't allocate buffer memory", file, line);
         return NULL;
     }
-    qf->bufiter = qf->buffer;
-    qf->buffer[0] = '\0';
-    qf->bufend = qf->buffer;
-    /* init struct fields */
-    qf->eof = 0;
-    qf->filepos = 0;
-    qf->path = strndup(path, QES_MAX_FN_LEN);
-    return(qf);
+    return __qes_file_setup(qf, path, mode, onerr, file, line);
+}
+
+struct qes_file *
+qes_file_open_reader_ (const char *path, qes_file_read_func reader,
+                       qes_file_free_func reader_free, void *data,
+                       qes_errhandler_func onerr, const char *file, int line)
+{
+    struct qes_file *qf = NULL;
+
+    if (path == NULL || reader == NULL || onerr == NULL || file == NULL) {
+        return NULL;
+    }
+    qf = qes_calloc(1, sizeof(*qf));
+    qf->reader = reader;
+    qf->reader_free = reader_free;
+    qf->reader_data = data;
+    return __qes_file_setup(qf, path, "r", onerr, file, line);
+}
+
+struct qes_file *
+qes_file_open_summed_ (const char *path, const char *mode,
+                       qes_errhandler_func onerr, const char *file, int line)
+{
+    struct qes_file_sink *sink = NULL;
+    struct qes_file *qf = NULL;
+    const char *chr = NULL;
+    int flags = O_WRONLY | O_CREAT;
+#ifdef ZLIB_FOUND
+    int level = Z_DEFAULT_COMPRESSION;
+    int strategy = Z_DEFAULT_STRATEGY;
+#endif
+
+    if (path == NULL || mode == NULL || onerr == NULL || file == NULL ||
+            qes_file_guess_mode(mode) != QES_FILE_MODE_WRITE) {
+        return NULL;
+    }
+    sink = qes_calloc_tagged(1, sizeof(*sink), QES_MEM_IO);
+    flags |= mode[0] == 'a' ? O_APPEND : O_TRUNC;
+#ifdef ZLIB_FOUND
+    /* Parse the mode as gzopen does */
+    sink->compress = 1;
+    for (chr = mode + 1; *chr != '\0'; chr++) {
+        if (*chr >= '0' && *chr <= '9') {
+            level = *chr - '0';
+        } else if (*chr == 'T') {
+            sink->compress = 0;
+        } else if (*chr == 'f') {
+            strategy = Z_FILTERED;
+        } else if (*chr == 'h') {
+            strategy = Z_HUFFMAN_ONLY;
+        } else if (*chr == 'R') {
+            strategy = Z_RLE;
+        } else if (*chr == 'F') {
+            strategy = Z_FIXED;
+        }
+    }
+    sink->strm.zalloc = qes_zalloc;
+    sink->strm.zfree = qes_zfree;
+    /* 15 + 16: max window, with a gzip header */
+    if (sink->compress &&
+            deflateInit2(&sink->strm, level, Z_DEFLATED, 15 + 16, 8,
+                         strategy) != Z_OK) {
+        (*onerr)("Couldn't initialise compression for %s\n", file, line,
+                path);
+        qes_free_tagged(sink, sizeof(*sink), QES_MEM_IO);
+        return NULL;
+    }
+#else
+    (void) chr;
+#endif
+    sink->fd = open(path, flags, 0666);
+    if (sink->fd < 0) {
+        (*onerr)("Opening file %s failed:\n%s\n", file, line,
+                path, strerror(errno));
+#ifdef ZLIB_FOUND
+        if (sink->compress) {
+            deflateEnd(&sink->strm);
+        }
+#endif
+        qes_free_tagged(sink, sizeof(*sink), QES_MEM_IO);
+        return NULL;
+    }
+    qf = qes_calloc(1, sizeof(*qf));
+    qf->sink = sink;
+    qf = __qes_file_setup(qf, path, mode, onerr, file, line);
+    if (qf == NULL) {
+        close(sink->fd);
+#ifdef ZLIB_FOUND
+        if (sink->compress) {
+            deflateEnd(&sink->strm);
+        }
+#endif
+        qes_free_tagged(sink, sizeof(*sink), QES_MEM_IO);
+    }
+    return qf;
+}
+
+int
+qes_file_finish (struct qes_file *file)
+{
+    struct qes_file_sink *sink = NULL;
+    int ret = 0;
+
+    if (file == NULL || file->sink == NULL) {
+        return -1;
+    }
+    sink = file->sink;
+    if (sink->fd < 0) {
+        /* Already finished */
+        return sink->failed;
+    }
+    ret = sink->failed || __qes_file_flush_sink(file) != 0;
+#ifdef ZLIB_FOUND
+    if (sink->compress) {
+        /* A synced file already ends in a complete member. Files with no
+         * members at all get an empty one, as gzclose would write. */
+        if (!ret && (sink->sums.size == 0 ||
+                     sink->sums.data_size != sink->synced)) {
+            ret = __qes_sink_write(sink, NULL, 0, 1) != 0;
+        }
+        deflateEnd(&sink->strm);
+    }
+#endif
+    if (close(sink->fd) != 0) {
+        ret = 1;
+    }
+    sink->fd = -1;
+    sink->failed = ret;
+    return ret;
+}
+
+int
+qes_file_sync (struct qes_file *file)
+{
+    struct qes_file_sink *sink = NULL;
+
+    if (file == NULL || file->sink == NULL || file->sink->fd < 0) {
+        return -1;
+    }
+    sink = file->sink;
+    if (sink->failed || __qes_file_flush_sink(file) != 0) {
+        return 1;
+    }
+    if (sink->sums.data_size == sink->synced) {
+        /* Don't add empty gzip members */
+        return 0;
+    }
+    sink->synced = sink->sums.data_size;
+#ifdef ZLIB_FOUND
+    if (sink->compress) {
+        if (__qes_sink_write(sink, NULL, 0, 1) != 0 ||
+                deflateReset(&sink->strm) != Z_OK) {
+            sink->failed = 1;
+            return 1;
+        }
+    }
+#endif
+    return 0;
+}
+
+int
+qes_file_set_sums (struct qes_file *file, const struct qes_file_sums *sums)
+{
+    if (file == NULL || file->sink == NULL || sums == NULL ||
+            file->sink->sums.data_size > 0) {
+        return -1;
+    }
+    file->sink->sums = *sums;
+    file->sink->synced = sums->data_size;
+    return 0;
+}
+
+int
+qes_file_sums (const struct qes_file *file, struct qes_file_sums *sums)
+{
+    if (file == NULL || file->sink == NULL || sums == NULL) {
+        return -1;
+    }
+    *sums = file->sink->sums;
+    return 0;
+}
+
+int
+qes_file_mem_estimate (const char *mode, int summed, int64_t *io,
+                       int64_t *zlib)
+{
+    enum qes_file_mode fmode = QES_FILE_MODE_UNKNOWN;
+
+    if (mode == NULL || io == NULL || zlib == NULL) {
+        return -1;
+    }
+    fmode = qes_file_guess_mode(mode);
+    if (fmode == QES_FILE_MODE_UNKNOWN ||
+            (summed && fmode != QES_FILE_MODE_WRITE)) {
+        return -1;
+    }
+    *io = QES_FILEBUFFER_LEN;
+    *zlib = 0;
+    if (summed) {
+        *io += sizeof(struct qes_file_sink);
+#ifdef ZLIB_FOUND
+        if (strchr(mode, 'T') == NULL) {
+            *zlib = QES_DEFLATE_MEM;
+        }
+#endif
+        return 0;
+    }
+#ifdef ZLIB_FOUND
+    *zlib = fmode == QES_FILE_MODE_READ ? QES_GZREAD_MEM : QES_GZWRITE_MEM;
+#endif
+    return 0;
 }
 
 enum qes_file_mode
@@ -126,7 +525,7 @@ qes_file_guess_mode (const char *mode)
 void
 qes_file_rewind (struct qes_file *file)
 {
-    if (qes_file_ok(file)) {
+    if (qes_file_ok(file) && file->fp != NULL) {
         QES_ZSEEK(file->fp, 0, SEEK_SET);
         file->filepos = 0;
         file->eof = 0;
@@ -143,8 +542,16 @@ qes_file_close_ (struct qes_file *file)
         if (file->fp != NULL) {
             QES_ZCLOSE(file->fp);
         }
+        if (file->reader_free != NULL) {
+            file->reader_free(file->reader_data);
+        }
+        if (file->sink != NULL) {
+            qes_file_finish(file);
+            qes_free_tagged(file->sink, sizeof(*file->sink), QES_MEM_IO);
+        }
+        qes_mem_account(QES_MEM_ZLIB, -(int64_t)file->zmem);
         qes_free(file->path);
-        qes_free(file->buffer);
+        qes_free_tagged(file->buffer, QES_FILEBUFFER_LEN, QES_MEM_IO);
         file->bufiter = NULL;
         file->bufend = NULL;
         qes_free(file);
@@ -162,6 +569,9 @@ qes_file_error (struct qes_file *file)
         /* Never return NULL, or we'll SIGSEGV printf */
         return "BAD FILE";
     }
+    if (file->fp == NULL) {
+        return errno != 0 ? strerror(errno) : "";
+    }
 #ifdef ZLIB_FOUND
     errstr = gzerror(file->fp, &error);
     if (error == Z_ERRNO) {
@@ -228,6 +638,12 @@ qes_file_peek(struct qes_file *file)
 int
 qes_file_putstr(struct qes_file *stream, const struct qes_str *str)
 {
+    if (stream != NULL && stream->sink != NULL) {
+        if (__qes_file_sink_put(stream, str->str, str->len) != 0) {
+            return 0;
+        }
+        return str->len;
+    }
     /* TODO: use the buffer in write mode */
     return QES_ZWRITE(stream->fp, str->str, str->len);
 }
@@ -235,9 +651,18 @@ qes_file_putstr(struct qes_file *stream, const struct qes_str *str)
 int
 qes_file_puts(struct qes_file *file, const char *str)
 {
+    size_t len = 0;
+
     if (!qes_file_ok(file) || !qes_file_writable(file)) {
         return -2;
     }
+    if (file->sink != NULL) {
+        len = strlen(str);
+        if (__qes_file_sink_put(file, str, len) != 0) {
+            return -1;
+        }
+        return len;
+    }
     return QES_ZFPUTS(file->fp, str);
 }
 
@@ -245,9 +670,19 @@ int
 qes_file_putc(struct qes_file *file, const int chr)
 {
     int res = 0;
+    char byte = chr;
+
     if (!qes_file_ok(file) || !qes_file_writable(file)) {
         return -2;
     }
+    if (file->sink != NULL) {
+        if (file->bufiter < file->buffer + QES_FILEBUFFER_LEN &&
+                file->sink->fd >= 0 && !file->sink->failed) {
+            *file->bufiter++ = byte;
+            return 1;
+        }
+        return __qes_file_sink_put(file, &byte, 1) == 0 ? 1 : -1;
+    }
     res = QES_ZFPUTC(file->fp, chr);
     if (res != chr) {
         return -1;
@@ -265,9 +700,40 @@ qes_file_getc(struct qes_file *file)
     if (file->eof) {
         return EOF;
     }
+    file->filepos++;
     return (file->bufiter++)[0];
 }
 
+ssize_t
+qes_file_skip(struct qes_file *file, size_t len)
+{
+    size_t skipped = 0;
+    size_t tocpy = 0;
+    int ret = 0;
+
+    if (!qes_file_ok(file) || file->mode != QES_FILE_MODE_READ) {
+        return -2;
+    }
+    while (skipped < len) {
+        if (file->bufiter >= file->bufend) {
+            ret = __qes_file_fill_buffer(file);
+            if (ret == 0) {
+                return -2;
+            } else if (ret == EOF) {
+                break;
+            }
+        }
+        tocpy = file->bufend - file->bufiter;
+        if (tocpy > len - skipped) {
+            tocpy = len - skipped;
+        }
+        file->bufiter += tocpy;
+        skipped += tocpy;
+    }
+    file->filepos += skipped;
+    return skipped;
+}
+
 ssize_t
 qes_file_getuntil_realloc_(struct qes_file *file, int delim, char **bufref,
                            size_t *sizeref, qes_errhandler_func onerr,
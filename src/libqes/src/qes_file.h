@@ -38,8 +38,33 @@ enum qes_file_mode {
     QES_FILE_MODE_WRITE
 };
 
+/* A custom source of bytes for a read-mode qes_file. Returns the number of
+ * bytes read into ``buf``, 0 at EOF or -1 on error. */
+typedef ssize_t (*qes_file_read_func)(void *data, char *buf, size_t len);
+typedef void (*qes_file_free_func)(void *data);
+
+/* Checksums of what has been written to a file opened with
+ * qes_file_open_summed. ``crc`` and ``size`` cover the bytes written to disk,
+ * ``data_crc`` and ``data_size`` the data before compression. Both are the
+ * CRC-32 used by gzip. */
+struct qes_file_sums {
+    uint32_t crc;
+    uint64_t size;
+    uint32_t data_crc;
+    uint64_t data_size;
+};
+
+/* Private state of a file opened with qes_file_open_summed */
+struct qes_file_sink;
+
 struct qes_file {
     QES_ZTYPE fp;
+    /* If set, bytes are read from reader(reader_data, ...) instead of fp */
+    qes_file_read_func reader;
+    qes_file_free_func reader_free;
+    void *reader_data;
+    /* If set, bytes are written via buffer to sink instead of fp */
+    struct qes_file_sink *sink;
     char *path;
     char *buffer;
     char *bufiter;
@@ -50,6 +75,8 @@ struct qes_file {
     int eof;
     /* Is the fp at EOF */
     int feof;
+    /* Estimated memory of fp's zlib state, counted as QES_MEM_ZLIB */
+    size_t zmem;
 };
 
 /* qes_file_open:
@@ -70,6 +97,139 @@ struct qes_file *qes_file_open_(const char             *path,
 #define qes_file_open_errprintexit(pth, mod)                                \
     qes_file_open_(pth, mod, errprintexit, __FILE__, __LINE__)
 
+/*===  FUNCTION  ============================================================*
+Name:           qes_file_open_offset
+Parameters:     const char *path: Path to open.
+                const char *mode: Mode, which must be a read mode.
+                off_t offset: Raw byte offset into ``path`` to start at.
+Description:    Opens ``path`` for reading, starting at ``offset`` bytes into
+                the underlying file. For compressed files, ``offset`` must be
+                the start of a gzip member (e.g. a BGZF block). The
+                ``filepos`` member counts (uncompressed) bytes from
+                ``offset``.
+Returns:        struct qes_file *: An opened file, or NULL on error.
+ *===========================================================================*/
+struct qes_file *qes_file_open_offset_
+                               (const char             *path,
+                                const char             *mode,
+                                off_t                   offset,
+                                qes_errhandler_func     onerr,
+                                const char             *file,
+                                int                     line);
+#define qes_file_open_offset(pth, mod, off)                                 \
+    qes_file_open_offset_(pth, mod, off, QES_DEFAULT_ERR_FN, __FILE__, __LINE__)
+#define qes_file_open_offset_errnil(pth, mod, off)                          \
+    qes_file_open_offset_(pth, mod, off, errnil, __FILE__, __LINE__)
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_file_open_reader
+Parameters:     const char *path: Path for error messages only.
+                qes_file_read_func reader: Function supplying file contents.
+                qes_file_free_func reader_free: Frees ``data`` on close. May
+                    be NULL.
+                void *data: Passed to ``reader`` and ``reader_free``.
+Description:    Creates a read-mode ``struct qes_file`` that reads through
+                ``reader``, e.g. to decompress part of a file via an index.
+                The file owns ``data`` once this returns successfully.
+Returns:        struct qes_file *: An opened file, or NULL on error.
+ *===========================================================================*/
+struct qes_file *qes_file_open_reader_
+                               (const char             *path,
+                                qes_file_read_func      reader,
+                                qes_file_free_func      reader_free,
+                                void                   *data,
+                                qes_errhandler_func     onerr,
+                                const char             *file,
+                                int                     line);
+#define qes_file_open_reader(pth, rdr, fre, dat)                            \
+    qes_file_open_reader_(pth, rdr, fre, dat, QES_DEFAULT_ERR_FN, __FILE__, \
+                          __LINE__)
+
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_file_open_summed
+Parameters:     const char *path: Path to open.
+                const char *mode: Write or append mode, as for
+                    ``qes_file_open``.
+Description:    Opens ``path`` for writing like ``qes_file_open``, but
+                compresses the data itself so that checksums of both the
+                uncompressed data and the bytes on disk can be kept as they
+                are written. See ``qes_file_sums``. When appending, only the
+                bytes written through this file are summed.
+Returns:        struct qes_file *: An opened file, or NULL on error.
+ *===========================================================================*/
+struct qes_file *qes_file_open_summed_
+                               (const char             *path,
+                                const char             *mode,
+                                qes_errhandler_func     onerr,
+                                const char             *file,
+                                int                     line);
+#define qes_file_open_summed(pth, mod)                                      \
+    qes_file_open_summed_(pth, mod, QES_DEFAULT_ERR_FN, __FILE__, __LINE__)
+#define qes_file_open_summed_errnil(pth, mod)                               \
+    qes_file_open_summed_(pth, mod, errnil, __FILE__, __LINE__)
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_file_finish
+Parameters:     struct qes_file *file: File opened by ``qes_file_open_summed``.
+Description:    Writes any buffered data, ends the compressed stream and
+                closes the underlying file, so that the sums are final. Any
+                later writes fail. ``qes_file_close`` calls this if needed.
+Returns:        int: 0 on success, 1 on failure, -1 on bad parameters.
+ *===========================================================================*/
+int qes_file_finish            (struct qes_file        *file);
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_file_sync
+Parameters:     struct qes_file *file: File opened by ``qes_file_open_summed``.
+Description:    Writes out any buffered data and, when compressing, ends the
+                current gzip member, so that the file on disk is complete and
+                can later be truncated back to its current size and appended
+                to. Later writes start a new gzip member. Does nothing to the
+                stream if nothing has been written since the last sync.
+Returns:        int: 0 on success, 1 on failure, -1 on bad parameters.
+ *===========================================================================*/
+int qes_file_sync              (struct qes_file        *file);
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_file_set_sums
+Parameters:     struct qes_file *file: File opened by ``qes_file_open_summed``
+                    in append mode, before anything is written.
+                const struct qes_file_sums *sums: Sums of the existing file.
+Description:    Continues the sums of a file being appended to, so they cover
+                the whole file.
+Returns:        int: 0 on success, -1 on bad parameters.
+ *===========================================================================*/
+int qes_file_set_sums          (struct qes_file        *file,
+                                const struct qes_file_sums *sums);
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_file_sums
+Parameters:     const struct qes_file *file: File opened by
+                    ``qes_file_open_summed``.
+                struct qes_file_sums *sums: Filled with the current sums.
+Returns:        int: 0 on success, -1 on bad parameters, including files not
+                opened by ``qes_file_open_summed``.
+ *===========================================================================*/
+int qes_file_sums              (const struct qes_file  *file,
+                                struct qes_file_sums   *sums);
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_file_mem_estimate
+Parameters:     const char *mode: Mode the file would be opened with.
+                int summed: Non-zero if it would be opened with
+                    ``qes_file_open_summed``.
+                int64_t *io: Set to the bytes it would count as QES_MEM_IO.
+                int64_t *zlib: Set to the bytes it would count as
+                    QES_MEM_ZLIB.
+Description:    Estimates the memory an open file takes, without opening it.
+Returns:        int: 0 on success, -1 on bad parameters.
+ *===========================================================================*/
+int qes_file_mem_estimate      (const char             *mode,
+                                int                     summed,
+                                int64_t                *io,
+                                int64_t                *zlib);
+
 
 /*===  FUNCTION  ============================================================*
 Name:           qes_file_close
@@ -100,6 +260,18 @@ int qes_file_putc              (struct qes_file        *stream,
                                 const int               chr);
 int qes_file_getc              (struct qes_file        *file);
 
+/*===  FUNCTION  ============================================================*
+Name:           qes_file_skip
+Parameters:     struct qes_file *file: File to read
+                size_t len: Number of bytes to discard.
+Description:    Reads and discards ``len`` bytes from ``file``, updating
+                ``file->filepos``.
+Returns:        ssize_t: number of bytes skipped (less than ``len`` only at
+                EOF), or -2 on error.
+ *===========================================================================*/
+ssize_t qes_file_skip          (struct qes_file        *file,
+                                size_t                  len);
+
 
 /*===  FUNCTION  ============================================================*
 Name:           qes_file_readline
@@ -220,7 +392,7 @@ qes_file_ok                    (const struct qes_file  *qf)
      * NULLness for all pointers we care about in current modes. Which, unless
      * we're Write-only, is all of them */
     return  qf != NULL && \
-            qf->fp != NULL && \
+            (qf->fp != NULL || qf->reader != NULL || qf->sink != NULL) && \
             qf->bufiter != NULL && \
             qf->buffer != NULL;
 }
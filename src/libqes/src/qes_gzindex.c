@@ -0,0 +1,566 @@
+/*
+ * Copyright 2015 Kevin Murray <spam@kdmurray.id.au>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * ============================================================================
+ *
+ *       Filename:  qes_gzindex.c
+ *
+ *    Description:  Random access into ordinary gzip files, via an index of
+ *                  inflate access points (as in zlib's examples/zran.c)
+ *        License:  GPLv3+
+ *         Author:  Kevin Murray, spam@kdmurray.id.au
+ *
+ * ============================================================================
+ */
+
+#include "qes_gzindex.h"
+
+#ifdef ZLIB_FOUND
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+/* Size of the inflate history window, and of our input reads */
+#define GZI_WINSIZE 32768U
+#define GZI_CHUNK 16384
+
+static const char gzi_magic[8] = "QESGZI\1";
+
+
+struct gzindex_reader {
+    z_stream strm;
+    int fd;
+    int done;
+    unsigned char input[GZI_CHUNK];
+};
+
+
+static int
+gzindex_add_point(struct qes_gzindex *index, int bits, off_t in, off_t out,
+                  unsigned left, const unsigned char *window)
+{
+    struct qes_gzindex_point *point = NULL;
+    unsigned char flat[GZI_WINSIZE];
+    uLongf len = 0;
+
+    if (index->n_points == index->alloced) {
+        index->alloced = index->alloced ? index->alloced * 2 : 64;
+        index->points = qes_realloc(index->points,
+                                    index->alloced * sizeof(*index->points));
+    }
+    point = &index->points[index->n_points];
+    point->bits = bits;
+    point->in = in;
+    point->out = out;
+    /* The output window is circular, so unroll it so the oldest byte is
+     * first */
+    if (left) {
+        memcpy(flat, window + GZI_WINSIZE - left, left);
+    }
+    if (left < GZI_WINSIZE) {
+        memcpy(flat + left, window, GZI_WINSIZE - left);
+    }
+    len = compressBound(GZI_WINSIZE);
+    point->window = qes_malloc(len);
+    if (compress2(point->window, &len, flat, GZI_WINSIZE, 1) != Z_OK) {
+        qes_free(point->window);
+        return 1;
+    }
+    point->window = qes_realloc(point->window, len);
+    point->window_len = len;
+    index->n_points++;
+    return 0;
+}
+
+struct qes_gzindex *
+qes_gzindex_build(const char *path, off_t span)
+{
+    struct qes_gzindex *index = NULL;
+    unsigned char *input = NULL;
+    unsigned char *window = NULL;
+    struct stat st;
+    z_stream strm;
+    FILE *fp = NULL;
+    off_t totin = 0;
+    off_t totout = 0;
+    off_t last = 0;
+    size_t got = 0;
+    int ret = Z_OK;
+    int ok = 0;
+
+    if (path == NULL || span < 1) {
+        return NULL;
+    }
+    fp = fopen(path, "rb");
+    if (fp == NULL) {
+        return NULL;
+    }
+    if (fstat(fileno(fp), &st) != 0) {
+        fclose(fp);
+        return NULL;
+    }
+    index = qes_calloc(1, sizeof(*index));
+    index->span = span;
+    index->file_size = st.st_size;
+    index->file_mtime = st.st_mtime;
+    input = qes_malloc(GZI_CHUNK);
+    window = qes_malloc(GZI_WINSIZE);
+    memset(&strm, 0, sizeof(strm));
+    strm.zalloc = qes_zalloc;
+    strm.zfree = qes_zfree;
+    /* 47 == 15 + 32: max window, and decode the gzip header */
+    if (inflateInit2(&strm, 47) != Z_OK) {
+        goto exit;
+    }
+    strm.avail_out = 0;
+    do {
+        got = fread(input, 1, GZI_CHUNK, fp);
+        if (ferror(fp) || got == 0) {
+            /* Read error, or truncated file */
+            goto done;
+        }
+        strm.avail_in = got;
+        strm.next_in = input;
+        do {
+            if (strm.avail_out == 0) {
+                strm.avail_out = GZI_WINSIZE;
+                strm.next_out = window;
+            }
+            /* Z_BLOCK makes inflate stop at each deflate block boundary,
+             * which are the only places we can restart from */
+            totin += strm.avail_in;
+            totout += strm.avail_out;
+            ret = inflate(&strm, Z_BLOCK);
+            totin -= strm.avail_in;
+            totout -= strm.avail_out;
+            if (ret == Z_NEED_DICT || ret == Z_MEM_ERROR ||
+                    ret == Z_DATA_ERROR) {
+                goto done;
+            }
+            if (ret == Z_STREAM_END) {
+                break;
+            }
+            /* At the end of a block that isn't the last one */
+            if ((strm.data_type & 128) && !(strm.data_type & 64) &&
+                    (totout == 0 || totout - last > span)) {
+                if (gzindex_add_point(index, strm.data_type & 7, totin,
+                                      totout, strm.avail_out, window) != 0) {
+                    goto done;
+                }
+                last = totout;
+            }
+        } while (strm.avail_in != 0);
+    } while (ret != Z_STREAM_END);
+    /* We don't handle gzip headers between members, so only index single
+     * member files. Multi-member files are often BGZF, which can be split
+     * without an index anyway. */
+    if (strm.avail_in > 0 || fread(input, 1, 1, fp) != 0) {
+        goto done;
+    }
+    index->length = totout;
+    ok = 1;
+done:
+    inflateEnd(&strm);
+exit:
+    fclose(fp);
+    qes_free(input);
+    qes_free(window);
+    if (!ok || index->n_points == 0) {
+        qes_gzindex_destroy(index);
+    }
+    return index;
+}
+
+void
+qes_gzindex_destroy_(struct qes_gzindex *index)
+{
+    size_t iii = 0;
+
+    if (index == NULL) {
+        return;
+    }
+    for (iii = 0; iii < index->n_points; iii++) {
+        qes_free(index->points[iii].window);
+    }
+    qes_free(index->points);
+    qes_free(index);
+}
+
+int
+qes_gzindex_save(const struct qes_gzindex *index, const char *idxpath)
+{
+    const struct qes_gzindex_point *point = NULL;
+    char *tmppath = NULL;
+    int64_t hdr[4];
+    uint64_t n_points = 0;
+    int64_t offsets[2];
+    int32_t bits = 0;
+    uint32_t window_len = 0;
+    FILE *fp = NULL;
+    size_t iii = 0;
+    int fd = -1;
+    int ok = 1;
+
+    if (index == NULL || idxpath == NULL) {
+        return -1;
+    }
+    /* Write to a temporary file and rename it, so a concurrent reader never
+     * sees a partial index */
+    if (asprintf(&tmppath, "%s.XXXXXX", idxpath) < 0) {
+        return 1;
+    }
+    fd = mkstemp(tmppath);
+    if (fd < 0) {
+        free(tmppath);
+        return 1;
+    }
+    /* mkstemp makes files only we can read, but the index isn't secret */
+    fchmod(fd, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    fp = fdopen(fd, "wb");
+    if (fp == NULL) {
+        close(fd);
+        unlink(tmppath);
+        free(tmppath);
+        return 1;
+    }
+    hdr[0] = index->file_size;
+    hdr[1] = index->file_mtime;
+    hdr[2] = index->span;
+    hdr[3] = index->length;
+    n_points = index->n_points;
+    ok &= fwrite(gzi_magic, sizeof(gzi_magic), 1, fp) == 1;
+    ok &= fwrite(hdr, sizeof(hdr), 1, fp) == 1;
+    ok &= fwrite(&n_points, sizeof(n_points), 1, fp) == 1;
+    for (iii = 0; ok && iii < index->n_points; iii++) {
+        point = &index->points[iii];
+        offsets[0] = point->out;
+        offsets[1] = point->in;
+        bits = point->bits;
+        window_len = point->window_len;
+        ok &= fwrite(offsets, sizeof(offsets), 1, fp) == 1;
+        ok &= fwrite(&bits, sizeof(bits), 1, fp) == 1;
+        ok &= fwrite(&window_len, sizeof(window_len), 1, fp) == 1;
+        ok &= fwrite(point->window, 1, window_len, fp) == window_len;
+    }
+    ok &= fclose(fp) == 0;
+    if (ok) {
+        ok = rename(tmppath, idxpath) == 0;
+    }
+    if (!ok) {
+        unlink(tmppath);
+    }
+    free(tmppath);
+    return ok ? 0 : 1;
+}
+
+struct qes_gzindex *
+qes_gzindex_load(const char *idxpath, const char *path)
+{
+    struct qes_gzindex *index = NULL;
+    struct qes_gzindex_point *point = NULL;
+    char magic[sizeof(gzi_magic)];
+    struct stat st;
+    int64_t hdr[4];
+    uint64_t n_points = 0;
+    int64_t offsets[2];
+    int32_t bits = 0;
+    uint32_t window_len = 0;
+    FILE *fp = NULL;
+    size_t iii = 0;
+    int ok = 1;
+
+    if (idxpath == NULL || path == NULL || stat(path, &st) != 0) {
+        return NULL;
+    }
+    fp = fopen(idxpath, "rb");
+    if (fp == NULL) {
+        return NULL;
+    }
+    ok &= fread(magic, sizeof(magic), 1, fp) == 1;
+    ok &= ok && memcmp(magic, gzi_magic, sizeof(magic)) == 0;
+    ok &= ok && fread(hdr, sizeof(hdr), 1, fp) == 1;
+    ok &= ok && fread(&n_points, sizeof(n_points), 1, fp) == 1;
+    /* Check the index is of this version of the file */
+    ok &= ok && hdr[0] == st.st_size && hdr[1] == st.st_mtime;
+    if (!ok || n_points == 0) {
+        fclose(fp);
+        return NULL;
+    }
+    index = qes_calloc(1, sizeof(*index));
+    index->file_size = hdr[0];
+    index->file_mtime = hdr[1];
+    index->span = hdr[2];
+    index->length = hdr[3];
+    index->alloced = n_points;
+    index->points = qes_calloc(n_points, sizeof(*index->points));
+    for (iii = 0; ok && iii < n_points; iii++) {
+        point = &index->points[iii];
+        ok &= fread(offsets, sizeof(offsets), 1, fp) == 1;
+        ok &= ok && fread(&bits, sizeof(bits), 1, fp) == 1;
+        ok &= ok && fread(&window_len, sizeof(window_len), 1, fp) == 1;
+        ok &= ok && window_len > 0 && window_len <= compressBound(GZI_WINSIZE);
+        if (!ok) {
+            break;
+        }
+        point->out = offsets[0];
+        point->in = offsets[1];
+        point->bits = bits;
+        point->window_len = window_len;
+        point->window = qes_malloc(window_len);
+        /* Count it now so destroy frees the window if the read fails */
+        index->n_points++;
+        ok &= fread(point->window, 1, window_len, fp) == window_len;
+    }
+    fclose(fp);
+    if (!ok) {
+        qes_gzindex_destroy(index);
+    }
+    return index;
+}
+
+struct qes_gzindex *
+qes_gzindex_get(const char *path, off_t span)
+{
+    struct qes_gzindex *index = NULL;
+    char *idxpath = NULL;
+
+    if (path == NULL) {
+        return NULL;
+    }
+    if (asprintf(&idxpath, "%s%s", path, QES_GZINDEX_EXT) < 0) {
+        return NULL;
+    }
+    index = qes_gzindex_load(idxpath, path);
+    if (index == NULL) {
+        index = qes_gzindex_build(path, span);
+        if (index != NULL) {
+            /* Only a cache, so it's fine if e.g. the directory is read-only */
+            qes_gzindex_save(index, idxpath);
+        }
+    }
+    free(idxpath);
+    return index;
+}
+
+static ssize_t
+gzindex_read(void *data, char *buf, size_t len)
+{
+    struct gzindex_reader *rdr = data;
+    ssize_t got = 0;
+    int ret = Z_OK;
+
+    if (rdr->done) {
+        return 0;
+    }
+    rdr->strm.next_out = (unsigned char *)buf;
+    rdr->strm.avail_out = len;
+    while (rdr->strm.avail_out > 0) {
+        if (rdr->strm.avail_in == 0) {
+            got = read(rdr->fd, rdr->input, GZI_CHUNK);
+            if (got < 0) {
+                return -1;
+            } else if (got == 0) {
+                /* Truncated file. Return what we have */
+                rdr->done = 1;
+                break;
+            }
+            rdr->strm.avail_in = got;
+            rdr->strm.next_in = rdr->input;
+        }
+        ret = inflate(&rdr->strm, Z_NO_FLUSH);
+        if (ret == Z_STREAM_END) {
+            rdr->done = 1;
+            break;
+        } else if (ret != Z_OK) {
+            return -1;
+        }
+    }
+    return len - rdr->strm.avail_out;
+}
+
+static void
+gzindex_reader_free(void *data)
+{
+    struct gzindex_reader *rdr = data;
+
+    if (rdr == NULL) {
+        return;
+    }
+    inflateEnd(&rdr->strm);
+    if (rdr->fd >= 0) {
+        close(rdr->fd);
+    }
+    qes_free(rdr);
+}
+
+struct qes_file *
+qes_gzindex_open(const struct qes_gzindex *index, const char *path,
+                 size_t point)
+{
+    const struct qes_gzindex_point *pt = NULL;
+    struct gzindex_reader *rdr = NULL;
+    struct qes_file *qf = NULL;
+    unsigned char window[GZI_WINSIZE];
+    uLongf window_len = GZI_WINSIZE;
+    unsigned char prev = 0;
+
+    if (index == NULL || path == NULL || point >= index->n_points) {
+        return NULL;
+    }
+    pt = &index->points[point];
+    if (uncompress(window, &window_len, pt->window, pt->window_len) != Z_OK ||
+            window_len != GZI_WINSIZE) {
+        return NULL;
+    }
+    rdr = qes_calloc(1, sizeof(*rdr));
+    rdr->fd = open(path, O_RDONLY);
+    if (rdr->fd < 0) {
+        qes_free(rdr);
+        return NULL;
+    }
+    /* Raw inflate, as we start mid-stream */
+    rdr->strm.zalloc = qes_zalloc;
+    rdr->strm.zfree = qes_zfree;
+    if (inflateInit2(&rdr->strm, -15) != Z_OK) {
+        close(rdr->fd);
+        qes_free(rdr);
+        return NULL;
+    }
+    if (lseek(rdr->fd, pt->in - (pt->bits ? 1 : 0), SEEK_SET) < 0) {
+        goto error;
+    }
+    if (pt->bits) {
+        /* The point starts part way through a byte */
+        if (read(rdr->fd, &prev, 1) != 1) {
+            goto error;
+        }
+        inflatePrime(&rdr->strm, pt->bits, prev >> (8 - pt->bits));
+    }
+    inflateSetDictionary(&rdr->strm, window, GZI_WINSIZE);
+    qf = qes_file_open_reader(path, gzindex_read, gzindex_reader_free, rdr);
+    if (qf == NULL) {
+        goto error;
+    }
+    return qf;
+error:
+    gzindex_reader_free(rdr);
+    return NULL;
+}
+
+/* Index of the last point at or before uncompressed offset ``out`` */
+static size_t
+gzindex_point_at(const struct qes_gzindex *index, off_t out)
+{
+    size_t lo = 0;
+    size_t hi = index->n_points;
+    size_t mid = 0;
+
+    while (hi - lo > 1) {
+        mid = lo + (hi - lo) / 2;
+        if (index->points[mid].out <= out) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+int
+qes_gzindex_split_range(const struct qes_gzindex *index, const char *path,
+                        size_t idx, size_t n, int pairs,
+                        struct qes_split_range *range)
+{
+    struct qes_file *qf = NULL;
+    size_t start = 0;
+    size_t end = 0;
+    off_t skip = 0;
+
+    if (index == NULL || path == NULL || range == NULL || n < 1 ||
+            idx >= n || index->n_points == 0) {
+        return -1;
+    }
+    /* As in qes_split_range, but rounded down to access points */
+    start = idx == 0 ? 0 :
+            gzindex_point_at(index, index->length * (double)idx / n);
+    end = gzindex_point_at(index, index->length * (double)(idx + 1) / n);
+    range->offset = index->points[start].out;
+    range->limit = idx + 1 == n ? -1 :
+                   index->points[end].out - index->points[start].out;
+    range->skip = 0;
+    if (idx == 0) {
+        return 0;
+    }
+    qf = qes_gzindex_open(index, path, start);
+    if (qf == NULL) {
+        return -1;
+    }
+    skip = qes_split_sync_fastq(qf, 1, pairs);
+    if (skip == -1) {
+        range->skip = qf->filepos;
+    } else if (skip >= 0) {
+        range->skip = skip;
+    }
+    qes_file_close(qf);
+    return skip < -1 ? -1 : 0;
+}
+
+struct qes_seqfile *
+qes_gzindex_split_open(const struct qes_gzindex *index, const char *path,
+                       const struct qes_split_range *range, size_t stride)
+{
+    if (range == NULL) {
+        return NULL;
+    }
+    return qes_gzindex_split_open_at(index, path, range, range->skip, stride);
+}
+
+struct qes_seqfile *
+qes_gzindex_split_open_at(const struct qes_gzindex *index, const char *path,
+                          const struct qes_split_range *range, off_t pos,
+                          size_t stride)
+{
+    struct qes_seqfile *sf = NULL;
+    struct qes_file *qf = NULL;
+    size_t point = 0;
+    off_t skip = 0;
+
+    if (index == NULL || path == NULL || range == NULL ||
+            index->n_points == 0 || pos < range->skip) {
+        return NULL;
+    }
+    point = gzindex_point_at(index, range->offset + pos);
+    skip = range->offset + pos - index->points[point].out;
+    qf = qes_gzindex_open(index, path, point);
+    if (qf == NULL) {
+        return NULL;
+    }
+    if (skip > 0 && qes_file_skip(qf, skip) != skip && !qf->eof) {
+        qes_file_close(qf);
+        return NULL;
+    }
+    qf->filepos = pos;
+    sf = qes_seqfile_create_file(qf);
+    if (sf == NULL) {
+        qes_file_close(qf);
+        return NULL;
+    }
+    qes_seqfile_set_limit(sf, range->limit, stride);
+    return sf;
+}
+
+#endif /* ZLIB_FOUND */
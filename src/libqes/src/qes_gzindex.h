@@ -0,0 +1,172 @@
+/*
+ * Copyright 2015 Kevin Murray <spam@kdmurray.id.au>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * ============================================================================
+ *
+ *       Filename:  qes_gzindex.h
+ *
+ *    Description:  Random access into ordinary gzip files, via an index of
+ *                  inflate access points (as in zlib's examples/zran.c)
+ *        License:  GPLv3+
+ *         Author:  Kevin Murray, spam@kdmurray.id.au
+ *
+ * ============================================================================
+ */
+
+#ifndef QES_GZINDEX_H
+#define QES_GZINDEX_H
+
+#include <qes_util.h>
+#include <qes_file.h>
+#include <qes_seqfile.h>
+#include <qes_split.h>
+
+#ifdef ZLIB_FOUND
+
+/* Default distance between access points, in uncompressed bytes */
+#define QES_GZINDEX_SPAN (8<<20)
+/* Extension appended to a gzip file's path to name its sidecar index */
+#define QES_GZINDEX_EXT ".qzi"
+
+/* An access point: everything needed to start inflating mid-stream. The
+ * 32K history window is stored deflated, as it is mostly redundant. */
+struct qes_gzindex_point {
+    off_t out;              /* Uncompressed offset */
+    off_t in;               /* Compressed offset of first full byte */
+    int bits;               /* Bits of the preceding byte needed, or 0 */
+    unsigned char *window;  /* Deflated history window */
+    size_t window_len;
+};
+
+struct qes_gzindex {
+    struct qes_gzindex_point *points;
+    size_t n_points;
+    size_t alloced;
+    off_t length;           /* Total uncompressed length */
+    off_t span;
+    /* Identify the gzip file, so stale sidecars are rebuilt */
+    off_t file_size;
+    int64_t file_mtime;
+};
+
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_gzindex_build
+Parameters:     const char *path: Single member gzip file to index.
+                off_t span: Minimum uncompressed distance between points.
+Description:    Inflates ``path`` once, recording an access point roughly
+                every ``span`` bytes.
+Returns:        struct qes_gzindex *: The index, or NULL on error or if
+                ``path`` isn't a single member gzip file.
+ *===========================================================================*/
+struct qes_gzindex *qes_gzindex_build(const char *path, off_t span);
+
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_gzindex_save
+Parameters:     const struct qes_gzindex *index: Index to save.
+                const char *idxpath: Sidecar file to write.
+Returns:        int: 0 on success, 1 on failure, -1 on bad parameters.
+ *===========================================================================*/
+int qes_gzindex_save(const struct qes_gzindex *index, const char *idxpath);
+
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_gzindex_load
+Parameters:     const char *idxpath: Sidecar file to read.
+                const char *path: The gzip file it should index.
+Description:    Loads an index saved by ``qes_gzindex_save``, checking that it
+                matches the current size and modification time of ``path``.
+Returns:        struct qes_gzindex *: The index, or NULL if it is missing,
+                stale or corrupt.
+ *===========================================================================*/
+struct qes_gzindex *qes_gzindex_load(const char *idxpath, const char *path);
+
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_gzindex_get
+Parameters:     const char *path: Gzip file.
+                off_t span: As for ``qes_gzindex_build``.
+Description:    Loads the sidecar index of ``path`` (``path`` followed by
+                QES_GZINDEX_EXT), or builds the index and tries to save it as
+                the sidecar. Failing to save the sidecar isn't an error.
+Returns:        struct qes_gzindex *: The index, or NULL on error.
+ *===========================================================================*/
+struct qes_gzindex *qes_gzindex_get(const char *path, off_t span);
+
+
+void qes_gzindex_destroy_(struct qes_gzindex *index);
+#define qes_gzindex_destroy(index) STMT_BEGIN                               \
+    qes_gzindex_destroy_(index);                                            \
+    index = NULL;                                                           \
+    STMT_END
+
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_gzindex_open
+Parameters:     const struct qes_gzindex *index: Index of ``path``.
+                const char *path: Gzip file.
+                size_t point: Index of the access point to start at.
+Description:    Opens ``path`` for reading from an access point. The
+                ``filepos`` of the returned file counts from the point.
+Returns:        struct qes_file *: An opened file, or NULL on error.
+ *===========================================================================*/
+struct qes_file *qes_gzindex_open(const struct qes_gzindex *index,
+                                  const char *path, size_t point);
+
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_gzindex_split_range
+Parameters:     As for ``qes_split_range``, plus the ``index`` of ``path``.
+Description:    Calculates the ``idx``th of ``n`` record-aligned ranges of a
+                gzip file. Ranges start at access points, so there can't be
+                more useful ranges than points; any extra ranges are empty.
+                ``range->offset`` is the uncompressed offset of the point.
+Returns:        int: 0 on success, -1 on error.
+ *===========================================================================*/
+int qes_gzindex_split_range(const struct qes_gzindex *index, const char *path,
+                            size_t idx, size_t n, int pairs,
+                            struct qes_split_range *range);
+
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_gzindex_split_open
+Parameters:     As for ``qes_split_open``, plus the ``index`` of ``path``.
+Description:    Opens a range calculated by ``qes_gzindex_split_range``.
+Returns:        struct qes_seqfile *: A seqfile that returns EOF at the end of
+                ``range``, or NULL on error.
+ *===========================================================================*/
+struct qes_seqfile *qes_gzindex_split_open(const struct qes_gzindex *index,
+                                           const char *path,
+                                           const struct qes_split_range *range,
+                                           size_t stride);
+
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_gzindex_split_open_at
+Parameters:     As for ``qes_split_open_at``, plus the ``index`` of ``path``.
+Description:    Opens a range at ``pos``, starting from the nearest access
+                point before it.
+Returns:        struct qes_seqfile *: As for ``qes_gzindex_split_open``.
+ *===========================================================================*/
+struct qes_seqfile *qes_gzindex_split_open_at(const struct qes_gzindex *index,
+                                              const char *path,
+                                              const struct qes_split_range *range,
+                                              off_t pos, size_t stride);
+
+#endif /* ZLIB_FOUND */
+#endif /* QES_GZINDEX_H */
@@ -28,14 +28,11 @@
  */
 
 #include "qes_match.h"
-
+#include "qes_simd.h"
 
 inline int_fast32_t
 qes_match_hamming (const char *seq1, const char *seq2, size_t len)
 {
-    int_fast32_t mismatches = 0;
-    size_t iii = 0;
-
     /* Error out on bad arguments */
     if (seq1 == NULL || seq2 == NULL) {
         return -1;
@@ -49,15 +46,10 @@ qes_match_hamming (const char *seq1, const char *seq2, size_t len)
             len = len2;
         }
     }
-    /* Count mismatches. See comment on analogous loop in qes_match_hamming_max
-     * for an explanation. */
-    while(iii < len) {
-        if (seq2[iii] != seq1[iii]) {
-            mismatches++;
-        }
-        iii++;
-    }
-    return mismatches;
+    /* There can't be more mismatches than chars, so this never stops early */
+    return qes_simd->hamming_max(seq1, seq2, len,
+                                 len < INT32_MAX ? (int_fast32_t)len :
+                                                   INT32_MAX - 1);
 }
 
 
@@ -65,9 +57,6 @@ inline int_fast32_t
 qes_match_hamming_max(const char *seq1, const char *seq2, size_t len,
                       int_fast32_t max)
 {
-    int_fast32_t mismatches = 0;
-    size_t iii = 0;
-
     /* Error out on bad arguments */
     if (seq1 == NULL || seq2 == NULL || max < 0) {
         return -1;
@@ -83,17 +72,7 @@ qes_match_hamming_max(const char *seq1, const char *seq2, size_t len,
     }
     /* We obediently go until ``len``, assuming whoever gave us ``len`` knew
        WTF they were doing. This makes things a bit faster, since these
-       functions are expected to be very much inner-loop. */
-    while(iii < len) {
-        /* Find mismatch count */
-        if (seq2[iii] != seq1[iii]) {
-            mismatches++;
-        }
-        iii++;
-        if (mismatches > max) {
-            /* Bail out if we're over max, always cap at max + 1 */
-            return max + 1;
-        }
-    }
-    return mismatches;
+       functions are expected to be very much inner-loop. The kernels compare
+       a vector at a time while they can. */
+    return qes_simd->hamming_max(seq1, seq2, len, max);
 }
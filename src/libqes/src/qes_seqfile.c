@@ -159,6 +159,10 @@ qes_seqfile_read (struct qes_seqfile *seqfile, struct qes_seq *seq)
     if (seqfile->qf->eof) {
         return EOF;
     }
+    if (seqfile->limit >= 0 && seqfile->qf->filepos > seqfile->limit &&
+            seqfile->n_records % seqfile->limit_stride == 0) {
+        return EOF;
+    }
     if (seqfile->format == FASTQ_FMT) {
         return read_fastq_seqfile(seqfile, seq);
     } else if (seqfile->format == FASTA_FMT) {
@@ -175,17 +179,34 @@ qes_seqfile_read (struct qes_seqfile *seqfile, struct qes_seq *seq)
 struct qes_seqfile *
 qes_seqfile_create (const char *path, const char *mode)
 {
-    struct qes_seqfile *sf = NULL;
     if (path == NULL || mode == NULL) return NULL;
-    sf = qes_calloc(1, sizeof(*sf));
-    sf->qf = qes_file_open(path, mode);
-    if (sf->qf == NULL) {
-        qes_free(sf->qf);
-        qes_free(sf);
-        return NULL;
+    return qes_seqfile_create_offset(path, mode, 0);
+}
+
+struct qes_seqfile *
+qes_seqfile_create_offset (const char *path, const char *mode, off_t offset)
+{
+    struct qes_file *qf = NULL;
+    if (path == NULL || mode == NULL || offset < 0) return NULL;
+    if (offset == 0) {
+        qf = qes_file_open(path, mode);
+    } else {
+        qf = qes_file_open_offset(path, mode, offset);
     }
+    return qes_seqfile_create_file(qf);
+}
+
+struct qes_seqfile *
+qes_seqfile_create_file (struct qes_file *qf)
+{
+    struct qes_seqfile *sf = NULL;
+    if (qf == NULL) return NULL;
+    sf = qes_calloc(1, sizeof(*sf));
+    sf->qf = qf;
     qes_str_init(&sf->scratch, __INIT_LINE_LEN);
     sf->n_records = 0;
+    sf->limit = -1;
+    sf->limit_stride = 1;
     qes_seqfile_guess_format(sf);
     return sf;
 }
@@ -220,6 +241,15 @@ qes_seqfile_set_format (struct qes_seqfile *seqfile,
     seqfile->format = format;
 }
 
+void
+qes_seqfile_set_limit (struct qes_seqfile *seqfile, off_t limit,
+                       size_t stride)
+{
+    if (!qes_seqfile_ok(seqfile)) return;
+    seqfile->limit = limit;
+    seqfile->limit_stride = stride > 0 ? stride : 1;
+}
+
 void
 qes_seqfile_destroy_(struct qes_seqfile *seqfile)
 {
@@ -271,11 +301,11 @@ qes_seqfile_format_seq(const struct qes_seq *seq, enum qes_seqfile_format fmt,
 ssize_t
 qes_seqfile_write (struct qes_seqfile *seqfile, struct qes_seq *seq)
 {
-#define sf_putc_check(c) ret = QES_ZFPUTC(seqfile->qf->fp, c);              \
-    if (ret != c) {return -2;}                                              \
+#define sf_putc_check(c) ret = qes_file_putc(seqfile->qf, c);               \
+    if (ret != 1) {return -2;}                                              \
     else {res_len += 1;}                                                    \
     ret = 0
-#define sf_puts_check(s) ret = QES_ZFPUTS(seqfile->qf->fp, s.str);          \
+#define sf_puts_check(s) ret = qes_file_puts(seqfile->qf, s.str);           \
     if (ret < 0) {return -2;}                                               \
     else {res_len += s.len;}                                                \
     ret = 0
@@ -55,6 +55,11 @@ struct qes_seqfile {
     /* A buffer to store misc shit in while reading.
        One per file to keep it re-entrant */
     struct qes_str scratch;
+    /* Stop reading once more than ``limit`` bytes of the file have been
+       consumed, or -1 for no limit. The limit is only checked before every
+       ``limit_stride``th record, so that interleaved pairs are never split */
+    off_t limit;
+    size_t limit_stride;
 };
 
 
@@ -68,6 +73,30 @@ Returns:        A fully usable ``struct qes_seqfile *`` or NULL.
  *===========================================================================*/
 struct qes_seqfile *qes_seqfile_create (const char *path, const char *mode);
 
+/*===  FUNCTION  ============================================================*
+Name:           qes_seqfile_create_offset
+Parameters:     const char *path: Path to open.
+                const char *mode: Mode to pass to the fopen equivalent used.
+                off_t offset: Raw offset to start reading from. See
+                    qes_file_open_offset.
+Description:    As qes_seqfile_create, but starts reading ``offset`` bytes
+                into the file. The format is only guessed correctly if
+                ``offset`` is the start of a record.
+Returns:        A fully usable ``struct qes_seqfile *`` or NULL.
+ *===========================================================================*/
+struct qes_seqfile *qes_seqfile_create_offset (const char *path,
+                                               const char *mode,
+                                               off_t offset);
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_seqfile_create_file
+Parameters:     struct qes_file *qf: An opened file.
+Description:    As qes_seqfile_create, but wraps an already opened file, which
+                the seqfile then owns.
+Returns:        A fully usable ``struct qes_seqfile *`` or NULL.
+ *===========================================================================*/
+struct qes_seqfile *qes_seqfile_create_file (struct qes_file *qf);
+
 
 /*===  FUNCTION  ============================================================*
 Name:           qes_seqfile_ok
@@ -102,6 +131,22 @@ enum qes_seqfile_format qes_seqfile_guess_format(struct qes_seqfile *file);
 void qes_seqfile_set_format (struct qes_seqfile *file,
                              enum qes_seqfile_format format);
 
+/*===  FUNCTION  ============================================================*
+Name:           qes_seqfile_set_limit
+Parameters:     struct qes_seqfile *file: File to limit.
+                off_t limit: Byte position (as in ``file->qf->filepos``)
+                    after which no new record may start, or -1 for no limit.
+                size_t stride: Check the limit only before every
+                    ``stride``th record, e.g. 2 for interleaved pairs.
+Description:    Limit reading of ``file`` to records that start at or before
+                ``limit``. Subsequent reads return EOF once the limit is
+                passed. Records that start before ``limit`` are always read
+                in full.
+Returns:        void
+ *===========================================================================*/
+void qes_seqfile_set_limit (struct qes_seqfile *file, off_t limit,
+                            size_t stride);
+
 ssize_t qes_seqfile_read (struct qes_seqfile *file, struct qes_seq *seq);
 
 ssize_t qes_seqfile_write (struct qes_seqfile *file, struct qes_seq *seq);
@@ -27,6 +27,7 @@
  */
 
 #include "qes_sequtil.h"
+#include "qes_simd.h"
 
 
 /*
@@ -238,35 +239,92 @@ qes_sequtil_revcomp (const char *seq, size_t len)
     char *outseq = strdup(seq);
     seqlen = seqlen < len ? seqlen : len - 1;
 
-    if (outseq[seqlen - 1] == '\n') {
+    if (seqlen > 0 && outseq[seqlen - 1] == '\n') {
         outseq[seqlen - 1] = '\0';
         seqlen--;
     }
 
-    qes_sequtil_revcomp_inplace(outseq, len);
+    qes_sequtil_revcomp_inplace(outseq, seqlen);
     return outseq;
 }
 
 inline void
 qes_sequtil_revcomp_inplace (char *seq, size_t len)
 {
-    size_t iii;
-    /* Trim trailing whitespace */
+    /* Up to the end of the string, and trim trailing whitespace */
+    len = strnlen(seq, len);
     while (len > 0 && isspace(seq[len - 1])) {
         seq[--len] = '\0';
     }
-    for (iii = 0; iii < len && seq[iii] != '\0'; iii++) {
-        size_t endpos = len - iii - 1;
-        char endchar = seq[endpos];
-        if (seq[iii] == 'a' || seq[iii] == 'A') seq[endpos] = 'T';
-        else if (seq[iii] == 'c' || seq[iii] == 'C') seq[endpos] = 'G';
-        else if (seq[iii] == 'g' || seq[iii] == 'G') seq[endpos] = 'C';
-        else if (seq[iii] == 't' || seq[iii] == 'T') seq[endpos] = 'A';
-        else seq[endpos] = 'N';
-        if (endchar == 'a' || endchar == 'A') seq[iii] = 'T';
-        else if (endchar == 'c' || endchar == 'C') seq[iii] = 'G';
-        else if (endchar == 'g' || endchar == 'G') seq[iii] = 'C';
-        else if (endchar == 't' || endchar == 'T') seq[iii] = 'A';
-        else seq[iii] = 'N';
+    qes_simd->revcomp(seq, len);
+}
+
+inline ssize_t
+qes_sequtil_revcomp_check (char *seq, size_t len)
+{
+    if (seq == NULL) {
+        return -1;
+    }
+    return qes_simd->revcomp(seq, len);
+}
+
+inline int
+qes_sequtil_pack (const char *seq, size_t len, uint64_t *packed,
+                  uint64_t *nmask)
+{
+    uint64_t bad = 0;
+
+    if (seq == NULL || packed == NULL || len > 32) {
+        return -1;
+    }
+    if (len == 0) {
+        *packed = 0;
+    } else {
+        qes_simd->pack(seq, len, packed, &bad);
+    }
+    if (nmask != NULL) {
+        *nmask = bad;
+    }
+    return bad != 0;
+}
+
+/* Complementing is flipping both bits of each base. Reversing swaps the
+ * bases within each byte, then the bytes, leaving len bases at the top. */
+inline int
+qes_sequtil_revcomp_packed (uint64_t *packed, uint64_t *nmask, size_t len)
+{
+    uint64_t bases = 0;
+    uint64_t bad = 0;
+
+    if (packed == NULL || len > 32) {
+        return -1;
+    }
+    if (len == 0) {
+        return 0;
+    }
+    bases = ~*packed;
+    bases = (bases >> 2 & 0x3333333333333333ULL) |
+            (bases & 0x3333333333333333ULL) << 2;
+    bases = (bases >> 4 & 0x0F0F0F0F0F0F0F0FULL) |
+            (bases & 0x0F0F0F0F0F0F0F0FULL) << 4;
+    *packed = __builtin_bswap64(bases) >> (64 - 2 * len);
+    if (nmask != NULL) {
+        bad = *nmask;
+        bad = (bad >> 1 & 0x5555555555555555ULL) |
+              (bad & 0x5555555555555555ULL) << 1;
+        bad = (bad >> 2 & 0x3333333333333333ULL) |
+              (bad & 0x3333333333333333ULL) << 2;
+        bad = (bad >> 4 & 0x0F0F0F0F0F0F0F0FULL) |
+              (bad & 0x0F0F0F0F0F0F0F0FULL) << 4;
+        bad = __builtin_bswap64(bad) >> (64 - len);
+        *nmask = bad;
+        /* Spread each bit of the mask over its base's two */
+        bad = (bad | bad << 16) & 0x0000FFFF0000FFFFULL;
+        bad = (bad | bad << 8) & 0x00FF00FF00FF00FFULL;
+        bad = (bad | bad << 4) & 0x0F0F0F0F0F0F0F0FULL;
+        bad = (bad | bad << 2) & 0x3333333333333333ULL;
+        bad = (bad | bad << 1) & 0x5555555555555555ULL;
+        *packed &= ~(bad * 3);
     }
+    return 0;
 }
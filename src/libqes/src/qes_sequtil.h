@@ -36,4 +36,23 @@ extern int qes_sequtil_translate_codon(const char *codon);
 extern char *qes_sequtil_revcomp(const char *seq, size_t len);
 extern void qes_sequtil_revcomp_inplace(char *seq, size_t len);
 
+/* Reverse-complements exactly len bases in place, checking them in the same
+ * pass. Returns how many weren't ACGT (and so are now N), or -1 if seq is
+ * NULL. */
+extern ssize_t qes_sequtil_revcomp_check(char *seq, size_t len);
+
+/* Packs up to 32 bases two bits each, A, C, G and T (in either case) as 0 to
+ * 3, with base i in bits 2i and 2i + 1 of *packed. Other bases pack as A,
+ * and set bit i of *nmask, if nmask isn't NULL. Returns 0 if every base was
+ * ACGT, 1 if not, or -1 on bad parameters. */
+extern int qes_sequtil_pack(const char *seq, size_t len, uint64_t *packed,
+                            uint64_t *nmask);
+
+/* Reverse-complements len bases packed as by qes_sequtil_pack in place. If
+ * nmask isn't NULL, it's reversed too, and the bases it marks stay packed as
+ * A, as they would be packing the reverse complement. Returns 0, or -1 on bad
+ * parameters. */
+extern int qes_sequtil_revcomp_packed(uint64_t *packed, uint64_t *nmask,
+                                      size_t len);
+
 #endif /* QES_SEQUTIL_H */
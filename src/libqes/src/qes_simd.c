@@ -0,0 +1,789 @@
+/*
+ * Copyright 2015 Kevin Murray <spam@kdmurray.id.au>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * ============================================================================
+ *
+ *       Filename:  qes_simd.c
+ *
+ *    Description:  SIMD kernels, picked for the CPU at run time
+ *        License:  GPLv3+
+ *         Author:  Kevin Murray, spam@kdmurray.id.au
+ *
+ * ============================================================================
+ */
+
+#include "qes_simd.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#   define QES_SIMD_X86
+#   include <immintrin.h>
+#   define QES_TARGET_SSE42 __attribute__((target("sse4.2,popcnt")))
+#   define QES_TARGET_AVX2 __attribute__((target("avx2,popcnt")))
+#   define QES_TARGET_AVX512 __attribute__((target("avx512f,avx512bw,popcnt")))
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#   define QES_SIMD_ARM
+#   include <arm_neon.h>
+#endif
+
+static const char *level_names[QES_SIMD_N_LEVELS] = {
+    "scalar", "sse4.2", "avx2", "avx512", "neon",
+};
+
+/* Complements of bases, upper case, or N for anything but ACGT */
+static const char comp_table[256] = {
+    ['A'] = 'T', ['C'] = 'G', ['G'] = 'C', ['T'] = 'A',
+    ['a'] = 'T', ['c'] = 'G', ['g'] = 'C', ['t'] = 'A',
+};
+
+static inline char
+comp_base(char base)
+{
+    char comp = comp_table[(unsigned char)base];
+
+    return comp != 0 ? comp : 'N';
+}
+
+/* Bits 0 to len - 1 */
+static inline uint64_t
+len_mask(size_t len)
+{
+    return len >= 64 ? UINT64_MAX : (UINT64_C(1) << len) - 1;
+}
+
+static inline int
+is_acgt(char base)
+{
+    return comp_table[(unsigned char)base] != 0;
+}
+
+/* Codes 0 to 3 of A, C, G and T, in either case: bits 1 and 2 of their
+ * bytes, XORed with bits 2 and 3 */
+static inline unsigned int
+base_code(char base)
+{
+    return (((unsigned char)base >> 1) ^ ((unsigned char)base >> 2)) & 3;
+}
+
+
+/*
+ * Scalar kernels, which the others finish with
+ */
+
+/* Number of differing bytes in the 8 bytes at seq1 and seq2. Each byte of
+ * the XOR of the two words is folded into its lowest bit, and these bits
+ * summed by a multiply. */
+static inline int_fast32_t
+word_mismatches(const char *seq1, const char *seq2)
+{
+    uint64_t word1 = 0;
+    uint64_t word2 = 0;
+    uint64_t diff = 0;
+
+    memcpy(&word1, seq1, sizeof(word1));
+    memcpy(&word2, seq2, sizeof(word2));
+    diff = word1 ^ word2;
+    diff |= diff >> 4;
+    diff |= diff >> 2;
+    diff |= diff >> 1;
+    diff &= 0x0101010101010101ULL;
+    return (int_fast32_t)((diff * 0x0101010101010101ULL) >> 56);
+}
+
+/* Counts mismatches from ``iii`` to ``len``, on top of ``mismatches``.
+ * Compare a word at a time while we can. */
+static inline int_fast32_t
+hamming_max_from(const char *seq1, const char *seq2, size_t iii, size_t len,
+                 int_fast32_t mismatches, int_fast32_t max)
+{
+    for (; iii + 8 <= len; iii += 8) {
+        mismatches += word_mismatches(seq1 + iii, seq2 + iii);
+        if (mismatches > max) {
+            return max + 1;
+        }
+    }
+    for (; iii < len; iii++) {
+        if (seq2[iii] != seq1[iii]) {
+            mismatches++;
+        }
+        if (mismatches > max) {
+            /* Bail out if we're over max, always cap at max + 1 */
+            return max + 1;
+        }
+    }
+    return mismatches;
+}
+
+static int_fast32_t
+hamming_max_scalar(const char *seq1, const char *seq2, size_t len,
+                   int_fast32_t max)
+{
+    return hamming_max_from(seq1, seq2, 0, len, 0, max);
+}
+
+/* Reverse-complements seq[lo, hi), adding bases that weren't ACGT to bad */
+static inline size_t
+revcomp_between(char *seq, size_t lo, size_t hi, size_t bad)
+{
+    char tmp = 0;
+
+    while (hi - lo >= 2) {
+        hi--;
+        bad += !is_acgt(seq[lo]) + !is_acgt(seq[hi]);
+        tmp = comp_base(seq[lo]);
+        seq[lo] = comp_base(seq[hi]);
+        seq[hi] = tmp;
+        lo++;
+    }
+    if (hi > lo) {
+        bad += !is_acgt(seq[lo]);
+        seq[lo] = comp_base(seq[lo]);
+    }
+    return bad;
+}
+
+static size_t
+revcomp_scalar(char *seq, size_t len)
+{
+    return revcomp_between(seq, 0, len, 0);
+}
+
+static int
+pack_scalar(const char *seq, size_t len, uint64_t *packed, uint64_t *nmask)
+{
+    uint64_t bases = 0;
+    uint64_t bad = 0;
+    size_t iii = 0;
+
+    for (iii = 0; iii < len; iii++) {
+        if (is_acgt(seq[iii])) {
+            bases |= (uint64_t)base_code(seq[iii]) << (2 * iii);
+        } else {
+            bad |= UINT64_C(1) << iii;
+        }
+    }
+    *packed = bases;
+    *nmask = bad;
+    return bad != 0;
+}
+
+/* Loads up to 8 bytes, left of them, at seq into a word, zeroing the rest,
+ * without reading past them. Under 8 bytes are two overlapping loads, whose
+ * shared bytes agree. */
+static inline uint64_t
+load_word(const char *seq, size_t left)
+{
+    uint64_t word = 0;
+    uint32_t lo32 = 0;
+    uint32_t hi32 = 0;
+    uint16_t lo16 = 0;
+    uint16_t hi16 = 0;
+
+    if (left >= 8) {
+        memcpy(&word, seq, 8);
+    } else if (left >= 4) {
+        memcpy(&lo32, seq, 4);
+        memcpy(&hi32, seq + left - 4, 4);
+        word = lo32 | (uint64_t)hi32 << (8 * (left - 4));
+    } else if (left >= 2) {
+        memcpy(&lo16, seq, 2);
+        memcpy(&hi16, seq + left - 2, 2);
+        word = lo16 | (uint64_t)hi16 << (8 * (left - 2));
+    } else if (left == 1) {
+        word = (unsigned char)seq[0];
+    }
+    return word;
+}
+
+/* Loads up to 32 bases into words[0..3], zeroing the rest. Copying short
+ * reads to a buffer instead stalls the vector load that follows, as it can't
+ * be forwarded from the smaller stores. */
+static inline void
+load_bases(const char *seq, size_t len, uint64_t words[4])
+{
+    words[0] = load_word(seq, len);
+    words[1] = len > 8 ? load_word(seq + 8, len - 8) : 0;
+    words[2] = len > 16 ? load_word(seq + 16, len - 16) : 0;
+    words[3] = len > 24 ? load_word(seq + 24, len - 24) : 0;
+}
+
+static const struct qes_simd_ops scalar_ops = {
+    QES_SIMD_SCALAR, "scalar",
+    hamming_max_scalar, revcomp_scalar, pack_scalar,
+};
+
+
+#ifdef QES_SIMD_X86
+/*
+ * SSE4.2, 16 bytes at a time
+ */
+
+QES_TARGET_SSE42 static int_fast32_t
+hamming_max_sse42(const char *seq1, const char *seq2, size_t len,
+                  int_fast32_t max)
+{
+    int_fast32_t mismatches = 0;
+    __m128i eq;
+    size_t iii = 0;
+
+    for (; iii + 16 <= len; iii += 16) {
+        eq = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(seq1 + iii)),
+                            _mm_loadu_si128((const __m128i *)(seq2 + iii)));
+        mismatches += 16 - _mm_popcnt_u32(_mm_movemask_epi8(eq));
+        if (mismatches > max) {
+            return max + 1;
+        }
+    }
+    return hamming_max_from(seq1, seq2, iii, len, mismatches, max);
+}
+
+/* Bases are upper cased by clearing bit 5, which only makes ACGT of acgt.
+ * Bytes of *valid are set for ACGT. */
+QES_TARGET_SSE42 static inline __m128i
+comp_sse42(__m128i bases, __m128i *valid)
+{
+    const __m128i upper = _mm_and_si128(bases, _mm_set1_epi8((char)0xDF));
+    const __m128i is_a = _mm_cmpeq_epi8(upper, _mm_set1_epi8('A'));
+    const __m128i is_c = _mm_cmpeq_epi8(upper, _mm_set1_epi8('C'));
+    const __m128i is_g = _mm_cmpeq_epi8(upper, _mm_set1_epi8('G'));
+    const __m128i is_t = _mm_cmpeq_epi8(upper, _mm_set1_epi8('T'));
+    __m128i comp = _mm_set1_epi8('N');
+
+    *valid = _mm_or_si128(_mm_or_si128(is_a, is_c), _mm_or_si128(is_g, is_t));
+    comp = _mm_blendv_epi8(comp, _mm_set1_epi8('T'), is_a);
+    comp = _mm_blendv_epi8(comp, _mm_set1_epi8('G'), is_c);
+    comp = _mm_blendv_epi8(comp, _mm_set1_epi8('C'), is_g);
+    return _mm_blendv_epi8(comp, _mm_set1_epi8('A'), is_t);
+}
+
+QES_TARGET_SSE42 static inline __m128i
+revcomp_vec_sse42(__m128i bases, size_t *bad)
+{
+    const __m128i reverse = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10,
+                                         11, 12, 13, 14, 15);
+    __m128i valid;
+    __m128i comp = comp_sse42(bases, &valid);
+
+    *bad += 16 - _mm_popcnt_u32(_mm_movemask_epi8(valid));
+    return _mm_shuffle_epi8(comp, reverse);
+}
+
+/* Swaps vectors from each end, reverse-complemented, until they'd meet */
+QES_TARGET_SSE42 static size_t
+revcomp_sse42(char *seq, size_t len)
+{
+    __m128i head;
+    __m128i tail;
+    size_t bad = 0;
+    size_t lo = 0;
+    size_t hi = len;
+
+    while (hi - lo >= 32) {
+        head = _mm_loadu_si128((const __m128i *)(seq + lo));
+        tail = _mm_loadu_si128((const __m128i *)(seq + hi - 16));
+        _mm_storeu_si128((__m128i *)(seq + lo),
+                         revcomp_vec_sse42(tail, &bad));
+        _mm_storeu_si128((__m128i *)(seq + hi - 16),
+                         revcomp_vec_sse42(head, &bad));
+        lo += 16;
+        hi -= 16;
+    }
+    return revcomp_between(seq, lo, hi, bad);
+}
+
+/* Packs 16 bases into 32 bits, and sets a bit of *valid for each ACGT. Codes
+ * are summed with their neighbours' times 4, then those pairs with theirs
+ * times 16, leaving a byte of four bases in the low byte of each 32 bits. */
+QES_TARGET_SSE42 static inline uint32_t
+pack_vec_sse42(__m128i bases, uint32_t *valid)
+{
+    const __m128i gather = _mm_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1,
+                                         -1, -1, -1, -1, -1, -1);
+    __m128i is_acgt;
+    __m128i codes;
+
+    comp_sse42(bases, &is_acgt);
+    *valid = _mm_movemask_epi8(is_acgt);
+    codes = _mm_xor_si128(_mm_srli_epi16(bases, 1), _mm_srli_epi16(bases, 2));
+    codes = _mm_and_si128(_mm_and_si128(codes, _mm_set1_epi8(3)), is_acgt);
+    codes = _mm_maddubs_epi16(codes, _mm_set1_epi16(0x0401));
+    codes = _mm_madd_epi16(codes, _mm_set1_epi32(0x00100001));
+    return _mm_cvtsi128_si32(_mm_shuffle_epi8(codes, gather));
+}
+
+QES_TARGET_SSE42 static int
+pack_sse42(const char *seq, size_t len, uint64_t *packed, uint64_t *nmask)
+{
+    uint64_t words[4];
+    uint32_t valid_lo = 0;
+    uint32_t valid_hi = 0;
+    uint64_t lo = 0;
+    uint64_t hi = 0;
+
+    load_bases(seq, len, words);
+    lo = pack_vec_sse42(_mm_set_epi64x(words[1], words[0]), &valid_lo);
+    if (len > 16) {
+        hi = pack_vec_sse42(_mm_set_epi64x(words[3], words[2]), &valid_hi);
+    }
+    *packed = lo | hi << 32;
+    *nmask = ~(valid_lo | (uint64_t)valid_hi << 16) & len_mask(len);
+    return *nmask != 0;
+}
+
+static const struct qes_simd_ops sse42_ops = {
+    QES_SIMD_SSE42, "sse4.2",
+    hamming_max_sse42, revcomp_sse42, pack_sse42,
+};
+
+
+/*
+ * AVX2, 32 bytes at a time
+ */
+
+QES_TARGET_AVX2 static int_fast32_t
+hamming_max_avx2(const char *seq1, const char *seq2, size_t len,
+                 int_fast32_t max)
+{
+    int_fast32_t mismatches = 0;
+    __m256i eq;
+    size_t iii = 0;
+
+    for (; iii + 32 <= len; iii += 32) {
+        eq = _mm256_cmpeq_epi8(
+                _mm256_loadu_si256((const __m256i *)(seq1 + iii)),
+                _mm256_loadu_si256((const __m256i *)(seq2 + iii)));
+        mismatches += 32 - _mm_popcnt_u32(_mm256_movemask_epi8(eq));
+        if (mismatches > max) {
+            return max + 1;
+        }
+    }
+    return hamming_max_from(seq1, seq2, iii, len, mismatches, max);
+}
+
+QES_TARGET_AVX2 static inline __m256i
+comp_avx2(__m256i bases, __m256i *valid)
+{
+    const __m256i upper = _mm256_and_si256(bases,
+                                           _mm256_set1_epi8((char)0xDF));
+    const __m256i is_a = _mm256_cmpeq_epi8(upper, _mm256_set1_epi8('A'));
+    const __m256i is_c = _mm256_cmpeq_epi8(upper, _mm256_set1_epi8('C'));
+    const __m256i is_g = _mm256_cmpeq_epi8(upper, _mm256_set1_epi8('G'));
+    const __m256i is_t = _mm256_cmpeq_epi8(upper, _mm256_set1_epi8('T'));
+    __m256i comp = _mm256_set1_epi8('N');
+
+    *valid = _mm256_or_si256(_mm256_or_si256(is_a, is_c),
+                             _mm256_or_si256(is_g, is_t));
+    comp = _mm256_blendv_epi8(comp, _mm256_set1_epi8('T'), is_a);
+    comp = _mm256_blendv_epi8(comp, _mm256_set1_epi8('G'), is_c);
+    comp = _mm256_blendv_epi8(comp, _mm256_set1_epi8('C'), is_g);
+    return _mm256_blendv_epi8(comp, _mm256_set1_epi8('A'), is_t);
+}
+
+QES_TARGET_AVX2 static inline __m256i
+revcomp_vec_avx2(__m256i bases, size_t *bad)
+{
+    const __m256i reverse = _mm256_set_epi8(
+            0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+            0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    __m256i valid;
+    __m256i comp = comp_avx2(bases, &valid);
+
+    *bad += 32 - _mm_popcnt_u32(_mm256_movemask_epi8(valid));
+    /* Bytes are shuffled within 128-bit lanes, then the lanes swapped */
+    comp = _mm256_shuffle_epi8(comp, reverse);
+    return _mm256_permute4x64_epi64(comp, 0x4E);
+}
+
+QES_TARGET_AVX2 static size_t
+revcomp_avx2(char *seq, size_t len)
+{
+    __m256i head;
+    __m256i tail;
+    size_t bad = 0;
+    size_t lo = 0;
+    size_t hi = len;
+
+    while (hi - lo >= 64) {
+        head = _mm256_loadu_si256((const __m256i *)(seq + lo));
+        tail = _mm256_loadu_si256((const __m256i *)(seq + hi - 32));
+        _mm256_storeu_si256((__m256i *)(seq + lo),
+                            revcomp_vec_avx2(tail, &bad));
+        _mm256_storeu_si256((__m256i *)(seq + hi - 32),
+                            revcomp_vec_avx2(head, &bad));
+        lo += 32;
+        hi -= 32;
+    }
+    return revcomp_between(seq, lo, hi, bad);
+}
+
+/* As pack_vec_sse42, for all 32 bases, with bytes beyond len zero */
+QES_TARGET_AVX2 static inline int
+pack_vec_avx2(__m256i bases, size_t len, uint64_t *packed, uint64_t *nmask)
+{
+    const __m256i gather = _mm256_setr_epi8(
+            0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+            0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    __m256i is_acgt;
+    __m256i codes;
+
+    comp_avx2(bases, &is_acgt);
+    codes = _mm256_xor_si256(_mm256_srli_epi16(bases, 1),
+                             _mm256_srli_epi16(bases, 2));
+    codes = _mm256_and_si256(_mm256_and_si256(codes, _mm256_set1_epi8(3)),
+                             is_acgt);
+    codes = _mm256_maddubs_epi16(codes, _mm256_set1_epi16(0x0401));
+    codes = _mm256_madd_epi16(codes, _mm256_set1_epi32(0x00100001));
+    codes = _mm256_shuffle_epi8(codes, gather);
+    *packed = (uint32_t)_mm256_extract_epi32(codes, 0) |
+            (uint64_t)(uint32_t)_mm256_extract_epi32(codes, 4) << 32;
+    *nmask = ~(uint64_t)(uint32_t)_mm256_movemask_epi8(is_acgt) &
+            len_mask(len);
+    return *nmask != 0;
+}
+
+QES_TARGET_AVX2 static int
+pack_avx2(const char *seq, size_t len, uint64_t *packed, uint64_t *nmask)
+{
+    uint64_t words[4];
+
+    if (len == 32) {
+        return pack_vec_avx2(_mm256_loadu_si256((const __m256i *)seq), len,
+                             packed, nmask);
+    }
+    load_bases(seq, len, words);
+    return pack_vec_avx2(_mm256_set_epi64x(words[3], words[2], words[1],
+                                           words[0]), len, packed, nmask);
+}
+
+static const struct qes_simd_ops avx2_ops = {
+    QES_SIMD_AVX2, "avx2",
+    hamming_max_avx2, revcomp_avx2, pack_avx2,
+};
+
+
+/*
+ * AVX-512BW, 64 bytes at a time. Masked loads don't fault past the mask, so
+ * tails are done in vectors too.
+ */
+
+QES_TARGET_AVX512 static int_fast32_t
+hamming_max_avx512(const char *seq1, const char *seq2, size_t len,
+                   int_fast32_t max)
+{
+    int_fast32_t mismatches = 0;
+    __mmask64 mask = 0;
+    size_t iii = 0;
+
+    for (; iii < len; iii += 64) {
+        mask = len_mask(len - iii);
+        mismatches += _mm_popcnt_u64(_mm512_mask_cmpneq_epi8_mask(mask,
+                _mm512_maskz_loadu_epi8(mask, seq1 + iii),
+                _mm512_maskz_loadu_epi8(mask, seq2 + iii)));
+        if (mismatches > max) {
+            return max + 1;
+        }
+    }
+    return mismatches;
+}
+
+QES_TARGET_AVX512 static inline __m512i
+revcomp_vec_avx512(__m512i bases, size_t *bad)
+{
+    const __m512i upper = _mm512_and_si512(bases,
+                                           _mm512_set1_epi8((char)0xDF));
+    const __m512i reverse = _mm512_broadcast_i32x4(_mm_set_epi8(
+            0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+    const __mmask64 is_a = _mm512_cmpeq_epi8_mask(upper,
+                                                  _mm512_set1_epi8('A'));
+    const __mmask64 is_c = _mm512_cmpeq_epi8_mask(upper,
+                                                  _mm512_set1_epi8('C'));
+    const __mmask64 is_g = _mm512_cmpeq_epi8_mask(upper,
+                                                  _mm512_set1_epi8('G'));
+    const __mmask64 is_t = _mm512_cmpeq_epi8_mask(upper,
+                                                  _mm512_set1_epi8('T'));
+    __m512i comp = _mm512_set1_epi8('N');
+
+    *bad += 64 - _mm_popcnt_u64(is_a | is_c | is_g | is_t);
+    comp = _mm512_mask_mov_epi8(comp, is_a, _mm512_set1_epi8('T'));
+    comp = _mm512_mask_mov_epi8(comp, is_c, _mm512_set1_epi8('G'));
+    comp = _mm512_mask_mov_epi8(comp, is_g, _mm512_set1_epi8('C'));
+    comp = _mm512_mask_mov_epi8(comp, is_t, _mm512_set1_epi8('A'));
+    /* Reverse the bytes of each 128-bit lane, then the lanes */
+    comp = _mm512_shuffle_epi8(comp, reverse);
+    return _mm512_shuffle_i64x2(comp, comp, 0x1B);
+}
+
+QES_TARGET_AVX512 static size_t
+revcomp_avx512(char *seq, size_t len)
+{
+    __m512i head;
+    __m512i tail;
+    size_t bad = 0;
+    size_t lo = 0;
+    size_t hi = len;
+
+    while (hi - lo >= 128) {
+        head = _mm512_loadu_si512(seq + lo);
+        tail = _mm512_loadu_si512(seq + hi - 64);
+        _mm512_storeu_si512(seq + lo, revcomp_vec_avx512(tail, &bad));
+        _mm512_storeu_si512(seq + hi - 64, revcomp_vec_avx512(head, &bad));
+        lo += 64;
+        hi -= 64;
+    }
+    return revcomp_between(seq, lo, hi, bad);
+}
+
+/* A masked load zeroes bytes beyond len, without copying short reads */
+QES_TARGET_AVX512 static int
+pack_avx512(const char *seq, size_t len, uint64_t *packed, uint64_t *nmask)
+{
+    const __m512i bases = _mm512_maskz_loadu_epi8(len_mask(len), seq);
+
+    return pack_vec_avx2(_mm512_castsi512_si256(bases), len, packed, nmask);
+}
+
+static const struct qes_simd_ops avx512_ops = {
+    QES_SIMD_AVX512, "avx512",
+    hamming_max_avx512, revcomp_avx512, pack_avx512,
+};
+#endif /* QES_SIMD_X86 */
+
+
+#ifdef QES_SIMD_ARM
+/*
+ * NEON, 16 bytes at a time
+ */
+
+static int_fast32_t
+hamming_max_neon(const char *seq1, const char *seq2, size_t len,
+                 int_fast32_t max)
+{
+    int_fast32_t mismatches = 0;
+    uint8x16_t eq;
+    size_t iii = 0;
+
+    for (; iii + 16 <= len; iii += 16) {
+        eq = vceqq_u8(vld1q_u8((const uint8_t *)seq1 + iii),
+                      vld1q_u8((const uint8_t *)seq2 + iii));
+        mismatches += 16 - vaddvq_u8(vshrq_n_u8(eq, 7));
+        if (mismatches > max) {
+            return max + 1;
+        }
+    }
+    return hamming_max_from(seq1, seq2, iii, len, mismatches, max);
+}
+
+static inline uint8x16_t
+comp_neon(uint8x16_t bases, uint8x16_t *valid)
+{
+    const uint8x16_t upper = vandq_u8(bases, vdupq_n_u8(0xDF));
+    const uint8x16_t is_a = vceqq_u8(upper, vdupq_n_u8('A'));
+    const uint8x16_t is_c = vceqq_u8(upper, vdupq_n_u8('C'));
+    const uint8x16_t is_g = vceqq_u8(upper, vdupq_n_u8('G'));
+    const uint8x16_t is_t = vceqq_u8(upper, vdupq_n_u8('T'));
+    uint8x16_t comp = vdupq_n_u8('N');
+
+    *valid = vorrq_u8(vorrq_u8(is_a, is_c), vorrq_u8(is_g, is_t));
+    comp = vbslq_u8(is_a, vdupq_n_u8('T'), comp);
+    comp = vbslq_u8(is_c, vdupq_n_u8('G'), comp);
+    comp = vbslq_u8(is_g, vdupq_n_u8('C'), comp);
+    return vbslq_u8(is_t, vdupq_n_u8('A'), comp);
+}
+
+static inline uint8x16_t
+revcomp_vec_neon(uint8x16_t bases, size_t *bad)
+{
+    uint8x16_t valid;
+    uint8x16_t comp = comp_neon(bases, &valid);
+
+    *bad += 16 - vaddvq_u8(vshrq_n_u8(valid, 7));
+    comp = vrev64q_u8(comp);
+    return vextq_u8(comp, comp, 8);
+}
+
+static size_t
+revcomp_neon(char *seq, size_t len)
+{
+    uint8x16_t head;
+    uint8x16_t tail;
+    size_t bad = 0;
+    size_t lo = 0;
+    size_t hi = len;
+
+    while (hi - lo >= 32) {
+        head = vld1q_u8((const uint8_t *)seq + lo);
+        tail = vld1q_u8((const uint8_t *)seq + hi - 16);
+        vst1q_u8((uint8_t *)seq + lo, revcomp_vec_neon(tail, &bad));
+        vst1q_u8((uint8_t *)seq + hi - 16, revcomp_vec_neon(head, &bad));
+        lo += 16;
+        hi -= 16;
+    }
+    return revcomp_between(seq, lo, hi, bad);
+}
+
+/* Packs 16 bases into 32 bits, and sets a bit of *valid for each ACGT. Codes
+ * are shifted into place within each four bytes, which are then summed. */
+static inline uint32_t
+pack_vec_neon(uint8x16_t bases, uint32_t *valid)
+{
+    const int8_t shifts[16] = {0, 2, 4, 6, 0, 2, 4, 6,
+                               0, 2, 4, 6, 0, 2, 4, 6};
+    const uint8_t bits[16] = {1, 2, 4, 8, 16, 32, 64, 128,
+                              1, 2, 4, 8, 16, 32, 64, 128};
+    uint8x16_t is_acgt;
+    uint8x16_t codes;
+    uint16x4_t quads;
+
+    comp_neon(bases, &is_acgt);
+    codes = vandq_u8(is_acgt, vld1q_u8(bits));
+    *valid = vaddv_u8(vget_low_u8(codes)) |
+            (uint32_t)vaddv_u8(vget_high_u8(codes)) << 8;
+    codes = veorq_u8(vshrq_n_u8(bases, 1), vshrq_n_u8(bases, 2));
+    codes = vandq_u8(vandq_u8(codes, vdupq_n_u8(3)), is_acgt);
+    codes = vshlq_u8(codes, vld1q_s8(shifts));
+    quads = vmovn_u32(vpaddlq_u16(vpaddlq_u8(codes)));
+    return vget_lane_u32(vreinterpret_u32_u8(
+            vmovn_u16(vcombine_u16(quads, quads))), 0);
+}
+
+static int
+pack_neon(const char *seq, size_t len, uint64_t *packed, uint64_t *nmask)
+{
+    uint64_t words[4];
+    uint32_t valid_lo = 0;
+    uint32_t valid_hi = 0;
+    uint64_t lo = 0;
+    uint64_t hi = 0;
+
+    load_bases(seq, len, words);
+    lo = pack_vec_neon(vcombine_u8(vcreate_u8(words[0]), vcreate_u8(words[1])),
+                       &valid_lo);
+    if (len > 16) {
+        hi = pack_vec_neon(vcombine_u8(vcreate_u8(words[2]),
+                                       vcreate_u8(words[3])), &valid_hi);
+    }
+    *packed = lo | hi << 32;
+    *nmask = ~(valid_lo | (uint64_t)valid_hi << 16) & len_mask(len);
+    return *nmask != 0;
+}
+
+static const struct qes_simd_ops neon_ops = {
+    QES_SIMD_NEON, "neon",
+    hamming_max_neon, revcomp_neon, pack_neon,
+};
+#endif /* QES_SIMD_ARM */
+
+
+/*
+ * Dispatch
+ */
+
+/* Kernels of each level this build has, or NULL */
+static const struct qes_simd_ops *const level_ops[QES_SIMD_N_LEVELS] = {
+    &scalar_ops,
+#ifdef QES_SIMD_X86
+    &sse42_ops, &avx2_ops, &avx512_ops,
+#else
+    NULL, NULL, NULL,
+#endif
+#ifdef QES_SIMD_ARM
+    &neon_ops,
+#else
+    NULL,
+#endif
+};
+
+/* Scalar until startup, so it's always safe to call through */
+const struct qes_simd_ops *qes_simd = &scalar_ops;
+
+enum qes_simd_level
+qes_simd_detect(void)
+{
+#ifdef QES_SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512bw") &&
+            __builtin_cpu_supports("popcnt")) {
+        return QES_SIMD_AVX512;
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) {
+        return QES_SIMD_AVX2;
+    }
+    if (__builtin_cpu_supports("sse4.2") &&
+            __builtin_cpu_supports("popcnt")) {
+        return QES_SIMD_SSE42;
+    }
+#elif defined(QES_SIMD_ARM)
+    /* NEON is part of AArch64 */
+    return QES_SIMD_NEON;
+#endif
+    return QES_SIMD_SCALAR;
+}
+
+int
+qes_simd_set(enum qes_simd_level level)
+{
+    const enum qes_simd_level best = qes_simd_detect();
+
+    if ((int)level < 0 || level >= QES_SIMD_N_LEVELS) {
+        return -1;
+    }
+    if (level_ops[level] == NULL) {
+        return 1;
+    }
+    /* The x86 levels each need those before them */
+    if (level != QES_SIMD_SCALAR && level != QES_SIMD_NEON &&
+            (best == QES_SIMD_NEON || level > best)) {
+        return 1;
+    }
+    qes_simd = level_ops[level];
+    return 0;
+}
+
+int
+qes_simd_parse(const char *name)
+{
+    int level = 0;
+
+    if (name == NULL) {
+        return -1;
+    }
+    for (level = 0; level < QES_SIMD_N_LEVELS; level++) {
+        if (strcmp(name, level_names[level]) == 0) {
+            return level;
+        }
+    }
+    return -1;
+}
+
+const char *
+qes_simd_name(enum qes_simd_level level)
+{
+    if ((int)level < 0 || level >= QES_SIMD_N_LEVELS) {
+        return NULL;
+    }
+    return level_names[level];
+}
+
+/* Picks the kernels as the program starts, before any threads */
+__attribute__((constructor)) static void
+qes_simd_init(void)
+{
+    int level = qes_simd_parse(getenv("QES_SIMD"));
+
+    if (level < 0 || qes_simd_set(level) != 0) {
+        qes_simd_set(qes_simd_detect());
+    }
+}
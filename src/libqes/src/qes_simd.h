@@ -0,0 +1,101 @@
+/*
+ * Copyright 2015 Kevin Murray <spam@kdmurray.id.au>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * ============================================================================
+ *
+ *       Filename:  qes_simd.h
+ *
+ *    Description:  SIMD kernels, picked for the CPU at run time
+ *        License:  GPLv3+
+ *         Author:  Kevin Murray, spam@kdmurray.id.au
+ *
+ * ============================================================================
+ */
+
+#ifndef QES_SIMD_H
+#define QES_SIMD_H
+
+#include <qes_util.h>
+
+/* Kernels are compiled for every level the compiler can target, each in
+ * functions of their own target, so no -march flag is needed and one binary
+ * runs everywhere. The best level the CPU supports is picked at startup,
+ * unless the QES_SIMD environment variable names another (e.g.
+ * QES_SIMD=scalar), which is useful for benchmarking. */
+enum qes_simd_level {
+    QES_SIMD_SCALAR = 0,
+    QES_SIMD_SSE42 = 1,
+    QES_SIMD_AVX2 = 2,
+    QES_SIMD_AVX512 = 3,        /* AVX-512BW */
+    QES_SIMD_NEON = 4,
+};
+#define QES_SIMD_N_LEVELS 5
+
+struct qes_simd_ops {
+    enum qes_simd_level level;
+    const char *name;
+    /* As qes_match_hamming_max, with len given */
+    int_fast32_t (*hamming_max)(const char *seq1, const char *seq2,
+                                size_t len, int_fast32_t max);
+    /* Reverse-complements exactly len bases in place, upper casing them and
+     * making anything but ACGT an N. Returns how many weren't ACGT. */
+    size_t (*revcomp)(char *seq, size_t len);
+    /* As qes_sequtil_pack, with 1 to 32 bases and nmask given */
+    int (*pack)(const char *seq, size_t len, uint64_t *packed,
+                uint64_t *nmask);
+};
+
+/* The kernels in use */
+extern const struct qes_simd_ops *qes_simd;
+
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_simd_detect
+Parameters:     void
+Description:    Finds the best level of kernels the CPU can run.
+Returns:        enum qes_simd_level: The level.
+ *===========================================================================*/
+enum qes_simd_level qes_simd_detect(void);
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_simd_set
+Parameters:     enum qes_simd_level level: Level of kernels to use
+Description:    Switches every caller to the kernels of ``level``, e.g. to
+                compare them. Not thread safe: call before starting threads.
+Returns:        int: 0 on success, 1 if this CPU or build can't run them, -1
+                on bad parameters.
+ *===========================================================================*/
+int qes_simd_set(enum qes_simd_level level);
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_simd_parse
+Parameters:     const char *name: Name of a level, as in qes_simd->name
+Description:    Looks up a level by name: scalar, sse4.2, avx2, avx512 or
+                neon.
+Returns:        int: The level, or -1 if there's none of that name.
+ *===========================================================================*/
+int qes_simd_parse(const char *name);
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_simd_name
+Parameters:     enum qes_simd_level level: A level
+Description:    Names a level.
+Returns:        const char *: Its name, or NULL if it's not a level.
+ *===========================================================================*/
+const char *qes_simd_name(enum qes_simd_level level);
+
+#endif /* QES_SIMD_H */
@@ -0,0 +1,547 @@
+/*
+ * Copyright 2015 Kevin Murray <spam@kdmurray.id.au>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * ============================================================================
+ *
+ *       Filename:  qes_split.c
+ *
+ *    Description:  Split sequence files into record-aligned byte ranges
+ *        License:  GPLv3+
+ *         Author:  Kevin Murray, spam@kdmurray.id.au
+ *
+ * ============================================================================
+ */
+
+#include "qes_split.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+/* Size of a BGZF block header, and the maximum size of a block */
+#define BGZF_HDR_LEN 18
+#define BGZF_MAX_BLOCK 65536
+/* Number of following blocks we check to confirm a candidate block start */
+#define BGZF_CHAIN_CHECK 4
+
+
+static inline int
+bgzf_is_header(const unsigned char *hdr)
+{
+    return hdr[0] == 0x1f && hdr[1] == 0x8b && hdr[2] == 8 &&
+           (hdr[3] & 4) && hdr[10] == 6 && hdr[11] == 0 &&
+           hdr[12] == 'B' && hdr[13] == 'C' && hdr[14] == 2 && hdr[15] == 0;
+}
+
+/* Reads the header of the block at ``offset``, giving its total size and
+ * (optionally) the uncompressed size of its contents. */
+static int
+bgzf_block_at(int fd, off_t offset, off_t *bsize, uint32_t *isize)
+{
+    unsigned char hdr[BGZF_HDR_LEN];
+    unsigned char tail[4];
+
+    if (pread(fd, hdr, BGZF_HDR_LEN, offset) != BGZF_HDR_LEN) {
+        return 0;
+    }
+    if (!bgzf_is_header(hdr)) {
+        return 0;
+    }
+    *bsize = (off_t)(hdr[16] | (hdr[17] << 8)) + 1;
+    if (isize != NULL) {
+        if (pread(fd, tail, 4, offset + *bsize - 4) != 4) {
+            return 0;
+        }
+        *isize = (uint32_t)tail[0] | ((uint32_t)tail[1] << 8) |
+                 ((uint32_t)tail[2] << 16) | ((uint32_t)tail[3] << 24);
+    }
+    return 1;
+}
+
+/* The gzip magic can appear by chance in compressed data, so we only accept
+ * a block start if the next few blocks are also valid (or we hit EOF). */
+static int
+bgzf_chain_ok(int fd, off_t offset, off_t filesize)
+{
+    off_t bsize = 0;
+    size_t iii;
+
+    for (iii = 0; iii < BGZF_CHAIN_CHECK; iii++) {
+        if (offset == filesize) {
+            return 1;
+        }
+        if (!bgzf_block_at(fd, offset, &bsize, NULL)) {
+            return 0;
+        }
+        offset += bsize;
+        if (offset > filesize) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Finds the first BGZF block starting at or after ``from``. Returns
+ * ``filesize`` if there is none. */
+static off_t
+bgzf_next_block(int fd, off_t from, off_t filesize)
+{
+    const size_t buflen = BGZF_MAX_BLOCK + BGZF_HDR_LEN;
+    unsigned char *buf = NULL;
+    ssize_t got = 0;
+    ssize_t iii = 0;
+    off_t ret = filesize;
+
+    buf = qes_malloc(buflen);
+    while (from < filesize) {
+        got = pread(fd, buf, buflen, from);
+        if (got <= 0) {
+            break;
+        }
+        for (iii = 0; iii + BGZF_HDR_LEN <= got; iii++) {
+            if (bgzf_is_header(buf + iii) &&
+                    bgzf_chain_ok(fd, from + iii, filesize)) {
+                ret = from + iii;
+                goto done;
+            }
+        }
+        /* Overlap windows so headers spanning two reads aren't missed */
+        from += got - BGZF_HDR_LEN + 1;
+        if (got < (ssize_t)buflen) {
+            break;
+        }
+    }
+done:
+    qes_free(buf);
+    return ret;
+}
+
+/* Sum of the uncompressed sizes of the blocks in [start, end) */
+static off_t
+bgzf_inflated_size(int fd, off_t start, off_t end)
+{
+    off_t total = 0;
+    off_t bsize = 0;
+    uint32_t isize = 0;
+
+    while (start < end) {
+        if (!bgzf_block_at(fd, start, &bsize, &isize)) {
+            return -1;
+        }
+        total += isize;
+        start += bsize;
+    }
+    return total;
+}
+
+enum qes_split_format
+qes_split_guess_format(const char *path)
+{
+    unsigned char hdr[BGZF_HDR_LEN];
+    ssize_t got = 0;
+    int fd = -1;
+
+    if (path == NULL) {
+        return QES_SPLIT_UNKNOWN;
+    }
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return QES_SPLIT_UNKNOWN;
+    }
+    got = pread(fd, hdr, BGZF_HDR_LEN, 0);
+    close(fd);
+    if (got < 2 || hdr[0] != 0x1f || hdr[1] != 0x8b) {
+        return got < 0 ? QES_SPLIT_UNKNOWN : QES_SPLIT_PLAIN;
+    }
+    if (got == BGZF_HDR_LEN && bgzf_is_header(hdr)) {
+        return QES_SPLIT_BGZF;
+    }
+    return QES_SPLIT_GZIP;
+}
+
+/* Length of a line, ignoring any line ending */
+static inline size_t
+line_len(const struct qes_str *line)
+{
+    size_t len = line->len;
+
+    while (len > 0 && (line->str[len - 1] == '\n' ||
+                       line->str[len - 1] == '\r')) {
+        len--;
+    }
+    return len;
+}
+
+static inline int
+is_fastq_record(const struct qes_str *lines)
+{
+    return lines[0].len > 0 && lines[0].str[0] == FASTQ_DELIM &&
+           lines[2].len > 0 && lines[2].str[0] == FASTQ_QUAL_DELIM &&
+           line_len(&lines[1]) == line_len(&lines[3]);
+}
+
+/* Length of a read name, without any comment or /1 or /2 suffix */
+static inline size_t
+read_name_len(const char *name, size_t maxlen)
+{
+    size_t len = 0;
+
+    while (len < maxlen && name[len] != '\0' && !isspace(name[len])) {
+        len++;
+    }
+    if (len > 2 && name[len - 2] == '/' &&
+            (name[len - 1] == '1' || name[len - 1] == '2')) {
+        len -= 2;
+    }
+    return len;
+}
+
+static inline int
+is_same_name(const char *name1, size_t len1, const char *name2, size_t len2)
+{
+    len1 = read_name_len(name1, len1);
+    return len1 == read_name_len(name2, len2) &&
+           strncmp(name1, name2, len1) == 0;
+}
+
+static inline int
+is_same_pair(const struct qes_str *hdr1, const struct qes_str *hdr2)
+{
+    return is_same_name(hdr1->str, hdr1->len, hdr2->str, hdr2->len);
+}
+
+off_t
+qes_split_sync_fastq(struct qes_file *qf, int partial, int pairs)
+{
+    /* Two records worth of lines, and where each line starts */
+    struct qes_str lines[8];
+    off_t starts[8];
+    const size_t want = pairs ? 8 : 4;
+    size_t have = 0;
+    size_t iii = 0;
+    ssize_t len = 0;
+    off_t ret = -1;
+
+    if (!qes_file_ok(qf)) {
+        return -2;
+    }
+    for (iii = 0; iii < want; iii++) {
+        qes_str_init(&lines[iii], __INIT_LINE_LEN);
+    }
+    if (partial) {
+        len = qes_file_readline_str(qf, &lines[0]);
+        if (len < 0) {
+            ret = len == EOF ? -1 : -2;
+            goto done;
+        }
+    }
+    while (1) {
+        while (have < want) {
+            starts[have] = qf->filepos;
+            len = qes_file_readline_str(qf, &lines[have]);
+            if (len < 0) {
+                ret = len == EOF ? -1 : -2;
+                goto done;
+            }
+            have++;
+        }
+        if (is_fastq_record(lines)) {
+            if (!pairs) {
+                ret = starts[0];
+                break;
+            }
+            if (is_fastq_record(lines + 4)) {
+                /* If the first record isn't mated to the second, it is the
+                 * second read of a pair, and the next record starts a pair */
+                ret = is_same_pair(&lines[0], &lines[4]) ? starts[0] : starts[4];
+                break;
+            }
+        }
+        /* Shift along by one line, recycling the first line's buffer */
+        {
+            struct qes_str first = lines[0];
+            memmove(lines, lines + 1, (want - 1) * sizeof(*lines));
+            memmove(starts, starts + 1, (want - 1) * sizeof(*starts));
+            lines[want - 1] = first;
+            have--;
+        }
+    }
+done:
+    for (iii = 0; iii < want; iii++) {
+        qes_str_destroy_cp(&lines[iii]);
+    }
+    return ret;
+}
+
+int
+qes_split_range(const char *path, size_t idx, size_t n, int pairs,
+                struct qes_split_range *range)
+{
+    enum qes_split_format fmt = QES_SPLIT_UNKNOWN;
+    struct stat st;
+    struct qes_file *qf = NULL;
+    off_t start = 0;
+    off_t end = 0;
+    off_t skip = 0;
+    int fd = -1;
+    int ret = -1;
+
+    if (path == NULL || range == NULL || n < 1 || idx >= n) {
+        return -1;
+    }
+    fmt = qes_split_guess_format(path);
+    if (stat(path, &st) != 0) {
+        return -1;
+    }
+    switch (fmt) {
+    case QES_SPLIT_PLAIN:
+        start = (off_t)(st.st_size * (double)idx / n);
+        end = (off_t)(st.st_size * (double)(idx + 1) / n);
+        range->offset = start;
+        range->limit = idx + 1 == n ? -1 : end - start;
+        break;
+    case QES_SPLIT_BGZF:
+        fd = open(path, O_RDONLY);
+        if (fd < 0) {
+            return -1;
+        }
+        start = idx == 0 ? 0 :
+                bgzf_next_block(fd, st.st_size * (double)idx / n, st.st_size);
+        end = idx + 1 == n ? st.st_size :
+              bgzf_next_block(fd, st.st_size * (double)(idx + 1) / n,
+                              st.st_size);
+        range->offset = start;
+        range->limit = idx + 1 == n ? -1 :
+                       bgzf_inflated_size(fd, start, end);
+        close(fd);
+        if (idx + 1 < n && range->limit < 0) {
+            return -1;
+        }
+        break;
+    case QES_SPLIT_GZIP:
+        if (n > 1) {
+            return 1;
+        }
+        range->offset = 0;
+        range->limit = -1;
+        break;
+    case QES_SPLIT_UNKNOWN:
+    default:
+        return -1;
+    }
+    range->skip = 0;
+    if (idx == 0) {
+        /* The first range starts at the start of the file */
+        return 0;
+    }
+    qf = qes_file_open_offset_errnil(path, "r", range->offset);
+    if (qf == NULL) {
+        return -1;
+    }
+    skip = qes_split_sync_fastq(qf, 1, pairs);
+    if (skip == -1) {
+        /* No records start in this range, so skip to EOF */
+        range->skip = qf->filepos;
+        ret = 0;
+    } else if (skip >= 0) {
+        range->skip = skip;
+        ret = 0;
+    }
+    qes_file_close(qf);
+    return ret;
+}
+
+/* Initial half-width of the window searched for an R2 mate. It is
+ * quadrupled until the mate is found or the window covers the whole file. */
+#define MATE_WINDOW (1<<20)
+
+/* Finds the start of the read named ``name`` in the byte range [lo, hi) of
+ * ``path``. Returns 0 and sets ``range`` if found, 1 if not, -1 on error. */
+static int
+find_mate(const char *path, const char *name, size_t namelen, off_t lo,
+          off_t hi, struct qes_split_range *range)
+{
+    struct qes_file *qf = NULL;
+    struct qes_seqfile *sf = NULL;
+    struct qes_seq *seq = NULL;
+    off_t pos = 0;
+    int ret = 1;
+
+    range->offset = lo;
+    range->skip = 0;
+    range->limit = -1;
+    if (lo > 0) {
+        qf = qes_file_open_offset_errnil(path, "r", lo);
+        if (qf == NULL) {
+            return -1;
+        }
+        pos = qes_split_sync_fastq(qf, 1, 0);
+        qes_file_close(qf);
+        if (pos == -1) {
+            return 1;
+        } else if (pos < 0) {
+            return -1;
+        }
+        range->skip = pos;
+    }
+    sf = qes_split_open(path, range, 1);
+    if (sf == NULL) {
+        return -1;
+    }
+    seq = qes_seq_create();
+    while (lo + (pos = sf->qf->filepos) < hi) {
+        if (qes_seqfile_read(sf, seq) < 1) {
+            break;
+        }
+        if (is_same_name(seq->name.str, seq->name.len, name, namelen)) {
+            range->skip = pos;
+            ret = 0;
+            break;
+        }
+    }
+    qes_seq_destroy(seq);
+    qes_seqfile_destroy(sf);
+    return ret;
+}
+
+int
+qes_split_range_paired(const char *path1, const char *path2, size_t idx,
+                       size_t n, struct qes_split_range *range1,
+                       struct qes_split_range *range2)
+{
+    struct qes_seqfile *sf = NULL;
+    struct qes_seq *seq = NULL;
+    struct stat st1;
+    struct stat st2;
+    off_t estimate = 0;
+    off_t window = MATE_WINDOW;
+    off_t lo = 0;
+    off_t hi = 0;
+    int ret = 0;
+
+    if (path1 == NULL || path2 == NULL || range1 == NULL || range2 == NULL) {
+        return -1;
+    }
+    if (qes_split_guess_format(path1) != QES_SPLIT_PLAIN ||
+            qes_split_guess_format(path2) != QES_SPLIT_PLAIN) {
+        return n > 1 ? 1 : qes_split_range(path1, idx, n, 0, range1);
+    }
+    ret = qes_split_range(path1, idx, n, 0, range1);
+    if (ret != 0) {
+        return ret;
+    }
+    range2->offset = 0;
+    range2->skip = 0;
+    range2->limit = -1;
+    if (idx == 0) {
+        return 0;
+    }
+    /* Find the name of R1's first read. If there isn't one, R2 is never
+     * read, so any range will do. */
+    sf = qes_split_open(path1, range1, 1);
+    if (sf == NULL) {
+        return -1;
+    }
+    seq = qes_seq_create();
+    if (qes_seqfile_read(sf, seq) < 1) {
+        ret = 0;
+        goto exit;
+    }
+    if (stat(path1, &st1) != 0 || stat(path2, &st2) != 0) {
+        ret = -1;
+        goto exit;
+    }
+    /* Mates are at roughly the same relative offset in each file */
+    estimate = (off_t)((double)(range1->offset + range1->skip) *
+                       st2.st_size / st1.st_size);
+    while (1) {
+        lo = estimate > window ? estimate - window : 0;
+        hi = estimate + window < st2.st_size ? estimate + window : st2.st_size;
+        ret = find_mate(path2, seq->name.str, seq->name.len, lo, hi, range2);
+        if (ret != 1 || (lo == 0 && hi == st2.st_size)) {
+            break;
+        }
+        window *= 4;
+    }
+exit:
+    qes_seq_destroy(seq);
+    qes_seqfile_destroy(sf);
+    return ret;
+}
+
+struct qes_seqfile *
+qes_split_open(const char *path, const struct qes_split_range *range,
+               size_t stride)
+{
+    if (path == NULL || range == NULL) {
+        return NULL;
+    }
+    return qes_split_open_at(path, range, range->skip, stride);
+}
+
+struct qes_seqfile *
+qes_split_open_at(const char *path, const struct qes_split_range *range,
+                  off_t pos, size_t stride)
+{
+    struct qes_seqfile *sf = NULL;
+    off_t offset = 0;
+    off_t skip = 0;
+    off_t bsize = 0;
+    uint32_t isize = 0;
+    int fd = -1;
+
+    if (path == NULL || range == NULL || pos < range->skip) {
+        return NULL;
+    }
+    offset = range->offset;
+    skip = pos;
+    switch (qes_split_guess_format(path)) {
+    case QES_SPLIT_PLAIN:
+        offset += skip;
+        skip = 0;
+        break;
+    case QES_SPLIT_BGZF:
+        /* Hop over whole blocks using their headers */
+        fd = open(path, O_RDONLY);
+        if (fd < 0) {
+            return NULL;
+        }
+        while (bgzf_block_at(fd, offset, &bsize, &isize) && isize > 0 &&
+                (off_t)isize <= skip) {
+            offset += bsize;
+            skip -= isize;
+        }
+        close(fd);
+        break;
+    default:
+        break;
+    }
+    sf = qes_seqfile_create_offset(path, "r", offset);
+    if (sf == NULL) {
+        return NULL;
+    }
+    if (skip > 0 && qes_file_skip(sf->qf, skip) != skip) {
+        /* Skipping past EOF is fine, it just means no records */
+        if (!sf->qf->eof) {
+            qes_seqfile_destroy(sf);
+            return NULL;
+        }
+    }
+    sf->qf->filepos = pos;
+    qes_seqfile_guess_format(sf);
+    qes_seqfile_set_limit(sf, range->limit, stride);
+    return sf;
+}
@@ -0,0 +1,154 @@
+/*
+ * Copyright 2015 Kevin Murray <spam@kdmurray.id.au>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * ============================================================================
+ *
+ *       Filename:  qes_split.h
+ *
+ *    Description:  Split sequence files into record-aligned byte ranges
+ *        License:  GPLv3+
+ *         Author:  Kevin Murray, spam@kdmurray.id.au
+ *
+ * ============================================================================
+ */
+
+#ifndef QES_SPLIT_H
+#define QES_SPLIT_H
+
+#include <qes_util.h>
+#include <qes_file.h>
+#include <qes_seqfile.h>
+
+
+enum qes_split_format {
+    QES_SPLIT_UNKNOWN = 0,
+    QES_SPLIT_PLAIN = 1,    /* Uncompressed text */
+    QES_SPLIT_BGZF = 2,     /* Blocked gzip, as made by bgzip */
+    QES_SPLIT_GZIP = 3,     /* Any other gzip file. Can't be split */
+};
+
+/* A range of a file that one reader should parse. Readers open the file at
+ * ``offset``, discard ``skip`` bytes to reach the first record, and then read
+ * every record that starts at or before ``limit`` bytes past ``offset``. All
+ * but ``offset`` are in uncompressed bytes. */
+struct qes_split_range {
+    off_t offset;
+    off_t skip;
+    off_t limit;    /* -1 means read until EOF */
+};
+
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_split_guess_format
+Parameters:     const char *path: File to inspect.
+Description:    Inspects the first bytes of ``path`` to decide whether it is
+                plain text, BGZF, or a plain gzip file.
+Returns:        enum qes_split_format: the format, or QES_SPLIT_UNKNOWN if
+                ``path`` can't be read.
+ *===========================================================================*/
+enum qes_split_format qes_split_guess_format(const char *path);
+
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_split_sync_fastq
+Parameters:     struct qes_file *qf: File to read, which may be positioned
+                    anywhere in a FASTQ file.
+                int partial: If true, the current line is assumed to be
+                    partial and is always discarded.
+                int pairs: If true, find the start of an interleaved pair
+                    rather than of a single record.
+Description:    Reads ``qf`` until the start of a FASTQ record is found. A
+                quality line may also start with '@', so a record is only
+                accepted if its third line starts with '+' and its sequence
+                and quality lines have equal length.
+Returns:        off_t: the value of ``qf->filepos`` at the first record start,
+                -1 if there are no records left, or -2 on error. Note that
+                ``qf`` is left positioned after the record, not at it.
+ *===========================================================================*/
+off_t qes_split_sync_fastq(struct qes_file *qf, int partial, int pairs);
+
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_split_range
+Parameters:     const char *path: FASTQ file to split.
+                size_t idx: Zero-based index of the range to calculate.
+                size_t n: Number of ranges the file is split into.
+                int pairs: If true, ranges start at interleaved pair starts.
+                struct qes_split_range *range: Output range.
+Description:    Calculates the ``idx``th of ``n`` record-aligned ranges of
+                ``path``. Every record of ``path`` falls in exactly one range.
+                Plain text files are split by byte, BGZF files on block
+                boundaries. Ordinary gzip files can't be split.
+Returns:        int: 0 on success, 1 if the file can't be split into ``n``
+                ranges, -1 on error.
+ *===========================================================================*/
+int qes_split_range(const char *path, size_t idx, size_t n, int pairs,
+                    struct qes_split_range *range);
+
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_split_range_paired
+Parameters:     const char *path1, *path2: R1 and R2 FASTQ files to split.
+                size_t idx: Zero-based index of the range to calculate.
+                size_t n: Number of ranges the files are split into.
+                struct qes_split_range *range1, *range2: Output ranges.
+Description:    Calculates the ``idx``th of ``n`` ranges of ``path1`` as with
+                ``qes_split_range``, and the range of ``path2`` that starts at
+                the mate of the first read in ``range1``. R1 and R2 lines
+                needn't be the same length, so R2 is searched by read name in
+                a growing window around the proportional offset. ``range2``
+                has no limit, so callers must stop reading R2 when R1 ends.
+                Only uncompressed files can be split this way.
+Returns:        int: 0 on success, 1 if the files can't be split into ``n``
+                ranges (or the mate can't be found), -1 on error.
+ *===========================================================================*/
+int qes_split_range_paired(const char *path1, const char *path2, size_t idx,
+                           size_t n, struct qes_split_range *range1,
+                           struct qes_split_range *range2);
+
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_split_open
+Parameters:     const char *path: FASTQ file to open.
+                const struct qes_split_range *range: Range to read.
+                size_t stride: Records per unit, i.e. 2 for interleaved pairs.
+Description:    Opens ``path`` for reading only the records in ``range``.
+Returns:        struct qes_seqfile *: A seqfile that returns EOF at the end of
+                ``range``, or NULL on error.
+ *===========================================================================*/
+struct qes_seqfile *qes_split_open(const char *path,
+                                   const struct qes_split_range *range,
+                                   size_t stride);
+
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_split_open_at
+Parameters:     As for ``qes_split_open``, plus
+                off_t pos: Uncompressed offset from ``range->offset`` of a
+                    record in ``range`` to start at, e.g. a saved
+                    ``filepos``. Must be at least ``range->skip``.
+Description:    Opens ``range`` part way through. Plain text files seek
+                straight to ``pos``, and BGZF files to the block containing
+                it, so only ordinary gzip files need to decompress everything
+                before ``pos``. ``filepos`` of the returned file is ``pos``.
+Returns:        struct qes_seqfile *: As for ``qes_split_open``.
+ *===========================================================================*/
+struct qes_seqfile *qes_split_open_at(const char *path,
+                                      const struct qes_split_range *range,
+                                      off_t pos, size_t stride);
+
+#endif /* QES_SPLIT_H */
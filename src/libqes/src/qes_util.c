@@ -73,3 +73,78 @@ errprintexit (QES_ERRFN_ARGS)
     QES_EXIT_FN(EXIT_FAILURE);
 }
 
+
+
+static int64_t qes_mem_cur[QES_MEM_TAGS];
+static int64_t qes_mem_max[QES_MEM_TAGS];
+
+void
+qes_mem_account(int tag, int64_t bytes)
+{
+    int64_t now = 0;
+    int64_t peak = 0;
+
+    if (tag < 0 || tag >= QES_MEM_TAGS) {
+        return;
+    }
+    now = __atomic_add_fetch(&qes_mem_cur[tag], bytes, __ATOMIC_RELAXED);
+    peak = __atomic_load_n(&qes_mem_max[tag], __ATOMIC_RELAXED);
+    while (now > peak &&
+           !__atomic_compare_exchange_n(&qes_mem_max[tag], &peak, now, 1,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+int64_t
+qes_mem_current(int tag)
+{
+    if (tag < 0 || tag >= QES_MEM_TAGS) {
+        return 0;
+    }
+    return __atomic_load_n(&qes_mem_cur[tag], __ATOMIC_RELAXED);
+}
+
+int64_t
+qes_mem_peak(int tag)
+{
+    if (tag < 0 || tag >= QES_MEM_TAGS) {
+        return 0;
+    }
+    return __atomic_load_n(&qes_mem_max[tag], __ATOMIC_RELAXED);
+}
+
+/* zlib frees without a size, so each block starts with its size. The header
+ * is padded to keep the block aligned. */
+union qes_zblock {
+    size_t size;
+    long double align_ld;
+    void *align_ptr;
+};
+
+void *
+qes_zalloc(void *opaque, unsigned int items, unsigned int size)
+{
+    size_t bytes = (size_t)items * size;
+    union qes_zblock *block = malloc(sizeof(*block) + bytes);
+
+    (void) opaque;
+    if (block == NULL) {
+        return NULL;
+    }
+    block->size = bytes;
+    qes_mem_account(QES_MEM_ZLIB, (int64_t)bytes);
+    return block + 1;
+}
+
+void
+qes_zfree(void *opaque, void *ptr)
+{
+    union qes_zblock *block = ptr;
+
+    (void) opaque;
+    if (block == NULL) {
+        return;
+    }
+    block--;
+    qes_mem_account(QES_MEM_ZLIB, -(int64_t)block->size);
+    free(block);
+}
@@ -121,6 +121,40 @@ void errprint (QES_ERRFN_ARGS);
 void errprintexit (QES_ERRFN_ARGS)  __attribute__ ((noreturn));
 typedef void (*qes_errhandler_func) (const char*, const char *, int, ...);
 
+/*
+ * Memory accounting
+ */
+
+/* Allocations made with the _tagged wrappers below are counted against a
+ * tag, so current and peak use can be reported by subsystem. libqes counts
+ * its file buffers as QES_MEM_IO and zlib's states as QES_MEM_ZLIB. Users of
+ * libqes can count their own allocations with tags from QES_MEM_USER up. */
+enum qes_mem_tag {
+    QES_MEM_IO = 0,
+    QES_MEM_ZLIB = 1,
+    QES_MEM_USER = 2,
+};
+#define QES_MEM_TAGS 8
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_mem_account
+Parameters:     int tag: Tag to count against, 0 <= tag < QES_MEM_TAGS.
+                int64_t bytes: Bytes allocated, or negative if freed.
+Description:    Counts an allocation or free, updating the tag's peak. Safe
+                to call from several threads.
+Returns:        void
+ *===========================================================================*/
+void qes_mem_account(int tag, int64_t bytes);
+
+/* Bytes currently counted against tag, and the most there has been */
+int64_t qes_mem_current(int tag);
+int64_t qes_mem_peak(int tag);
+
+/* zlib alloc_func and free_func, which count zlib's memory as QES_MEM_ZLIB.
+ * Set a z_stream's zalloc and zfree to these before initialising it. */
+void *qes_zalloc(void *opaque, unsigned int items, unsigned int size);
+void qes_zfree(void *opaque, void *ptr);
+
 /* qes_roundupz:
  *   Round up a `size_t` to the next highest power of two.
  */
@@ -247,4 +281,55 @@ qes_realloc_ (void *data, size_t size, qes_errhandler_func onerr, const char *fi
     }                               \
     STMT_END
 
+/* As above, counting the allocation against a tag. free() doesn't know the
+ * size of what it frees, so callers give it. */
+static inline void *
+qes_calloc_tagged_ (size_t n, size_t size, int tag, qes_errhandler_func onerr,
+        const char *file, int line)
+{
+    void *ret = qes_calloc_(n, size, onerr, file, line);
+    if (ret != NULL) {
+        qes_mem_account(tag, (int64_t)(n * size));
+    }
+    return ret;
+}
+#define qes_calloc_tagged(n, sz, tag) \
+    qes_calloc_tagged_(n, sz, tag, QES_DEFAULT_ERR_FN, __FILE__, __LINE__)
+
+static inline void *
+qes_malloc_tagged_ (size_t size, int tag, qes_errhandler_func onerr,
+        const char *file, int line)
+{
+    void *ret = qes_malloc_(size, onerr, file, line);
+    if (ret != NULL) {
+        qes_mem_account(tag, (int64_t)size);
+    }
+    return ret;
+}
+#define qes_malloc_tagged(sz, tag) \
+    qes_malloc_tagged_(sz, tag, QES_DEFAULT_ERR_FN, __FILE__, __LINE__)
+
+static inline void *
+qes_realloc_tagged_ (void *data, size_t old_size, size_t size, int tag,
+        qes_errhandler_func onerr, const char *file, int line)
+{
+    void *ret = qes_realloc_(data, size, onerr, file, line);
+    if (ret != NULL) {
+        qes_mem_account(tag, (int64_t)size - (int64_t)old_size);
+    }
+    return ret;
+}
+#define qes_realloc_tagged(ptr, old_sz, sz, tag) \
+    qes_realloc_tagged_(ptr, old_sz, sz, tag, QES_DEFAULT_ERR_FN, __FILE__, \
+                        __LINE__)
+
+#define qes_free_tagged(data, sz, tag)                  \
+    STMT_BEGIN                                          \
+    if (data != NULL) {                                 \
+        qes_mem_account(tag, -(int64_t)(sz));           \
+        free(data);                                     \
+        data = NULL;                                    \
+    }                                                   \
+    STMT_END
+
 #endif /* QES_UTIL_H */
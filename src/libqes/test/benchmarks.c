@@ -32,6 +32,9 @@
 #include <stdlib.h>
 #include <qes_file.h>
 #include <qes_seqfile.h>
+#include <qes_match.h>
+#include <qes_sequtil.h>
+#include <qes_simd.h>
 #ifdef ZLIB_FOUND
 #  include <zlib.h>
 #else
@@ -51,6 +54,9 @@ void bench_gnu_getline_file(int silent);
 void bench_qes_seqfile_parse_fq(int silent);
 void bench_kseq_parse_fq(int silent);
 void bench_qes_seqfile_write(int silent);
+void bench_qes_match_hamming(int silent);
+void bench_qes_sequtil_revcomp(int silent);
+void bench_qes_sequtil_pack(int silent);
 #ifdef OPENMP_FOUND
 void bench_qes_seqfile_par_iter_fq_macro(int silent);
 #endif
@@ -236,6 +242,91 @@ bench_qes_seqfile_write(int silent)
 
 }
 
+/* Reads for the kernel benchmarks, made once, so only the kernels (as picked
+ * by QES_SIMD) are timed */
+#define BENCH_N_READS (1<<14)
+#define BENCH_READ_LEN 150
+
+static char *
+bench_reads(void)
+{
+    static char *reads = NULL;
+    uint32_t state = 1;
+    size_t iii = 0;
+
+    if (reads == NULL) {
+        reads = malloc(BENCH_N_READS * BENCH_READ_LEN);
+        assert(reads != NULL);
+        for (iii = 0; iii < BENCH_N_READS * BENCH_READ_LEN; iii++) {
+            state = state * 1103515245 + 12345;
+            reads[iii] = "ACGT"[(state >> 16) & 3];
+        }
+    }
+    return reads;
+}
+
+void
+bench_qes_match_hamming(int silent)
+{
+    const char *reads = bench_reads();
+    int_fast32_t mismatches = 0;
+    size_t iii = 0;
+
+    for (iii = 1; iii < BENCH_N_READS; iii++) {
+        mismatches += qes_match_hamming(reads + (iii - 1) * BENCH_READ_LEN,
+                                        reads + iii * BENCH_READ_LEN,
+                                        BENCH_READ_LEN);
+    }
+    if (!silent) {
+        printf("[qes_match_hamming] (%s) %ld mismatches\n", qes_simd->name,
+               (long)mismatches);
+    }
+}
+
+void
+bench_qes_sequtil_revcomp(int silent)
+{
+    char *reads = bench_reads();
+    size_t iii = 0;
+
+    for (iii = 0; iii < BENCH_N_READS; iii++) {
+        qes_sequtil_revcomp_inplace(reads + iii * BENCH_READ_LEN,
+                                    BENCH_READ_LEN);
+    }
+    if (!silent) {
+        printf("[qes_sequtil_revcomp] (%s) First read starts %.10s\n",
+               qes_simd->name, reads);
+    }
+}
+
+/* Packs windows of 8 to 32 bases along each read, and reverse complements
+ * them packed */
+void
+bench_qes_sequtil_pack(int silent)
+{
+    const char *reads = bench_reads();
+    uint64_t packed = 0;
+    uint64_t nmask = 0;
+    uint64_t sum = 0;
+    size_t len = 0;
+    size_t iii = 0;
+    size_t jjj = 0;
+
+    for (iii = 0; iii < BENCH_N_READS; iii++) {
+        for (jjj = 0; jjj + 32 <= BENCH_READ_LEN; jjj += 8) {
+            len = 8 + (iii + jjj) % 25;
+            qes_sequtil_pack(reads + iii * BENCH_READ_LEN + jjj, len,
+                             &packed, &nmask);
+            qes_sequtil_revcomp_packed(&packed, &nmask, len);
+            sum += packed;
+        }
+    }
+    if (!silent) {
+        printf("[qes_sequtil_pack] (%s) Sum of packed prefixes %" PRIu64 "\n",
+               qes_simd->name, sum);
+    }
+}
+
 static const bench_t benchmarks[] = {
     { "qes_file_readline", &bench_qes_file_readline_file},
     { "qes_file_readline_realloc", &bench_qes_file_readline_realloc_file},
@@ -248,6 +339,9 @@ static const bench_t benchmarks[] = {
 #endif
     { "kseq_parse_fq", &bench_kseq_parse_fq},
     { "qes_seqfile_write", &bench_qes_seqfile_write},
+    { "qes_match_hamming", &bench_qes_match_hamming},
+    { "qes_sequtil_revcomp", &bench_qes_sequtil_revcomp},
+    { "qes_sequtil_pack", &bench_qes_sequtil_pack},
     { NULL, NULL}
 };
 
@@ -34,9 +34,12 @@ struct testgroup_t libqes_tests[] = {
     {"qes/match/", qes_match_tests},
     {"qes/file/", qes_file_tests},
     {"qes/seqfile/", qes_seqfile_tests},
+    {"qes/split/", qes_split_tests},
+    {"qes/gzindex/", qes_gzindex_tests},
     {"qes/seq/", qes_seq_tests},
     {"qes/log/", qes_log_tests},
     {"qes/sequtil/", qes_sequtil_tests},
+    {"qes/simd/", qes_simd_tests},
     {"testdata/", data_tests},
     {"testhelpers/", helper_tests},
     END_OF_GROUPS
@@ -432,6 +432,222 @@ end:
 
 }
 
+static void
+test_qes_file_open_summed (void *ptr)
+{
+    struct qes_file_sums sums;
+    struct qes_file *file = NULL;
+    struct qes_file *in = NULL;
+    struct qes_file *check = NULL;
+    const char *modes[] = {"wT", "w6", "w1R"};
+    char *writeable = NULL;
+    char *readable = NULL;
+    char *crc = NULL;
+    char line[1024];
+    char expt[1024];
+    char hex[9];
+    ssize_t len = 0;
+    size_t iii = 0;
+
+    (void) ptr;
+    readable = find_data_file("test.fastq");
+    tt_assert(readable != NULL);
+    writeable = get_writable_file();
+    tt_assert(writeable != NULL);
+    for (iii = 0; iii < sizeof(modes) / sizeof(*modes); iii++) {
+        file = qes_file_open_summed(writeable, modes[iii]);
+        tt_assert(qes_file_ok(file));
+        tt_assert(qes_file_writable(file));
+        in = qes_file_open(readable, "r");
+        tt_assert(in != NULL);
+        /* Mix all the ways of writing */
+        while ((len = qes_file_readline(in, line, sizeof(line))) > 0) {
+            if (len > 1) {
+                tt_int_op(qes_file_putc(file, line[0]), ==, 1);
+                tt_int_op(qes_file_puts(file, line + 1), ==, len - 1);
+            } else {
+                tt_int_op(qes_file_puts(file, line), ==, len);
+            }
+        }
+        qes_file_close(in);
+        tt_int_op(qes_file_finish(file), ==, 0);
+        tt_int_op(qes_file_finish(file), ==, 0);
+        tt_int_op(qes_file_puts(file, "late"), <, 0);
+        tt_int_op(qes_file_sums(file, &sums), ==, 0);
+        qes_file_close(file);
+        /* The sums must match those of what is on disk... */
+        crc = crc32_file(writeable);
+        snprintf(hex, sizeof(hex), "%08x", sums.crc);
+        tt_str_op(hex, ==, crc);
+        free(crc);
+        /* ... and of the data */
+        crc = crc32_file(readable);
+        snprintf(hex, sizeof(hex), "%08x", sums.data_crc);
+        tt_str_op(hex, ==, crc);
+        free(crc);
+        crc = NULL;
+        tt_int_op(sums.data_size, ==, 144230);
+#ifdef ZLIB_FOUND
+        if (iii > 0) {
+            tt_int_op(sums.size, <, 144230);
+        } else
+#endif
+        {
+            tt_int_op(sums.size, ==, 144230);
+        }
+        /* Which can be read back */
+        in = qes_file_open(readable, "r");
+        check = qes_file_open(writeable, "r");
+        tt_assert(check != NULL);
+        while ((len = qes_file_readline(in, expt, sizeof(expt))) > 0) {
+            tt_int_op(qes_file_readline(check, line, sizeof(line)), ==, len);
+            tt_str_op(line, ==, expt);
+        }
+        tt_int_op(qes_file_readline(check, line, sizeof(line)), ==, EOF);
+        qes_file_close(in);
+        qes_file_close(check);
+    }
+    /* Bad params */
+    tt_ptr_op(qes_file_open_summed(writeable, "r"), ==, NULL);
+    tt_int_op(qes_file_finish(NULL), ==, -1);
+    tt_int_op(qes_file_sums(NULL, &sums), ==, -1);
+    in = qes_file_open(readable, "r");
+    tt_int_op(qes_file_sums(in, &sums), ==, -1);
+end:
+    qes_file_close(file);
+    qes_file_close(in);
+    qes_file_close(check);
+    if (crc != NULL) free(crc);
+    clean_writable_file(writeable);
+    free(readable);
+}
+
+static void
+test_qes_file_sync (void *ptr)
+{
+    struct qes_file_sums synced;
+    struct qes_file_sums sums;
+    struct qes_file *file = NULL;
+    const char *modes[] = {"wT", "w6"};
+    const char *amodes[] = {"aT", "a6"};
+    char *writeable = NULL;
+    char *crc = NULL;
+    char line[64];
+    char hex[9];
+    size_t iii = 0;
+
+    (void) ptr;
+    writeable = get_writable_file();
+    tt_assert(writeable != NULL);
+    for (iii = 0; iii < 2; iii++) {
+        file = qes_file_open_summed(writeable, modes[iii]);
+        tt_assert(file != NULL);
+        tt_int_op(qes_file_puts(file, "kept\n"), ==, 5);
+        tt_int_op(qes_file_sync(file), ==, 0);
+        /* A second sync with no new data changes nothing */
+        tt_int_op(qes_file_sync(file), ==, 0);
+        tt_int_op(qes_file_sums(file, &synced), ==, 0);
+        tt_int_op(synced.data_size, ==, 5);
+        tt_int_op(qes_file_puts(file, "lost\n"), ==, 5);
+        qes_file_close(file);
+        /* Resume from the sync, as after a crash */
+        tt_int_op(truncate(writeable, synced.size), ==, 0);
+        file = qes_file_open_summed(writeable, amodes[iii]);
+        tt_assert(file != NULL);
+        tt_int_op(qes_file_set_sums(file, &synced), ==, 0);
+        tt_int_op(qes_file_puts(file, "resumed\n"), ==, 8);
+        tt_int_op(qes_file_finish(file), ==, 0);
+        tt_int_op(qes_file_sums(file, &sums), ==, 0);
+        tt_int_op(qes_file_set_sums(file, &synced), ==, -1);
+        qes_file_close(file);
+        tt_int_op(sums.data_size, ==, 13);
+        crc = crc32_file(writeable);
+        snprintf(hex, sizeof(hex), "%08x", sums.crc);
+        tt_str_op(hex, ==, crc);
+        free(crc);
+        crc = NULL;
+        file = qes_file_open(writeable, "r");
+        tt_assert(file != NULL);
+        tt_int_op(qes_file_readline(file, line, sizeof(line)), ==, 5);
+        tt_str_op(line, ==, "kept\n");
+        tt_int_op(qes_file_readline(file, line, sizeof(line)), ==, 8);
+        tt_str_op(line, ==, "resumed\n");
+        tt_int_op(qes_file_readline(file, line, sizeof(line)), ==, EOF);
+        qes_file_close(file);
+    }
+    tt_int_op(qes_file_sync(NULL), ==, -1);
+    tt_int_op(qes_file_set_sums(NULL, &sums), ==, -1);
+end:
+    qes_file_close(file);
+    if (crc != NULL) free(crc);
+    clean_writable_file(writeable);
+}
+
+static void
+test_qes_file_mem_estimate (void *ptr)
+{
+    struct qes_file *file = NULL;
+    const char *modes[] = {"wT", "w6"};
+    char *writeable = NULL;
+    char *readable = NULL;
+    int64_t io = 0;
+    int64_t zlib = 0;
+    int64_t io_before = 0;
+    int64_t zlib_before = 0;
+    size_t iii = 0;
+
+    (void) ptr;
+    readable = find_data_file("test.fastq");
+    tt_assert(readable != NULL);
+    writeable = get_writable_file();
+    tt_assert(writeable != NULL);
+    /* Summed writes are counted exactly, bar zlib's state */
+    for (iii = 0; iii < sizeof(modes) / sizeof(*modes); iii++) {
+        tt_int_op(qes_file_mem_estimate(modes[iii], 1, &io, &zlib), ==, 0);
+        io_before = qes_mem_current(QES_MEM_IO);
+        zlib_before = qes_mem_current(QES_MEM_ZLIB);
+        file = qes_file_open_summed(writeable, modes[iii]);
+        tt_assert(file != NULL);
+        tt_int_op(qes_mem_current(QES_MEM_IO) - io_before, ==, io);
+#ifdef ZLIB_FOUND
+        if (iii > 0) {
+            tt_int_op(zlib, >, 0);
+            tt_int_op(qes_mem_current(QES_MEM_ZLIB) - zlib_before, >,
+                      zlib * 9 / 10);
+            tt_int_op(qes_mem_current(QES_MEM_ZLIB) - zlib_before, <,
+                      zlib * 11 / 10);
+        } else
+#endif
+        {
+            tt_int_op(zlib, ==, 0);
+            tt_int_op(qes_mem_current(QES_MEM_ZLIB), ==, zlib_before);
+        }
+        qes_file_close(file);
+        tt_int_op(qes_mem_current(QES_MEM_IO), ==, io_before);
+        tt_int_op(qes_mem_current(QES_MEM_ZLIB), ==, zlib_before);
+    }
+    /* gzFile states can only be estimated, so are counted as estimated */
+    tt_int_op(qes_file_mem_estimate("r", 0, &io, &zlib), ==, 0);
+    io_before = qes_mem_current(QES_MEM_IO);
+    zlib_before = qes_mem_current(QES_MEM_ZLIB);
+    file = qes_file_open(readable, "r");
+    tt_assert(file != NULL);
+    tt_int_op(qes_mem_current(QES_MEM_IO) - io_before, ==, io);
+    tt_int_op(qes_mem_current(QES_MEM_ZLIB) - zlib_before, ==, zlib);
+    qes_file_close(file);
+    tt_int_op(qes_mem_current(QES_MEM_IO), ==, io_before);
+    tt_int_op(qes_mem_current(QES_MEM_ZLIB), ==, zlib_before);
+    /* Bad params */
+    tt_int_op(qes_file_mem_estimate(NULL, 0, &io, &zlib), ==, -1);
+    tt_int_op(qes_file_mem_estimate("r", 1, &io, &zlib), ==, -1);
+    tt_int_op(qes_file_mem_estimate("x", 0, &io, &zlib), ==, -1);
+    tt_int_op(qes_file_mem_estimate("r", 0, NULL, &zlib), ==, -1);
+end:
+    qes_file_close(file);
+    clean_writable_file(writeable);
+    free(readable);
+}
+
 struct testcase_t qes_file_tests[] = {
     { "qes_file_open", test_qes_file_open, 0, NULL, NULL},
     { "qes_file_peek", test_qes_file_peek, 0, NULL, NULL},
@@ -442,5 +658,8 @@ struct testcase_t qes_file_tests[] = {
     { "qes_file_rewind", test_qes_file_rewind, 0, NULL, NULL},
     { "qes_file_getuntil", test_qes_file_getuntil, 0, NULL, NULL},
     { "qes_file_ok", test_qes_file_ok, 0, NULL, NULL},
+    { "qes_file_open_summed", test_qes_file_open_summed, 0, NULL, NULL},
+    { "qes_file_sync", test_qes_file_sync, 0, NULL, NULL},
+    { "qes_file_mem_estimate", test_qes_file_mem_estimate, 0, NULL, NULL},
     END_OF_TESTCASES
 };
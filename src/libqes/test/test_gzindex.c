@@ -0,0 +1,221 @@
+/*
+ * Copyright 2015 Kevin Murray <spam@kdmurray.id.au>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * ============================================================================
+ *
+ *       Filename:  test_gzindex.c
+ *
+ *    Description:  Test qes_gzindex.c
+ *        License:  GPLv3+
+ *         Author:  Kevin Murray, spam@kdmurray.id.au
+ *
+ * ============================================================================
+ */
+
+#include "tests.h"
+#include <qes_gzindex.h>
+
+
+#ifdef ZLIB_FOUND
+/* test.fastq.gz is a single deflate block, so make a file of several */
+static char *
+make_multiblock_gz(void)
+{
+    char *fname = NULL;
+    char *outname = NULL;
+    char buf[4096];
+    FILE *fp = NULL;
+    gzFile gz = NULL;
+    size_t len = 0;
+    int iii = 0;
+
+    fname = find_data_file("test.fastq");
+    outname = get_writable_file();
+    if (fname == NULL || outname == NULL) goto error;
+    gz = gzopen(outname, "wb");
+    if (gz == NULL) goto error;
+    for (iii = 0; iii < 4; iii++) {
+        fp = fopen(fname, "rb");
+        if (fp == NULL) goto error;
+        while ((len = fread(buf, 1, sizeof(buf), fp)) > 0) {
+            if (gzwrite(gz, buf, len) != (int)len) goto error;
+        }
+        fclose(fp);
+        fp = NULL;
+    }
+    if (gzclose(gz) != Z_OK) {
+        gz = NULL;
+        goto error;
+    }
+    free(fname);
+    return outname;
+error:
+    if (fp != NULL) fclose(fp);
+    if (gz != NULL) gzclose(gz);
+    if (fname != NULL) free(fname);
+    if (outname != NULL) clean_writable_file(outname);
+    return NULL;
+}
+
+
+static void
+test_qes_gzindex_build(void *ptr)
+{
+    struct qes_gzindex *index = NULL;
+    struct qes_gzindex *loaded = NULL;
+    struct qes_file *qf = NULL;
+    struct qes_file *whole = NULL;
+    char *fname = NULL;
+    char *idxname = NULL;
+    char buf[1024];
+    char expt[1024];
+    size_t iii = 0;
+    ssize_t len = 0;
+
+    (void) ptr;
+    fname = make_multiblock_gz();
+    tt_assert(fname != NULL);
+    index = qes_gzindex_build(fname, 1024);
+    tt_ptr_op(index, !=, NULL);
+    tt_int_op(index->length, ==, 4 * 144230);
+    tt_int_op(index->n_points, >, 1);
+    /* Reading from each point must match reading the whole file */
+    for (iii = 0; iii < index->n_points; iii++) {
+        qf = qes_gzindex_open(index, fname, iii);
+        tt_ptr_op(qf, !=, NULL);
+        whole = qes_file_open(fname, "r");
+        tt_int_op(qes_file_skip(whole, index->points[iii].out), ==,
+                  index->points[iii].out);
+        len = qes_file_readline(qf, buf, sizeof(buf));
+        tt_int_op(len, >, 0);
+        tt_int_op(qes_file_readline(whole, expt, sizeof(expt)), ==, len);
+        tt_str_op(buf, ==, expt);
+        qes_file_close(qf);
+        qes_file_close(whole);
+    }
+    /* Round trip through a sidecar */
+    idxname = get_writable_file();
+    tt_assert(idxname != NULL);
+    tt_int_op(qes_gzindex_save(index, idxname), ==, 0);
+    loaded = qes_gzindex_load(idxname, fname);
+    tt_ptr_op(loaded, !=, NULL);
+    tt_int_op(loaded->n_points, ==, index->n_points);
+    tt_int_op(loaded->length, ==, index->length);
+    for (iii = 0; iii < index->n_points; iii++) {
+        tt_int_op(loaded->points[iii].out, ==, index->points[iii].out);
+        tt_int_op(loaded->points[iii].in, ==, index->points[iii].in);
+        tt_int_op(loaded->points[iii].bits, ==, index->points[iii].bits);
+        tt_int_op(loaded->points[iii].window_len, ==,
+                  index->points[iii].window_len);
+    }
+    /* An index of another file is stale */
+    qes_gzindex_destroy(loaded);
+    clean_writable_file(fname);
+    fname = find_data_file("loremipsum.txt.gz");
+    tt_ptr_op(qes_gzindex_load(idxname, fname), ==, NULL);
+    /* Not gzip */
+    free(fname);
+    fname = find_data_file("test.fastq");
+    tt_ptr_op(qes_gzindex_build(fname, 1024), ==, NULL);
+    tt_ptr_op(qes_gzindex_build(NULL, 1024), ==, NULL);
+end:
+    qes_file_close(qf);
+    qes_file_close(whole);
+    qes_gzindex_destroy(index);
+    qes_gzindex_destroy(loaded);
+    if (fname != NULL) free(fname);
+    if (idxname != NULL) clean_writable_file(idxname);
+}
+
+
+static void
+test_qes_gzindex_split_range(void *ptr)
+{
+    struct qes_split_range range;
+    struct qes_gzindex *index = NULL;
+    struct qes_seqfile *sf = NULL;
+    struct qes_seqfile *whole = NULL;
+    struct qes_seq *seq = NULL;
+    struct qes_seq *expt = NULL;
+    char *fname = NULL;
+    size_t n = 0;
+    size_t idx = 0;
+    size_t total = 0;
+    size_t expect = 4000;
+    int pass = 0;
+
+    (void) ptr;
+    seq = qes_seq_create();
+    expt = qes_seq_create();
+    /* First several access points, then a file with only one, where all but
+     * the last range are empty */
+    fname = make_multiblock_gz();
+    tt_assert(fname != NULL);
+again:
+    index = qes_gzindex_build(fname, 1024);
+    tt_ptr_op(index, !=, NULL);
+    /* Reading all ranges in order must give every record exactly once */
+    for (n = 1; n <= 16; n++) {
+        whole = qes_seqfile_create(fname, "r");
+        tt_ptr_op(whole, !=, NULL);
+        total = 0;
+        for (idx = 0; idx < n; idx++) {
+            tt_int_op(qes_gzindex_split_range(index, fname, idx, n, 0, &range),
+                      ==, 0);
+            sf = qes_gzindex_split_open(index, fname, &range, 1);
+            tt_ptr_op(sf, !=, NULL);
+            while (qes_seqfile_read(sf, seq) > 0) {
+                tt_int_op(qes_seqfile_read(whole, expt), >, 0);
+                tt_str_op(seq->name.str, ==, expt->name.str);
+                tt_str_op(seq->qual.str, ==, expt->qual.str);
+                total++;
+            }
+            qes_seqfile_destroy(sf);
+        }
+        tt_int_op(total, ==, expect);
+        qes_seqfile_destroy(whole);
+    }
+    if (pass++ == 0) {
+        qes_gzindex_destroy(index);
+        clean_writable_file(fname);
+        fname = find_data_file("test.fastq.gz");
+        tt_assert(fname != NULL);
+        expect = 1000;
+        goto again;
+    }
+    /* Bad params */
+    tt_int_op(qes_gzindex_split_range(index, fname, 2, 2, 0, &range), ==, -1);
+    tt_int_op(qes_gzindex_split_range(NULL, fname, 0, 1, 0, &range), ==, -1);
+    tt_int_op(qes_gzindex_split_range(index, fname, 0, 1, 0, NULL), ==, -1);
+end:
+    qes_seqfile_destroy(sf);
+    qes_seqfile_destroy(whole);
+    qes_seq_destroy(seq);
+    qes_seq_destroy(expt);
+    qes_gzindex_destroy(index);
+    if (fname != NULL) free(fname);
+}
+#endif
+
+
+struct testcase_t qes_gzindex_tests[] = {
+#ifdef ZLIB_FOUND
+    { "qes_gzindex_build", test_qes_gzindex_build, 0, NULL, NULL},
+    { "qes_gzindex_split_range", test_qes_gzindex_split_range, 0, NULL, NULL},
+#endif
+    END_OF_TESTCASES
+};
@@ -50,6 +50,13 @@ test_qes_hamming (void *p)
     tt_int_op(qes_match_hamming("ACTTG", "ACTTGT", 0), ==, 0);
     tt_int_op(qes_match_hamming("ACATG", "ACTTGT", 0), ==, 1);
     tt_int_op(qes_match_hamming("ACTTGT", "ACTTG", 0), ==, 0);
+    /* Longer than a word, with mismatches in and after the words */
+    tt_int_op(qes_match_hamming("ACGTACGTACGTACGTACG", "ACGTACGTACGTACGTACG",
+                                19), ==, 0);
+    tt_int_op(qes_match_hamming("TCGTACGAACGTACGTACG", "ACGTACGTACGTACGTACC",
+                                19), ==, 3);
+    tt_int_op(qes_match_hamming("TTTTTTTTTTTTTTTTTTT", "AAAAAAAAAAAAAAAAAAA",
+                                19), ==, 19);
     /* Give it hell */
     tt_int_op(qes_match_hamming("ACTTG", NULL, 0), ==, -1);
     tt_int_op(qes_match_hamming(NULL, "ACTTG", 0), ==, -1);
@@ -86,6 +93,14 @@ test_qes_hamming_max (void *p)
     tt_int_op(qes_match_hamming_max("ACTTG", "ACTGA", 5, 0), ==, 1);
     tt_int_op(qes_match_hamming_max("ACTTG", "ACTGA", 5, 1), ==, 2);
     tt_int_op(qes_match_hamming_max("ACTTG", "ACTGA", 5, 2), ==, 2);
+    tt_int_op(qes_match_hamming_max("TCGTACGAACGTACGTACG",
+                                    "ACGTACGTACGTACGTACC", 19, 2), ==, 3);
+    tt_int_op(qes_match_hamming_max("TCGTACGAACGTACGTACG",
+                                    "ACGTACGTACGTACGTACC", 19, 3), ==, 3);
+    tt_int_op(qes_match_hamming_max("TCGTACGAACGTACGTACG",
+                                    "ACGTACGTACGTACGTACC", 19, 1), ==, 2);
+    tt_int_op(qes_match_hamming_max("TCGTACGAACGTACGTACG",
+                                    "ACGTACGTACGTACGTACC", 0, INT_MAX), ==, 3);
     /* Give it hell */
     tt_int_op(qes_match_hamming_max("ACTTG", NULL, 0, INT_MAX), ==, -1);
     tt_int_op(qes_match_hamming_max(NULL, "ACTTG", 0, INT_MAX), ==, -1);
@@ -61,7 +61,98 @@ end:
     if (cdn != NULL) free(cdn);
 }
 
+static void
+test_qes_sequtil_revcomp (void *ptr)
+{
+    char seq[] = "AACGTNacgtTTTGGGCCCAAAACCCCGGGGTTTTAACCGGTTAAN\n";
+    char *rc = NULL;
+
+    (void) ptr;
+    /* Upper cased, with N for anything but ACGT and trailing whitespace
+     * trimmed */
+    rc = qes_sequtil_revcomp(seq, sizeof(seq));
+    tt_str_op(rc, ==, "NTTAACCGGTTAAAACCCCGGGGTTTTGGGCCCAAAACGTNACGTT");
+    qes_sequtil_revcomp_inplace(seq, sizeof(seq));
+    tt_str_op(seq, ==, rc);
+    /* Odd and even lengths, and nothing */
+    strcpy(seq, "ACGTA");
+    qes_sequtil_revcomp_inplace(seq, 5);
+    tt_str_op(seq, ==, "TACGT");
+    qes_sequtil_revcomp_inplace(seq, 4);
+    tt_str_op(seq, ==, "CGTAT");
+    qes_sequtil_revcomp_inplace(seq, 0);
+    tt_str_op(seq, ==, "CGTAT");
+end:
+    free(rc);
+}
+
+static void
+test_qes_sequtil_revcomp_check (void *ptr)
+{
+    char seq[] = "ACGTNacgtx";
+
+    (void) ptr;
+    /* Exactly len bases, counting those that weren't ACGT */
+    tt_int_op(qes_sequtil_revcomp_check(seq, 10), ==, 2);
+    tt_str_op(seq, ==, "NACGTNACGT");
+    tt_int_op(qes_sequtil_revcomp_check(seq, 4), ==, 1);
+    tt_str_op(seq, ==, "CGTNTNACGT");
+    tt_int_op(qes_sequtil_revcomp_check(seq, 0), ==, 0);
+    tt_int_op(qes_sequtil_revcomp_check(NULL, 4), ==, -1);
+end:
+    ;
+}
+
+static void
+test_qes_sequtil_pack (void *ptr)
+{
+    const char *seq = "ACGTTGCAacgtNAAAACCCCGGGGTTTTAAC";
+    char rc[33];
+    uint64_t packed = 0;
+    uint64_t nmask = 0;
+    uint64_t rc_packed = 0;
+    uint64_t rc_nmask = 0;
+    size_t len = 0;
+
+    (void) ptr;
+    /* First base lowest */
+    tt_int_op(qes_sequtil_pack("ACGT", 4, &packed, &nmask), ==, 0);
+    tt_assert(packed == 0xE4);
+    tt_assert(nmask == 0);
+    tt_int_op(qes_sequtil_pack("TNA", 3, &packed, &nmask), ==, 1);
+    tt_assert(packed == 0x3);
+    tt_assert(nmask == 0x2);
+    tt_int_op(qes_sequtil_pack("acgt", 4, &packed, NULL), ==, 0);
+    tt_assert(packed == 0xE4);
+    tt_int_op(qes_sequtil_pack(seq, 0, &packed, &nmask), ==, 0);
+    tt_assert(packed == 0);
+    tt_assert(nmask == 0);
+    /* Packing then reverse complementing is the same as the reverse */
+    for (len = 0; len <= 32; len++) {
+        memcpy(rc, seq, len);
+        rc[len] = '\0';
+        tt_int_op(qes_sequtil_revcomp_check(rc, len), >=, 0);
+        tt_int_op(qes_sequtil_pack(rc, len, &rc_packed, &rc_nmask), >=, 0);
+        tt_int_op(qes_sequtil_pack(seq, len, &packed, &nmask), ==,
+                  len > 12);
+        tt_int_op(qes_sequtil_revcomp_packed(&packed, &nmask, len), ==, 0);
+        tt_assert(packed == rc_packed);
+        tt_assert(nmask == rc_nmask);
+    }
+    /* Bad parameters */
+    tt_int_op(qes_sequtil_pack(seq, 33, &packed, &nmask), ==, -1);
+    tt_int_op(qes_sequtil_pack(NULL, 4, &packed, &nmask), ==, -1);
+    tt_int_op(qes_sequtil_pack(seq, 4, NULL, &nmask), ==, -1);
+    tt_int_op(qes_sequtil_revcomp_packed(NULL, &nmask, 4), ==, -1);
+    tt_int_op(qes_sequtil_revcomp_packed(&packed, NULL, 33), ==, -1);
+end:
+    ;
+}
+
 struct testcase_t qes_sequtil_tests[] = {
     { "qes_sequtil_translate_codon", test_qes_sequtil_translate_codon, 0, NULL, NULL},
+    { "qes_sequtil_revcomp", test_qes_sequtil_revcomp, 0, NULL, NULL},
+    { "qes_sequtil_revcomp_check", test_qes_sequtil_revcomp_check, 0, NULL, NULL},
+    { "qes_sequtil_pack", test_qes_sequtil_pack, 0, NULL, NULL},
     END_OF_TESTCASES
 };
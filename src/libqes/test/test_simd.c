@@ -0,0 +1,159 @@
+/*
+ * Copyright 2015 Kevin Murray <spam@kdmurray.id.au>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * ============================================================================
+ *
+ *       Filename:  test_simd.c
+ *
+ *    Description:  Tests for the SIMD kernels
+ *        License:  GPLv3+
+ *         Author:  Kevin Murray, spam@kdmurray.id.au
+ *
+ * ============================================================================
+ */
+
+#include "tests.h"
+#include <qes_simd.h>
+
+/* Long enough for every kernel's vector loops and tails */
+#define SIMD_TEST_LEN 300
+
+static uint32_t simd_rand_state = 1;
+
+static char
+simd_rand_base(void)
+{
+    const char bases[] = "ACGTACGTacgtNn-\n";
+
+    simd_rand_state = simd_rand_state * 1103515245 + 12345;
+    return bases[(simd_rand_state >> 16) % 16];
+}
+
+static void
+test_qes_simd_levels (void *ptr)
+{
+    const enum qes_simd_level best = qes_simd_detect();
+    int level = 0;
+
+    (void) ptr;
+    /* Whatever was picked at startup is usable */
+    tt_ptr_op(qes_simd, !=, NULL);
+    tt_int_op(qes_simd_parse(qes_simd->name), ==, qes_simd->level);
+    for (level = 0; level < QES_SIMD_N_LEVELS; level++) {
+        tt_int_op(qes_simd_parse(qes_simd_name(level)), ==, level);
+    }
+    tt_int_op(qes_simd_parse("avx1024"), ==, -1);
+    tt_int_op(qes_simd_parse(NULL), ==, -1);
+    tt_ptr_op(qes_simd_name(QES_SIMD_N_LEVELS), ==, NULL);
+    tt_int_op(qes_simd_set(QES_SIMD_N_LEVELS), ==, -1);
+    tt_int_op(qes_simd_set(QES_SIMD_SCALAR), ==, 0);
+    tt_int_op(qes_simd->level, ==, QES_SIMD_SCALAR);
+    tt_int_op(qes_simd_set(best), ==, 0);
+    tt_int_op(qes_simd->level, ==, best);
+    if (best != QES_SIMD_NEON) {
+        tt_int_op(qes_simd_set(QES_SIMD_NEON), ==, 1);
+    }
+end:
+    qes_simd_set(best);
+}
+
+/* Every level this CPU runs agrees with the scalar kernels */
+static void
+test_qes_simd_kernels (void *ptr)
+{
+    const enum qes_simd_level best = qes_simd_detect();
+    char seq1[SIMD_TEST_LEN];
+    char seq2[SIMD_TEST_LEN];
+    char expect[SIMD_TEST_LEN];
+    char *exact = NULL;
+    int_fast32_t mismatches = 0;
+    uint64_t packed[2] = {0, 0};
+    uint64_t nmask[2] = {0, 0};
+    size_t bad = 0;
+    size_t len = 0;
+    size_t iii = 0;
+    int level = 0;
+
+    (void) ptr;
+    for (level = 1; level < QES_SIMD_N_LEVELS; level++) {
+        if (qes_simd_set(level) != 0) {
+            continue;
+        }
+        for (len = 0; len < SIMD_TEST_LEN; len++) {
+            for (iii = 0; iii < len; iii++) {
+                seq1[iii] = simd_rand_base();
+                seq2[iii] = simd_rand_base();
+            }
+            /* Exactly len bytes, so kernels mustn't read past them */
+            exact = malloc(len + 1);
+            memcpy(exact, seq1, len);
+            /* Hamming distances, stopping at a few maxima */
+            qes_simd_set(QES_SIMD_SCALAR);
+            mismatches = qes_simd->hamming_max(seq1, seq2, len, len);
+            qes_simd_set(level);
+            tt_int_op(qes_simd->hamming_max(exact, seq2, len, len), ==,
+                      mismatches);
+            tt_int_op(qes_simd->hamming_max(exact, exact, len, 0), ==, 0);
+            if (mismatches > 0) {
+                tt_int_op(qes_simd->hamming_max(exact, seq2, len,
+                                                mismatches - 1), ==,
+                          mismatches);
+            }
+            /* Packed prefixes */
+            if (len > 0 && len <= 32) {
+                qes_simd_set(QES_SIMD_SCALAR);
+                tt_int_op(qes_simd->pack(seq1, len, &packed[0], &nmask[0]),
+                          ==, nmask[0] != 0);
+                qes_simd_set(level);
+                tt_int_op(qes_simd->pack(exact, len, &packed[1], &nmask[1]),
+                          ==, nmask[1] != 0);
+                tt_assert(packed[0] == packed[1]);
+                tt_assert(nmask[0] == nmask[1]);
+            }
+            /* Reverse complements, and how many bases weren't ACGT */
+            memcpy(expect, seq1, len);
+            qes_simd_set(QES_SIMD_SCALAR);
+            bad = qes_simd->revcomp(expect, len);
+            qes_simd_set(level);
+            tt_int_op(qes_simd->revcomp(exact, len), ==, bad);
+            tt_int_op(memcmp(exact, expect, len), ==, 0);
+            free(exact);
+            exact = NULL;
+        }
+    }
+    /* The scalar kernels themselves */
+    qes_simd_set(QES_SIMD_SCALAR);
+    strcpy(seq1, "AACgtNX");
+    tt_int_op(qes_simd->revcomp(seq1, 7), ==, 2);
+    tt_str_op(seq1, ==, "NNACGTT");
+    tt_int_op(qes_simd->pack("ACgTN", 5, &packed[0], &nmask[0]), ==, 1);
+    tt_assert(packed[0] == 0xE4);
+    tt_assert(nmask[0] == 0x10);
+    tt_int_op(qes_simd->hamming_max("ACGTACGTAC", "ACGAACGTTT", 10, 5), ==,
+              3);
+    tt_int_op(qes_simd->hamming_max("ACGTACGTAC", "ACGAACGTTT", 10, 1), ==,
+              2);
+end:
+    free(exact);
+    qes_simd_set(best);
+}
+
+struct testcase_t qes_simd_tests[] = {
+    { "qes_simd_levels", test_qes_simd_levels, 0, NULL, NULL},
+    { "qes_simd_kernels", test_qes_simd_kernels, 0, NULL, NULL},
+    END_OF_TESTCASES
+};
@@ -0,0 +1,233 @@
+/*
+ * Copyright 2015 Kevin Murray <spam@kdmurray.id.au>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * ============================================================================
+ *
+ *       Filename:  test_split.c
+ *
+ *    Description:  Test qes_split.c
+ *        License:  GPLv3+
+ *         Author:  Kevin Murray, spam@kdmurray.id.au
+ *
+ * ============================================================================
+ */
+
+#include "tests.h"
+#include <qes_split.h>
+
+
+static void
+test_qes_split_guess_format(void *ptr)
+{
+    char *fname = NULL;
+
+    (void) ptr;
+    fname = find_data_file("test.fastq");
+    tt_assert(fname != NULL);
+    tt_int_op(qes_split_guess_format(fname), ==, QES_SPLIT_PLAIN);
+    free(fname);
+    fname = find_data_file("test.fastq.gz");
+    tt_assert(fname != NULL);
+    tt_int_op(qes_split_guess_format(fname), ==, QES_SPLIT_GZIP);
+    free(fname);
+    fname = NULL;
+    tt_int_op(qes_split_guess_format(NULL), ==, QES_SPLIT_UNKNOWN);
+    tt_int_op(qes_split_guess_format("/nonexistent"), ==, QES_SPLIT_UNKNOWN);
+end:
+    if (fname != NULL) free(fname);
+}
+
+
+static void
+test_qes_split_range(void *ptr)
+{
+    struct qes_split_range range;
+    struct qes_seqfile *sf = NULL;
+    struct qes_seqfile *whole = NULL;
+    struct qes_seq *seq = NULL;
+    struct qes_seq *expt = NULL;
+    char *fname = NULL;
+    size_t n = 0;
+    size_t idx = 0;
+    size_t total = 0;
+    int res = 0;
+
+    (void) ptr;
+    fname = find_data_file("test.fastq");
+    tt_assert(fname != NULL);
+    seq = qes_seq_create();
+    expt = qes_seq_create();
+    /* Reading all ranges in order must give every record exactly once */
+    for (n = 1; n <= 16; n++) {
+        whole = qes_seqfile_create(fname, "r");
+        tt_ptr_op(whole, !=, NULL);
+        total = 0;
+        for (idx = 0; idx < n; idx++) {
+            res = qes_split_range(fname, idx, n, 0, &range);
+            tt_int_op(res, ==, 0);
+            sf = qes_split_open(fname, &range, 1);
+            tt_ptr_op(sf, !=, NULL);
+            while (qes_seqfile_read(sf, seq) > 0) {
+                tt_int_op(qes_seqfile_read(whole, expt), >, 0);
+                tt_str_op(seq->name.str, ==, expt->name.str);
+                total++;
+            }
+            qes_seqfile_destroy(sf);
+        }
+        tt_int_op(total, ==, 1000);
+        qes_seqfile_destroy(whole);
+    }
+    /* Plain gzip can only be read as a single range */
+    free(fname);
+    fname = find_data_file("test.fastq.gz");
+    tt_assert(fname != NULL);
+    tt_int_op(qes_split_range(fname, 0, 1, 0, &range), ==, 0);
+    tt_int_op(range.offset, ==, 0);
+    tt_int_op(range.limit, ==, -1);
+    tt_int_op(qes_split_range(fname, 0, 2, 0, &range), ==, 1);
+    /* Bad params */
+    tt_int_op(qes_split_range(fname, 2, 2, 0, &range), ==, -1);
+    tt_int_op(qes_split_range(fname, 0, 0, 0, &range), ==, -1);
+    tt_int_op(qes_split_range(NULL, 0, 1, 0, &range), ==, -1);
+    tt_int_op(qes_split_range(fname, 0, 1, 0, NULL), ==, -1);
+end:
+    qes_seqfile_destroy(sf);
+    qes_seqfile_destroy(whole);
+    qes_seq_destroy(seq);
+    qes_seq_destroy(expt);
+    if (fname != NULL) free(fname);
+}
+
+
+static void
+test_qes_split_range_paired(void *ptr)
+{
+    struct qes_split_range range1;
+    struct qes_split_range range2;
+    struct qes_seqfile *sf1 = NULL;
+    struct qes_seqfile *sf2 = NULL;
+    struct qes_seq *seq1 = NULL;
+    struct qes_seq *seq2 = NULL;
+    char *fname1 = NULL;
+    char *fname2 = NULL;
+    FILE *fp = NULL;
+    size_t n = 0;
+    size_t idx = 0;
+    size_t total = 0;
+    size_t trim = 0;
+
+    (void) ptr;
+    fname1 = find_data_file("test.fastq");
+    tt_assert(fname1 != NULL);
+    seq1 = qes_seq_create();
+    seq2 = qes_seq_create();
+    /* Make an R2 file with differing line lengths to R1 */
+    fname2 = get_writable_file();
+    tt_assert(fname2 != NULL);
+    fp = fopen(fname2, "w");
+    tt_ptr_op(fp, !=, NULL);
+    sf1 = qes_seqfile_create(fname1, "r");
+    while (qes_seqfile_read(sf1, seq1) > 0) {
+        trim = total++ % 7;
+        fprintf(fp, "@%s extra comment\n%s\n+\n%s\n", seq1->name.str,
+                seq1->seq.str + trim, seq1->qual.str + trim);
+    }
+    fclose(fp);
+    qes_seqfile_destroy(sf1);
+    /* Every pair must be read exactly once, with R1 and R2 in sync */
+    for (n = 1; n <= 16; n++) {
+        total = 0;
+        for (idx = 0; idx < n; idx++) {
+            tt_int_op(qes_split_range_paired(fname1, fname2, idx, n, &range1,
+                                             &range2), ==, 0);
+            sf1 = qes_split_open(fname1, &range1, 1);
+            sf2 = qes_split_open(fname2, &range2, 1);
+            tt_ptr_op(sf1, !=, NULL);
+            tt_ptr_op(sf2, !=, NULL);
+            while (qes_seqfile_read(sf1, seq1) > 0) {
+                tt_int_op(qes_seqfile_read(sf2, seq2), >, 0);
+                tt_str_op(seq1->name.str, ==, seq2->name.str);
+                total++;
+            }
+            qes_seqfile_destroy(sf1);
+            qes_seqfile_destroy(sf2);
+        }
+        tt_int_op(total, ==, 1000);
+    }
+    tt_int_op(qes_split_range_paired(NULL, fname2, 0, 1, &range1, &range2),
+              ==, -1);
+end:
+    qes_seqfile_destroy(sf1);
+    qes_seqfile_destroy(sf2);
+    qes_seq_destroy(seq1);
+    qes_seq_destroy(seq2);
+    if (fname1 != NULL) free(fname1);
+    if (fname2 != NULL) clean_writable_file(fname2);
+}
+
+
+static void
+test_qes_split_open_at(void *ptr)
+{
+    struct qes_split_range range;
+    struct qes_seqfile *sf = NULL;
+    struct qes_seqfile *whole = NULL;
+    struct qes_seq *seq = NULL;
+    struct qes_seq *expt = NULL;
+    char *fname = NULL;
+    off_t pos = 0;
+    size_t iii = 0;
+
+    (void) ptr;
+    fname = find_data_file("test.fastq");
+    tt_assert(fname != NULL);
+    seq = qes_seq_create();
+    expt = qes_seq_create();
+    tt_int_op(qes_split_range(fname, 1, 3, 0, &range), ==, 0);
+    tt_ptr_op(qes_split_open_at(fname, &range, range.skip - 1, 1), ==, NULL);
+    /* Reopening at a saved filepos must continue with the next record */
+    whole = qes_split_open(fname, &range, 1);
+    tt_ptr_op(whole, !=, NULL);
+    for (iii = 0; iii < 10; iii++) {
+        tt_int_op(qes_seqfile_read(whole, expt), >, 0);
+    }
+    pos = whole->qf->filepos;
+    sf = qes_split_open_at(fname, &range, pos, 1);
+    tt_ptr_op(sf, !=, NULL);
+    tt_int_op(sf->qf->filepos, ==, pos);
+    while (qes_seqfile_read(whole, expt) > 0) {
+        tt_int_op(qes_seqfile_read(sf, seq), >, 0);
+        tt_str_op(seq->name.str, ==, expt->name.str);
+    }
+    /* Including stopping at the end of the range */
+    tt_int_op(qes_seqfile_read(sf, seq), ==, EOF);
+end:
+    qes_seqfile_destroy(sf);
+    qes_seqfile_destroy(whole);
+    qes_seq_destroy(seq);
+    qes_seq_destroy(expt);
+    if (fname != NULL) free(fname);
+}
+
+
+struct testcase_t qes_split_tests[] = {
+    { "qes_split_guess_format", test_qes_split_guess_format, 0, NULL, NULL},
+    { "qes_split_range", test_qes_split_range, 0, NULL, NULL},
+    { "qes_split_range_paired", test_qes_split_range_paired, 0, NULL, NULL},
+    { "qes_split_open_at", test_qes_split_open_at, 0, NULL, NULL},
+    END_OF_TESTCASES
+};
@@ -149,6 +149,51 @@ end:
     ;
 }
 
+static void
+test_qes_mem (void *ptr)
+{
+    /* A tag nothing else uses */
+    const int tag = QES_MEM_TAGS - 1;
+    const int64_t peak = qes_mem_peak(tag);
+    int64_t zlib = 0;
+    char *buf = NULL;
+    void *zbuf = NULL;
+
+    (void) ptr;
+    tt_int_op(qes_mem_current(tag), ==, 0);
+    buf = qes_malloc_tagged(100, tag);
+    tt_assert(buf != NULL);
+    tt_int_op(qes_mem_current(tag), ==, 100);
+    buf = qes_realloc_tagged(buf, 100, 1000, tag);
+    tt_assert(buf != NULL);
+    tt_int_op(qes_mem_current(tag), ==, 1000);
+    buf = qes_realloc_tagged(buf, 1000, 10, tag);
+    tt_int_op(qes_mem_current(tag), ==, 10);
+    tt_int_op(qes_mem_peak(tag), ==, peak > 1000 ? peak : 1000);
+    qes_free_tagged(buf, 10, tag);
+    tt_ptr_op(buf, ==, NULL);
+    tt_int_op(qes_mem_current(tag), ==, 0);
+    buf = qes_calloc_tagged(10, 20, tag);
+    tt_int_op(buf[199], ==, 0);
+    tt_int_op(qes_mem_current(tag), ==, 200);
+    qes_free_tagged(buf, 200, tag);
+    tt_int_op(qes_mem_current(tag), ==, 0);
+    /* Bad tags are ignored */
+    qes_mem_account(QES_MEM_TAGS, 100);
+    qes_mem_account(-1, 100);
+    tt_int_op(qes_mem_current(QES_MEM_TAGS), ==, 0);
+    tt_int_op(qes_mem_peak(-1), ==, 0);
+    /* zlib's allocations are counted */
+    zlib = qes_mem_current(QES_MEM_ZLIB);
+    zbuf = qes_zalloc(NULL, 10, 100);
+    tt_assert(zbuf != NULL);
+    tt_int_op((uintptr_t)zbuf % sizeof(void *), ==, 0);
+    tt_int_op(qes_mem_current(QES_MEM_ZLIB) - zlib, ==, 1000);
+    qes_zfree(NULL, zbuf);
+    tt_int_op(qes_mem_current(QES_MEM_ZLIB), ==, zlib);
+end:
+    ;
+}
 
 struct testcase_t qes_util_tests[] = {
     { "qes_calloc", test_qes_calloc, 0, NULL, NULL},
@@ -157,5 +202,6 @@ struct testcase_t qes_util_tests[] = {
     { "qes_free", test_qes_free, 0, NULL, NULL},
     { "qes_roundup32", test_qes_roundup32, 0, NULL, NULL},
     { "qes_roundup64", test_qes_roundup64, 0, NULL, NULL},
+    { "qes_mem", test_qes_mem, 0, NULL, NULL},
     END_OF_TESTCASES
 };
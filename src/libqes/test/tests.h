@@ -45,10 +45,16 @@ extern struct testcase_t qes_match_tests[];
 extern struct testcase_t qes_file_tests[];
 /* test_seqfile tests */
 extern struct testcase_t qes_seqfile_tests[];
+/* test_split tests */
+extern struct testcase_t qes_split_tests[];
+/* test_gzindex tests */
+extern struct testcase_t qes_gzindex_tests[];
 /* test_seq tests */
 extern struct testcase_t qes_seq_tests[];
 /* test_sequtil tests */
 extern struct testcase_t qes_sequtil_tests[];
+/* test_simd tests */
+extern struct testcase_t qes_simd_tests[];
 /* test_log tests */
 extern struct testcase_t qes_log_tests[];
 /* test_helpers tests */
@@ -26,6 +26,7 @@
 #include "axe.h"
 
 #include <getopt.h>
+#include <signal.h>
 
 static void
 print_version(FILE *stream)
@@ -69,7 +70,10 @@ print_usage(FILE *stream)
 {
     print_version(stream);
     fprintf(stream, "\nUSAGE:\n");
-    fprintf(stream, "axe-demux [-mzc2pt] -b (-f [-r] | -i) (-F [-R] | -I)\n");
+    fprintf(stream, "axe-demux [-mzc2ptj] [--chunk i/N] [--gz-index] -b (-f [-r] | -i) (-F [-R] | -I)\n");
+    fprintf(stream, "          [--checkpoint FILE [--checkpoint-every N] [--resume]]\n");
+    fprintf(stream, "axe-demux --count-only [-mcj] -b (-f [-r] | -i) [-t FILE]\n");
+    fprintf(stream, "axe-demux (--preview N | --sample-fraction F) [-mcj] -b (-f [-r] | -i) [-t FILE]\n");
     fprintf(stream, "axe-demux -h\n");
     fprintf(stream, "axe-demux -v\n\n");
     fprintf(stream, "OPTIONS:\n");
@@ -78,6 +82,19 @@ print_usage(FILE *stream)
     fprintf(stream, "    -c, --combinatorial\tUse combinatorial barcode matching. [flag, default OFF]\n");
     fprintf(stream, "    -p, --permissive\tDon't error on barcode mismatch confict, matching only\n");
     fprintf(stream, "                    \texactly for conficting barcodes. [flag, default OFF]\n");
+    fprintf(stream, "        --engine\tMatch with this engine: auto, trie, brute, whitelist,\n");
+    fprintf(stream, "                \tseed or edit. auto picks one for the barcodes and\n");
+    fprintf(stream, "                \t-m. [default auto]\n");
+    fprintf(stream, "        --whitelist\tMatch against an index of the barcodes rather than\n");
+    fprintf(stream, "                   \tall their mutants, for very many barcodes of one\n");
+    fprintf(stream, "                   \tlength. Reads within -m of two barcodes are\n");
+    fprintf(stream, "                   \tunknown. Same as --engine whitelist. [flag]\n");
+    fprintf(stream, "        --seed-index\tMatch through exact seeds of the barcodes rather\n");
+    fprintf(stream, "                    \tthan all their mutants, for long barcodes or high\n");
+    fprintf(stream, "                    \t-m. Same as --engine seed. [flag]\n");
+    fprintf(stream, "        --indels\tCount insertions and deletions as well as\n");
+    fprintf(stream, "                \tsubstitutions towards -m, trimming what the barcode\n");
+    fprintf(stream, "                \ttook up of each read. Same as --engine edit. [flag]\n");
     fprintf(stream, "    -2, --trim-r2\tTrim barcode from R2 read as well as R1. [flag, default OFF]\n");
     fprintf(stream, "    -b, --barcodes\tBarcode file. See --help for example. [file]\n");
     fprintf(stream, "    -f, --fwd-in\tInput forward read. [file]\n");
@@ -86,7 +103,48 @@ print_usage(FILE *stream)
     fprintf(stream, "    -R, --rev-out\tOutput reverse read prefix. [file prefix or existing directory]\n");
     fprintf(stream, "    -i, --ilfq-in\tInput interleaved paired reads. [file]\n");
     fprintf(stream, "    -I, --ilfq-out\tOutput interleaved paired reads prefix. [file prefix or existing directory]\n");
-    fprintf(stream, "    -t, --table-file\tOutput a summary table of demultiplexing statistics to file. [file]\n");
+    fprintf(stream, "    -t, --table-file\tOutput a summary table of demultiplexing statistics to file,\n");
+    fprintf(stream, "                    \tand output checksums to <file>.manifest. [file]\n");
+    fprintf(stream, "        --stats\tOutput run statistics, including counts by number of\n");
+    fprintf(stream, "               \tmismatches, to file as JSON. [file]\n");
+    fprintf(stream, "        --pair-matrix\tOutput counts of every R1 and R2 barcode pair, used\n");
+    fprintf(stream, "                     \tor not, as a matrix. Needs -c. [file]\n");
+    fprintf(stream, "        --count-only\tOnly match and count reads, for checking barcodes.\n");
+    fprintf(stream, "                    \tNo reads are written, so -F, -R and -I are optional.\n");
+    fprintf(stream, "                    \t[flag, default OFF]\n");
+    fprintf(stream, "        --preview\tOnly count the first N reads, estimating each sample's\n");
+    fprintf(stream, "                 \tyield in the whole input. Implies --count-only. [int]\n");
+    fprintf(stream, "        --sample-fraction\tOnly count reads from evenly spread parts of the\n");
+    fprintf(stream, "                         \tinput, about this fraction of it, estimating each\n");
+    fprintf(stream, "                         \tsample's yield. Implies --count-only. [float, 0-1]\n");
+    fprintf(stream, "        --unknown-top\tReport this many of the most common barcode\n");
+    fprintf(stream, "                     \tprefixes of unknown reads, or 0 for none. [int, default 10]\n");
+    fprintf(stream, "        --chunk\t\tOnly process chunk i of N of the input, for merging\n");
+    fprintf(stream, "               \t\twith axe-merge. Input must be uncompressed, BGZF, or\n");
+    fprintf(stream, "               \t\tgzip with --gz-index. [i/N]\n");
+    fprintf(stream, "    -j, --threads\tNumber of threads to parse input with. Output read\n");
+    fprintf(stream, "                 \torder is not preserved if > 1. [int, default 1]\n");
+    fprintf(stream, "        --gz-index\tIndex gzip input so it can be split by --chunk or -j.\n");
+    fprintf(stream, "                  \tThe index is saved next to the input. [flag, default OFF]\n");
+    fprintf(stream, "        --checkpoint\tPeriodically save progress to this file, so an\n");
+    fprintf(stream, "                    \tinterrupted run can be resumed. Gzip input is\n");
+    fprintf(stream, "                    \tindexed as with --gz-index, except separate R1\n");
+    fprintf(stream, "                    \tand R2 files, which are decompressed again from\n");
+    fprintf(stream, "                    \ttheir start on resume. [file]\n");
+    fprintf(stream, "        --checkpoint-every\tReads between checkpoints. [int, default 10000000]\n");
+    fprintf(stream, "        --resume\tResume from the --checkpoint file, if it exists.\n");
+    fprintf(stream, "                \tUse the same options as the interrupted run. [flag]\n");
+    fprintf(stream, "        --metrics\tPeriodically rewrite live statistics to this file, for\n");
+    fprintf(stream, "                 \tthe Prometheus textfile collector. [file]\n");
+    fprintf(stream, "        --metrics-every\tSeconds between rewriting the metrics file.\n");
+    fprintf(stream, "                       \t[int, default 10]\n");
+    fprintf(stream, "        --live-stats\tKeep live counts in this file, for monitoring tools\n");
+    fprintf(stream, "                    \tto memory-map. [file]\n");
+    fprintf(stream, "                    \tSend SIGUSR1 to write metrics immediately (to stderr\n");
+    fprintf(stream, "                    \twithout --metrics).\n");
+    fprintf(stream, "        --estimate-memory\tPrint the memory this run would use, by\n");
+    fprintf(stream, "                         \tsubsystem, without opening any inputs or\n");
+    fprintf(stream, "                         \toutputs. [flag, default OFF]\n");
     fprintf(stream, "    -h, --help\t\tPrint this usage plus additional help.\n");
     fprintf(stream, "    -V, --version\tPrint version string.\n");
     fprintf(stream, "    -v, --verbose\tBe more verbose. Additive, -vv is more vebose than -v.\n");
@@ -94,13 +152,17 @@ print_usage(FILE *stream)
     fprintf(stream, "\n");
 }
 
-static const char *axe_opts = "m:z:c2pb:f:F:r:R:i:I:t:hVvqd";
+static const char *axe_opts = "m:z:c2pb:f:F:r:R:i:I:t:j:hVvqd";
 static const struct option axe_longopts[] = {
     { "mismatch",   optional_argument,  NULL,   'm' },
     { "ziplevel",   required_argument,  NULL,   'z' },
     { "combinatorial", no_argument,     NULL,   'c' },
     { "trim-r2",    no_argument,        NULL,   '2' },
     { "permissive", no_argument,        NULL,   'p' },
+    { "engine",     required_argument,  NULL,   'A' },
+    { "whitelist",  no_argument,        NULL,   'H' },
+    { "seed-index", no_argument,        NULL,   'D' },
+    { "indels",     no_argument,        NULL,   'K' },
     { "barcodes",   required_argument,  NULL,   'b' },
     { "fwd-in",     required_argument,  NULL,   'f' },
     { "fwd-out",    required_argument,  NULL,   'F' },
@@ -109,6 +171,22 @@ static const struct option axe_longopts[] = {
     { "ilfq-in",    required_argument,  NULL,   'i' },
     { "ilfq-out",   required_argument,  NULL,   'I' },
     { "table-file", required_argument,  NULL,   't' },
+    { "stats",      required_argument,  NULL,   'J' },
+    { "unknown-top", required_argument, NULL,   'U' },
+    { "pair-matrix", required_argument, NULL,   'M' },
+    { "count-only", no_argument,        NULL,   'N' },
+    { "preview",    required_argument,  NULL,   'Y' },
+    { "sample-fraction", required_argument, NULL, 'X' },
+    { "chunk",      required_argument,  NULL,   'k' },
+    { "threads",    required_argument,  NULL,   'j' },
+    { "gz-index",   no_argument,        NULL,   'G' },
+    { "checkpoint", required_argument,  NULL,   'P' },
+    { "checkpoint-every", required_argument, NULL, 'E' },
+    { "resume",     no_argument,        NULL,   'S' },
+    { "metrics",    required_argument,  NULL,   'O' },
+    { "metrics-every", required_argument, NULL, 'W' },
+    { "live-stats", required_argument,  NULL,   'L' },
+    { "estimate-memory", no_argument,   NULL,   'Z' },
     { "help",       no_argument,        NULL,   'h' },
     { "version",    no_argument,        NULL,   'V' },
     { "verbose",    no_argument,        NULL,   'v' },
@@ -116,11 +194,38 @@ static const struct option axe_longopts[] = {
     { NULL,         0,                  NULL,    0  }
 };
 
+static int
+parse_chunk(struct axe_config *config, const char *arg)
+{
+    char *end = NULL;
+    long idx = 0;
+    long n = 0;
+
+    idx = strtol(arg, &end, 10);
+    if (end == arg || *end != '/') {
+        return 1;
+    }
+    arg = end + 1;
+    n = strtol(arg, &end, 10);
+    if (end == arg || *end != '\0') {
+        return 1;
+    }
+    if (n < 1 || idx < 1 || idx > n) {
+        return 1;
+    }
+    /* Chunks are numbered from 1 on the command line */
+    config->chunk_index = idx - 1;
+    config->n_chunks = n;
+    return 0;
+}
+
 static int
 parse_args(struct axe_config *config, int argc, char * const *argv)
 {
     int c = 0;
     int optind = 0;
+    int engine = 0;
+    size_t n_engines = 0;
     bool fullhelp = false;
 
     if (argc < 2 ) {
@@ -135,6 +240,10 @@ parse_args(struct axe_config *config, int argc, char * const *argv)
     config->mismatches = 0;
     config->verbosity = 0;
     config->out_compress_level = 0;
+    config->threads = 1;
+    config->checkpoint_every = 10000000;
+    config->unknown_top = 10;
+    config->metrics_every = 10;
     /* Parse argv using getopt */
     while ((c = getopt_long(argc, argv, axe_opts, axe_longopts, &optind)) > 0){
         switch (c) {
@@ -150,6 +259,27 @@ parse_args(struct axe_config *config, int argc, char * const *argv)
             case 'p':
                 config->permissive |= 1;
                 break;
+            case 'A':
+                engine = axe_engine_find(optarg);
+                if (engine < 0) {
+                    fprintf(stderr, "ERROR: Unknown engine '%s'\n", optarg);
+                    goto error;
+                }
+                config->engine = engine;
+                n_engines++;
+                break;
+            case 'H':
+                config->engine = AXE_ENGINE_WHITELIST;
+                n_engines++;
+                break;
+            case 'D':
+                config->engine = AXE_ENGINE_SEED;
+                n_engines++;
+                break;
+            case 'K':
+                config->engine = AXE_ENGINE_EDIT;
+                n_engines++;
+                break;
             case '2':
                 config->trim_rev |= 1;
                 break;
@@ -193,6 +323,69 @@ parse_args(struct axe_config *config, int argc, char * const *argv)
             case 't':
                 config->table_file = strdup(optarg);
                 break;
+            case 'J':
+                config->stats_file = strdup(optarg);
+                break;
+            case 'U':
+                config->unknown_top = atol(optarg);
+                break;
+            case 'M':
+                config->matrix_file = strdup(optarg);
+                break;
+            case 'N':
+                config->count_only = true;
+                break;
+            case 'Y':
+                config->preview = strtoull(optarg, NULL, 10);
+                if (config->preview < 1) {
+                    fprintf(stderr, "ERROR: Silly preview size '%s'\n",
+                            optarg);
+                    goto error;
+                }
+                break;
+            case 'X':
+                config->sample_fraction = strtod(optarg, NULL);
+                if (!(config->sample_fraction > 0 &&
+                      config->sample_fraction <= 1)) {
+                    fprintf(stderr, "ERROR: Sample fraction '%s' must be "
+                            "above 0 and at most 1\n", optarg);
+                    goto error;
+                }
+                break;
+            case 'j':
+                config->threads = atol(optarg);
+                break;
+            case 'G':
+                config->use_gz_index |= 1;
+                break;
+            case 'P':
+                config->checkpoint_file = strdup(optarg);
+                break;
+            case 'E':
+                config->checkpoint_every = strtoull(optarg, NULL, 10);
+                break;
+            case 'S':
+                config->resume = true;
+                break;
+            case 'O':
+                config->metrics_file = strdup(optarg);
+                break;
+            case 'W':
+                config->metrics_every = strtoull(optarg, NULL, 10);
+                break;
+            case 'L':
+                config->live_file = strdup(optarg);
+                break;
+            case 'Z':
+                config->estimate_memory = true;
+                break;
+            case 'k':
+                if (parse_chunk(config, optarg) != 0) {
+                    fprintf(stderr, "ERROR: Bad chunk '%s', expected e.g. 2/8\n",
+                            optarg);
+                    goto error;
+                }
+                break;
             case 'h':
                 fullhelp = true;
                 goto printhelp;
@@ -218,9 +411,50 @@ parse_args(struct axe_config *config, int argc, char * const *argv)
         fprintf(stderr, "ERROR: Barcode file must be provided\n");
         goto error;
     }
-    if (config->mismatches > 4) {
-        fprintf(stderr, "ERROR: Silly mismatch level %zu\n",
-                config->mismatches);
+    if (config->threads < 1 || config->threads > 1024) {
+        fprintf(stderr, "ERROR: Silly number of threads %zu\n",
+                config->threads);
+        goto error;
+    }
+    if (config->unknown_top > 1000) {
+        fprintf(stderr, "ERROR: Silly number of unknown prefixes %zu\n",
+                config->unknown_top);
+        goto error;
+    }
+    if (config->checkpoint_every < 1) {
+        fprintf(stderr, "ERROR: Silly checkpoint interval %" PRIu64 "\n",
+                config->checkpoint_every);
+        goto error;
+    }
+    if (config->metrics_every < 1) {
+        fprintf(stderr, "ERROR: Silly metrics interval %" PRIu64 "\n",
+                config->metrics_every);
+        goto error;
+    }
+    if (config->matrix_file != NULL && !config->match_combo) {
+        fprintf(stderr, "ERROR: --pair-matrix needs combinatorial barcodes (-c)\n");
+        goto error;
+    }
+    if (config->preview > 0 || config->sample_fraction > 0) {
+        if (config->preview > 0 && config->sample_fraction > 0) {
+            fprintf(stderr, "ERROR: Give only one of --preview and --sample-fraction\n");
+            goto error;
+        }
+        if (config->n_chunks > 0 || config->checkpoint_file != NULL) {
+            fprintf(stderr, "ERROR: --preview and --sample-fraction can't be "
+                    "used with --chunk or --checkpoint\n");
+            goto error;
+        }
+        /* Partial outputs would be of no use */
+        config->count_only = true;
+    }
+    if (config->resume && config->checkpoint_file == NULL) {
+        fprintf(stderr, "ERROR: --resume needs a --checkpoint file\n");
+        goto error;
+    }
+    if (n_engines > 1) {
+        fprintf(stderr, "ERROR: --engine, --whitelist, --seed-index and "
+                        "--indels are exclusive\n");
         goto error;
     }
     if (config->in_mode == READS_UNKNOWN) {
@@ -280,6 +514,11 @@ parse_args(struct axe_config *config, int argc, char * const *argv)
                 break;
         }
     }
+    if (config->count_only) {
+        /* Nothing is written, so any output prefixes are ignored */
+        config->out_mode = config->in_mode;
+        goto outputs_ok;
+    }
     if (config->out_prefixes[0] == NULL) {
         switch (config->out_mode) {
             case READS_SINGLE:
@@ -330,6 +569,7 @@ parse_args(struct axe_config *config, int argc, char * const *argv)
                 break;
         }
     }
+outputs_ok:
     config->have_cli_opts = true;
     format_call_number = 0;
     qes_logger_init(config->logger, "[axe] ", QES_LOG_DEBUG);
@@ -352,11 +592,19 @@ version:
     exit(0);
 }
 
+static void
+request_metrics(int signum)
+{
+    (void)signum;
+    axe_metrics_requested = 1;
+}
+
 int
 main (int argc, char * const *argv)
 {
     int ret = 0;
     struct axe_config *config = axe_config_create();
+    struct sigaction action;
 
     if (config == NULL) {
         ret = EXIT_FAILURE;
@@ -390,11 +638,31 @@ main (int argc, char * const *argv)
         fprintf(stderr, "[main] ERROR: axe_load_tries returned %i\n", ret);
         goto end;
     }
+    if (config->estimate_memory) {
+        /* Stop before opening any inputs or outputs */
+        ret = axe_print_memory_estimate(config);
+        if (ret != 0) {
+            fprintf(stderr, "[main] ERROR: axe_print_memory_estimate "
+                    "returned %i\n", ret);
+        }
+        goto end;
+    }
+    ret = axe_load_checkpoint(config);
+    if (ret != 0) {
+        fprintf(stderr, "[main] ERROR: axe_load_checkpoint returned %i\n", ret);
+        goto end;
+    }
     ret = axe_make_outputs(config);
     if (ret != 0) {
         fprintf(stderr, "[main] ERROR: axe_make_outputs returned %i\n", ret);
         goto end;
     }
+    /* Restart interrupted reads and writes, rather than failing them */
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = request_metrics;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGUSR1, &action, NULL);
     ret = axe_process_file(config);
     if (ret != 0) {
         fprintf(stderr, "[main] ERROR: axe_process_file returned %i\n", ret);
@@ -410,6 +678,21 @@ main (int argc, char * const *argv)
         fprintf(stderr, "[main] ERROR: axe_write_table returned %i\n", ret);
         goto end;
     }
+    ret = axe_write_manifest(config);
+    if (ret != 0) {
+        fprintf(stderr, "[main] ERROR: axe_write_manifest returned %i\n", ret);
+        goto end;
+    }
+    ret = axe_write_stats(config);
+    if (ret != 0) {
+        fprintf(stderr, "[main] ERROR: axe_write_stats returned %i\n", ret);
+        goto end;
+    }
+    ret = axe_write_matrix(config);
+    if (ret != 0) {
+        fprintf(stderr, "[main] ERROR: axe_write_matrix returned %i\n", ret);
+        goto end;
+    }
 end:
     axe_config_destroy(config);
     return ret;
@@ -0,0 +1,639 @@
+/*
+ * ============================================================================
+ *
+ *       Filename:  merge.c
+ *    Description:  Merge the outputs of axe-demux --chunk runs
+ *      Copyright:  2014-2016 Kevin Murray <kdmfoss@gmail.com>
+ *        License:  GNU GPL v3+
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ============================================================================
+ */
+
+
+#include "axe.h"
+
+#include <getopt.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/* Each chunk's output is a complete gzip stream (or plain text), and
+ * concatenated gzip streams are themselves a valid gzip file. So merging is
+ * just concatenation, and we never need to decompress anything. */
+
+#define MERGE_BUFSIZE (1<<20)
+
+static void
+print_usage(FILE *stream)
+{
+    fprintf(stream, "AXE Version %s\n", AXE_VERSION);
+    fprintf(stream, "\nUSAGE:\n");
+    fprintf(stream, "axe-merge [-czkt] -n N -b BARCODES (-F [-R] | -I)\n");
+    fprintf(stream, "axe-merge -h\n\n");
+    fprintf(stream, "Merges the outputs of N runs of axe-demux --chunk i/N. Give\n");
+    fprintf(stream, "the same -c, -b, -F/-R/-I, -z and -t values as the axe-demux runs.\n\n");
+    fprintf(stream, "OPTIONS:\n");
+    fprintf(stream, "    -n, --chunks\tNumber of chunks to merge. [int]\n");
+    fprintf(stream, "    -c, --combinatorial\tBarcodes are combinatorial. [flag, default OFF]\n");
+    fprintf(stream, "    -b, --barcodes\tBarcode file. [file]\n");
+    fprintf(stream, "    -F, --fwd-out\tOutput forward read prefix. [file prefix or existing directory]\n");
+    fprintf(stream, "    -R, --rev-out\tOutput reverse read prefix. [file prefix or existing directory]\n");
+    fprintf(stream, "    -I, --ilfq-out\tOutput interleaved paired reads prefix. [file prefix or existing directory]\n");
+    fprintf(stream, "    -z, --ziplevel\tGzip compression level the chunks were written with. [int, default 0]\n");
+    fprintf(stream, "    -t, --table-file\tSum chunk tables into this table file, and combine\n");
+    fprintf(stream, "                    \tchunk checksum manifests. [file]\n");
+    fprintf(stream, "        --pair-matrix\tSum chunk pair matrices into this file. [file]\n");
+    fprintf(stream, "    -k, --keep\t\tKeep chunk files after merging. [flag, default OFF]\n");
+    fprintf(stream, "    -h, --help\t\tPrint this usage.\n");
+    fprintf(stream, "    -q, --quiet\t\tBe very quiet.\n");
+    fprintf(stream, "\n");
+}
+
+static const char *merge_opts = "n:cb:F:R:I:z:t:khq";
+static const struct option merge_longopts[] = {
+    { "chunks",     required_argument,  NULL,   'n' },
+    { "combinatorial", no_argument,     NULL,   'c' },
+    { "barcodes",   required_argument,  NULL,   'b' },
+    { "fwd-out",    required_argument,  NULL,   'F' },
+    { "rev-out",    required_argument,  NULL,   'R' },
+    { "ilfq-out",   required_argument,  NULL,   'I' },
+    { "ziplevel",   required_argument,  NULL,   'z' },
+    { "table-file", required_argument,  NULL,   't' },
+    { "pair-matrix", required_argument, NULL,   'M' },
+    { "keep",       no_argument,        NULL,   'k' },
+    { "help",       no_argument,        NULL,   'h' },
+    { "quiet",      no_argument,        NULL,   'q' },
+    { NULL,         0,                  NULL,    0  }
+};
+
+static int
+copy_fd(int out_fd, int in_fd, char *buf)
+{
+    ssize_t got = 0;
+    ssize_t put = 0;
+    ssize_t off = 0;
+
+#ifdef AXE_HAVE_COPY_FILE_RANGE
+    /* Let the kernel copy (or reflink) the data if it can */
+    do {
+        got = copy_file_range(in_fd, NULL, out_fd, NULL, MERGE_BUFSIZE, 0);
+    } while (got > 0);
+    if (got == 0) {
+        return 0;
+    }
+    if (errno != EXDEV && errno != EINVAL && errno != ENOSYS &&
+            errno != EOPNOTSUPP) {
+        return 1;
+    }
+    /* Fall back to read/write, from wherever copy_file_range got to */
+#endif
+    while ((got = read(in_fd, buf, MERGE_BUFSIZE)) > 0) {
+        for (off = 0; off < got; off += put) {
+            put = write(out_fd, buf + off, got - off);
+            if (put < 0) {
+                return 1;
+            }
+        }
+    }
+    return got < 0 ? 1 : 0;
+}
+
+static int
+merge_parts(struct axe_config *config, const char *prefix, const char *id,
+            int read, bool keep)
+{
+    char *buf = NULL;
+    char *ext = NULL;
+    char *path = NULL;
+    char *part = NULL;
+    size_t n_chunks = config->n_chunks;
+    size_t iii = 0;
+    int out_fd = -1;
+    int in_fd = -1;
+    int ret = 1;
+
+    /* Make the final output's name while n_chunks is 0 */
+    config->n_chunks = 0;
+    ext = axe_make_file_ext(config);
+    path = axe_format_outfile_path(prefix, id, read, ext);
+    qes_free(ext);
+    config->n_chunks = n_chunks;
+    if (path == NULL) {
+        goto exit;
+    }
+    out_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out_fd < 0) {
+        qes_log_format_fatal(config->logger, "Couldn't open %s: %s\n", path,
+                             strerror(errno));
+        goto exit;
+    }
+    buf = qes_malloc(MERGE_BUFSIZE);
+    for (iii = 0; iii < n_chunks; iii++) {
+        config->chunk_index = iii;
+        ext = axe_make_file_ext(config);
+        part = axe_format_outfile_path(prefix, id, read, ext);
+        qes_free(ext);
+        if (part == NULL) {
+            goto exit;
+        }
+        in_fd = open(part, O_RDONLY);
+        if (in_fd < 0) {
+            qes_log_format_fatal(config->logger, "Couldn't open chunk %s: %s\n",
+                                 part, strerror(errno));
+            goto exit;
+        }
+        if (copy_fd(out_fd, in_fd, buf) != 0) {
+            qes_log_format_fatal(config->logger, "Couldn't copy %s to %s: %s\n",
+                                 part, path, strerror(errno));
+            goto exit;
+        }
+        close(in_fd);
+        in_fd = -1;
+        qes_free(part);
+    }
+    if (close(out_fd) != 0) {
+        out_fd = -1;
+        qes_log_format_fatal(config->logger, "Couldn't close %s: %s\n", path,
+                             strerror(errno));
+        goto exit;
+    }
+    out_fd = -1;
+    /* Only remove parts once the whole output has been written */
+    for (iii = 0; !keep && iii < n_chunks; iii++) {
+        config->chunk_index = iii;
+        ext = axe_make_file_ext(config);
+        part = axe_format_outfile_path(prefix, id, read, ext);
+        qes_free(ext);
+        if (part != NULL) {
+            unlink(part);
+        }
+        qes_free(part);
+    }
+    ret = 0;
+exit:
+    if (in_fd >= 0) close(in_fd);
+    if (out_fd >= 0) close(out_fd);
+    qes_free(part);
+    qes_free(path);
+    qes_free(buf);
+    return ret;
+}
+
+static int
+merge_outputs(struct axe_config *config, const char *id, bool keep)
+{
+    int ret = 0;
+
+    switch (config->out_mode) {
+    case READS_SINGLE:
+        ret = merge_parts(config, config->out_prefixes[0], id, 1, keep);
+        break;
+    case READS_PAIRED:
+        ret = merge_parts(config, config->out_prefixes[0], id, 1, keep);
+        if (ret == 0) {
+            ret = merge_parts(config, config->out_prefixes[1], id, 2, keep);
+        }
+        break;
+    case READS_INTERLEAVED:
+        ret = merge_parts(config, config->out_prefixes[0], id, 0, keep);
+        break;
+    case READS_UNKNOWN:
+    default:
+        ret = -1;
+        break;
+    }
+    return ret;
+}
+
+/* Chunk tables (and pair matrices) have identical rows, so we sum the count
+ * columns of each row, checking the other columns agree. Count columns are
+ * those from Count on (Count and any per-mismatch counts after it), or all
+ * but the first in a matrix. */
+static int
+merge_tables(struct axe_config *config, const char *final_path, bool keep)
+{
+    FILE **tabs = NULL;
+    FILE *out = NULL;
+    char *line = NULL;
+    char *first = NULL;
+    char *count = NULL;
+    char *end = NULL;
+    char *path = NULL;
+    size_t linesz = 0;
+    size_t firstsz = 0;
+    size_t n_chunks = config->n_chunks;
+    size_t keycols = 0;
+    size_t n_sums = 0;
+    size_t keylen = 0;
+    size_t iii = 0;
+    size_t jjj = 0;
+    uint64_t *sums = NULL;
+    ssize_t len = 0;
+    int ret = 1;
+
+    tabs = qes_calloc(n_chunks, sizeof(*tabs));
+    for (iii = 0; iii < n_chunks; iii++) {
+        config->chunk_index = iii;
+        path = axe_make_chunk_path(config, final_path);
+        tabs[iii] = path == NULL ? NULL : fopen(path, "r");
+        if (tabs[iii] == NULL) {
+            qes_log_format_fatal(config->logger, "Couldn't open table %s\n",
+                                 path);
+            goto exit;
+        }
+        qes_free(path);
+    }
+    out = fopen(final_path, "w");
+    if (out == NULL) {
+        qes_log_format_fatal(config->logger, "Couldn't open table %s: %s\n",
+                             final_path, strerror(errno));
+        goto exit;
+    }
+    while ((len = getline(&first, &firstsz, tabs[0])) > 0) {
+        if (strncmp(first, "Barcode", 7) == 0 ||
+                strncmp(first, "R1Barcode", 9) == 0) {
+            /* Header line, copy verbatim, noting which columns are counts */
+            fputs(first, out);
+            for (iii = 1; iii < n_chunks; iii++) {
+                if (getline(&line, &linesz, tabs[iii]) != len ||
+                        strcmp(line, first) != 0) {
+                    goto mismatch;
+                }
+            }
+            count = strstr(first, "\tCount");
+            if (count == NULL) {
+                count = strchr(first, '\t');
+            }
+            if (count == NULL) {
+                goto mismatch;
+            }
+            for (keycols = 1, end = first; end < count; end++) {
+                keycols += *end == '\t';
+            }
+            for (n_sums = 1, end = count + 1; *end != '\0'; end++) {
+                n_sums += *end == '\t';
+            }
+            sums = qes_calloc(n_sums, sizeof(*sums));
+            continue;
+        }
+        for (count = first, jjj = 0; jjj < keycols && count != NULL; jjj++) {
+            count = strchr(count + 1, '\t');
+        }
+        if (sums == NULL || count == NULL) {
+            goto mismatch;
+        }
+        keylen = count - first;
+        memset(sums, 0, n_sums * sizeof(*sums));
+        for (iii = 0; iii < n_chunks; iii++) {
+            if (iii > 0 && (getline(&line, &linesz, tabs[iii]) < 0 ||
+                            strncmp(line, first, keylen + 1) != 0)) {
+                goto mismatch;
+            }
+            end = (iii > 0 ? line : first) + keylen;
+            for (jjj = 0; jjj < n_sums; jjj++) {
+                if (*end != '\t') {
+                    goto mismatch;
+                }
+                sums[jjj] += strtoull(end + 1, &end, 10);
+            }
+        }
+        fprintf(out, "%.*s", (int)keylen, first);
+        for (jjj = 0; jjj < n_sums; jjj++) {
+            fprintf(out, "\t%" PRIu64, sums[jjj]);
+        }
+        fprintf(out, "\n");
+    }
+    if (fclose(out) != 0) {
+        out = NULL;
+        goto exit;
+    }
+    out = NULL;
+    for (iii = 0; !keep && iii < n_chunks; iii++) {
+        config->chunk_index = iii;
+        path = axe_make_chunk_path(config, final_path);
+        if (path != NULL) {
+            unlink(path);
+        }
+        qes_free(path);
+    }
+    ret = 0;
+    goto exit;
+mismatch:
+    qes_log_format_fatal(config->logger,
+                         "Chunk table %zu doesn't match the first chunk's table\n",
+                         iii + 1);
+exit:
+    for (iii = 0; iii < n_chunks; iii++) {
+        if (tabs[iii] != NULL) fclose(tabs[iii]);
+    }
+    if (out != NULL) fclose(out);
+    qes_free(tabs);
+    qes_free(sums);
+    qes_free(path);
+    free(line);
+    free(first);
+    return ret;
+}
+
+/* Splits a manifest line into the file name (left in ``line``) and sums */
+static int
+parse_manifest_line(char *line, struct qes_file_sums *sums)
+{
+    char *fields[4];
+    char *tab = NULL;
+    int iii = 0;
+
+    for (iii = 3; iii >= 0; iii--) {
+        tab = strrchr(line, '\t');
+        if (tab == NULL) {
+            return 1;
+        }
+        *tab = '\0';
+        fields[iii] = tab + 1;
+    }
+    sums->size = strtoull(fields[0], NULL, 10);
+    sums->crc = strtoul(fields[1], NULL, 16);
+    sums->data_size = strtoull(fields[2], NULL, 10);
+    sums->data_crc = strtoul(fields[3], NULL, 16);
+    return 0;
+}
+
+/* Chunk manifests list the same outputs in the same order. Merged outputs
+ * are concatenations of their chunks, so their CRCs can be combined from the
+ * chunks' CRCs without reading the merged files back. */
+static int
+merge_manifests(struct axe_config *config, bool keep)
+{
+    FILE **mans = NULL;
+    FILE *out = NULL;
+    struct qes_file_sums sums;
+    struct qes_file_sums part;
+    char *line = NULL;
+    char *first = NULL;
+    char *path = NULL;
+    char *ext = NULL;
+    char *final_ext = NULL;
+    size_t linesz = 0;
+    size_t firstsz = 0;
+    size_t n_chunks = config->n_chunks;
+    size_t namelen = 0;
+    size_t extlen = 0;
+    size_t iii = 0;
+    int ret = 1;
+
+    mans = qes_calloc(n_chunks, sizeof(*mans));
+    for (iii = 0; iii < n_chunks; iii++) {
+        config->chunk_index = iii;
+        path = axe_make_manifest_path(config);
+        mans[iii] = path == NULL ? NULL : fopen(path, "r");
+        if (mans[iii] == NULL) {
+            qes_log_format_fatal(config->logger, "Couldn't open manifest %s\n",
+                                 path);
+            goto exit;
+        }
+        qes_free(path);
+    }
+    config->n_chunks = 0;
+    path = axe_make_manifest_path(config);
+    final_ext = axe_make_file_ext(config);
+    config->n_chunks = n_chunks;
+    out = path == NULL ? NULL : fopen(path, "w");
+    if (out == NULL) {
+        qes_log_format_fatal(config->logger, "Couldn't open manifest %s\n",
+                             path);
+        goto exit;
+    }
+    qes_free(path);
+    /* Header */
+    if (getline(&first, &firstsz, mans[0]) < 0) {
+        iii = 0;
+        goto mismatch;
+    }
+    fputs(first, out);
+    for (iii = 1; iii < n_chunks; iii++) {
+        if (getline(&line, &linesz, mans[iii]) < 0 ||
+                strcmp(line, first) != 0) {
+            goto mismatch;
+        }
+    }
+    while (getline(&first, &firstsz, mans[0]) > 0) {
+        memset(&sums, 0, sizeof(sums));
+        for (iii = 0; iii < n_chunks; iii++) {
+            if (iii > 0 && getline(&line, &linesz, mans[iii]) < 0) {
+                goto mismatch;
+            }
+            if (parse_manifest_line(iii == 0 ? first : line, &part) != 0) {
+                goto mismatch;
+            }
+            /* Strip the chunk's extension, checking it names the same output
+             * as the first chunk's line */
+            config->chunk_index = iii;
+            ext = axe_make_file_ext(config);
+            extlen = strlen(ext);
+            if (iii == 0) {
+                namelen = strlen(first);
+                if (namelen < extlen ||
+                        strcmp(first + namelen - extlen, ext) != 0) {
+                    goto mismatch;
+                }
+                namelen -= extlen;
+            } else if (strlen(line) != namelen + extlen ||
+                       strncmp(line, first, namelen) != 0 ||
+                       strcmp(line + namelen, ext) != 0) {
+                goto mismatch;
+            }
+            qes_free(ext);
+            sums.crc = crc32_combine(sums.crc, part.crc, part.size);
+            sums.size += part.size;
+            sums.data_crc = crc32_combine(sums.data_crc, part.data_crc,
+                                          part.data_size);
+            sums.data_size += part.data_size;
+        }
+        fprintf(out, "%.*s%s\t%" PRIu64 "\t%08" PRIx32 "\t%" PRIu64
+                "\t%08" PRIx32 "\n", (int)namelen, first, final_ext,
+                sums.size, sums.crc, sums.data_size, sums.data_crc);
+    }
+    if (fclose(out) != 0) {
+        out = NULL;
+        goto exit;
+    }
+    out = NULL;
+    for (iii = 0; !keep && iii < n_chunks; iii++) {
+        config->chunk_index = iii;
+        path = axe_make_manifest_path(config);
+        if (path != NULL) {
+            unlink(path);
+        }
+        qes_free(path);
+    }
+    ret = 0;
+    goto exit;
+mismatch:
+    qes_log_format_fatal(config->logger,
+                         "Chunk manifest %zu doesn't match the first chunk's manifest\n",
+                         iii + 1);
+exit:
+    for (iii = 0; iii < n_chunks; iii++) {
+        if (mans[iii] != NULL) fclose(mans[iii]);
+    }
+    if (out != NULL) fclose(out);
+    qes_free(mans);
+    qes_free(path);
+    qes_free(ext);
+    qes_free(final_ext);
+    free(line);
+    free(first);
+    return ret;
+}
+
+static int
+parse_args(struct axe_config *config, bool *keep, int argc, char * const *argv)
+{
+    int c = 0;
+    long n = 0;
+
+    while ((c = getopt_long(argc, argv, merge_opts, merge_longopts, NULL)) > 0) {
+        switch (c) {
+            case 'n':
+                n = atol(optarg);
+                config->n_chunks = n > 0 ? n : 0;
+                break;
+            case 'c':
+                config->match_combo |= 1;
+                break;
+            case 'b':
+                config->barcode_file = strdup(optarg);
+                break;
+            case 'F':
+                config->out_prefixes[0] = strdup(optarg);
+                if (config->out_mode != READS_PAIRED) {
+                    config->out_mode = READS_SINGLE;
+                }
+                break;
+            case 'R':
+                config->out_prefixes[1] = strdup(optarg);
+                config->out_mode = READS_PAIRED;
+                break;
+            case 'I':
+                config->out_prefixes[0] = strdup(optarg);
+                config->out_mode = READS_INTERLEAVED;
+                break;
+            case 'z':
+                config->out_compress_level = atoi(optarg);
+                break;
+            case 't':
+                config->table_file = strdup(optarg);
+                break;
+            case 'M':
+                config->matrix_file = strdup(optarg);
+                break;
+            case 'k':
+                *keep = true;
+                break;
+            case 'q':
+                config->verbosity -= 1;
+                break;
+            case 'h':
+                print_usage(stdout);
+                axe_config_destroy(config);
+                exit(0);
+            case '?':
+            default:
+                return 1;
+        }
+    }
+    if (config->n_chunks == 0) {
+        fprintf(stderr, "ERROR: Number of chunks must be given\n");
+        return 1;
+    }
+    if (config->barcode_file == NULL) {
+        fprintf(stderr, "ERROR: Barcode file must be provided\n");
+        return 1;
+    }
+    if (config->out_prefixes[0] == NULL ||
+            (config->out_mode == READS_PAIRED && config->out_prefixes[1] == NULL)) {
+        fprintf(stderr, "ERROR: Output prefix(es) must be provided\n");
+        return 1;
+    }
+    qes_logger_init(config->logger, "[axe-merge] ", QES_LOG_DEBUG);
+    qes_logger_add_destination_formatted(config->logger, stderr, QES_LOG_DEBUG,
+                                         &axe_formatter);
+    return 0;
+}
+
+int
+main (int argc, char * const *argv)
+{
+    int ret = 0;
+    bool keep = false;
+    size_t iii = 0;
+    struct axe_config *config = axe_config_create();
+
+    if (config == NULL) {
+        ret = EXIT_FAILURE;
+        goto end;
+    }
+    ret = parse_args(config, &keep, argc, argv);
+    if (ret != 0) {
+        print_usage(stderr);
+        goto end;
+    }
+    ret = axe_read_barcodes(config);
+    if (ret != 0) {
+        fprintf(stderr, "[main] ERROR: axe_read_barcodes returned %i\n", ret);
+        goto end;
+    }
+    for (iii = 0; iii < config->n_barcode_pairs; iii++) {
+        ret = merge_outputs(config, config->barcodes[iii]->id, keep);
+        if (ret != 0) {
+            fprintf(stderr, "[main] ERROR: merging outputs of %s failed\n",
+                    config->barcodes[iii]->id);
+            goto end;
+        }
+    }
+    ret = merge_outputs(config, "unknown", keep);
+    if (ret != 0) {
+        fprintf(stderr, "[main] ERROR: merging unknown outputs failed\n");
+        goto end;
+    }
+    if (config->table_file != NULL) {
+        ret = merge_tables(config, config->table_file, keep);
+        if (ret != 0) {
+            fprintf(stderr, "[main] ERROR: merging tables failed\n");
+            goto end;
+        }
+        ret = merge_manifests(config, keep);
+        if (ret != 0) {
+            fprintf(stderr, "[main] ERROR: merging manifests failed\n");
+            goto end;
+        }
+    }
+    if (config->matrix_file != NULL) {
+        ret = merge_tables(config, config->matrix_file, keep);
+        if (ret != 0) {
+            fprintf(stderr, "[main] ERROR: merging pair matrices failed\n");
+            goto end;
+        }
+    }
+    if (config->verbosity >= 0) {
+        axe_format_bold(config->logger,
+                        "Merged %zu chunks of %zu samples\n",
+                        config->n_chunks, config->n_barcode_pairs);
+    }
+end:
+    axe_config_destroy(config);
+    return ret;
+}
@@ -1,14 +1,18 @@
 #!/usr/bin/env python
 from __future__ import print_function
+import gzip
 import hashlib
+import json
 import logging
 import os
 from os import path
 import re
 import shutil
+import struct
 import subprocess as sp
 import sys
 import unittest
+import zlib
 
 
 if len(sys.argv) < 2:
@@ -37,6 +41,7 @@ class AxeTest(unittest.TestCase):
         self.data = path.join(CMAKE_BINARY_DIR, "data")
         self.out = path.join(CMAKE_BINARY_DIR, "out", "cli_tests")
         self.axe = path.join(CMAKE_BINARY_DIR, "bin", "axe-demux")
+        self.merge = path.join(CMAKE_BINARY_DIR, "bin", "axe-merge")
         self.log = logging.getLogger("AxeTest")
         if not path.exists(self.data) or not path.exists(self.axe):
             print("Please run axe_cli_tests.py after compiling axe")
@@ -182,6 +187,283 @@ class TestFakeSE(AxeTest):
         self._do_test_zip(1)
         self.assertDictEqual(self.zfiles, self.get_md5_dict())
 
+    def test_fake_se_1mm_stats(self):
+        table = path.join(self.out, "fake_se.tsv")
+        stats = path.join(self.out, "fake_se.json")
+        command = [self.axe,
+            "-f", path.join(self.data, "fake_1mm_R1.fq.gz"),
+            "-F", self.outfq,
+            '-b', self.barcodes,
+            '-m', '1',
+            '-t', table,
+            '--stats', stats,
+        ]
+        self.assertTrue(self.run_and_check_stdout(command))
+        with open(table) as fh:
+            rows = [l.rstrip('\n').split('\t') for l in fh]
+        self.assertEqual(rows, [
+            ['Barcode', 'Sample', 'Count', '0mm', '1mm'],
+            ['ATCACG', '1', '1', '0', '1'],
+            ['CGATGT', '2', '1', '0', '1'],
+            ['N', 'No Barcode', '1', '0', '0'],
+        ])
+        with open(stats) as fh:
+            run = json.load(fh)
+        self.assertEqual(run['reads_processed'], 3)
+        self.assertEqual(run['reads_failed'], 1)
+        # Each read's prefix is new to the cache
+        self.assertEqual(run['prefix_cache'],
+                         {'lookups': 3, 'hits': 0, 'hit_rate': 0.0})
+        self.assertEqual([(s['id'], s['count'], s['mismatches'])
+                          for s in run['samples']],
+                         [('1', 1, [0, 1]), ('2', 1, [0, 1])])
+        self.assertEqual(run['unknown_prefixes'],
+                         [{'prefix': 'TAGGCC', 'count': 1,
+                           'max_overcount': 0}])
+        self.assertEqual(run['threads'], 1)
+        self.assertEqual(sorted(run['stage_seconds']),
+                         ['match', 'read', 'wait', 'write'])
+        self.assertTrue(all(t >= 0 for t in run['stage_seconds'].values()))
+        self.assertTrue(run['mean_write_queue'] >= 0)
+
+    def test_fake_se_count_only(self):
+        table = path.join(self.out, "fake_se.tsv")
+        command = [self.axe,
+            "-f", path.join(self.data, "fake_1mm_R1.fq.gz"),
+            '-b', self.barcodes,
+            '-m', '1',
+            '-t', table,
+            '--count-only',
+        ]
+        self.assertTrue(self.run_and_check_stdout(command))
+        with open(table) as fh:
+            rows = [l.rstrip('\n').split('\t') for l in fh]
+        self.assertEqual(rows, [
+            ['Barcode', 'Sample', 'Count', '0mm', '1mm'],
+            ['ATCACG', '1', '1', '0', '1'],
+            ['CGATGT', '2', '1', '0', '1'],
+            ['N', 'No Barcode', '1', '0', '0'],
+        ])
+        # Only the table is written
+        self.assertEqual(os.listdir(self.out), ["fake_se.tsv"])
+
+    def test_fake_se_whitelist(self):
+        table = path.join(self.out, "fake_se.tsv")
+        command = [self.axe,
+            "-f", path.join(self.data, "fake_2mm_R1.fq.gz"),
+            '-b', self.barcodes,
+            '-t', table,
+            '--count-only',
+        ]
+        tables = []
+        for mm in ['1', '2']:
+            for engine in [['-p'], ['--whitelist']]:
+                self.assertTrue(self.run_and_check_stdout(
+                    command + ['-m', mm] + engine))
+                with open(table) as fh:
+                    tables.append(fh.read())
+        # The index matches reads as the permissive tries do
+        self.assertEqual(tables[0], tables[1])
+        self.assertEqual(tables[2], tables[3])
+        self.assertIn('ATCACG\t1\t1\t0\t0\t1\n', tables[3])
+        # Barcodes of several lengths can't be indexed
+        command = [self.axe,
+            "-f", path.join(self.data, "gbs_R1.fastq.gz"),
+            '-b', path.join(self.data, "gbs_se.barcodes"),
+            '--count-only',
+            '--whitelist',
+        ]
+        self.assertFalse(self.run_and_check_stdout(command))
+
+    def test_fake_se_seed_index(self):
+        table = path.join(self.out, "fake_se.tsv")
+        # Barcodes of several lengths, matched as by the tries
+        command = [self.axe,
+            "-f", path.join(self.data, "gbs_R1.fastq.gz"),
+            '-b', path.join(self.data, "gbs_se.barcodes"),
+            '-m', '1',
+            '-t', table,
+            '--count-only',
+        ]
+        tables = []
+        for engine in [[], ['--seed-index']]:
+            self.assertTrue(self.run_and_check_stdout(command + engine))
+            with open(table) as fh:
+                tables.append(fh.read())
+        self.assertEqual(tables[0], tables[1])
+        # Mismatch levels too high for the tries use seeds
+        command = [self.axe,
+            "-f", path.join(self.data, "fake_2mm_R1.fq.gz"),
+            '-b', self.barcodes,
+            '-m', '5',
+            '-t', table,
+            '--count-only',
+        ]
+        self.assertTrue(self.run_and_check_stdout(command))
+        with open(table) as fh:
+            rows = [l.rstrip('\n').split('\t') for l in fh]
+        self.assertEqual(rows[0], ['Barcode', 'Sample', 'Count', '0mm',
+                                   '1mm', '2mm', '3mm', '4mm', '5mm'])
+        # The unknown read is within five mismatches of the first barcode
+        self.assertEqual([r[2] for r in rows[1:]], ['2', '1', '0'])
+        self.assertFalse(self.run_and_check_stdout(command + ['-m', '6']))
+
+    def test_fake_se_indels(self):
+        infq = path.join(self.out, "indels.fq")
+        reads = ["ATCCGTTTTTTTTT",  # ATCACG, less its second A
+                 "ATCAACGGGGGGGG",  # ATCACG, with another A
+                 "CGATGTAAAAAAA"]
+        with open(infq, "w") as fh:
+            for i, seq in enumerate(reads):
+                fh.write("@read{}\n{}\n+\n{}\n".format(i, seq,
+                                                      "I" * len(seq)))
+        command = [self.axe,
+            "-f", infq,
+            "-F", self.outfq,
+            '-b', self.barcodes,
+            '-m', '1',
+        ]
+        # Substitutions alone can't match the first two
+        self.assertTrue(self.run_and_check_stdout(command))
+        with open(self.nobcdfq) as fh:
+            self.assertEqual(fh.read().count('@read'), 2)
+        self.assertTrue(self.run_and_check_stdout(command + ['--indels']))
+        seqs = {}
+        for sample in ['1', '2', 'unknown']:
+            fq = path.join(self.out, "fake_se_{}_R1.fastq".format(sample))
+            with open(fq) as fh:
+                seqs[sample] = fh.read().split('\n')[1::4]
+        # Each read loses only what its barcode took up
+        self.assertEqual(seqs, {'1': ['TTTTTTTTT', 'GGGGGGG'],
+                                '2': ['AAAAAAA'],
+                                'unknown': []})
+
+    def test_fake_se_engines(self):
+        table = path.join(self.out, "fake_se.tsv")
+        command = [self.axe,
+            "-f", path.join(self.data, "fake_1mm_R1.fq.gz"),
+            '-b', self.barcodes,
+            '-m', '1',
+            '-t', table,
+            '--count-only',
+        ]
+        tables = []
+        for engine in ['auto', 'trie', 'brute', 'whitelist', 'seed', 'edit']:
+            self.assertTrue(self.run_and_check_stdout(
+                command + ['--engine', engine]))
+            with open(table) as fh:
+                tables.append(fh.read())
+        # Every engine matches these reads alike
+        for other in tables[1:]:
+            self.assertEqual(tables[0], other)
+        self.assertFalse(self.run_and_check_stdout(
+            command + ['--engine', 'datrie']))
+        self.assertFalse(self.run_and_check_stdout(
+            command + ['--engine', 'trie', '--whitelist']))
+        # The tries can't hold so many mutants, and say so
+        for mm in ['8', '7']:
+            proc = sp.run(command[:5] + ['-m', mm] + command[7:] +
+                          ['--engine', 'trie'], stdout=sp.PIPE, stderr=sp.PIPE)
+            self.assertEqual(proc.returncode, 1)
+            self.assertIn(b'The trie engine supports -m <= 4', proc.stderr)
+
+    def test_fake_se_engines_prefixes(self):
+        barcodes = path.join(self.out, "prefixes.tsv")
+        infq = path.join(self.out, "prefixes.fq")
+        table = path.join(self.out, "prefixes_table.tsv")
+        with open(barcodes, "w") as fh:
+            fh.write("Barcode\tID\nAAAA\ts1\nAAAACC\ts2\nAAAAGG\ts3\n"
+                     "AAAACCGG\ts4\n")
+        reads = ["AAAACCGGTT", "AAAACCGCTT",  # AAAACCGG
+                 "AAAACGTTTT",  # As near AAAACC as AAAAGG, so AAAA
+                 "AAAATTTTTT", "AAAAGCTTTT", "AAAANNNNNN",  # AAAA
+                 "AAAACCGNTT",  # An N in AAAACCGG's bases, so AAAACC
+                 "AAAACNTTTT",  # and in AAAACC's, so AAAA
+                 "NAAACCGGTT", "AANACCGGTT", "TTTTTTTTTT"]  # Unknown
+        with open(infq, "w") as fh:
+            for i, seq in enumerate(reads):
+                fh.write("@read{}\n{}\n+\n{}\n".format(i, seq,
+                                                      "I" * len(seq)))
+        command = [self.axe,
+            "-f", infq,
+            '-b', barcodes,
+            '-m', '1',
+            '-p',
+            '-t', table,
+            '--count-only',
+        ]
+        tables = []
+        for engine in ['auto', 'trie', 'brute', 'seed', 'edit']:
+            self.assertTrue(self.run_and_check_stdout(
+                command + ['--engine', engine]))
+            with open(table) as fh:
+                tables.append(fh.read())
+        # Every engine but the whitelists, for one length, matches alike
+        for other in tables[1:]:
+            self.assertEqual(tables[0], other)
+        rows = [l.split('\t') for l in tables[0].splitlines()]
+        self.assertEqual([r[2] for r in rows[1:]], ['5', '1', '0', '2', '3'])
+
+    def test_fake_se_estimate_memory(self):
+        base = [self.axe,
+            "-f", path.join(self.data, "fake_1mm_R1.fq.gz"),
+            "-F", self.outfq,
+            '-b', self.barcodes,
+            '-m', '1',
+        ]
+        estimate = sp.check_output(base + ['--estimate-memory'])
+        rows = [l.split('\t') for l in estimate.decode().splitlines()]
+        self.assertEqual(rows[0], ['Subsystem', 'Bytes', 'MiB'])
+        bytes = dict((r[0], int(r[1])) for r in rows[1:])
+        self.assertEqual(sorted(bytes),
+                         ['io', 'lookup', 'total', 'tries', 'zlib'])
+        self.assertEqual(bytes['total'], sum(v for k, v in bytes.items()
+                                             if k != 'total'))
+        # Nothing is opened
+        self.assertEqual(os.listdir(self.out), [])
+        # Plain outputs have no zlib state to estimate, so the estimate is
+        # exactly what the run uses at its peak
+        stats = path.join(self.out, "stats.json")
+        self.assertTrue(self.run_and_check_stdout(base + ['--stats', stats]))
+        with open(stats) as fh:
+            memory = json.load(fh)['memory']
+        for name in ['io', 'zlib', 'tries', 'lookup']:
+            self.assertEqual(memory[name]['peak'], bytes[name], name)
+        # Everything but the outputs has been freed by then
+        self.assertEqual(memory['zlib']['current'], 0)
+
+    def test_fake_se_live_metrics(self):
+        metrics = path.join(self.out, "axe.prom")
+        live = path.join(self.out, "axe.live")
+        command = [self.axe,
+            "-f", path.join(self.data, "fake_0mm_R1.fq.gz"),
+            "-F", self.outfq,
+            '-b', self.barcodes,
+            '--metrics', metrics,
+            '--live-stats', live,
+        ]
+        self.assertTrue(self.run_and_check_stdout(command))
+        with open(metrics) as fh:
+            prom = dict(l.rsplit(' ', 1) for l in fh.read().splitlines()
+                        if not l.startswith('#'))
+        self.assertEqual(prom['axe_reads_processed_total'], '3')
+        self.assertEqual(prom['axe_reads_failed_total'], '1')
+        self.assertEqual(prom['axe_running'], '0')
+        self.assertEqual(prom['axe_sample_reads_total{sample="1"}'], '1')
+        self.assertFalse(path.exists(metrics + ".tmp"))
+        with open(live, 'rb') as fh:
+            data = fh.read()
+        header = struct.unpack('=8s9Q', data[:80])
+        magic, seq, n_samples, names_offset, running = header[:5]
+        self.assertEqual(magic, b'AXELIVE1')
+        self.assertEqual(seq % 2, 0)
+        self.assertEqual(running, 0)
+        self.assertEqual(header[7:], (3, 2, 1))
+        counts = struct.unpack('=%dQ' % n_samples,
+                               data[80:80 + 8 * n_samples])
+        names = data[names_offset:].split(b'\0')[:n_samples]
+        self.assertEqual(dict(zip(names, counts)), {b'1': 1, b'2': 1})
+
     def test_fake_se_2mm(self):
         self._do_test(2)
         files = {
@@ -200,6 +482,332 @@ class TestFakeSE(AxeTest):
         }
         self.assertDictEqual(zfiles, self.get_md5_dict())
 
+class TestChunkedSE(AxeTest):
+    def __init__(self, methodName='runTest'):
+        super(TestChunkedSE, self).__init__(methodName)
+        self.barcodes = path.join(self.data, "pare.barcodes")
+        self.outfq = path.join(self.out, "pare_se")
+        # Chunks need an uncompressed (or BGZF) input
+        self.infq = path.join(CMAKE_BINARY_DIR, "out", "pare_chunked.fq")
+
+    def setUp(self):
+        super(TestChunkedSE, self).setUp()
+        with gzip.open(path.join(self.data, "pare.fq.gz"), 'rb') as ifh, \
+                open(self.infq, 'wb') as ofh:
+            shutil.copyfileobj(ifh, ofh)
+
+    def tearDown(self):
+        super(TestChunkedSE, self).tearDown()
+        if path.exists(self.infq):
+            os.unlink(self.infq)
+
+    def _do_test(self, n_chunks, extra=[]):
+        for i in range(1, n_chunks + 1):
+            command = [self.axe,
+                "-f", self.infq,
+                "-F", self.outfq,
+                '-b', self.barcodes,
+                '--chunk', "{}/{}".format(i, n_chunks),
+            ] + extra
+            self.assertTrue(self.run_and_check_stdout(command))
+        command = [self.merge,
+            "-n", str(n_chunks),
+            "-F", self.outfq,
+            '-b', self.barcodes,
+        ] + extra
+        self.assertTrue(self.run_and_check_stdout(command))
+
+    def test_chunked_se(self):
+        self._do_test(3)
+        files = {
+            'pare_se_1_R1.fastq': 'd41d8cd98f00b204e9800998ecf8427e',
+            'pare_se_2_R1.fastq': 'd41d8cd98f00b204e9800998ecf8427e',
+            'pare_se_3_R1.fastq': 'd41d8cd98f00b204e9800998ecf8427e',
+            'pare_se_4_R1.fastq': '8e5eef3323e597b209f79dc9fcd74c9a',
+            'pare_se_5_R1.fastq': 'd41d8cd98f00b204e9800998ecf8427e',
+            'pare_se_6_R1.fastq': '7228a165f353920328360dedc3a41205',
+            'pare_se_7_R1.fastq': 'd41d8cd98f00b204e9800998ecf8427e',
+            'pare_se_8_R1.fastq': 'b349d3276ba7c7515d0093b1a49b3959',
+            'pare_se_9_R1.fastq': '74b4763271aefcc135425b06730874ba',
+            'pare_se_unknown_R1.fastq': 'd450569dd8fd4bdddffbfaeec4980273',
+        }
+        self.assertDictEqual(files, self.get_md5_dict())
+
+    def test_chunked_se_table(self):
+        table = path.join(self.out, "pare_se.tsv")
+        self._do_test(4, ['-t', table])
+        with open(table) as fh:
+            counts = [l.rstrip('\n').split('\t') for l in fh]
+        self.assertEqual(counts[0], ['Barcode', 'Sample', 'Count'])
+        # Chunk tables are removed by axe-merge
+        self.assertEqual([], [f for f in os.listdir(self.out) if 'chunk' in f])
+        total = sum(int(row[-1]) for row in counts[1:])
+        with open(self.infq) as fh:
+            self.assertEqual(total, sum(1 for _ in fh) // 4)
+
+    def test_chunked_se_manifest(self):
+        table = path.join(self.out, "pare_se.tsv")
+        self._do_test(3, ['-t', table, '-z', '6'])
+        with open(table + ".manifest") as fh:
+            rows = [l.rstrip('\n').split('\t') for l in fh]
+        self.assertEqual(rows[0],
+                         ['File', 'Bytes', 'CRC32', 'DataBytes', 'DataCRC32'])
+        self.assertEqual(len(rows), 11)
+        # Merged sums are combined from the chunks', so check them against
+        # the files themselves
+        for name, size, crc, data_size, data_crc in rows[1:]:
+            self.assertFalse('chunk' in name)
+            with open(name, 'rb') as fh:
+                raw = fh.read()
+            data = gzip.decompress(raw)
+            self.assertEqual(int(size), len(raw))
+            self.assertEqual(int(crc, 16), zlib.crc32(raw))
+            self.assertEqual(int(data_size), len(data))
+            self.assertEqual(int(data_crc, 16), zlib.crc32(data))
+
+    def test_chunk_gzip_input(self):
+        command = [self.axe,
+            "-f", path.join(self.data, "pare.fq.gz"),
+            "-F", self.outfq,
+            '-b', self.barcodes,
+            '--chunk', "1/2",
+        ]
+        self.assertFalse(self.run_and_check_stdout(command))
+
+
+class TestThreads(AxeTest):
+    """Threaded runs write reads in a different order, so compare the sorted
+    records of each output against a single-threaded run"""
+
+    def __init__(self, methodName='runTest'):
+        super(TestThreads, self).__init__(methodName)
+        self.indir = path.join(CMAKE_BINARY_DIR, "out", "threads_in")
+
+    def setUp(self):
+        super(TestThreads, self).setUp()
+        if not path.exists(self.indir):
+            os.makedirs(self.indir)
+        for fq in ["pare.fq", "gbs_R1.fastq", "gbs_R2.fastq"]:
+            with gzip.open(path.join(self.data, fq + ".gz"), 'rb') as ifh, \
+                    open(path.join(self.indir, fq), 'wb') as ofh:
+                shutil.copyfileobj(ifh, ofh)
+
+    def tearDown(self):
+        super(TestThreads, self).tearDown()
+        shutil.rmtree(self.indir)
+
+    def records(self, fname):
+        with open(fname) as fh:
+            lines = fh.read().splitlines()
+        return [tuple(lines[i:i + 4]) for i in range(0, len(lines), 4)]
+
+    def compare_runs(self, args, prefixes):
+        outdirs = []
+        for threads in ["1", "3"]:
+            outdir = path.join(self.out, "j" + threads)
+            os.makedirs(outdir)
+            outdirs.append(outdir)
+            command = [self.axe, '-j', threads] + args
+            for flag in prefixes:
+                command += [flag, outdir + "/"]
+            self.assertTrue(self.run_and_check_stdout(command))
+        serial = sorted(os.listdir(outdirs[0]))
+        self.assertEqual(serial, sorted(os.listdir(outdirs[1])))
+        for fle in serial:
+            self.assertEqual(
+                sorted(self.records(path.join(outdirs[0], fle))),
+                sorted(self.records(path.join(outdirs[1], fle))))
+        return outdirs[1]
+
+    def test_threads_se(self):
+        self.compare_runs(["-f", path.join(self.indir, "pare.fq"),
+                           "-b", path.join(self.data, "pare.barcodes")],
+                          ["-F"])
+
+    def test_threads_paired(self):
+        outdir = self.compare_runs(
+            ["-f", path.join(self.indir, "gbs_R1.fastq"),
+             "-r", path.join(self.indir, "gbs_R2.fastq"),
+             "-b", path.join(self.data, "gbs_se.barcodes")],
+            ["-F", "-R"])
+        # Pairs must still be written in the same order to R1 and R2
+        for fle in os.listdir(outdir):
+            if not fle.endswith("_R1.fastq"):
+                continue
+            r1 = self.records(path.join(outdir, fle))
+            r2 = self.records(path.join(outdir, fle[:-9] + "_R2.fastq"))
+            self.assertEqual([r[0].split()[0] for r in r1],
+                             [r[0].split()[0] for r in r2])
+
+    def test_threads_gz_index(self):
+        infile = path.join(self.indir, "gbs_R1.fastq.gz")
+        shutil.copy(path.join(self.data, "gbs_R1.fastq.gz"), infile)
+        self.compare_runs(["--gz-index", "-f", infile,
+                           "-b", path.join(self.data, "gbs_se.barcodes")],
+                          ["-F"])
+        self.assertTrue(path.exists(infile + ".qzi"))
+
+    def test_chunk_gz_index_points(self):
+        # Copies of gbs_R1 make an input longer than the index's 8 MiB span,
+        # so the second chunk starts from a later access point
+        infile = path.join(self.indir, "gbs_long_R1.fastq.gz")
+        barcodes = path.join(self.data, "gbs_se.barcodes")
+        with gzip.open(path.join(self.data, "gbs_R1.fastq.gz"), 'rb') as fh:
+            data = fh.read()
+        with gzip.open(infile, 'wb', compresslevel=1) as fh:
+            for i in range(40):
+                fh.write(data)
+        serial = path.join(self.out, "serial")
+        chunked = path.join(self.out, "chunked")
+        os.makedirs(serial)
+        os.makedirs(chunked)
+        self.assertTrue(self.run_and_check_stdout(
+            [self.axe, "-f", infile, "-b", barcodes, "-F", serial + "/"]))
+        for i in ["1", "2"]:
+            self.assertTrue(self.run_and_check_stdout(
+                [self.axe, "--gz-index", "--chunk", i + "/2", "-f", infile,
+                 "-b", barcodes, "-F", chunked + "/"]))
+            if i == "1":
+                # Magic, four header fields, then the number of points
+                with open(infile + ".qzi", 'rb') as fh:
+                    n_points = struct.unpack("=Q", fh.read(48)[40:])[0]
+                self.assertGreaterEqual(n_points, 2)
+        second = sum(len(self.records(path.join(chunked, f)))
+                     for f in os.listdir(chunked) if "chunk2of2" in f)
+        self.assertGreater(second, 0)
+        self.assertTrue(self.run_and_check_stdout(
+            [self.merge, "-n", "2", "-b", barcodes, "-F", chunked + "/"]))
+        files = sorted(os.listdir(serial))
+        self.assertEqual(files, sorted(os.listdir(chunked)))
+        for fle in files:
+            self.assertEqual(
+                sorted(self.records(path.join(serial, fle))),
+                sorted(self.records(path.join(chunked, fle))))
+
+    def test_pair_matrix(self):
+        with open(path.join(self.data, "gbs.barcodes")) as fh:
+            samples = [l.split() for l in fh.read().splitlines()[1:]]
+        # Each sample's own pair, plus pairs hopped onto the next sample's
+        # R2 barcode, and a pair with an unknown R2 barcode
+        pairs = [(s[0], s[1], 2) for s in samples[:4]]
+        pairs += [(samples[i][0], samples[i + 1][1], 1) for i in range(3)]
+        pairs += [(samples[0][0], "NNNNNNNNN", 1)]
+        r1 = path.join(self.indir, "hop_R1.fastq")
+        r2 = path.join(self.indir, "hop_R2.fastq")
+        with open(r1, "w") as fh1, open(r2, "w") as fh2:
+            for i, (bcd1, bcd2, n) in enumerate(pairs * 10):
+                for fh, bcd in [(fh1, bcd1), (fh2, bcd2)]:
+                    for j in range(n):
+                        seq = bcd + "ACGTTGCA" * 5
+                        fh.write("@r%d_%d\n%s\n+\n%s\n"
+                                 % (i, j, seq, "I" * len(seq)))
+        matrix = path.join(self.out, "matrix.tsv")
+        command = [self.axe, "-j", "3", "-c", "--pair-matrix", matrix,
+                   "-f", r1, "-r", r2,
+                   "-b", path.join(self.data, "gbs.barcodes"),
+                   "-F", self.out + "/", "-R", self.out + "/"]
+        self.assertTrue(self.run_and_check_stdout(command))
+        with open(matrix) as fh:
+            rows = [l.split("\t") for l in fh.read().splitlines()]
+        self.assertEqual(rows[0][0], "R1Barcode")
+        counts = {}
+        for row in rows[1:]:
+            self.assertEqual(len(row), len(rows[0]))
+            for bcd2, count in zip(rows[0][1:], row[1:]):
+                if int(count) > 0:
+                    counts[(row[0], bcd2)] = int(count)
+        expect = {}
+        for bcd1, bcd2, n in pairs[:-1]:
+            expect[(bcd1, bcd2)] = n * 10
+        self.assertEqual(expect, counts)
+
+    def test_preview(self):
+        stats = path.join(self.out, "preview.json")
+        command = [self.axe, "--preview", "100", "--stats", stats,
+                   "-f", path.join(self.indir, "gbs_R1.fastq"),
+                   "-b", path.join(self.data, "gbs_se.barcodes")]
+        self.assertTrue(self.run_and_check_stdout(command))
+        with open(stats) as fh:
+            run = json.load(fh)
+        self.assertEqual(run['reads_processed'], 100)
+        self.assertEqual(run['sampling']['preview'], 100)
+        # Reads are all much the same size, so the total is close
+        self.assertTrue(800 < run['sampling']['estimated_reads'] < 1200)
+        est = run['failed_estimate']
+        self.assertTrue(est['share_low'] <= est['share'] <= est['share_high'])
+        self.assertEqual(os.listdir(self.out), ["preview.json"])
+
+    def test_sample_fraction(self):
+        table = path.join(self.out, "sample.tsv")
+        stats = path.join(self.out, "sample.json")
+        command = [self.axe, "-j", "3", "--sample-fraction", "0.5",
+                   "-t", table, "--stats", stats,
+                   "-f", path.join(self.indir, "gbs_R1.fastq"),
+                   "-b", path.join(self.data, "gbs_se.barcodes")]
+        self.assertTrue(self.run_and_check_stdout(command))
+        with open(stats) as fh:
+            run = json.load(fh)
+        self.assertTrue(400 < run['reads_processed'] < 600)
+        self.assertTrue(0.45 < run['sampling']['input_fraction'] < 0.55)
+        self.assertTrue(900 < run['sampling']['estimated_reads'] < 1100)
+        with open(table) as fh:
+            rows = [l.rstrip('\n').split('\t') for l in fh]
+        self.assertEqual(rows[0][3:], ['Share', 'ShareLow', 'ShareHigh',
+                                       'Estimate', 'EstimateLow',
+                                       'EstimateHigh'])
+        for row in rows[1:]:
+            low, est, high = (float(row[i]) for i in (7, 6, 8))
+            self.assertTrue(low <= est <= high)
+        # Sampling picks the same windows every time
+        with open(table) as fh:
+            first = fh.read()
+        self.assertTrue(self.run_and_check_stdout(command))
+        with open(table) as fh:
+            self.assertEqual(first, fh.read())
+
+    def test_resume_checkpoint(self):
+        args = ["-f", path.join(self.indir, "gbs_R1.fastq"),
+                "-b", path.join(self.data, "gbs_se.barcodes")]
+        serial = path.join(self.out, "serial")
+        resumed = path.join(self.out, "resumed")
+        checkpoint = path.join(self.out, "checkpoint")
+        os.makedirs(serial)
+        os.makedirs(resumed)
+        self.assertTrue(self.run_and_check_stdout(
+            [self.axe, "-z", "6", "-F", serial + "/"] + args))
+        # Kill a run once it has checkpointed. Checkpointing every read
+        # keeps it busy enough to be killed before it finishes.
+        command = [self.axe, "-q", "-j", "3", "-z", "6", "-F", resumed + "/",
+                   "--checkpoint", checkpoint, "--checkpoint-every", "1"]
+        proc = sp.Popen(command + args)
+        while proc.poll() is None and not path.exists(checkpoint):
+            pass
+        proc.kill()
+        proc.wait()
+        # Anything written after the checkpoint is discarded on resume
+        with open(path.join(resumed, "A1_R1.fastq.gz"), "ab") as fh:
+            fh.write(b"partial record")
+        self.assertTrue(self.run_and_check_stdout(command + ["--resume"] +
+                                                  args))
+        self.assertFalse(path.exists(checkpoint))
+        self.assertEqual(sorted(os.listdir(serial)),
+                         sorted(os.listdir(resumed)))
+        for fle in os.listdir(serial):
+            with gzip.open(path.join(serial, fle), 'rb') as fh:
+                expect = sorted(fh.read().splitlines())
+            with gzip.open(path.join(resumed, fle), 'rb') as fh:
+                self.assertEqual(expect, sorted(fh.read().splitlines()))
+
+    def test_checkpoint_gz_index(self):
+        # Gzip input is indexed to resume from, even with one thread
+        infile = path.join(self.indir, "gbs_R1.fastq.gz")
+        shutil.copy(path.join(self.data, "gbs_R1.fastq.gz"), infile)
+        self.assertTrue(self.run_and_check_stdout(
+            [self.axe, "-f", infile, "-F", self.out + "/",
+             "-b", path.join(self.data, "gbs_se.barcodes"),
+             "--checkpoint", path.join(self.out, "checkpoint")]))
+        self.assertTrue(path.exists(infile + ".qzi"))
+
 
 if __name__ == '__main__':
     log = logging.getLogger("AxeTest")
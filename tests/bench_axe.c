@@ -0,0 +1,850 @@
+/*
+ * ============================================================================
+ *
+ *       Filename:  bench_axe.c
+ *
+ *    Description:  Benchmarks of barcode matching, trie building and whole
+ *                  runs, on synthetic reads. Results are written as JSON.
+ *        License:  GPLv3+
+ *         Author:  Kevin Murray, spam@kdmurray.id.au
+ *
+ * ============================================================================
+ */
+
+#include "axe.h"
+#include <qes_simd.h>
+
+#include <getopt.h>
+#include <math.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <zlib.h>
+
+enum bench_mode {
+    BENCH_SE = 0,       /* Single end reads, R1 barcodes */
+    BENCH_PE = 1,       /* Paired reads, R1 barcodes */
+    BENCH_COMBO = 2,    /* Paired reads, combinatorial barcodes */
+};
+
+static const char *bench_mode_names[] = {"se", "pe", "combo"};
+
+struct bench_opts {
+    enum bench_mode mode;
+    size_t n_barcodes;
+    size_t barcode_len;
+    size_t n_reads;
+    size_t read_len;
+    double mismatch_rate;   /* Per barcode base */
+    double n_rate;          /* Per read base */
+    double unknown_rate;    /* Reads with a random barcode */
+    size_t max_mismatches;  /* Levels 0 to this are benchmarked */
+    enum axe_engine_type engine;
+    size_t threads;
+    size_t rounds;          /* Of matching alone */
+    int gzip;               /* Gzip the input */
+    int out_compress_level;
+    int count_only;         /* Don't write outputs in whole runs */
+    uint64_t seed;
+    char *dir;
+    int own_dir;            /* dir was made by us, so is removed */
+    char *json_file;
+};
+
+/* Reads, kept in memory for matching alone */
+struct bench_reads {
+    struct qes_seq **r1;
+    struct qes_seq **r2;
+    size_t n;
+    off_t bytes;            /* Size of the input file(s) */
+};
+
+struct bench_level {
+    size_t mismatches;
+    const char *engine;     /* As picked, if automatically */
+    double trie_seconds;
+    size_t trie_keys;
+    int64_t trie_bytes;     /* As counted by qes_mem */
+    int64_t lookup_bytes;
+    double match_seconds;
+    uint64_t matched;
+    double run_seconds;
+    uint64_t run_reads;
+    uint64_t run_demultiplexed;
+    double run_cache_hit_rate;
+    double stage_seconds[AXE_N_STAGES];
+};
+
+static const char *bench_stage_names[] = {"read", "match", "wait", "write"};
+
+/* xorshift64*, so a seed generates the same reads everywhere */
+static uint64_t bench_rng_state = 1;
+
+static inline uint64_t
+bench_rand(void)
+{
+    bench_rng_state ^= bench_rng_state >> 12;
+    bench_rng_state ^= bench_rng_state << 25;
+    bench_rng_state ^= bench_rng_state >> 27;
+    return bench_rng_state * 2685821657736338717ULL;
+}
+
+static inline double
+bench_rand_unif(void)
+{
+    return (bench_rand() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static inline char
+bench_rand_base(void)
+{
+    return "ACGT"[bench_rand() >> 62];
+}
+
+static double
+bench_seconds(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static size_t
+hamming(const char *a, const char *b, size_t len)
+{
+    size_t dist = 0;
+    size_t iii = 0;
+
+    for (iii = 0; iii < len; iii++) {
+        dist += a[iii] != b[iii];
+    }
+    return dist;
+}
+
+/* Random barcodes, at least 3 mismatches apart where that's possible so
+ * that one mismatch can always be corrected, and always distinct */
+static char **
+make_barcodes(size_t n, size_t len)
+{
+    char **seqs = qes_calloc(n, sizeof(*seqs));
+    size_t min_dist = len < 3 ? 1 : 3;
+    size_t tries = 0;
+    size_t iii = 0;
+    size_t jjj = 0;
+
+    for (iii = 0; iii < n; iii++) {
+        seqs[iii] = qes_calloc(len + 1, 1);
+        while (1) {
+            for (jjj = 0; jjj < len; jjj++) {
+                seqs[iii][jjj] = bench_rand_base();
+            }
+            for (jjj = 0; jjj < iii; jjj++) {
+                if (hamming(seqs[iii], seqs[jjj], len) < min_dist) {
+                    break;
+                }
+            }
+            if (jjj == iii) {
+                break;
+            }
+            /* The space is too crowded, settle for distinct barcodes */
+            if (++tries > 10000 && min_dist > 1) {
+                min_dist = 1;
+            }
+        }
+    }
+    return seqs;
+}
+
+static void
+free_barcodes(char **seqs, size_t n)
+{
+    size_t iii = 0;
+
+    for (iii = 0; iii < n; iii++) {
+        qes_free(seqs[iii]);
+    }
+    qes_free(seqs);
+}
+
+static char *
+bench_path(const struct bench_opts *opts, const char *name)
+{
+    size_t len = strlen(opts->dir) + strlen(name) + 2;
+    char *path = qes_malloc(len);
+
+    snprintf(path, len, "%s/%s", opts->dir, name);
+    return path;
+}
+
+/* Writes the barcode file, and returns the barcodes of each sample in
+ * bcd1 and bcd2 (combinatorial only). Combinatorial samples are all
+ * combinations of about sqrt(n_barcodes) R1 and R2 barcodes. */
+static int
+write_barcodes(const struct bench_opts *opts, char ***bcd1, char ***bcd2)
+{
+    char *path = bench_path(opts, "bench.barcodes");
+    FILE *fp = NULL;
+    char **pool1 = NULL;
+    char **pool2 = NULL;
+    size_t n1 = opts->n_barcodes;
+    size_t n2 = 0;
+    size_t iii = 0;
+
+    fp = fopen(path, "w");
+    if (fp == NULL) {
+        fprintf(stderr, "ERROR: Couldn't write %s\n", path);
+        qes_free(path);
+        return 1;
+    }
+    *bcd1 = qes_calloc(opts->n_barcodes, sizeof(**bcd1));
+    *bcd2 = NULL;
+    if (opts->mode == BENCH_COMBO) {
+        n1 = ceil(sqrt(opts->n_barcodes));
+        n2 = (opts->n_barcodes + n1 - 1) / n1;
+        pool2 = make_barcodes(n2, opts->barcode_len);
+        *bcd2 = qes_calloc(opts->n_barcodes, sizeof(**bcd2));
+    }
+    pool1 = make_barcodes(n1, opts->barcode_len);
+    for (iii = 0; iii < opts->n_barcodes; iii++) {
+        if (opts->mode == BENCH_COMBO) {
+            (*bcd1)[iii] = strdup(pool1[iii % n1]);
+            (*bcd2)[iii] = strdup(pool2[iii / n1]);
+            fprintf(fp, "%s\t%s\tS%zu\n", (*bcd1)[iii], (*bcd2)[iii], iii);
+        } else {
+            (*bcd1)[iii] = strdup(pool1[iii]);
+            fprintf(fp, "%s\tS%zu\n", (*bcd1)[iii], iii);
+        }
+    }
+    free_barcodes(pool1, n1);
+    if (pool2 != NULL) {
+        free_barcodes(pool2, n2);
+    }
+    fclose(fp);
+    qes_free(path);
+    return 0;
+}
+
+/* Fills seq with barcode (or a random one), mutated at mismatch_rate,
+ * followed by random bases, with Ns at n_rate */
+static void
+make_read(const struct bench_opts *opts, char *seq, const char *barcode)
+{
+    size_t bcd_len = barcode != NULL ? strlen(barcode) : 0;
+    size_t iii = 0;
+    char base = 0;
+
+    for (iii = 0; iii < opts->read_len; iii++) {
+        if (iii < bcd_len) {
+            base = barcode[iii];
+            if (bench_rand_unif() < opts->mismatch_rate) {
+                /* Any of the three other bases */
+                while ((seq[iii] = bench_rand_base()) == base);
+                base = seq[iii];
+            }
+        } else {
+            base = bench_rand_base();
+        }
+        if (opts->n_rate > 0 && bench_rand_unif() < opts->n_rate) {
+            base = 'N';
+        }
+        seq[iii] = base;
+    }
+    seq[opts->read_len] = '\0';
+}
+
+static struct qes_seq *
+keep_read(const char *name, const char *seq, const char *qual, size_t len)
+{
+    struct qes_seq *read = qes_seq_create();
+
+    qes_seq_fill_name(read, name, strlen(name));
+    qes_seq_fill_seq(read, seq, len);
+    qes_seq_fill_qual(read, qual, len);
+    return read;
+}
+
+/* Generates the input file(s), keeping the reads for matching alone */
+static int
+write_reads(const struct bench_opts *opts, char **bcd1, char **bcd2,
+            struct bench_reads *reads)
+{
+    const char *ext = opts->gzip ? "fastq.gz" : "fastq";
+    const char *gzmode = opts->gzip ? "wb6" : "wbT";
+    int paired = opts->mode != BENCH_SE;
+    gzFile fp[2] = {NULL, NULL};
+    char *path = NULL;
+    char name[64] = "";
+    char fname[64] = "";
+    char *seq = qes_calloc(opts->read_len + 1, 1);
+    char *qual = qes_calloc(opts->read_len + 1, 1);
+    size_t sample = 0;
+    size_t iii = 0;
+    int ret = 1;
+    struct stat st;
+
+    memset(qual, 'I', opts->read_len);
+    reads->r1 = qes_calloc(opts->n_reads, sizeof(*reads->r1));
+    reads->r2 = paired ? qes_calloc(opts->n_reads, sizeof(*reads->r2)) : NULL;
+    reads->n = opts->n_reads;
+    reads->bytes = 0;
+    for (iii = 0; iii < (paired ? 2u : 1u); iii++) {
+        snprintf(fname, sizeof(fname), "bench_R%zu.%s", iii + 1, ext);
+        path = bench_path(opts, fname);
+        fp[iii] = gzopen(path, gzmode);
+        if (fp[iii] == NULL) {
+            fprintf(stderr, "ERROR: Couldn't write %s\n", path);
+            qes_free(path);
+            goto exit;
+        }
+        qes_free(path);
+    }
+    for (iii = 0; iii < opts->n_reads; iii++) {
+        int unknown = bench_rand_unif() < opts->unknown_rate;
+
+        sample = bench_rand() % opts->n_barcodes;
+        snprintf(name, sizeof(name), "bench:%zu", iii);
+        make_read(opts, seq, unknown ? NULL : bcd1[sample]);
+        gzprintf(fp[0], "@%s\n%s\n+\n%s\n", name, seq, qual);
+        reads->r1[iii] = keep_read(name, seq, qual, opts->read_len);
+        if (paired) {
+            make_read(opts, seq, unknown || bcd2 == NULL ? NULL : bcd2[sample]);
+            gzprintf(fp[1], "@%s\n%s\n+\n%s\n", name, seq, qual);
+            reads->r2[iii] = keep_read(name, seq, qual, opts->read_len);
+        }
+    }
+    ret = 0;
+exit:
+    for (iii = 0; iii < 2; iii++) {
+        if (fp[iii] != NULL) {
+            gzclose(fp[iii]);
+            snprintf(fname, sizeof(fname), "bench_R%zu.%s", iii + 1, ext);
+            path = bench_path(opts, fname);
+            if (stat(path, &st) == 0) {
+                reads->bytes += st.st_size;
+            }
+            qes_free(path);
+        }
+    }
+    qes_free(seq);
+    qes_free(qual);
+    return ret;
+}
+
+static void
+free_reads(struct bench_reads *reads)
+{
+    size_t iii = 0;
+
+    for (iii = 0; iii < reads->n; iii++) {
+        qes_seq_destroy(reads->r1[iii]);
+        if (reads->r2 != NULL) {
+            qes_seq_destroy(reads->r2[iii]);
+        }
+    }
+    qes_free(reads->r1);
+    qes_free(reads->r2);
+}
+
+static struct axe_config *
+bench_config(const struct bench_opts *opts, size_t mismatches)
+{
+    struct axe_config *config = axe_config_create();
+    const char *ext = opts->gzip ? "fastq.gz" : "fastq";
+    char fname[64] = "";
+    size_t iii = 0;
+
+    config->barcode_file = bench_path(opts, "bench.barcodes");
+    config->match_combo = opts->mode == BENCH_COMBO;
+    config->mismatches = mismatches;
+    config->engine = opts->engine;
+    /* Random barcodes can collide once mutated, which axe-demux -p allows */
+    config->permissive = true;
+    config->verbosity = -1;
+    config->threads = opts->threads;
+    config->out_compress_level = opts->out_compress_level;
+    config->count_only = opts->count_only;
+    config->unknown_top = 10;
+    config->metrics_every = 10;
+    config->in_mode = opts->mode == BENCH_SE ? READS_SINGLE : READS_PAIRED;
+    config->out_mode = config->in_mode;
+    for (iii = 0; iii < (opts->mode == BENCH_SE ? 1u : 2u); iii++) {
+        snprintf(fname, sizeof(fname), "bench_R%zu.%s", iii + 1, ext);
+        config->infiles[iii] = bench_path(opts, fname);
+        snprintf(fname, sizeof(fname), "out_R%zu", iii + 1);
+        config->out_prefixes[iii] = bench_path(opts, fname);
+    }
+    config->have_cli_opts = true;
+    qes_logger_init(config->logger, "[bench_axe] ", QES_LOG_WARNING);
+    qes_logger_add_destination_formatted(config->logger, stderr,
+                                         QES_LOG_WARNING, &axe_formatter);
+    return config;
+}
+
+static int
+bench_tries(struct axe_config *config, struct bench_level *level)
+{
+    int64_t trie_mem = 0;
+    double start = 0;
+
+    if (axe_read_barcodes(config) != 0 ||
+            axe_setup_barcode_lookup(config) != 0) {
+        fprintf(stderr, "ERROR: Couldn't load the barcodes\n");
+        return 1;
+    }
+    level->lookup_bytes = qes_mem_current(AXE_MEM_LOOKUP);
+    trie_mem = qes_mem_current(AXE_MEM_TRIE);
+    start = bench_seconds();
+    if (axe_make_tries(config) != 0 || axe_load_tries(config) != 0) {
+        fprintf(stderr, "ERROR: Couldn't build the tries\n");
+        return 1;
+    }
+    level->trie_seconds = bench_seconds() - start;
+    level->trie_bytes = qes_mem_current(AXE_MEM_TRIE) - trie_mem;
+    level->engine = config->engine_ops->name;
+    level->trie_keys = config->engine_stats.keys;
+    return 0;
+}
+
+/* Matches the reads in memory, so nothing but matching is timed */
+static int
+bench_match(struct axe_config *config, const struct bench_opts *opts,
+            const struct bench_reads *reads, struct bench_level *level)
+{
+    struct axe_matcher *matcher = axe_matcher_create(config);
+    struct axe_worker *worker = axe_worker_create(matcher);
+    struct axe_match match;
+    double start = bench_seconds();
+    size_t rnd = 0;
+    size_t iii = 0;
+
+    if (worker == NULL) {
+        fprintf(stderr, "ERROR: Couldn't make a matcher\n");
+        axe_matcher_destroy(matcher);
+        return 1;
+    }
+    level->matched = 0;
+    for (rnd = 0; rnd < opts->rounds; rnd++) {
+        for (iii = 0; iii < reads->n; iii++) {
+            if (axe_worker_match(worker, reads->r1[iii],
+                                 config->match_combo ? reads->r2[iii] : NULL,
+                                 &match) == 0) {
+                level->matched++;
+            }
+        }
+    }
+    level->match_seconds = bench_seconds() - start;
+    level->matched /= opts->rounds;
+    axe_worker_destroy(worker);
+    axe_matcher_destroy(matcher);
+    return 0;
+}
+
+static int
+bench_run(struct axe_config *config, struct bench_level *level)
+{
+    size_t iii = 0;
+
+    if (axe_make_outputs(config) != 0) {
+        fprintf(stderr, "ERROR: Couldn't make the outputs\n");
+        return 1;
+    }
+    if (axe_process_file(config) != 0) {
+        fprintf(stderr, "ERROR: axe_process_file failed\n");
+        return 1;
+    }
+    level->run_seconds = config->time_taken;
+    level->run_reads = config->reads_processed;
+    level->run_demultiplexed = config->reads_demultiplexed;
+    if (config->cache_lookups > 0) {
+        level->run_cache_hit_rate = (double)config->cache_hits /
+                                    (double)config->cache_lookups;
+    }
+    for (iii = 0; iii < AXE_N_STAGES; iii++) {
+        level->stage_seconds[iii] = config->stage_seconds[iii];
+    }
+    return 0;
+}
+
+static double
+per_second(double n, double seconds)
+{
+    return seconds > 0 ? n / seconds : 0;
+}
+
+static void
+write_json(FILE *fp, const struct bench_opts *opts,
+           const struct bench_reads *reads, const struct bench_level *levels,
+           size_t n_levels)
+{
+    struct rusage usage;
+    size_t iii = 0;
+    size_t jjj = 0;
+
+    getrusage(RUSAGE_SELF, &usage);
+    fprintf(fp, "{\n");
+    fprintf(fp, "  \"version\": \"%s\",\n", AXE_VERSION);
+    fprintf(fp, "  \"time\": %lld,\n", (long long)time(NULL));
+#ifdef OPENMP_FOUND
+    fprintf(fp, "  \"openmp\": true,\n");
+#else
+    fprintf(fp, "  \"openmp\": false,\n");
+#endif
+    fprintf(fp, "  \"params\": {\n");
+    fprintf(fp, "    \"mode\": \"%s\",\n", bench_mode_names[opts->mode]);
+    fprintf(fp, "    \"barcodes\": %zu,\n", opts->n_barcodes);
+    fprintf(fp, "    \"barcode_length\": %zu,\n", opts->barcode_len);
+    fprintf(fp, "    \"reads\": %zu,\n", opts->n_reads);
+    fprintf(fp, "    \"read_length\": %zu,\n", opts->read_len);
+    fprintf(fp, "    \"mismatch_rate\": %g,\n", opts->mismatch_rate);
+    fprintf(fp, "    \"n_rate\": %g,\n", opts->n_rate);
+    fprintf(fp, "    \"unknown_rate\": %g,\n", opts->unknown_rate);
+    fprintf(fp, "    \"gzip\": %s,\n", opts->gzip ? "true" : "false");
+    fprintf(fp, "    \"out_compress_level\": %d,\n", opts->out_compress_level);
+    fprintf(fp, "    \"count_only\": %s,\n",
+            opts->count_only ? "true" : "false");
+    fprintf(fp, "    \"threads\": %zu,\n", opts->threads);
+    fprintf(fp, "    \"rounds\": %zu,\n", opts->rounds);
+    fprintf(fp, "    \"seed\": %" PRIu64 ",\n", opts->seed);
+    fprintf(fp, "    \"simd\": \"%s\"\n", qes_simd->name);
+    fprintf(fp, "  },\n");
+    fprintf(fp, "  \"input_bytes\": %lld,\n", (long long)reads->bytes);
+    fprintf(fp, "  \"levels\": [");
+    for (iii = 0; iii < n_levels; iii++) {
+        const struct bench_level *lvl = &levels[iii];
+        double matched = lvl->matched * opts->rounds;
+
+        fprintf(fp, "%s\n    {\n", iii > 0 ? "," : "");
+        fprintf(fp, "      \"mismatches\": %zu,\n", lvl->mismatches);
+        fprintf(fp, "      \"engine\": \"%s\",\n", lvl->engine);
+        fprintf(fp, "      \"trie_build_seconds\": %0.6f,\n",
+                lvl->trie_seconds);
+        fprintf(fp, "      \"trie_keys\": %zu,\n", lvl->trie_keys);
+        fprintf(fp, "      \"trie_bytes\": %" PRId64 ",\n", lvl->trie_bytes);
+        fprintf(fp, "      \"lookup_bytes\": %" PRId64 ",\n",
+                lvl->lookup_bytes);
+        fprintf(fp, "      \"match\": {\n");
+        fprintf(fp, "        \"seconds\": %0.6f,\n", lvl->match_seconds);
+        fprintf(fp, "        \"reads_per_second\": %0.1f,\n",
+                per_second((double)reads->n * opts->rounds,
+                           lvl->match_seconds));
+        fprintf(fp, "        \"matched\": %" PRIu64 ",\n", lvl->matched);
+        fprintf(fp, "        \"matched_per_second\": %0.1f\n",
+                per_second(matched, lvl->match_seconds));
+        fprintf(fp, "      },\n");
+        fprintf(fp, "      \"run\": {\n");
+        fprintf(fp, "        \"seconds\": %0.6f,\n", lvl->run_seconds);
+        fprintf(fp, "        \"reads\": %" PRIu64 ",\n", lvl->run_reads);
+        fprintf(fp, "        \"demultiplexed\": %" PRIu64 ",\n",
+                lvl->run_demultiplexed);
+        fprintf(fp, "        \"reads_per_second\": %0.1f,\n",
+                per_second(lvl->run_reads, lvl->run_seconds));
+        fprintf(fp, "        \"input_mb_per_second\": %0.3f,\n",
+                per_second(reads->bytes / 1e6, lvl->run_seconds));
+        fprintf(fp, "        \"cache_hit_rate\": %0.4f,\n",
+                lvl->run_cache_hit_rate);
+        fprintf(fp, "        \"stage_seconds\": {");
+        for (jjj = 0; jjj < AXE_N_STAGES; jjj++) {
+            fprintf(fp, "%s\"%s\": %0.6f", jjj > 0 ? ", " : "",
+                    bench_stage_names[jjj], lvl->stage_seconds[jjj]);
+        }
+        fprintf(fp, "}\n");
+        fprintf(fp, "      }\n");
+        fprintf(fp, "    }");
+    }
+    fprintf(fp, "\n  ],\n");
+    /* ru_maxrss is in kilobytes on Linux */
+    fprintf(fp, "  \"max_rss_kb\": %ld\n", (long)usage.ru_maxrss);
+    fprintf(fp, "}\n");
+}
+
+/* Removes the files we made, and the directory if we made it */
+static void
+clean_dir(const struct bench_opts *opts)
+{
+    DIR *dir = NULL;
+    struct dirent *ent = NULL;
+    char *path = NULL;
+
+    if (!opts->own_dir) {
+        return;
+    }
+    dir = opendir(opts->dir);
+    if (dir == NULL) {
+        return;
+    }
+    while ((ent = readdir(dir)) != NULL) {
+        if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) {
+            continue;
+        }
+        path = bench_path(opts, ent->d_name);
+        unlink(path);
+        qes_free(path);
+    }
+    closedir(dir);
+    rmdir(opts->dir);
+}
+
+static void
+print_usage(FILE *stream)
+{
+    fprintf(stream, "USAGE:\n");
+    fprintf(stream, "bench_axe [options]\n\n");
+    fprintf(stream, "Generates synthetic barcodes and reads, then for each mismatch level\n");
+    fprintf(stream, "times building the tries, matching reads in memory and a whole run.\n\n");
+    fprintf(stream, "OPTIONS:\n");
+    fprintf(stream, "    -M, --mode\t\tse, pe or combo [default se]\n");
+    fprintf(stream, "    -n, --barcodes\tNumber of samples [default 96]\n");
+    fprintf(stream, "    -l, --barcode-length\tBarcode length [default 8]\n");
+    fprintf(stream, "    -r, --reads\t\tNumber of reads (pairs) [default 200000]\n");
+    fprintf(stream, "    -L, --read-length\tRead length [default 100]\n");
+    fprintf(stream, "    -e, --mismatch-rate\tChance of a mismatch per barcode base [default 0.01]\n");
+    fprintf(stream, "    -N, --n-rate\tChance of an N per base [default 0.001]\n");
+    fprintf(stream, "    -u, --unknown-rate\tFraction of reads with random barcodes [default 0.05]\n");
+    fprintf(stream, "    -m, --max-mismatches\tBenchmark -m 0 to this [default 2]\n");
+    fprintf(stream, "    -E, --engine\tMatching engine, as for axe-demux [default auto]\n");
+    fprintf(stream, "    -g, --gzip\t\tGzip the input\n");
+    fprintf(stream, "    -z, --ziplevel\tCompress outputs with this level [default 0]\n");
+    fprintf(stream, "    -c, --count-only\tWrite no outputs in whole runs\n");
+    fprintf(stream, "    -j, --threads\tThreads in whole runs [default 1]\n");
+    fprintf(stream, "    -R, --rounds\tRounds of matching alone [default 3]\n");
+    fprintf(stream, "    -s, --seed\t\tRandom seed [default 1]\n");
+    fprintf(stream, "    -d, --dir\t\tDirectory for the input and outputs, which are\n");
+    fprintf(stream, "             \t\tkept [default: a temporary directory]\n");
+    fprintf(stream, "    -o, --output\tWrite JSON results here [default stdout]\n");
+    fprintf(stream, "    -h, --help\t\tPrint this help\n");
+}
+
+static const char *bench_opts_str = "M:n:l:r:L:e:N:u:m:E:gz:cj:R:s:d:o:h";
+static const struct option bench_longopts[] = {
+    { "mode",           required_argument,  NULL,   'M' },
+    { "barcodes",       required_argument,  NULL,   'n' },
+    { "barcode-length", required_argument,  NULL,   'l' },
+    { "reads",          required_argument,  NULL,   'r' },
+    { "read-length",    required_argument,  NULL,   'L' },
+    { "mismatch-rate",  required_argument,  NULL,   'e' },
+    { "n-rate",         required_argument,  NULL,   'N' },
+    { "unknown-rate",   required_argument,  NULL,   'u' },
+    { "max-mismatches", required_argument,  NULL,   'm' },
+    { "engine",         required_argument,  NULL,   'E' },
+    { "gzip",           no_argument,        NULL,   'g' },
+    { "ziplevel",       required_argument,  NULL,   'z' },
+    { "count-only",     no_argument,        NULL,   'c' },
+    { "threads",        required_argument,  NULL,   'j' },
+    { "rounds",         required_argument,  NULL,   'R' },
+    { "seed",           required_argument,  NULL,   's' },
+    { "dir",            required_argument,  NULL,   'd' },
+    { "output",         required_argument,  NULL,   'o' },
+    { "help",           no_argument,        NULL,   'h' },
+    { NULL,             0,                  NULL,    0  }
+};
+
+static int
+parse_args(struct bench_opts *opts, int argc, char * const *argv)
+{
+    int engine = 0;
+    int c = 0;
+
+    while ((c = getopt_long(argc, argv, bench_opts_str, bench_longopts,
+                            NULL)) > 0) {
+        switch (c) {
+            case 'M':
+                if (strcmp(optarg, "se") == 0) {
+                    opts->mode = BENCH_SE;
+                } else if (strcmp(optarg, "pe") == 0) {
+                    opts->mode = BENCH_PE;
+                } else if (strcmp(optarg, "combo") == 0) {
+                    opts->mode = BENCH_COMBO;
+                } else {
+                    fprintf(stderr, "ERROR: Unknown mode '%s'\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'n':
+                opts->n_barcodes = strtoul(optarg, NULL, 10);
+                break;
+            case 'l':
+                opts->barcode_len = strtoul(optarg, NULL, 10);
+                break;
+            case 'r':
+                opts->n_reads = strtoul(optarg, NULL, 10);
+                break;
+            case 'L':
+                opts->read_len = strtoul(optarg, NULL, 10);
+                break;
+            case 'e':
+                opts->mismatch_rate = strtod(optarg, NULL);
+                break;
+            case 'N':
+                opts->n_rate = strtod(optarg, NULL);
+                break;
+            case 'u':
+                opts->unknown_rate = strtod(optarg, NULL);
+                break;
+            case 'm':
+                opts->max_mismatches = strtoul(optarg, NULL, 10);
+                break;
+            case 'E':
+                engine = axe_engine_find(optarg);
+                if (engine < 0) {
+                    fprintf(stderr, "ERROR: Unknown engine '%s'\n", optarg);
+                    return 1;
+                }
+                opts->engine = engine;
+                break;
+            case 'g':
+                opts->gzip = 1;
+                break;
+            case 'z':
+                opts->out_compress_level = atoi(optarg);
+                break;
+            case 'c':
+                opts->count_only = 1;
+                break;
+            case 'j':
+                opts->threads = strtoul(optarg, NULL, 10);
+                break;
+            case 'R':
+                opts->rounds = strtoul(optarg, NULL, 10);
+                break;
+            case 's':
+                opts->seed = strtoull(optarg, NULL, 10);
+                break;
+            case 'd':
+                opts->dir = strdup(optarg);
+                break;
+            case 'o':
+                opts->json_file = strdup(optarg);
+                break;
+            case 'h':
+                print_usage(stdout);
+                exit(EXIT_SUCCESS);
+            default:
+                return 1;
+        }
+    }
+    if (opts->n_barcodes < 1 || opts->barcode_len < 1 ||
+            opts->barcode_len > 32) {
+        fprintf(stderr, "ERROR: Bad barcode count or length\n");
+        return 1;
+    }
+    if (opts->read_len <= opts->barcode_len || opts->n_reads < 1) {
+        fprintf(stderr, "ERROR: Reads must be longer than the barcodes\n");
+        return 1;
+    }
+    if (opts->max_mismatches > 4 || opts->threads < 1 || opts->rounds < 1) {
+        fprintf(stderr, "ERROR: Bad mismatches, threads or rounds\n");
+        return 1;
+    }
+    if (opts->mismatch_rate < 0 || opts->mismatch_rate > 1 ||
+            opts->n_rate < 0 || opts->n_rate > 1 ||
+            opts->unknown_rate < 0 || opts->unknown_rate > 1) {
+        fprintf(stderr, "ERROR: Rates must be between 0 and 1\n");
+        return 1;
+    }
+    if (opts->out_compress_level < 0 || opts->out_compress_level > 9) {
+        fprintf(stderr, "ERROR: Bad ziplevel %d\n", opts->out_compress_level);
+        return 1;
+    }
+    if (opts->seed == 0) {
+        /* xorshift never leaves 0 */
+        opts->seed = 1;
+    }
+    return 0;
+}
+
+int
+main (int argc, char *argv[])
+{
+    struct bench_opts opts = {
+        .mode = BENCH_SE,
+        .n_barcodes = 96,
+        .barcode_len = 8,
+        .n_reads = 200000,
+        .read_len = 100,
+        .mismatch_rate = 0.01,
+        .n_rate = 0.001,
+        .unknown_rate = 0.05,
+        .max_mismatches = 2,
+        .threads = 1,
+        .rounds = 3,
+        .seed = 1,
+    };
+    struct bench_reads reads;
+    struct bench_level *levels = NULL;
+    struct axe_config *config = NULL;
+    char **bcd1 = NULL;
+    char **bcd2 = NULL;
+    char tmpdir[] = "/tmp/bench_axe.XXXXXX";
+    FILE *fp = stdout;
+    size_t iii = 0;
+    int ret = EXIT_FAILURE;
+
+    memset(&reads, 0, sizeof(reads));
+    if (parse_args(&opts, argc, argv) != 0) {
+        print_usage(stderr);
+        goto exit;
+    }
+    if (opts.dir == NULL) {
+        if (mkdtemp(tmpdir) == NULL) {
+            fprintf(stderr, "ERROR: Couldn't make a temporary directory\n");
+            goto exit;
+        }
+        opts.dir = strdup(tmpdir);
+        opts.own_dir = 1;
+    }
+    bench_rng_state = opts.seed;
+    if (write_barcodes(&opts, &bcd1, &bcd2) != 0 ||
+            write_reads(&opts, bcd1, bcd2, &reads) != 0) {
+        goto exit;
+    }
+    levels = qes_calloc(opts.max_mismatches + 1, sizeof(*levels));
+    for (iii = 0; iii <= opts.max_mismatches; iii++) {
+        levels[iii].mismatches = iii;
+        config = bench_config(&opts, iii);
+        if (bench_tries(config, &levels[iii]) != 0 ||
+                bench_match(config, &opts, &reads, &levels[iii]) != 0) {
+            goto exit;
+        }
+        if (bench_run(config, &levels[iii]) != 0) {
+            goto exit;
+        }
+        axe_config_destroy(config);
+        fprintf(stderr, "[bench_axe] -m %zu (%s): %0.0f reads/s matching, "
+                "%0.0f reads/s end to end, %0.1f%% cache hits\n", iii,
+                levels[iii].engine,
+                per_second((double)reads.n * opts.rounds,
+                           levels[iii].match_seconds),
+                per_second(levels[iii].run_reads, levels[iii].run_seconds),
+                levels[iii].run_cache_hit_rate * 100.0);
+    }
+    if (opts.json_file != NULL) {
+        fp = fopen(opts.json_file, "w");
+        if (fp == NULL) {
+            fprintf(stderr, "ERROR: Couldn't write %s\n", opts.json_file);
+            goto exit;
+        }
+    }
+    write_json(fp, &opts, &reads, levels, opts.max_mismatches + 1);
+    if (fp != stdout) {
+        fclose(fp);
+    }
+    ret = EXIT_SUCCESS;
+exit:
+    axe_config_destroy(config);
+    if (bcd1 != NULL) {
+        free_barcodes(bcd1, opts.n_barcodes);
+    }
+    if (bcd2 != NULL) {
+        free_barcodes(bcd2, opts.n_barcodes);
+    }
+    free_reads(&reads);
+    qes_free(levels);
+    if (opts.dir != NULL) {
+        clean_dir(&opts);
+    }
+    qes_free(opts.dir);
+    qes_free(opts.json_file);
+    return ret;
+}
@@ -17,6 +17,7 @@
  */
 
 #include "tests.h"
+#include <math.h>
 
 static void
 test_product (void *ptr)
@@ -88,8 +89,818 @@ end:
     }
 }
 
+static void
+test_topk (void *ptr)
+{
+    struct axe_topk *topk = NULL;
+    struct axe_topk_entry **sorted = NULL;
+    struct axe_topk_entry *entry = NULL;
+    char key[8] = "";
+    size_t iii = 0;
+
+    (void)ptr;
+    topk = axe_topk_create(4, 3);
+    tt_ptr_op(topk, !=, NULL);
+    /* Keys are truncated to key_len */
+    entry = axe_topk_add(topk, "AAAAAA", 6, 1);
+    tt_str_op(entry->key, ==, "AAA");
+    tt_ptr_op(axe_topk_add(topk, "AAA", 3, 1), ==, entry);
+    tt_int_op(entry->count, ==, 2);
+    /* Interleave a frequent key with a stream of distinct ones, which keep
+     * evicting each other */
+    for (iii = 0; iii < 200; iii++) {
+        axe_topk_add(topk, "CCC", 3, 1);
+        snprintf(key, sizeof(key), "%03zu", iii);
+        axe_topk_add(topk, key, 3, 1);
+    }
+    tt_int_op(topk->n, ==, 4);
+    sorted = axe_topk_sorted(topk);
+    tt_ptr_op(sorted[4], ==, NULL);
+    tt_str_op(sorted[0]->key, ==, "CCC");
+    tt_int_op(sorted[0]->count, ==, 200);
+    tt_int_op(sorted[0]->error, ==, 0);
+    for (iii = 1; iii < 4; iii++) {
+        /* Overestimated by exactly their error, as each was seen once */
+        tt_int_op(sorted[iii]->count - sorted[iii]->error, ==, 1);
+        tt_int_op(sorted[iii]->count, <=, sorted[0]->count);
+    }
+    /* Everything tracked can still be found through the hash table */
+    for (iii = 0; iii < 4; iii++) {
+        entry = sorted[iii];
+        tt_ptr_op(axe_topk_add(topk, entry->key, 3, 0), ==, entry);
+    }
+end:
+    free(sorted);
+    axe_topk_destroy(topk);
+}
+
+static void
+test_pair_counts (void *ptr)
+{
+    struct axe_pair_counts *pc = NULL;
+    struct axe_pair_counts *other = NULL;
+    size_t iii = 0;
+
+    (void)ptr;
+    /* Small enough to be a dense matrix */
+    pc = axe_pair_counts_create(3, 4, 12);
+    tt_ptr_op(pc, !=, NULL);
+    tt_ptr_op(pc->dense, !=, NULL);
+    axe_pair_counts_add(pc, 2, 3, 5);
+    axe_pair_counts_add(pc, 2, 3, 1);
+    tt_int_op(axe_pair_counts_get(pc, 2, 3), ==, 6);
+    tt_int_op(axe_pair_counts_get(pc, 3, 2), ==, 0);
+    axe_pair_counts_destroy(pc);
+    /* Too big, so pairs are hashed, and the table must grow */
+    pc = axe_pair_counts_create(3000, 3000, 12);
+    tt_ptr_op(pc, !=, NULL);
+    tt_ptr_op(pc->dense, ==, NULL);
+    for (iii = 0; iii < 5000; iii++) {
+        axe_pair_counts_add(pc, iii % 3000, iii / 2, 1);
+    }
+    axe_pair_counts_add(pc, 0, 0, 9);
+    tt_int_op(pc->n_keys, ==, 5000);
+    tt_int_op(pc->table_size, >=, 2 * pc->n_keys);
+    for (iii = 0; iii < 5000; iii++) {
+        tt_int_op(axe_pair_counts_get(pc, iii % 3000, iii / 2), ==,
+                  iii == 0 ? 10 : 1);
+    }
+    tt_int_op(axe_pair_counts_get(pc, 2999, 2999), ==, 0);
+    axe_pair_counts_destroy(pc);
+    /* Merging a sparse table into a dense one empties the sparse one */
+    pc = axe_pair_counts_create(3, 4, 12);
+    other = axe_pair_counts_create(3, 4, 0);
+    tt_ptr_op(other->dense, ==, NULL);
+    axe_pair_counts_add(pc, 1, 2, 1);
+    axe_pair_counts_add(other, 1, 2, 2);
+    axe_pair_counts_add(other, 2, 0, 3);
+    axe_pair_counts_merge(pc, other);
+    tt_int_op(axe_pair_counts_get(pc, 1, 2), ==, 3);
+    tt_int_op(axe_pair_counts_get(pc, 2, 0), ==, 3);
+    tt_int_op(axe_pair_counts_get(other, 1, 2), ==, 0);
+    tt_int_op(axe_pair_counts_get(other, 2, 0), ==, 0);
+end:
+    axe_pair_counts_destroy(pc);
+    axe_pair_counts_destroy(other);
+}
+
+static void
+test_wilson_interval (void *ptr)
+{
+    double low = 0;
+    double high = 0;
+
+    (void)ptr;
+    axe_wilson_interval(5, 10, &low, &high);
+    tt_assert(fabs(low - 0.236590) < 1e-6);
+    tt_assert(fabs(high - 0.763410) < 1e-6);
+    /* Bounds stay within [0, 1], and are never zero width */
+    axe_wilson_interval(0, 10, &low, &high);
+    tt_assert(low == 0);
+    tt_assert(fabs(high - 0.277540) < 1e-6);
+    axe_wilson_interval(10, 10, &low, &high);
+    tt_assert(high == 1);
+    tt_assert(low < 1);
+    axe_wilson_interval(0, 0, &low, &high);
+    tt_assert(low == 0 && high == 1);
+end:
+    ;
+}
+
+static void
+test_trie_memory (void *ptr)
+{
+    struct axe_trie *trie = NULL;
+    const int64_t before = qes_mem_current(AXE_MEM_TRIE);
+    int64_t built = 0;
+
+    (void)ptr;
+    trie = axe_trie_create();
+    tt_ptr_op(trie, !=, NULL);
+    tt_int_op(qes_mem_current(AXE_MEM_TRIE), >, before);
+    tt_int_op(axe_trie_add(trie, "ACGTACGT", 1), ==, 0);
+    tt_int_op(axe_trie_add(trie, "ACGTTTTT", 2), ==, 0);
+    tt_int_op(axe_trie_add(trie, "TTTTACGT", 3), ==, 0);
+    built = qes_mem_current(AXE_MEM_TRIE);
+    tt_int_op(built, >, before);
+    tt_int_op(qes_mem_peak(AXE_MEM_TRIE), >=, built);
+    tt_int_op(axe_trie_delete(trie, "ACGTTTTT"), !=, 0);
+    tt_int_op(qes_mem_current(AXE_MEM_TRIE), <, built);
+    axe_trie_destroy(trie);
+    tt_int_op(qes_mem_current(AXE_MEM_TRIE), ==, before);
+end:
+    axe_trie_destroy(trie);
+}
+
+static void
+test_pack_kernel (void *ptr)
+{
+    const char bases[] = "ACGTACGTACGTACGN";
+    axe_pack_fn pack = NULL;
+    uint64_t expect = 0;
+    uint64_t packed = 0;
+    uint32_t rand = 1;
+    char *seq = NULL;
+    size_t len = 0;
+    size_t iii = 0;
+    size_t jjj = 0;
+    int bad = 0;
+
+    (void)ptr;
+    tt_assert(axe_pack_kernel(0) == NULL);
+    tt_assert(axe_pack_kernel(33) == NULL);
+    tt_assert(axe_pack_kernel(8) != axe_pack_kernel(7));
+    for (len = 1; len <= 32; len++) {
+        pack = axe_pack_kernel(len);
+        tt_assert(pack != NULL);
+        /* Exactly len bytes, so kernels mustn't load past them */
+        seq = malloc(len);
+        for (iii = 0; iii < 200; iii++) {
+            expect = 0;
+            bad = 0;
+            for (jjj = 0; jjj < len; jjj++) {
+                rand = rand * 1103515245 + 12345;
+                seq[jjj] = bases[(rand >> 16) % 16];
+                bad |= seq[jjj] == 'N';
+                expect = (expect << 2) | ((strchr(bases, seq[jjj]) - bases) & 3);
+            }
+            tt_int_op(pack(seq, len, &packed), ==, bad);
+            if (!bad) {
+                tt_int_op(packed, ==, expect);
+            }
+        }
+        /* Lower case isn't ACGT */
+        seq[len - 1] = 'a';
+        tt_int_op(pack(seq, len, &packed), ==, 1);
+        free(seq);
+        seq = NULL;
+    }
+end:
+    free(seq);
+}
+
+static void
+test_whitelist (void *ptr)
+{
+    struct axe_whitelist *wl = NULL;
+    const char *seqs[] = {"AAAAAA", "CCCCCC", "ACGTAC", "ACGTAA"};
+    const char *bad_len[] = {"AAAAAA", "CCCCC"};
+    const char *bad_base[] = {"AAAAAA", "CCNCCC"};
+    const char *dups[] = {"AAAAAA", "CCCCCC", "AAAAAA"};
+    const int64_t before = qes_mem_current(AXE_MEM_TRIE);
+    intptr_t value = 0;
+
+    (void)ptr;
+    tt_ptr_op(axe_whitelist_create(bad_len, 2, 0), ==, NULL);
+    tt_ptr_op(axe_whitelist_create(bad_base, 2, 0), ==, NULL);
+    tt_ptr_op(axe_whitelist_create(dups, 3, 0), ==, NULL);
+    tt_ptr_op(axe_whitelist_create(seqs, 4, 6), ==, NULL);
+    tt_int_op(qes_mem_current(AXE_MEM_TRIE), ==, before);
+    wl = axe_whitelist_create(seqs, 4, 2);
+    tt_ptr_op(wl, !=, NULL);
+    tt_int_op(qes_mem_current(AXE_MEM_TRIE), >, before);
+    /* Exact, and within two mismatches */
+    tt_int_op(axe_whitelist_match(wl, "CCCCCCTT", 8, &value), ==, 0);
+    tt_int_op(value, ==, 1);
+    tt_int_op(axe_whitelist_match(wl, "AATAGA", 6, &value), ==, 0);
+    tt_int_op(value, ==, 0);
+    /* Too far from any barcode, or near two */
+    tt_int_op(axe_whitelist_match(wl, "AAATTT", 6, &value), ==, 1);
+    tt_int_op(value, ==, -1);
+    tt_int_op(axe_whitelist_match(wl, "ACGTAC", 6, &value), ==, 1);
+    tt_int_op(value, ==, -1);
+    /* Too short, or not ACGT */
+    tt_int_op(axe_whitelist_match(wl, "CCCCC", 5, &value), ==, 1);
+    tt_int_op(axe_whitelist_match(wl, "CCNCCC", 6, &value), ==, 1);
+    tt_int_op(axe_whitelist_match(NULL, "CCCCCC", 6, &value), ==, -1);
+    axe_whitelist_destroy(wl);
+    tt_ptr_op(wl, ==, NULL);
+    tt_int_op(qes_mem_current(AXE_MEM_TRIE), ==, before);
+    /* Exactly, the two close barcodes are distinct */
+    wl = axe_whitelist_create(seqs, 4, 0);
+    tt_int_op(axe_whitelist_match(wl, "ACGTAA", 6, &value), ==, 0);
+    tt_int_op(value, ==, 3);
+    tt_int_op(axe_whitelist_match(wl, "ACGTAG", 6, &value), ==, 1);
+end:
+    axe_whitelist_destroy(wl);
+}
+
+static void
+test_seed_index (void *ptr)
+{
+    struct axe_seed_index *si = NULL;
+    const char *seqs[] = {"AAAAAAAAAAAAAAAAAAAA", "CCCCCCCCCCCCCCCCCCCC",
+                          "ACGTACGTACGTACGTACGTAC", "ACGTACGTACGTACGTACGT"};
+    const char *bad_base[] = {"AAAAAAAAAA", "CCCCNCCCCC"};
+    const char *dups[] = {"AAAAAAAAAA", "CCCCCCCCCC", "AAAAAAAAAA"};
+    const char *prefixes[] = {"AAAA", "AAAACC"};
+    const int64_t before = qes_mem_current(AXE_MEM_TRIE);
+    intptr_t value = 0;
+
+    (void)ptr;
+    tt_ptr_op(axe_seed_index_create(bad_base, 2, 0), ==, NULL);
+    tt_ptr_op(axe_seed_index_create(dups, 3, 0), ==, NULL);
+    tt_ptr_op(axe_seed_index_create(seqs, 4, 20), ==, NULL);
+    tt_int_op(qes_mem_current(AXE_MEM_TRIE), ==, before);
+    si = axe_seed_index_create(seqs, 4, 6);
+    tt_ptr_op(si, !=, NULL);
+    tt_int_op(qes_mem_current(AXE_MEM_TRIE), >, before);
+    /* Six mismatches, spread over every seed but one */
+    tt_int_op(axe_seed_index_match(si, "ATATATATATATAAAAAAAAGG", 22, &value),
+              ==, 0);
+    tt_int_op(value, ==, 0);
+    tt_int_op(axe_seed_index_match(si, "ATATATATATATATAAAAAA", 20, &value),
+              ==, 1);
+    tt_int_op(value, ==, -1);
+    /* The longest of the exact matches */
+    tt_int_op(axe_seed_index_match(si, "ACGTACGTACGTACGTACGTAC", 22, &value),
+              ==, 0);
+    tt_int_op(value, ==, 2);
+    /* Nearer the shorter barcode, but within mismatches of the longer */
+    tt_int_op(axe_seed_index_match(si, "ACGTACGTACGTACGTACGTTT", 22, &value),
+              ==, 0);
+    tt_int_op(value, ==, 2);
+    /* Too short, or not ACGT */
+    tt_int_op(axe_seed_index_match(si, "CCCCCCCCCCCCCCCCCCC", 19, &value),
+              ==, 1);
+    tt_int_op(axe_seed_index_match(si, "CCCCCCCCCNCCCCCCCCCC", 20, &value),
+              ==, 1);
+    tt_int_op(axe_seed_index_match(NULL, "CCCCCCCCCC", 10, &value), ==, -1);
+    axe_seed_index_destroy(si);
+    tt_ptr_op(si, ==, NULL);
+    tt_int_op(qes_mem_current(AXE_MEM_TRIE), ==, before);
+    /* Equally near two barcodes of one length */
+    si = axe_seed_index_create(dups, 2, 1);
+    tt_int_op(axe_seed_index_match(si, "AAAAACCCCC", 10, &value), ==, 1);
+    tt_int_op(axe_seed_index_match(si, "AAAAAAAAAC", 10, &value), ==, 0);
+    tt_int_op(value, ==, 0);
+    axe_seed_index_destroy(si);
+    /* The longer barcode wins, though the shorter is nearer */
+    si = axe_seed_index_create(prefixes, 2, 1);
+    tt_int_op(axe_seed_index_match(si, "AAAACGTTTTTTTTTT", 16, &value), ==, 0);
+    tt_int_op(value, ==, 1);
+end:
+    axe_seed_index_destroy(si);
+}
+
+static void
+test_edit_index (void *ptr)
+{
+    struct axe_edit_index *ei = NULL;
+    const char *seqs[] = {"ACGTACGT", "TTTTGGGG", "CCCCAAAA"};
+    const char *close[] = {"AAAAAAAA", "AAAAAAAC"};
+    const char *prefixes[] = {"AAAA", "AAAACC"};
+    const char *bad_base[] = {"AAAAAAAA", "CCCNCCCC"};
+    const char *dups[] = {"AAAAAAAA", "CCCCCCCC", "AAAAAAAA"};
+    const char *long_seqs[] = {"AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA"
+                               "AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA"};
+    const int64_t before = qes_mem_current(AXE_MEM_TRIE);
+    intptr_t value = 0;
+    size_t edits = 0;
+    size_t consumed = 0;
+
+    (void)ptr;
+    tt_ptr_op(axe_edit_index_create(bad_base, 2, 1), ==, NULL);
+    tt_ptr_op(axe_edit_index_create(dups, 3, 1), ==, NULL);
+    tt_ptr_op(axe_edit_index_create(seqs, 3, 8), ==, NULL);
+    /* Barcodes and their edits must fit in a column */
+    tt_ptr_op(axe_edit_index_create(long_seqs, 1, 1), ==, NULL);
+    ei = axe_edit_index_create(long_seqs, 1, 0);
+    tt_ptr_op(ei, !=, NULL);
+    axe_edit_index_destroy(ei);
+    tt_int_op(qes_mem_current(AXE_MEM_TRIE), ==, before);
+    ei = axe_edit_index_create(seqs, 3, 1);
+    tt_ptr_op(ei, !=, NULL);
+    tt_int_op(qes_mem_current(AXE_MEM_TRIE), >, before);
+    /* Exact, and a substitution */
+    tt_int_op(axe_edit_index_match(ei, "ACGTACGTNN", 10, &value, &edits,
+                                   &consumed), ==, 0);
+    tt_int_op(value, ==, 0);
+    tt_int_op(edits, ==, 0);
+    tt_int_op(consumed, ==, 8);
+    tt_int_op(axe_edit_index_match(ei, "CCCCAATACC", 10, &value, &edits,
+                                   &consumed), ==, 0);
+    tt_int_op(value, ==, 2);
+    tt_int_op(edits, ==, 1);
+    tt_int_op(consumed, ==, 8);
+    /* A deletion takes up one base less, and an insertion one more */
+    tt_int_op(axe_edit_index_match(ei, "ACGACGTGG", 9, &value, &edits,
+                                   &consumed), ==, 0);
+    tt_int_op(value, ==, 0);
+    tt_int_op(edits, ==, 1);
+    tt_int_op(consumed, ==, 7);
+    tt_int_op(axe_edit_index_match(ei, "TATTTGGGGAC", 11, &value, &edits,
+                                   &consumed), ==, 0);
+    tt_int_op(value, ==, 1);
+    tt_int_op(edits, ==, 1);
+    tt_int_op(consumed, ==, 9);
+    /* Two edits away, or too short */
+    tt_int_op(axe_edit_index_match(ei, "AGGTTCGTCC", 10, &value, &edits,
+                                   &consumed), ==, 1);
+    tt_int_op(value, ==, -1);
+    tt_int_op(axe_edit_index_match(ei, "ACGTAC", 6, &value, &edits,
+                                   &consumed), ==, 1);
+    tt_int_op(axe_edit_index_match(NULL, "ACGTACGT", 8, &value, &edits,
+                                   &consumed), ==, -1);
+    axe_edit_index_destroy(ei);
+    tt_ptr_op(ei, ==, NULL);
+    tt_int_op(qes_mem_current(AXE_MEM_TRIE), ==, before);
+    /* Equally near two barcodes of one length */
+    ei = axe_edit_index_create(close, 2, 1);
+    tt_int_op(axe_edit_index_match(ei, "AAAAAAAGTT", 10, &value, &edits,
+                                   &consumed), ==, 1);
+    tt_int_op(axe_edit_index_match(ei, "AAAAAAACTT", 10, &value, &edits,
+                                   &consumed), ==, 0);
+    tt_int_op(value, ==, 1);
+    axe_edit_index_destroy(ei);
+    /* The longer barcode wins, though the shorter is nearer */
+    ei = axe_edit_index_create(prefixes, 2, 1);
+    tt_int_op(axe_edit_index_match(ei, "AAAACGTTTTTTTTTT", 16, &value, &edits,
+                                   &consumed), ==, 0);
+    tt_int_op(value, ==, 1);
+    tt_int_op(edits, ==, 1);
+end:
+    axe_edit_index_destroy(ei);
+}
+
+static void
+test_brute_index (void *ptr)
+{
+    struct axe_brute_index *bi = NULL;
+    const char *seqs[] = {"AAAA", "CCCC", "GGGGTT"};
+    const char *near[] = {"AAAAAA", "AAAACC", "CCCC"};
+    const char *bad_base[] = {"AAAA", "CCNC"};
+    const char *long_seqs[] = {"AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA"};
+    const char *many[AXE_BRUTE_MAX_BARCODES + 1];
+    const int64_t before = qes_mem_current(AXE_MEM_TRIE);
+    intptr_t value = 0;
+    size_t iii = 0;
+
+    (void)ptr;
+    for (iii = 0; iii <= AXE_BRUTE_MAX_BARCODES; iii++) {
+        many[iii] = "ACGT";
+    }
+    /* Sets the tries must handle */
+    tt_ptr_op(axe_brute_index_create(many, AXE_BRUTE_MAX_BARCODES + 1, 0,
+                                     false), ==, NULL);
+    tt_ptr_op(axe_brute_index_create(bad_base, 2, 0, false), ==, NULL);
+    tt_ptr_op(axe_brute_index_create(long_seqs, 1, 0, false), ==, NULL);
+    tt_ptr_op(axe_brute_index_create(near, 3, 1, false), ==, NULL);
+    tt_ptr_op(axe_brute_index_create(near, 3, 2, true), ==, NULL);
+    tt_int_op(qes_mem_current(AXE_MEM_TRIE), ==, before);
+    bi = axe_brute_index_create(seqs, 3, 1, false);
+    tt_ptr_op(bi, !=, NULL);
+    tt_int_op(qes_mem_current(AXE_MEM_TRIE), >, before);
+    tt_int_op(axe_brute_index_match(bi, "AAAAT", 5, &value), ==, 0);
+    tt_int_op(value, ==, 0);
+    tt_int_op(axe_brute_index_match(bi, "ACAAT", 5, &value), ==, 0);
+    tt_int_op(value, ==, 0);
+    /* The longest barcode wins */
+    tt_int_op(axe_brute_index_match(bi, "GGGGTA", 6, &value), ==, 0);
+    tt_int_op(value, ==, 2);
+    /* Walks stop at anything but ACGT, as they do through the tries */
+    tt_int_op(axe_brute_index_match(bi, "CCCNGGG", 7, &value), ==, 1);
+    tt_int_op(value, ==, -1);
+    tt_int_op(axe_brute_index_match(bi, "TTTTT", 5, &value), ==, 1);
+    tt_int_op(axe_brute_index_match(bi, "CCC", 3, &value), ==, 1);
+    tt_int_op(axe_brute_index_match(NULL, "CCCC", 4, &value), ==, -1);
+    axe_brute_index_destroy(bi);
+    tt_ptr_op(bi, ==, NULL);
+    tt_int_op(qes_mem_current(AXE_MEM_TRIE), ==, before);
+    /* Permissively, reads near both of two barcodes fall back to shorter
+     * ones */
+    bi = axe_brute_index_create(near, 3, 1, true);
+    tt_ptr_op(bi, !=, NULL);
+    tt_int_op(axe_brute_index_match(bi, "AAAACA", 6, &value), ==, 1);
+    tt_int_op(axe_brute_index_match(bi, "AAAAAAT", 7, &value), ==, 0);
+    tt_int_op(value, ==, 0);
+    tt_int_op(axe_brute_index_match(bi, "CCACCA", 6, &value), ==, 0);
+    tt_int_op(value, ==, 2);
+end:
+    axe_brute_index_destroy(bi);
+}
+
+static void
+fill_read(struct qes_seq *read, const char *seq)
+{
+    const char *qual = "IIIIIIIIII";
+
+    qes_seq_fill_name(read, "read", 4);
+    qes_seq_fill_seq(read, seq, strlen(seq));
+    qes_seq_fill_qual(read, qual, strlen(seq));
+}
+
+/* Single end barcodes, matched with a mismatch, and reads matching them */
+static const char *test_barcodes =
+        "Barcode\tID\nAAAA\ts1\nCCCC\ts2\nGGGGTT\ts3\n";
+static const char *test_reads[] = {"AAAAT", "ACAAT", "CCCCG", "TTTTT",
+                                   "GGGGTTA", "GGGGTA"};
+/* Sample each read matches, or -1 if unknown, and its mismatches */
+static const ssize_t test_samples[] = {0, 0, 1, -1, 2, 2};
+static const size_t test_mismatches[] = {0, 1, 0, 0, 0, 1};
+
+/* Reads ``barcodes``, written to ``path``, up to the barcode lookup */
+static struct axe_config *
+test_config(char *path, const char *barcodes)
+{
+    struct axe_config *config = axe_config_create();
+    int fd = mkstemp(path);
+
+    if (fd < 0 || write(fd, barcodes, strlen(barcodes)) < 0) {
+        axe_config_destroy(config);
+        return NULL;
+    }
+    close(fd);
+    config->barcode_file = strdup(path);
+    config->mismatches = 1;
+    config->unknown_top = 2;
+    config->verbosity = -1;
+    if (axe_read_barcodes(config) != 0 ||
+            axe_setup_barcode_lookup(config) != 0) {
+        axe_config_destroy(config);
+    }
+    return config;
+}
+
+static void
+test_worker (void *ptr)
+{
+    char path[] = "/tmp/axe_test_XXXXXX";
+    const char **reads = test_reads;
+    const ssize_t *samples = test_samples;
+    const size_t *mismatches = test_mismatches;
+    struct axe_config *config = test_config(path, test_barcodes);
+    struct axe_worker *workers[2] = {NULL, NULL};
+    struct qes_seq *read = qes_seq_create();
+    struct axe_match match;
+    size_t iii = 0;
+
+    (void)ptr;
+    tt_ptr_op(config, !=, NULL);
+    /* No tries yet */
+    tt_ptr_op(axe_matcher_create(config), ==, NULL);
+    tt_int_op(axe_make_tries(config), ==, 0);
+    tt_int_op(axe_load_tries(config), ==, 0);
+    config->matcher = axe_matcher_create(config);
+    tt_ptr_op(config->matcher, !=, NULL);
+    tt_int_op(config->matcher->n_mismatch_levels, ==, 2);
+    /* Workers share the matcher, but count separately */
+    for (iii = 0; iii < 2; iii++) {
+        workers[iii] = axe_worker_create(config->matcher);
+        tt_ptr_op(workers[iii], !=, NULL);
+    }
+    for (iii = 0; iii < 6; iii++) {
+        fill_read(read, reads[iii]);
+        tt_int_op(axe_worker_match(workers[iii % 2], read, NULL, &match), ==,
+                  samples[iii] < 0 ? 1 : 0);
+        tt_int_op(match.sample, ==, samples[iii]);
+        tt_int_op(match.mismatches, ==, mismatches[iii]);
+        tt_int_op(axe_worker_count(workers[iii % 2], &match, read, NULL), ==,
+                  0);
+    }
+    tt_int_op(workers[0]->reads_processed, ==, 3);
+    tt_int_op(workers[1]->reads_failed, ==, 1);
+    tt_int_op(config->reads_processed, ==, 0);
+    /* Reducing adds each worker's counts to the config's, and zeroes them */
+    for (iii = 0; iii < 2; iii++) {
+        tt_int_op(axe_worker_reduce(config, workers[iii]), ==, 0);
+        tt_int_op(workers[iii]->reads_processed, ==, 0);
+    }
+    tt_int_op(config->reads_processed, ==, 6);
+    tt_int_op(config->reads_demultiplexed, ==, 5);
+    tt_int_op(config->reads_failed, ==, 1);
+    tt_int_op(config->barcodes[0]->count, ==, 2);
+    tt_int_op(config->barcodes[1]->count, ==, 1);
+    tt_int_op(config->barcodes[2]->count, ==, 2);
+    tt_int_op(config->mismatch_counts[0], ==, 1);
+    tt_int_op(config->mismatch_counts[1], ==, 1);
+    tt_int_op(config->mismatch_counts[2 * 2 + 1], ==, 1);
+    tt_int_op(config->unknown_prefixes->n, ==, 1);
+    tt_str_op(config->unknown_prefixes->entries[0].key, ==, "TTTTT");
+    /* Reducing again adds nothing */
+    tt_int_op(axe_worker_reduce(config, workers[0]), ==, 0);
+    tt_int_op(config->reads_processed, ==, 6);
+    tt_int_op(axe_worker_match(NULL, read, NULL, &match), ==, -1);
+    tt_int_op(axe_worker_reduce(NULL, workers[0]), ==, -1);
+end:
+    unlink(path);
+    axe_worker_destroy(workers[0]);
+    axe_worker_destroy(workers[1]);
+    qes_seq_destroy(read);
+    axe_config_destroy(config);
+}
+
+static void
+test_prefix_cache (void *ptr)
+{
+    char path[] = "/tmp/axe_test_XXXXXX";
+    struct axe_config *config = test_config(path, test_barcodes);
+    /* test_reads, made at least as long as the barcodes */
+    const char *reads[] = {"AAAATAC", "ACAATAC", "CCCCGAC", "TTTTTAC",
+                           "GGGGTTA", "GGGGTAC"};
+    struct axe_worker *worker = NULL;
+    struct qes_seq *read = qes_seq_create();
+    struct axe_match match;
+    size_t rnd = 0;
+    size_t iii = 0;
+
+    (void)ptr;
+    tt_ptr_op(config, !=, NULL);
+    tt_int_op(axe_make_tries(config), ==, 0);
+    tt_int_op(axe_load_tries(config), ==, 0);
+    config->matcher = axe_matcher_create(config);
+    tt_ptr_op(config->matcher, !=, NULL);
+    tt_int_op(config->matcher->cache_lens[0], ==, 6);
+    worker = axe_worker_create(config->matcher);
+    tt_ptr_op(worker, !=, NULL);
+    /* Found in the cache the second time, including the unknown read */
+    for (rnd = 0; rnd < 2; rnd++) {
+        for (iii = 0; iii < 6; iii++) {
+            fill_read(read, reads[iii]);
+            tt_int_op(axe_worker_match(worker, read, NULL, &match), ==,
+                      test_samples[iii] < 0 ? 1 : 0);
+            tt_int_op(match.sample, ==, test_samples[iii]);
+            tt_int_op(match.mismatches, ==, test_mismatches[iii]);
+        }
+        tt_int_op(worker->cache_hits, ==, rnd * 6);
+    }
+    tt_int_op(worker->cache_lookups, ==, 12);
+    /* Prefixes with an N, or shorter than the barcodes, aren't cached, nor
+     * counted as lookups */
+    for (rnd = 0; rnd < 2; rnd++) {
+        fill_read(read, "AANATAC");
+        tt_int_op(axe_worker_match(worker, read, NULL, &match), ==, 1);
+        fill_read(read, "CCCC");
+        tt_int_op(axe_worker_match(worker, read, NULL, &match), ==, 0);
+        tt_int_op(match.sample, ==, 1);
+    }
+    tt_int_op(worker->cache_lookups, ==, 12);
+    tt_int_op(worker->cache_hits, ==, 6);
+    tt_int_op(axe_worker_reduce(config, worker), ==, 0);
+    tt_int_op(config->cache_lookups, ==, 12);
+    tt_int_op(config->cache_hits, ==, 6);
+    tt_int_op(worker->cache_hits, ==, 0);
+end:
+    unlink(path);
+    axe_worker_destroy(worker);
+    qes_seq_destroy(read);
+    axe_config_destroy(config);
+}
+
+struct test_sink {
+    struct qes_seq *const *reads;
+    ssize_t samples[6];
+    size_t n;
+    size_t stop_after;
+};
+
+static int
+test_sink_fn(void *data, const struct axe_match *match, struct qes_seq *seq1,
+             struct qes_seq *seq2)
+{
+    struct test_sink *sink = data;
+
+    /* Reads are handed over as they are, not copied */
+    if (seq1 != sink->reads[sink->n] || seq2 != NULL) {
+        return 1;
+    }
+    sink->samples[sink->n++] = match->sample;
+    return sink->n == sink->stop_after;
+}
+
+static void
+test_stream (void *ptr)
+{
+    char path[] = "/tmp/axe_test_XXXXXX";
+    struct axe_config *config = test_config(path, test_barcodes);
+    struct axe_stream *stream = NULL;
+    struct qes_seq *reads[6] = {NULL};
+    struct test_sink sink;
+    size_t iii = 0;
+
+    (void)ptr;
+    tt_ptr_op(config, !=, NULL);
+    tt_int_op(axe_make_tries(config), ==, 0);
+    tt_int_op(axe_load_tries(config), ==, 0);
+    config->matcher = axe_matcher_create(config);
+    for (iii = 0; iii < 6; iii++) {
+        reads[iii] = qes_seq_create();
+        fill_read(reads[iii], test_reads[iii]);
+    }
+    memset(&sink, 0, sizeof(sink));
+    sink.reads = reads;
+    tt_ptr_op(axe_stream_create(config->matcher, NULL, &sink), ==, NULL);
+    stream = axe_stream_create(config->matcher, test_sink_fn, &sink);
+    tt_ptr_op(stream, !=, NULL);
+    tt_int_op(axe_stream_batch(stream, reads, NULL, 6), ==, 0);
+    tt_int_op(sink.n, ==, 6);
+    for (iii = 0; iii < 6; iii++) {
+        tt_int_op(sink.samples[iii], ==, test_samples[iii]);
+    }
+    /* A sink can stop the stream */
+    sink.n = 0;
+    sink.stop_after = 2;
+    tt_int_op(axe_stream_batch(stream, reads, NULL, 6), ==, 1);
+    tt_int_op(sink.n, ==, 2);
+    tt_int_op(axe_worker_reduce(config, stream->worker), ==, 0);
+    tt_int_op(config->reads_processed, ==, 8);
+    tt_int_op(config->barcodes[0]->count, ==, 4);
+    tt_int_op(axe_stream_read(NULL, reads[0], NULL), ==, -1);
+end:
+    unlink(path);
+    axe_stream_destroy(stream);
+    for (iii = 0; iii < 6; iii++) {
+        qes_seq_destroy(reads[iii]);
+    }
+    axe_config_destroy(config);
+}
+
+/* Barcodes and reads every engine must match alike, with one mismatch */
+static const char *engine_barcodes =
+        "Barcode\tID\nACGTACGT\ts1\nTTGGCCAA\ts2\nCAGTCAGT\ts3\n";
+static const char *engine_reads[] = {"ACGTACGTTT", "ACCTACGTTT", "TTGGCCTAGG",
+                                     "CAGTCAGTAC", "GGGGGGGGGG", "ACGAAGGTTT",
+                                     "CCGT"};
+static const ssize_t engine_samples[] = {0, 0, 1, 2, -1, -1, -1};
+static const size_t engine_mismatches[] = {0, 1, 1, 0, 0, 0, 0};
+/* Barcodes prefixing others, which all but the whitelists must match alike
+ * with -p: the longest barcode within a mismatch wins, unless two of its
+ * length are, and reads' Ns match nothing */
+static const char *prefix_barcodes =
+        "Barcode\tID\nAAAA\ts1\nAAAACC\ts2\nAAAAGG\ts3\nAAAACCGG\ts4\n";
+static const char *prefix_reads[] = {"AAAACCGGTT", "AAAACCGCTT", "AAAACGTTTT",
+                                     "AAAATTTTTT", "NAAACCGGTT", "AAAANNNNNN",
+                                     "AAAAGCTTTT", "AAAACCGNTT", "AANACCGGTT",
+                                     "TTTTTTTTTT", "AAAAGGCCTT", "AAAACNTTTT"};
+static const ssize_t prefix_samples[] = {3, 3, 0, 0, -1, 0, 0, 1, -1, -1, 2, 0};
+static const size_t prefix_lens[] = {8, 8, 4, 4, 0, 4, 4, 6, 0, 0, 6, 4};
+
+static void
+test_engines (void *ptr)
+{
+    char path[] = "/tmp/axe_test_XXXXXX";
+    struct axe_config *config = NULL;
+    struct axe_worker *worker = NULL;
+    struct qes_seq *reads[7] = {NULL};
+    struct qes_seq *prefix_seqs[12] = {NULL};
+    intptr_t values[7];
+    struct axe_match match;
+    const int64_t before = qes_mem_current(AXE_MEM_TRIE);
+    int type = 0;
+    size_t iii = 0;
+
+    (void)ptr;
+    tt_int_op(axe_engine_find("auto"), ==, AXE_ENGINE_AUTO);
+    tt_int_op(axe_engine_find("seed"), ==, AXE_ENGINE_SEED);
+    tt_int_op(axe_engine_find("datrie"), ==, -1);
+    for (iii = 0; iii < 7; iii++) {
+        reads[iii] = qes_seq_create();
+        fill_read(reads[iii], engine_reads[iii]);
+    }
+    for (iii = 0; iii < 12; iii++) {
+        prefix_seqs[iii] = qes_seq_create();
+        fill_read(prefix_seqs[iii], prefix_reads[iii]);
+    }
+    for (type = AXE_ENGINE_AUTO; type < AXE_N_ENGINES; type++) {
+        config = test_config(path, engine_barcodes);
+        tt_ptr_op(config, !=, NULL);
+        unlink(path);
+        strcpy(path, "/tmp/axe_test_XXXXXX");
+        config->engine = type;
+        tt_int_op(axe_make_tries(config), ==, 0);
+        tt_int_op(axe_load_tries(config), ==, 0);
+        /* Few short barcodes are compared by brute force */
+        tt_ptr_op(config->engine_ops, ==,
+                  axe_engines[type == AXE_ENGINE_AUTO ? AXE_ENGINE_BRUTE :
+                                                        type]);
+        tt_int_op(config->engine_stats.keys, >=, 3);
+        tt_int_op(config->engine_stats.bytes, >, 0);
+        config->matcher = axe_matcher_create(config);
+        worker = axe_worker_create(config->matcher);
+        tt_ptr_op(worker, !=, NULL);
+        for (iii = 0; iii < 7; iii++) {
+            tt_int_op(axe_worker_match(worker, reads[iii], NULL, &match), ==,
+                      engine_samples[iii] < 0 ? 1 : 0);
+            tt_int_op(match.sample, ==, engine_samples[iii]);
+            if (engine_samples[iii] >= 0) {
+                tt_int_op(match.mismatches, ==, engine_mismatches[iii]);
+                tt_int_op(match.lens[0], ==, 8);
+            }
+        }
+        tt_int_op(axe_engine_match_batch(config->engine_ops,
+                                         config->indices[0],
+                                         worker->states[0], reads, 7,
+                                         values), ==, 4);
+        tt_int_op(values[2], ==, 1);
+        tt_int_op(values[4], ==, -1);
+        axe_worker_destroy(worker);
+        axe_config_destroy(config);
+        tt_int_op(qes_mem_current(AXE_MEM_TRIE), ==, before);
+    }
+    for (type = AXE_ENGINE_AUTO; type < AXE_N_ENGINES; type++) {
+        if (type == AXE_ENGINE_WHITELIST) {
+            continue;
+        }
+        config = test_config(path, prefix_barcodes);
+        tt_ptr_op(config, !=, NULL);
+        unlink(path);
+        strcpy(path, "/tmp/axe_test_XXXXXX");
+        config->engine = type;
+        config->permissive = true;
+        tt_int_op(axe_make_tries(config), ==, 0);
+        tt_int_op(axe_load_tries(config), ==, 0);
+        config->matcher = axe_matcher_create(config);
+        worker = axe_worker_create(config->matcher);
+        tt_ptr_op(worker, !=, NULL);
+        for (iii = 0; iii < 12; iii++) {
+            tt_int_op(axe_worker_match(worker, prefix_seqs[iii], NULL,
+                                       &match), ==,
+                      prefix_samples[iii] < 0 ? 1 : 0);
+            tt_int_op(match.sample, ==, prefix_samples[iii]);
+            if (prefix_samples[iii] >= 0) {
+                tt_int_op(match.lens[0], ==, prefix_lens[iii]);
+            }
+        }
+        axe_worker_destroy(worker);
+        axe_config_destroy(config);
+    }
+    /* Engines asked for must suit the barcodes */
+    config = test_config(path, test_barcodes);
+    config->engine = AXE_ENGINE_WHITELIST;
+    tt_int_op(axe_make_tries(config), !=, 0);
+    tt_ptr_op(config->engine_ops, ==, NULL);
+    config->engine = AXE_ENGINE_TRIE;
+    config->mismatches = 4;
+    tt_int_op(axe_make_tries(config), !=, 0);
+    config->mismatches = 3;
+    tt_int_op(axe_make_tries(config), ==, 0);
+end:
+    unlink(path);
+    axe_worker_destroy(worker);
+    axe_config_destroy(config);
+    for (iii = 0; iii < 7; iii++) {
+        qes_seq_destroy(reads[iii]);
+    }
+    for (iii = 0; iii < 12; iii++) {
+        qes_seq_destroy(prefix_seqs[iii]);
+    }
+}
+
 struct testcase_t core_tests[] = {
     { "product", test_product, 0, NULL, NULL},
     { "hamming_mutate", test_hamming_mutate, 0, NULL, NULL},
+    { "topk", test_topk, 0, NULL, NULL},
+    { "pair_counts", test_pair_counts, 0, NULL, NULL},
+    { "wilson_interval", test_wilson_interval, 0, NULL, NULL},
+    { "trie_memory", test_trie_memory, 0, NULL, NULL},
+    { "pack_kernel", test_pack_kernel, 0, NULL, NULL},
+    { "whitelist", test_whitelist, 0, NULL, NULL},
+    { "seed_index", test_seed_index, 0, NULL, NULL},
+    { "edit_index", test_edit_index, 0, NULL, NULL},
+    { "brute_index", test_brute_index, 0, NULL, NULL},
+    { "worker", test_worker, 0, NULL, NULL},
+    { "prefix_cache", test_prefix_cache, 0, NULL, NULL},
+    { "stream", test_stream, 0, NULL, NULL},
+    { "engines", test_engines, 0, NULL, NULL},
     END_OF_TESTCASES
 };